@@ -0,0 +1,104 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+
+namespace {
+	// Furthest any component of b strays from a, relative to the size of a's bounds
+	float relativeError(const AABB& a, const AABB& b) {
+		const float scale = std::max(1.0f, glm::length(glm::max(glm::abs(a.vmin), glm::abs(a.vmax))));
+		float err = 0.0f;
+		for (const auto& [x, y] : { std::pair{ a.vmin, b.vmin }, { a.vmax, b.vmax }, { a.origin, b.origin }, { a.extent, b.extent } })
+			err = std::max(err, glm::compMax(glm::abs(x - y)));
+		err = std::max(err, std::abs(a.sphereRadius - b.sphereRadius));
+		return err / scale;
+	}
+}
+
+// Dynamic slab refresh: rows of random meshes under rotated, scaled and moved transforms.
+// Per row transformAABB against the batched kernels and the job split on top of them.
+// Kernels have to write the same bits as each other and stay within rounding of transformAABB.
+BENCH_SUITE(AABBTransform) {
+	constexpr uint32_t meshCount = 64;
+	constexpr float maxRelativeError = 1e-5f;
+
+	std::mt19937 rng(77u);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	std::vector<GPUMeshData> meshes(meshCount);
+	for (GPUMeshData& mesh : meshes) {
+		const glm::vec3 c(unit(rng), unit(rng), unit(rng));
+		const glm::vec3 e = glm::abs(glm::vec3(unit(rng), unit(rng), unit(rng))) * 2.0f + 0.05f;
+		mesh.localAABB = Bench::makeAABB(c, e);
+	}
+
+	bool ok = true;
+	fmt::print("{:>8} {:>14} {:>14} {:>14} {:>14} {:>14} {:>10}\n",
+		"rows", "transformAABB", "Scalar", "SSE", "AVX2", "jobs", "max error");
+
+	for (uint32_t rows : { 4'096u, 65'536u, 262'144u }) {
+		Visibility::VisibilityState vs;
+		Bench::fillVisibilityState(vs, std::vector<AABB>(rows));
+
+		std::vector<glm::mat4> transforms(rows);
+		for (glm::mat4& m : transforms) {
+			const glm::vec3 axis = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.0f, 0.0f, 1e-3f));
+			m = glm::translate(glm::mat4(1.0f), glm::vec3(unit(rng), unit(rng), unit(rng)) * 500.0f)
+				* glm::rotate(glm::mat4(1.0f), unit(rng) * glm::pi<float>(), axis)
+				* glm::scale(glm::mat4(1.0f), glm::abs(glm::vec3(unit(rng), unit(rng), unit(rng))) * 3.0f + 0.1f);
+		}
+
+		std::vector<AABB> reference(rows);
+		const double refMs = Bench::medianMs(5, [&] {
+			for (uint32_t i = 0; i < rows; ++i)
+				reference[i] = Visibility::transformAABB(meshes[vs.instances[i].meshID].localAABB, transforms[vs.transformIDs[i]]);
+		});
+
+		// Odd run lengths so the two row AVX2 loop leaves tails
+		std::vector<AABB> scalarOut(rows);
+		std::vector<AABB> out(rows);
+		double kernelMs[static_cast<size_t>(Visibility::CullKernel::Count)] = {};
+		float maxError = 0.0f;
+
+		for (uint8_t k = 0; k < static_cast<uint8_t>(Visibility::CullKernel::Count); ++k) {
+			const auto kernel = static_cast<Visibility::CullKernel>(k);
+			if (!Visibility::cullKernelSupported(kernel)) continue;
+
+			std::vector<AABB>& target = kernel == Visibility::CullKernel::Scalar ? scalarOut : out;
+			for (uint32_t first = 0; first < rows; first += 7)
+				Visibility::transformRowBounds(vs.instances.data(), vs.transformIDs.data(), meshes, transforms,
+					first, std::min(7u, rows - first), target.data(), kernel);
+
+			if (kernel != Visibility::CullKernel::Scalar &&
+				memcmp(out.data(), scalarOut.data(), rows * sizeof(AABB)) != 0) {
+				fmt::print("[AABBTransform] {} rows: {} differs from the scalar kernel\n", rows, Visibility::cullKernelName(kernel));
+				ok = false;
+			}
+
+			kernelMs[k] = Bench::medianMs(5, [&] {
+				Visibility::transformRowBounds(vs.instances.data(), vs.transformIDs.data(), meshes, transforms,
+					0, rows, out.data(), kernel);
+			});
+		}
+
+		for (uint32_t i = 0; i < rows; ++i)
+			maxError = std::max(maxError, relativeError(reference[i], scalarOut[i]));
+		if (maxError > maxRelativeError) {
+			fmt::print("[AABBTransform] {} rows: {:.3g} off transformAABB\n", rows, maxError);
+			ok = false;
+		}
+
+		// Whole slab as one run through the engine entry point, split over the workers
+		const std::vector<Visibility::RowRun> runs{ { 0, rows } };
+		const double jobsMs = Bench::medianMs(5, [&] { Visibility::updateWorldAABBs(vs, runs, meshes, transforms); });
+		if (memcmp(vs.worldAABBs.data(), scalarOut.data(), rows * sizeof(AABB)) != 0) {
+			fmt::print("[AABBTransform] {} rows: updateWorldAABBs differs from the scalar kernel\n", rows);
+			ok = false;
+		}
+
+		auto rate = [&](double ms) { return fmt::format("{:7.1f} Mrow/s", ms > 0.0 ? rows / ms / 1000.0 : 0.0); };
+		fmt::print("{:>8} {:>14} {:>14} {:>14} {:>14} {:>14} {:>10.2g}\n",
+			rows, rate(refMs), rate(kernelMs[0]), rate(kernelMs[1]), rate(kernelMs[2]), rate(jobsMs), maxError);
+	}
+
+	return ok;
+}
@@ -0,0 +1,146 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+#include "engine/JobSystem.h"
+
+// 60k live rows out of 160k, 500 of them moving every frame, with four bulk spawns of 20k rows
+// and one despawn of 20k over 240 frames. Each frame applies the sync and culls one view, the
+// frame time is both. Synchronous rebuilds against background ones: frame time spread, frames a
+// spawn waits in the flat list, and every frame's cull has to match the brute force reference.
+BENCH_SUITE(AsyncRebuild) {
+	constexpr uint32_t baseRows = 60'000;
+	constexpr uint32_t batchRows = 20'000;
+	constexpr uint32_t totalRows = baseRows + 5 * batchRows;
+	constexpr uint32_t frames = 240;
+	constexpr uint32_t movingRows = 500;
+
+	const std::vector<AABB> boxes = Bench::makeUnevenScene(totalRows, 83u);
+	const std::vector<Frustum> frustums = Bench::makeFrustums(8, 29u);
+	bool ok = true;
+
+	if (JobSystem::getThreadCount() < 2)
+		fmt::print("1 scheduler thread, background builds run in place. Rerun with --threads 2 or more.\n");
+
+	fmt::print("{:>7} {:>10} {:>10} {:>10} {:>14} {:>13}\n", "mode", "median ms", "p99 ms", "max ms", "loose frames", "max loose");
+
+	for (const bool async : { false, true }) {
+		Visibility::VisibilityState vs;
+		Bench::fillVisibilityState(vs, boxes);
+		for (uint32_t row = baseRows; row < totalRows; ++row) Visibility::setRowActive(vs, row, false);
+		vs.asyncRebuild = async;
+		Visibility::buildBVH(vs);
+
+		std::mt19937 rng(3u);
+		std::vector<double> samples;
+		uint32_t looseFrames = 0;
+		size_t maxLoose = 0;
+		uint32_t nextBatch = baseRows;
+
+		std::vector<GPUInstance> visible;
+		std::vector<AABB> visibleAABBs;
+
+		for (uint32_t f = 0; f < frames; ++f) {
+			VisibilitySyncResult sync{};
+
+			// Bulk spawns, then the first batch goes away again
+			if (f % 40 == 20 && nextBatch < totalRows - batchRows) {
+				for (uint32_t row = nextBatch; row < nextBatch + batchRows; ++row) {
+					Visibility::setRowActive(vs, row, true);
+					sync.addedRows.push_back(row);
+				}
+				nextBatch += batchRows;
+				sync.topologyChanged = true;
+			}
+			if (f == 200) {
+				for (uint32_t row = baseRows; row < baseRows + batchRows; ++row) {
+					Visibility::setRowActive(vs, row, false);
+					sync.removedRows.push_back(row);
+				}
+				sync.topologyChanged = true;
+			}
+
+			std::vector<Visibility::RowRun> moved;
+			const glm::vec3 offset(std::sin(f * 0.2f), 0.0f, std::cos(f * 0.2f));
+			for (uint32_t i = 0; i < movingRows; ++i) {
+				const uint32_t row = vs.active[rng() % vs.active.size()];
+				vs.worldAABBs[row] = Bench::makeAABB(boxes[row].origin + offset, boxes[row].extent);
+				moved.push_back({ row, 1 });
+			}
+			Visibility::markRowsDirty(vs, moved);
+			sync.refitOnly = true;
+
+			const Frustum& frus = frustums[f % frustums.size()];
+			Bench::Timer t;
+			Visibility::applySyncResult(vs, sync);
+			Visibility::cullBVHCollect(vs, frus, visible, visibleAABBs);
+			samples.push_back(t.ms());
+
+			looseFrames += vs.looseRows.empty() ? 0u : 1u;
+			maxLoose = std::max(maxLoose, vs.looseRows.size());
+
+			if (ok && Bench::sortedTransformIDs(visible) != Bench::referenceCull(vs, frus)) {
+				fmt::print("[AsyncRebuild] {} frame {}: cull mismatch\n", async ? "async" : "sync", f);
+				ok = false;
+			}
+		}
+
+		// Whatever is still in flight lands, then the tree has to hold exactly the live rows
+		Visibility::finishAsyncBVHBuild(vs, true);
+		uint32_t inTree = 0;
+		for (const Visibility::BVHNode& node : vs.bvh) inTree += node.count;
+		bool holdsLive = inTree == vs.active.size();
+		for (uint32_t row : vs.active)
+			holdsLive &= row < vs.rowLeaf.size() && vs.rowLeaf[row] != Visibility::BVH_NO_NODE;
+		if (!holdsLive || !vs.looseRows.empty()) {
+			fmt::print("[AsyncRebuild] {}: tree doesn't hold the live rows after the last build\n", async ? "async" : "sync");
+			ok = false;
+		}
+
+		const Bench::Timing timing = Bench::summarize(samples);
+		Bench::record("AsyncRebuild", async ? "async" : "sync", totalRows, "frame", timing);
+		fmt::print("{:>7} {:>10.3f} {:>10.3f} {:>10.3f} {:>14} {:>13}\n", async ? "async" : "sync",
+			timing.median, timing.p99, *std::max_element(samples.begin(), samples.end()), looseFrames, maxLoose);
+	}
+
+	// A spawn starts a background build, a synchronous rebuild overtakes it, and a second spawn
+	// turns loose while the stale build is still pending. Dropping the stale build has to start
+	// another one, or the second batch stays in the flat list for good.
+	{
+		Visibility::VisibilityState vs;
+		Bench::fillVisibilityState(vs, boxes);
+		for (uint32_t row = baseRows; row < totalRows; ++row) Visibility::setRowActive(vs, row, false);
+		vs.asyncRebuild = true;
+		Visibility::buildBVH(vs);
+
+		auto spawn = [&](uint32_t first) {
+			VisibilitySyncResult sync{};
+			for (uint32_t row = first; row < first + batchRows; ++row) {
+				Visibility::setRowActive(vs, row, true);
+				sync.addedRows.push_back(row);
+			}
+			sync.topologyChanged = true;
+			// Straight to the tree edit, applySyncResult would swap a build that already finished
+			Visibility::updateBVHIncremental(vs, sync);
+		};
+
+		spawn(baseRows);
+		Visibility::buildBVH(vs);
+		spawn(baseRows + batchRows);
+		const size_t looseAfterSpawn = vs.looseRows.size();
+
+		uint32_t finishes = 0;
+		while (vs.pendingBuild && finishes < 4) {
+			Visibility::finishAsyncBVHBuild(vs, true);
+			++finishes;
+		}
+
+		fmt::print("overtaken build: {} rows loose after the second spawn, {} after {} finishes\n",
+			looseAfterSpawn, vs.looseRows.size(), finishes);
+		if (!vs.looseRows.empty()) {
+			fmt::print("[AsyncRebuild] rows spawned behind an overtaken build never left the flat list\n");
+			ok = false;
+		}
+	}
+
+	return ok;
+}
@@ -0,0 +1,79 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+
+// Binary vs 4-wide layouts: memory per node, cull time, and a refit round trip.
+BENCH_SUITE(BVH4Layout) {
+	constexpr uint32_t sizes[] = { 100'000, 1'000'000 };
+	constexpr BVHLayout layouts[] = { BVHLayout::Binary, BVHLayout::BVH4, BVHLayout::BVH4Quantized };
+	constexpr const char* layoutNames[] = { "binary", "bvh4", "bvh4-q16" };
+	constexpr size_t nodeBytes[] = { sizeof(Visibility::BVHNode), sizeof(Visibility::BVH4Node), sizeof(Visibility::BVH4QNode) };
+
+	const std::vector<Frustum> frustums = Bench::makeFrustums(64, 11u);
+	bool ok = true;
+
+	fmt::print("{:>9} {:>9} {:>10} {:>8} {:>9} {:>10} {:>11} {:>9}\n",
+		"rows", "layout", "bytes/node", "nodes", "tree MB", "build ms", "tests/cull", "cull ms");
+
+	for (uint32_t size : sizes) {
+		std::vector<AABB> boxes = Bench::makeUnevenScene(size, 321u + size);
+
+		for (uint32_t l = 0; l < std::size(layouts); ++l) {
+			Visibility::VisibilityState vs;
+			Bench::fillVisibilityState(vs, boxes);
+			vs.layout = layouts[l];
+
+			const double buildMs = Bench::medianMs(3, [&] { Visibility::buildBVH(vs); });
+			const size_t nodes = layouts[l] == BVHLayout::Binary ? vs.bvh.size() : vs.bvh4.nodes.size();
+			// A 4-wide walk tests each slot at most once, however often it comes back to the node
+			uint64_t slots = 0;
+			for (const Visibility::BVH4Node& n : vs.bvh4.nodes) slots += n.slots;
+
+			std::vector<GPUInstance> visible;
+			std::vector<AABB> visibleAABBs;
+			uint64_t tests = 0;
+			const double cullMs = Bench::medianMs(3, [&] {
+				tests = 0;
+				for (const Frustum& f : frustums) {
+					Visibility::CullStats stats{};
+					Visibility::cullBVHCollect(vs, f, visible, visibleAABBs, &stats);
+					tests += stats.nodesVisited;
+					if (layouts[l] != BVHLayout::Binary && stats.nodesVisited > slots) {
+						fmt::print("[BVH4Layout] {} {} rows: {} slot tests for {} slots\n", layoutNames[l], size, stats.nodesVisited, slots);
+						ok = false;
+					}
+				}
+			}) / frustums.size();
+
+			auto check = [&](const char* when) {
+				for (uint32_t i = 0; i < 8; ++i) {
+					Visibility::cullBVHCollect(vs, frustums[i], visible, visibleAABBs);
+					if (Bench::sortedTransformIDs(visible) != Bench::referenceCull(vs, frustums[i])) {
+						fmt::print("[BVH4Layout] {} {} rows: {} mismatch on frustum {}\n", layoutNames[l], size, when, i);
+						ok = false;
+					}
+				}
+			};
+			check("build");
+
+			// Nudge a tenth of the rows and refit, the tree has to stay exact
+			std::vector<Visibility::RowRun> nudged;
+			for (uint32_t i = 0; i < size; i += 10) {
+				AABB& b = vs.worldAABBs[i];
+				b = Bench::makeAABB(b.origin + glm::vec3(3.0f, 0.0f, -2.0f), b.extent);
+				nudged.push_back({ i, 1 });
+			}
+			Visibility::markRowsDirty(vs, nudged);
+			VisibilitySyncResult refit{};
+			refit.refitOnly = true;
+			Visibility::applySyncResult(vs, refit);
+			check("refit");
+
+			fmt::print("{:>9} {:>9} {:>10} {:>8} {:>9.2f} {:>10.2f} {:>11.1f} {:>9.4f}\n",
+				size, layoutNames[l], nodeBytes[l], nodes, nodes * nodeBytes[l] / (1024.0 * 1024.0),
+				buildMs, static_cast<double>(tests) / frustums.size(), cullMs);
+		}
+	}
+
+	return ok;
+}
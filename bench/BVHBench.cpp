@@ -0,0 +1,57 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+
+// Median, binned SAH and LBVH builds over uneven scenes: build time, SAH cost of the result
+// and how much of the tree a cull has to walk.
+BENCH_SUITE(BVHBuild) {
+	constexpr uint32_t sizes[] = { 10'000, 100'000, 1'000'000 };
+	constexpr BVHBuildMode modes[] = { BVHBuildMode::Median, BVHBuildMode::BinnedSAH, BVHBuildMode::LBVH };
+	constexpr const char* modeNames[] = { "median", "sah", "lbvh" };
+
+	const std::vector<Frustum> frustums = Bench::makeFrustums(64, 7u);
+	bool ok = true;
+
+	fmt::print("{:>9} {:>7} {:>10} {:>9} {:>8} {:>11} {:>10}\n",
+		"rows", "mode", "build ms", "sah cost", "nodes", "visits/cull", "cull ms");
+
+	for (uint32_t size : sizes) {
+		const std::vector<AABB> boxes = Bench::makeUnevenScene(size, 1234u + size);
+		const uint32_t reps = size >= 1'000'000 ? 3 : 7;
+
+		for (uint32_t m = 0; m < std::size(modes); ++m) {
+			Visibility::VisibilityState vs;
+			Bench::fillVisibilityState(vs, boxes);
+			vs.buildMode = modes[m];
+
+			const double buildMs = Bench::medianMs(reps, [&] { Visibility::buildBVH(vs); });
+
+			std::vector<GPUInstance> visible;
+			std::vector<AABB> visibleAABBs;
+			uint64_t visits = 0;
+
+			Bench::Timer cullTimer;
+			for (const Frustum& f : frustums) {
+				Visibility::CullStats stats{};
+				Visibility::cullBVHCollect(vs, f, visible, visibleAABBs, &stats);
+				visits += stats.nodesVisited;
+			}
+			const double cullMs = cullTimer.ms() / frustums.size();
+
+			// Tree must return exactly the rows a brute force pass does
+			for (uint32_t i = 0; i < 8; ++i) {
+				Visibility::cullBVHCollect(vs, frustums[i], visible, visibleAABBs);
+				if (Bench::sortedTransformIDs(visible) != Bench::referenceCull(vs, frustums[i])) {
+					fmt::print("[BVHBuild] {} rows {} build: cull mismatch on frustum {}\n", size, modeNames[m], i);
+					ok = false;
+				}
+			}
+
+			fmt::print("{:>9} {:>7} {:>10.3f} {:>9.2f} {:>8} {:>11.1f} {:>10.4f}\n",
+				size, modeNames[m], buildMs, Visibility::computeSAHCost(vs.bvh), vs.bvh.size(),
+				static_cast<double>(visits) / frustums.size(), cullMs);
+		}
+	}
+
+	return ok;
+}
@@ -0,0 +1,297 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+
+// Every live row reachable exactly once, parent links and rowLeaf consistent, boxes containing children
+static bool validateTree(const Visibility::VisibilityState& vs) {
+	std::vector<uint32_t> seen(vs.instances.size(), 0);
+	std::vector<uint32_t> stack = { 0u };
+	bool ok = vs.bvhParent[0] == -1;
+
+	auto contains = [](const AABB& outer, const AABB& inner) {
+		return glm::all(glm::lessThanEqual(outer.vmin, inner.vmin)) && glm::all(glm::greaterThanEqual(outer.vmax, inner.vmax));
+	};
+
+	while (!stack.empty() && ok) {
+		const uint32_t n = stack.back();
+		stack.pop_back();
+		const Visibility::BVHNode& node = vs.bvh[n];
+
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				const uint32_t row = vs.leafIndex[i];
+				++seen[row];
+				ok = ok && vs.rowLeaf[row] == n && contains(node.box, vs.worldAABBs[row]);
+			}
+			continue;
+		}
+
+		for (int c : { node.left, node.right }) {
+			ok = ok && vs.bvhParent[c] == static_cast<int>(n) && contains(node.box, vs.bvh[c].box);
+			stack.push_back(static_cast<uint32_t>(c));
+		}
+	}
+
+	for (uint32_t row = 0; row < seen.size() && ok; ++row)
+		ok = seen[row] == (vs.activeSlot[row] != Visibility::ROW_INACTIVE ? 1u : 0u);
+	return ok;
+}
+
+// Props spawning and despawning every frame: incremental insert/remove against full rebuilds.
+BENCH_SUITE(BVHIncremental) {
+	constexpr uint32_t liveRows = 100'000;
+	constexpr uint32_t spareRows = 20'000;
+	constexpr uint32_t frames = 200;
+	constexpr uint32_t churnPerFrame = 200; // rows despawned and spawned each frame
+
+	std::vector<AABB> boxes = Bench::makeUnevenScene(liveRows + spareRows, 555u);
+
+	Visibility::VisibilityState vs;
+	Bench::fillVisibilityState(vs, boxes);
+	for (uint32_t row = liveRows; row < liveRows + spareRows; ++row)
+		Visibility::setRowActive(vs, row, false);
+
+	const double rebuildMs = Bench::medianMs(3, [&] { Visibility::buildBVH(vs); });
+	const float startCost = vs.builtSAHCost;
+
+	std::mt19937 rng(9u);
+	std::vector<uint32_t> spare;
+	for (uint32_t row = liveRows; row < liveRows + spareRows; ++row) spare.push_back(row);
+
+	std::vector<double> frameMs;
+	uint32_t rebuilds = 0;
+	size_t maxSlots = 0;
+	const std::vector<AABB> respawn = Bench::makeUnevenScene(frames * churnPerFrame, 556u);
+
+	for (uint32_t f = 0; f < frames; ++f) {
+		VisibilitySyncResult sync{};
+		sync.topologyChanged = true;
+
+		for (uint32_t i = 0; i < churnPerFrame; ++i) {
+			const uint32_t out = vs.active[rng() % vs.active.size()];
+			Visibility::setRowActive(vs, out, false);
+			sync.removedRows.push_back(out);
+
+			const size_t pick = rng() % spare.size();
+			const uint32_t in = spare[pick];
+			spare[pick] = out;
+			vs.worldAABBs[in] = respawn[f * churnPerFrame + i]; // spawns somewhere new
+			Visibility::setRowActive(vs, in, true);
+			sync.addedRows.push_back(in);
+		}
+
+		Bench::Timer t;
+		rebuilds += Visibility::updateBVHIncremental(vs, sync) ? 1 : 0;
+		frameMs.push_back(t.ms());
+		maxSlots = std::max(maxSlots, vs.leafIndex.size());
+	}
+
+	std::sort(frameMs.begin(), frameMs.end());
+	const double median = frameMs[frameMs.size() / 2];
+
+	fmt::print("{} live rows, {} spawned + {} despawned per frame over {} frames\n", liveRows, churnPerFrame, churnPerFrame, frames);
+	fmt::print("full rebuild       {:>9.3f} ms\n", rebuildMs);
+	fmt::print("incremental frame  {:>9.3f} ms median, {:.3f} ms max ({:.2f} us per edit)\n",
+		median, frameMs.back(), median * 1000.0 / (2.0 * churnPerFrame));
+	fmt::print("rebuilds triggered {:>9}\n", rebuilds);
+	fmt::print("SAH cost           {:>9.2f} at build, {:.2f} now\n", startCost, Visibility::computeSAHCost(vs.bvh));
+
+	fmt::print("leafIndex slots    {:>9} max, {} free now\n", maxSlots, vs.freeLeafSlots.size());
+
+	bool ok = validateTree(vs);
+	if (!ok) fmt::print("[BVHIncremental] tree links or bounds broken after churn\n");
+
+	// Removals run before inserts each sync and inserts reuse the freed slots, so steady churn
+	// never needs more slots than live rows
+	if (maxSlots > liveRows || vs.leafIndex.size() - vs.freeLeafSlots.size() != vs.active.size()) {
+		fmt::print("[BVHIncremental] leafIndex grew to {} slots for {} live rows\n", maxSlots, liveRows);
+		ok = false;
+	}
+
+	std::vector<GPUInstance> visible;
+	std::vector<AABB> visibleAABBs;
+	for (BVHLayout layout : { BVHLayout::Binary, BVHLayout::BVH4 }) {
+		vs.layout = layout;
+		if (layout != BVHLayout::Binary) Visibility::buildBVH4(vs);
+
+		for (const Frustum& frus : Bench::makeFrustums(8, 3u)) {
+			Visibility::cullBVHCollect(vs, frus, visible, visibleAABBs);
+			if (Bench::sortedTransformIDs(visible) != Bench::referenceCull(vs, frus)) {
+				fmt::print("[BVHIncremental] cull mismatch after churn\n");
+				ok = false;
+			}
+		}
+	}
+	vs.layout = BVHLayout::Binary;
+
+	// Same churn one row at a time on the 4-wide layout at growing sizes. Edits stay on the binary
+	// tree and bvh4 is collapsed again only every bvh.size() / 8 edits or once they settle, so the
+	// cost per edit, collapses included, shouldn't grow with the row count.
+	{
+		constexpr uint32_t edits = 4000;
+		fmt::print("\n{:>9} {:>14} {:>14} {:>10}\n", "rows", "median us/edit", "mean us/edit", "collapses");
+
+		for (uint32_t rows : { 25'000u, 100'000u, 400'000u }) {
+			const std::vector<AABB> sizedBoxes = Bench::makeUnevenScene(rows + 1, 557u + rows);
+			Visibility::VisibilityState sized;
+			Bench::fillVisibilityState(sized, sizedBoxes);
+			sized.layout = BVHLayout::BVH4;
+			Visibility::setRowActive(sized, rows, false);
+			Visibility::buildBVH(sized);
+
+			std::mt19937 editRng(rows);
+			uint32_t spareRow = rows;
+			uint32_t collapses = 0;
+			std::vector<double> editMs;
+			double totalMs = 0.0;
+
+			for (uint32_t e = 0; e < edits; ++e) {
+				VisibilitySyncResult sync{};
+				sync.topologyChanged = true;
+
+				const uint32_t out = sized.active[editRng() % sized.active.size()];
+				Visibility::setRowActive(sized, out, false);
+				Visibility::setRowActive(sized, spareRow, true);
+				sync.removedRows.push_back(out);
+				sync.addedRows.push_back(spareRow);
+				spareRow = out;
+
+				Bench::Timer t;
+				Visibility::applySyncResult(sized, sync);
+				const double ms = t.ms();
+				editMs.push_back(ms);
+				totalMs += ms;
+				collapses += sized.bvh4Stale ? 0u : 1u;
+			}
+
+			// Mid-burst the binary tree answers, once the edits settle bvh4 has to match it
+			for (bool settled : { false, true }) {
+				if (settled) Visibility::applySyncResult(sized, VisibilitySyncResult{});
+				for (const Frustum& frus : Bench::makeFrustums(4, 5u)) {
+					Visibility::cullBVHCollect(sized, frus, visible, visibleAABBs);
+					if (Bench::sortedTransformIDs(visible) != Bench::referenceCull(sized, frus)) {
+						fmt::print("[BVHIncremental] {} rows: 4-wide cull mismatch {} the edits settled\n", rows, settled ? "after" : "before");
+						ok = false;
+					}
+				}
+			}
+			if (sized.bvh4Stale) {
+				fmt::print("[BVHIncremental] {} rows: bvh4 still stale after a sync without edits\n", rows);
+				ok = false;
+			}
+
+			const Bench::Timing timing = Bench::summarize(editMs);
+			Bench::record("BVHIncremental", "bvh4 single edits", rows, "edit", timing);
+			fmt::print("{:>9} {:>14.3f} {:>14.3f} {:>10}\n", rows, timing.median * 1000.0, totalMs * 1000.0 / edits, collapses);
+		}
+	}
+
+	// Drain to empty and refill through the same path, covers root collapse and regrowth
+	{
+		VisibilitySyncResult sync{};
+		sync.topologyChanged = true;
+		std::vector<uint32_t> live = vs.active;
+		for (uint32_t i = 0; i < live.size(); ++i) {
+			Visibility::removeRowBVH(vs, live[i]);
+			Visibility::setRowActive(vs, live[i], false);
+			if (i % 1000 == 0 && !vs.bvh.empty() && !validateTree(vs)) {
+				fmt::print("[BVHIncremental] tree broken while draining\n");
+				ok = false;
+				break;
+			}
+		}
+		ok = ok && vs.bvh.empty();
+
+		for (uint32_t i = 0; i < 5000; ++i) {
+			Visibility::setRowActive(vs, live[i], true);
+			Visibility::insertRowBVH(vs, live[i]);
+		}
+		ok = ok && validateTree(vs);
+		if (!ok) fmt::print("[BVHIncremental] drain/refill failed\n");
+
+		// Shrink in small syncs, each under the rebuild delta. The freed slots pile up until a
+		// rebuild compacts them, never more than the fraction plus one sync's worth.
+		size_t maxFree = 0;
+		while (vs.active.size() > 500) {
+			VisibilitySyncResult shrink{};
+			shrink.topologyChanged = true;
+			for (uint32_t i = 0; i < 50; ++i) {
+				const uint32_t out = vs.active.back();
+				Visibility::setRowActive(vs, out, false);
+				shrink.removedRows.push_back(out);
+			}
+			Visibility::updateBVHIncremental(vs, shrink);
+			maxFree = std::max(maxFree, vs.freeLeafSlots.size());
+		}
+		if (!validateTree(vs) || static_cast<float>(vs.freeLeafSlots.size()) > static_cast<float>(vs.leafIndex.size()) * Visibility::BVH_DEAD_SLOT_MAX_FRACTION) {
+			fmt::print("[BVHIncremental] {} of {} leafIndex slots free after shrinking, max {}\n",
+				vs.freeLeafSlots.size(), vs.leafIndex.size(), maxFree);
+			ok = false;
+		}
+	}
+
+	// Slab sync: model 0 grows in the same frame model 1's copies grow, then shrink, so model
+	// 1's transforms move under its surviving copies. Every live copy has to follow them.
+	{
+		std::vector<GPUMeshData> meshData(2);
+		meshData[0].localAABB = Bench::makeAABB(glm::vec3(0.0f), glm::vec3(1.0f));
+		meshData[1].localAABB = Bench::makeAABB(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.5f));
+
+		std::unordered_map<SceneID, std::shared_ptr<ModelAsset>> loaded;
+		std::vector<GlobalInstance> gis(2);
+		for (uint8_t m = 0; m < 2; ++m) {
+			// ModelAsset's destructor frees GPU resources the bench doesn't link, the two are leaked
+			std::shared_ptr<ModelAsset> asset(new ModelAsset(), [](ModelAsset*) {});
+			for (uint32_t local = 0; local < 2; ++local) {
+				auto baked = std::make_shared<GPUInstance>();
+				baked->meshID = local;
+				asset->runtime.bakedInstances.push_back(baked);
+				asset->runtime.localToNodeSlot.push_back(local);
+			}
+			loaded[static_cast<SceneID>(m)] = asset;
+
+			gis[m].instanceID = m;
+			gis[m].sceneID = m;
+			gis[m].transformCount = 2;
+			gis[m].perInstanceStride = 2;
+			gis[m].capacityCopies = 8;
+		}
+		gis[0].usedCopies = 2;
+		gis[1].usedCopies = 3;
+		gis[1].firstTransform = 4;
+
+		std::vector<glm::mat4> transforms(32);
+		for (uint32_t t = 0; t < transforms.size(); ++t)
+			transforms[t] = glm::translate(glm::mat4(1.0f), glm::vec3(static_cast<float>(t) * 10.0f, 0.0f, 0.0f));
+
+		Visibility::VisibilityState sceneVS;
+		Visibility::syncFromGlobalInstances(sceneVS, gis, loaded, meshData, transforms);
+		Visibility::buildBVH(sceneVS);
+
+		for (uint32_t copies : { 4u, 2u }) {
+			gis[0].usedCopies += 2;
+			gis[1].firstTransform = gis[0].usedCopies * gis[0].transformCount;
+			gis[1].usedCopies = copies;
+			Visibility::applySyncResult(sceneVS, Visibility::syncFromGlobalInstances(sceneVS, gis, loaded, meshData, transforms));
+
+			const Visibility::CoreSlab& slab = sceneVS.slabs.at(static_cast<SceneID>(1));
+			bool follows = slab.usedCopies == copies;
+			for (uint32_t c = 0; c < copies && follows; ++c) {
+				for (uint32_t local = 0; local < 2; ++local) {
+					const uint32_t row = slab.copyFirst[c] + local;
+					const uint32_t tid = gis[1].firstTransform + c * 2 + local;
+					const AABB expected = Visibility::transformAABB(meshData[local].localAABB, transforms[tid]);
+					follows = follows && sceneVS.transformIDs[row] == tid && sceneVS.instances[row].transformID == tid &&
+						sceneVS.activeSlot[row] != Visibility::ROW_INACTIVE &&
+						sceneVS.worldAABBs[row].vmin == expected.vmin && sceneVS.worldAABBs[row].vmax == expected.vmax;
+				}
+			}
+			if (!follows || !validateTree(sceneVS)) {
+				fmt::print("[BVHIncremental] model resized to {} copies kept stale transforms after an earlier model grew\n", copies);
+				ok = false;
+			}
+		}
+	}
+
+	return ok;
+}
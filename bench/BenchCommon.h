@@ -0,0 +1,289 @@
+#pragma once
+
+#include "renderer/scene/Visibility.h"
+
+#include <random>
+#include <algorithm>
+
+// Headless CPU benchmarks for the frame pipeline, no Vulkan device is created.
+// Each suite registers itself with BENCH_SUITE and returns false when a result
+// doesn't match its reference path.
+namespace Bench {
+	using SuiteFn = bool(*)();
+
+	struct Suite {
+		const char* name;
+		SuiteFn fn;
+	};
+
+	inline std::vector<Suite>& registry() {
+		static std::vector<Suite> suites;
+		return suites;
+	}
+
+	struct Registrar {
+		Registrar(const char* name, SuiteFn fn) { registry().push_back({ name, fn }); }
+	};
+
+#define BENCH_SUITE(name) \
+	static bool name(); \
+	static Bench::Registrar name##_registrar(#name, name); \
+	static bool name()
+
+	struct Timer {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		inline double ms() const {
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+	};
+
+	// Runs fn reps times and returns the median in milliseconds
+	template<typename Fn>
+	inline double medianMs(uint32_t reps, Fn&& fn) {
+		std::vector<double> samples(reps);
+		for (uint32_t i = 0; i < reps; ++i) {
+			Timer t;
+			fn();
+			samples[i] = t.ms();
+		}
+		std::sort(samples.begin(), samples.end());
+		return samples[reps / 2];
+	}
+
+	struct Timing {
+		double median = 0.0;
+		double p99 = 0.0; // nearest rank, the slowest sample when there are fewer than 100
+		uint32_t samples = 0;
+	};
+
+	inline Timing summarize(std::vector<double> samples) {
+		Timing t{};
+		if (samples.empty()) return t;
+		std::sort(samples.begin(), samples.end());
+		const size_t n = samples.size();
+		t.median = samples[n / 2];
+		t.p99 = samples[static_cast<size_t>(std::ceil(0.99 * static_cast<double>(n))) - 1];
+		t.samples = static_cast<uint32_t>(n);
+		return t;
+	}
+
+	// One timed stage for the JSON report BenchMain writes with --json
+	struct ReportEntry {
+		std::string suite;
+		std::string scene;
+		uint32_t rows = 0;
+		std::string stage;
+		Timing timing;
+	};
+
+	inline std::vector<ReportEntry>& report() {
+		static std::vector<ReportEntry> entries;
+		return entries;
+	}
+
+	inline void record(const char* suite, const std::string& scene, uint32_t rows, const char* stage, const Timing& timing) {
+		report().push_back({ suite, scene, rows, stage, timing });
+	}
+
+	inline AABB makeAABB(const glm::vec3& center, const glm::vec3& halfExtent) {
+		AABB b{};
+		b.vmin = center - halfExtent;
+		b.vmax = center + halfExtent;
+		b.origin = center;
+		b.extent = halfExtent;
+		b.sphereRadius = glm::length(halfExtent);
+		return b;
+	}
+
+	// Uneven object sizes spread over clusters, mostly small props with a few large
+	// buildings, which is where median splits fall apart.
+	inline std::vector<AABB> makeUnevenScene(uint32_t count, uint32_t seed, float worldSize = 1000.0f) {
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		const uint32_t clusterCount = std::max(count / 2000u, 4u);
+		std::vector<glm::vec3> clusters(clusterCount);
+		for (auto& c : clusters)
+			c = glm::vec3(unit(rng), unit(rng) * 0.1f, unit(rng)) * worldSize - glm::vec3(worldSize * 0.5f, 0.0f, worldSize * 0.5f);
+
+		std::vector<AABB> boxes(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			const glm::vec3& c = clusters[rng() % clusterCount];
+			const float spread = worldSize * 0.05f;
+			const glm::vec3 p = c + (glm::vec3(unit(rng), unit(rng), unit(rng)) - 0.5f) * spread * 2.0f;
+
+			const float r = unit(rng);
+			const float size = (r < 0.9f) ? 0.2f + unit(rng) : (r < 0.99f ? 2.0f + unit(rng) * 5.0f : 10.0f + unit(rng) * 30.0f);
+			boxes[i] = makeAABB(p, glm::vec3(size, size * (0.5f + unit(rng)), size));
+		}
+		return boxes;
+	}
+
+	// Fills a VisibilityState with one row per box, all of them active
+	inline void fillVisibilityState(Visibility::VisibilityState& vs, const std::vector<AABB>& boxes) {
+		vs.cleanup();
+		const uint32_t count = static_cast<uint32_t>(boxes.size());
+		vs.worldAABBs = boxes;
+		vs.instances.resize(count);
+		vs.transformIDs.resize(count);
+		vs.active.resize(count);
+		vs.activeSlot.resize(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			GPUInstance& row = vs.instances[i];
+			row.meshID = i % 64;
+			row.materialID = i % 16;
+			row.transformID = i;
+			row.drawType = 0;
+			row.passType = 0;
+			vs.transformIDs[i] = i;
+			vs.active[i] = i;
+			vs.activeSlot[i] = i;
+		}
+	}
+
+	// City blocks: one solid building per block, then small props scattered along the streets.
+	// Buildings come first in boxes, they double as exact occluders.
+	struct CityScene {
+		std::vector<AABB> boxes;
+		uint32_t buildingCount = 0;
+		float blockSize = 40.0f;
+		uint32_t blocks = 0; // per side, centered on the origin
+	};
+
+	inline CityScene makeCityScene(uint32_t blocks, uint32_t props, uint32_t seed) {
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		CityScene city;
+		city.blocks = blocks;
+		const float half = city.blockSize * 0.5f;
+		const float footprint = half * 0.75f; // leaves 10m streets between buildings
+		const float origin = -city.blockSize * static_cast<float>(blocks) * 0.5f;
+
+		for (uint32_t bz = 0; bz < blocks; ++bz) {
+			for (uint32_t bx = 0; bx < blocks; ++bx) {
+				const float height = 10.0f + unit(rng) * 50.0f;
+				const glm::vec3 center(origin + (bx + 0.5f) * city.blockSize, height * 0.5f, origin + (bz + 0.5f) * city.blockSize);
+				city.boxes.push_back(makeAABB(center, glm::vec3(footprint, height * 0.5f, footprint)));
+			}
+		}
+		city.buildingCount = static_cast<uint32_t>(city.boxes.size());
+
+		const float extent = city.blockSize * static_cast<float>(blocks);
+		while (city.boxes.size() < city.buildingCount + props) {
+			const glm::vec3 p(origin + unit(rng) * extent, 0.0f, origin + unit(rng) * extent);
+			const float lx = std::fmod(p.x - origin, city.blockSize) - half;
+			const float lz = std::fmod(p.z - origin, city.blockSize) - half;
+			if (std::abs(lx) < footprint + 1.5f && std::abs(lz) < footprint + 1.5f) continue; // inside a building
+
+			const glm::vec3 size = glm::vec3(0.3f + unit(rng), 0.5f + unit(rng) * 2.0f, 0.3f + unit(rng));
+			city.boxes.push_back(makeAABB(p + glm::vec3(0.0f, size.y, 0.0f), size));
+		}
+		return city;
+	}
+
+	// Cameras scattered through the scene looking at random points near the ground
+	inline std::vector<glm::mat4> makeViewProjs(uint32_t count, uint32_t seed, float worldSize = 1000.0f) {
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(-0.5f, 0.5f);
+
+		std::vector<glm::mat4> out(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			const glm::vec3 eye(unit(rng) * worldSize, 5.0f + (unit(rng) + 0.5f) * 50.0f, unit(rng) * worldSize);
+			const glm::vec3 target(unit(rng) * worldSize, 0.0f, unit(rng) * worldSize);
+			glm::mat4 proj = glm::perspective(glm::radians(70.f), 16.0f / 9.0f, 0.1f, 500.f);
+			proj[1][1] *= -1;
+			out[i] = proj * glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+		}
+		return out;
+	}
+
+	inline std::vector<Frustum> makeFrustums(uint32_t count, uint32_t seed, float worldSize = 1000.0f) {
+		std::vector<Frustum> out;
+		out.reserve(count);
+		for (const glm::mat4& vp : makeViewProjs(count, seed, worldSize))
+			out.push_back(Visibility::extractFrustum(vp));
+		return out;
+	}
+
+	// Camera flying a slow loop through the scene, consecutive frames see nearly the same thing
+	inline std::vector<Frustum> makeFlyPath(uint32_t frames, float worldSize = 1000.0f) {
+		std::vector<Frustum> out;
+		out.reserve(frames);
+		for (uint32_t f = 0; f < frames; ++f) {
+			const float t = static_cast<float>(f) / static_cast<float>(frames) * glm::two_pi<float>();
+			const glm::vec3 eye(std::cos(t) * worldSize * 0.3f, 20.0f, std::sin(t) * worldSize * 0.3f);
+			const glm::vec3 dir(-std::sin(t), -0.05f, std::cos(t)); // along the loop
+			glm::mat4 proj = glm::perspective(glm::radians(70.f), 16.0f / 9.0f, 0.1f, 500.f);
+			proj[1][1] *= -1;
+			out.push_back(Visibility::extractFrustum(proj * glm::lookAt(eye, eye + dir, glm::vec3(0.0f, 1.0f, 0.0f))));
+		}
+		return out;
+	}
+
+	// Meshes with MAX_MESH_LODS levels each, every level its own index range
+	inline void makeLODMeshes(uint32_t meshCount, std::vector<GPUMeshData>& meshes, std::vector<MeshLODs>& meshLODs) {
+		meshes.assign(meshCount, {});
+		meshLODs.assign(meshCount, {});
+		uint32_t firstIndex = 0;
+		for (uint32_t m = 0; m < meshCount; ++m) {
+			meshes[m].vertexOffset = m * 1000;
+			meshes[m].vertexCount = 1000;
+			meshLODs[m].count = MAX_MESH_LODS;
+			for (uint32_t l = 0; l < MAX_MESH_LODS; ++l) {
+				const uint32_t indexCount = 3 * (600u >> l);
+				meshLODs[m].levels[l] = { firstIndex, indexCount };
+				firstIndex += indexCount;
+			}
+			meshes[m].firstIndex = meshLODs[m].levels[0].firstIndex;
+			meshes[m].indexCount = meshLODs[m].levels[0].indexCount;
+		}
+	}
+
+	// A cull result as draw preparation gets it: rows over the meshes with a few popular ones
+	// drawing most of them, random materials and levels, one in ten transparent, boxes spread
+	// over the world. transformID is the row.
+	struct VisibleRows {
+		std::vector<GPUInstance> instances;
+		std::vector<uint8_t> lods;
+		std::vector<AABB> aabbs;
+	};
+
+	inline VisibleRows makeVisibleRows(uint32_t rows, uint32_t meshCount, uint32_t materialCount, uint32_t seed, float worldSize = 1000.0f) {
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		VisibleRows out;
+		out.instances.resize(rows);
+		out.lods.resize(rows);
+		out.aabbs.resize(rows);
+		for (uint32_t i = 0; i < rows; ++i) {
+			const float r = unit(rng);
+			out.instances[i].meshID = static_cast<uint32_t>(r * r * r * meshCount);
+			out.instances[i].materialID = rng() % materialCount;
+			out.instances[i].transformID = i;
+			out.instances[i].passType = static_cast<uint32_t>(rng() % 10 == 0 ? MaterialPass::Transparent : MaterialPass::Opaque);
+			out.lods[i] = static_cast<uint8_t>(rng() % MAX_MESH_LODS);
+			out.aabbs[i] = makeAABB(glm::vec3(unit(rng), unit(rng), unit(rng)) * worldSize, glm::vec3(1.0f));
+		}
+		return out;
+	}
+
+	// Rows in a cull result, sorted so traversal order doesn't matter when comparing
+	inline std::vector<uint32_t> sortedTransformIDs(const std::vector<GPUInstance>& rows) {
+		std::vector<uint32_t> ids(rows.size());
+		for (size_t i = 0; i < rows.size(); ++i) ids[i] = rows[i].transformID;
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	}
+
+	// Brute force reference: every active row against the frustum
+	inline std::vector<uint32_t> referenceCull(const Visibility::VisibilityState& vs, const Frustum& frus) {
+		std::vector<uint32_t> ids;
+		for (uint32_t row : vs.active)
+			if (Visibility::boxInFrustum(vs.worldAABBs[row], frus))
+				ids.push_back(vs.instances[row].transformID);
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	}
+}
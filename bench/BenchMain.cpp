@@ -0,0 +1,64 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+#include "engine/JobSystem.h"
+
+// Writes every recorded stage, rerun on another commit and diff the files to compare
+static bool writeReport(const char* path) {
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		fmt::print("[Bench] can't write {}\n", path);
+		return false;
+	}
+
+	fmt::print(file, "{{\n  \"threads\": {},\n  \"results\": [", JobSystem::getThreadCount());
+	const auto& entries = Bench::report();
+	for (size_t i = 0; i < entries.size(); ++i) {
+		const Bench::ReportEntry& e = entries[i];
+		fmt::print(file, "{}\n    {{ \"suite\": \"{}\", \"scene\": \"{}\", \"rows\": {}, \"stage\": \"{}\", "
+			"\"median_ms\": {:.6f}, \"p99_ms\": {:.6f}, \"samples\": {} }}",
+			i ? "," : "", e.suite, e.scene, e.rows, e.stage, e.timing.median, e.timing.p99, e.timing.samples);
+	}
+	fmt::print(file, "\n  ]\n}}\n");
+	fclose(file);
+
+	fmt::print("[Bench] {} timings written to {}\n", entries.size(), path);
+	return true;
+}
+
+// HeadlessBench [--json path] [--threads n] [suite name filter...]
+// Runs every registered suite, or only those whose name contains one of the filters.
+// Suites that record stage timings put them in the JSON report. --threads sets the scheduler
+// thread count, every hardware thread by default.
+int main(int argc, char** argv) {
+	const char* jsonPath = nullptr;
+	uint32_t threads = 0;
+	std::vector<std::string_view> filters;
+	for (int i = 1; i < argc; ++i) {
+		if (std::string_view(argv[i]) == "--json" && i + 1 < argc) jsonPath = argv[++i];
+		else if (std::string_view(argv[i]) == "--threads" && i + 1 < argc) threads = static_cast<uint32_t>(std::atoi(argv[++i]));
+		else filters.push_back(argv[i]);
+	}
+
+	JobSystem::initScheduler(threads);
+	fmt::print("[Bench] {} scheduler threads\n", JobSystem::getThreadCount());
+
+	uint32_t failed = 0;
+	for (const Bench::Suite& suite : Bench::registry()) {
+		bool selected = filters.empty();
+		for (size_t i = 0; i < filters.size() && !selected; ++i)
+			selected = std::string_view(suite.name).find(filters[i]) != std::string_view::npos;
+		if (!selected) continue;
+
+		fmt::print("\n== {} ==\n", suite.name);
+		if (!suite.fn()) {
+			fmt::print("[Bench] {} FAILED\n", suite.name);
+			++failed;
+		}
+	}
+
+	if (jsonPath && !writeReport(jsonPath)) ++failed;
+
+	JobSystem::shutdownScheduler();
+	return failed ? 1 : 0;
+}
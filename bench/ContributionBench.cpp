@@ -0,0 +1,188 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+#include "core/loader/MeshLOD.h"
+#include "renderer/scene/ContributionCull.h"
+
+// Unit UV sphere, a closed mesh dense enough for every level to be built
+static GPUMeshData makeSphereMesh(uint32_t rings, uint32_t segments, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+	GPUMeshData mesh{};
+	mesh.vertexOffset = static_cast<uint32_t>(vertices.size());
+	mesh.firstIndex = static_cast<uint32_t>(indices.size());
+
+	for (uint32_t r = 0; r <= rings; ++r) {
+		const float phi = glm::pi<float>() * static_cast<float>(r) / static_cast<float>(rings);
+		for (uint32_t s = 0; s <= segments; ++s) {
+			const float theta = glm::two_pi<float>() * static_cast<float>(s) / static_cast<float>(segments);
+			Vertex v{};
+			v.position = glm::vec3(std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta));
+			v.normal = v.position;
+			vertices.push_back(v);
+		}
+	}
+
+	for (uint32_t r = 0; r < rings; ++r) {
+		for (uint32_t s = 0; s < segments; ++s) {
+			const uint32_t a = r * (segments + 1) + s;
+			const uint32_t b = a + segments + 1;
+			indices.insert(indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+		}
+	}
+
+	mesh.vertexCount = static_cast<uint32_t>(vertices.size()) - mesh.vertexOffset;
+	mesh.indexCount = static_cast<uint32_t>(indices.size()) - mesh.firstIndex;
+	mesh.localAABB = Bench::makeAABB(glm::vec3(0.0f), glm::vec3(1.0f));
+	return mesh;
+}
+
+// LOD levels of a dense sphere, then the screen size stage over cameras in a 100k row scene:
+// rows dropped, rows per level and triangles left against drawing everything at level 0.
+// Every drop and every level is checked against the projected size, and a row pacing back and
+// forth over a level boundary has to switch less often with hysteresis than without.
+BENCH_SUITE(Contribution) {
+	bool ok = true;
+
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	const GPUMeshData sphere = makeSphereMesh(96, 192, vertices, indices);
+
+	MeshLODs lods{};
+	const double lodMs = Bench::medianMs(3, [&] {
+		indices.resize(sphere.firstIndex + sphere.indexCount);
+		lods = MeshLOD::buildLODs(vertices, indices, sphere);
+	});
+
+	fmt::print("sphere LODs ({:.3f} ms):", lodMs);
+	for (uint32_t l = 0; l < lods.count; ++l)
+		fmt::print(" {}", lods.levels[l].indexCount / 3);
+	fmt::print(" triangles\n");
+
+	if (lods.count != MAX_MESH_LODS) {
+		fmt::print("[Contribution] sphere only got {} levels\n", lods.count);
+		ok = false;
+	}
+	for (uint32_t l = 1; l < lods.count; ++l) {
+		const MeshLODRange& range = lods.levels[l];
+		if (range.indexCount >= lods.levels[l - 1].indexCount) {
+			fmt::print("[Contribution] level {} isn't coarser than level {}\n", l, l - 1);
+			ok = false;
+		}
+		for (uint32_t i = 0; i < range.indexCount; i += 3) {
+			const uint32_t* tri = &indices[range.firstIndex + i];
+			if (tri[0] >= sphere.vertexCount || tri[1] >= sphere.vertexCount || tri[2] >= sphere.vertexCount ||
+				tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2]) {
+				fmt::print("[Contribution] level {} has a bad triangle at {}\n", l, i / 3);
+				ok = false;
+				break;
+			}
+		}
+	}
+
+	// Every bench mesh draws the sphere's levels
+	const std::vector<MeshLODs> meshLODs(64, lods);
+
+	Visibility::VisibilityState vs;
+	Bench::fillVisibilityState(vs, Bench::makeUnevenScene(100'000, 23u));
+	Visibility::buildBVH(vs);
+
+	glm::mat4 proj = glm::perspective(glm::radians(70.f), 16.0f / 9.0f, 0.1f, 500.f);
+	proj[1][1] *= -1;
+	const float scale = Visibility::pixelScale(proj, 1080.0f);
+	const Visibility::ContributionSettings settings{};
+
+	fmt::print("{:>5} {:>8} {:>8} {:>27} {:>10} {:>10} {:>9}\n",
+		"view", "visible", "dropped", "rows per level", "tris lod0", "tris", "stage ms");
+
+	std::mt19937 rng(5u);
+	std::uniform_real_distribution<float> unit(-0.5f, 0.5f);
+	std::vector<GPUInstance> culled, visible;
+	std::vector<AABB> culledAABBs, visibleAABBs;
+	std::vector<uint8_t> levels;
+
+	constexpr uint32_t views = 8;
+	for (uint32_t v = 0; v < views; ++v) {
+		const glm::vec3 eye(unit(rng) * 1000.0f, 5.0f + (unit(rng) + 0.5f) * 50.0f, unit(rng) * 1000.0f);
+		const glm::vec3 target(unit(rng) * 1000.0f, 0.0f, unit(rng) * 1000.0f);
+		const Frustum frus = Visibility::extractFrustum(proj * glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+		Visibility::cullBVHCollect(vs, frus, culled, culledAABBs);
+
+		// State carried between runs like between frames, only the first run fills the map
+		Visibility::ContributionStats stats{};
+		Visibility::LODState state;
+		const double stageMs = Bench::medianMs(5, [&] {
+			visible = culled;
+			visibleAABBs = culledAABBs;
+			Visibility::cullContribution(settings, state, eye, scale, meshLODs, visible, visibleAABBs, levels, &stats);
+		});
+
+		uint64_t trisLod0 = 0, tris = 0;
+		for (size_t i = 0; i < visible.size(); ++i) {
+			trisLod0 += lods.levels[0].indexCount / 3;
+			tris += lods.levels[levels[i]].indexCount / 3;
+
+			// Same camera every run, so the level is the plain one for the size
+			const float pixels = Visibility::projectedPixelSize(visibleAABBs[i], eye, scale);
+			if (pixels < settings.minPixelSize || levels[i] != Visibility::selectLOD(pixels, levels[i], lods.count, 0.0f)) {
+				fmt::print("[Contribution] view {}: row {} kept at level {} with {:.2f} px\n",
+					v, visible[i].transformID, levels[i], pixels);
+				ok = false;
+				break;
+			}
+		}
+
+		std::vector<uint8_t> kept(vs.instances.size(), 0);
+		for (const GPUInstance& row : visible) kept[row.transformID] = 1;
+		for (size_t i = 0; i < culled.size(); ++i) {
+			if (kept[culled[i].transformID]) continue;
+			if (Visibility::projectedPixelSize(culledAABBs[i], eye, scale) >= settings.minPixelSize) {
+				fmt::print("[Contribution] view {}: row {} dropped above the pixel threshold\n", v, culled[i].transformID);
+				ok = false;
+				break;
+			}
+		}
+
+		fmt::print("{:>5} {:>8} {:>8} {:>6} {:>6} {:>6} {:>6} {:>10} {:>10} {:>9.3f}\n",
+			v, stats.tested, stats.culled,
+			stats.levelRows[0], stats.levelRows[1], stats.levelRows[2], stats.levelRows[3],
+			trisLod0, tris, stageMs);
+	}
+
+	// A row pacing over the level 0/1 boundary, jitter makes every crossing a few back and forths
+	auto countSwitches = [&](float hysteresis) {
+		Visibility::ContributionSettings paced{};
+		paced.lodHysteresis = hysteresis;
+		Visibility::LODState state;
+		std::mt19937 jitter(9u);
+		std::uniform_real_distribution<float> noise(-0.03f, 0.03f);
+
+		const float boundaryDist = 2.0f * scale / Visibility::LOD_PIXEL_SIZES[0];
+		uint32_t switches = 0, last = UINT32_MAX;
+		for (uint32_t f = 0; f < 600; ++f) {
+			const float wave = std::sin(static_cast<float>(f) * 0.05f) * 0.2f;
+			const float dist = boundaryDist * (1.0f + wave + noise(jitter));
+
+			std::vector<GPUInstance> row(1);
+			row[0].meshID = 0;
+			row[0].transformID = 0;
+			std::vector<AABB> box{ Bench::makeAABB(glm::vec3(0.0f, 0.0f, -dist), glm::vec3(1.0f / std::sqrt(3.0f))) };
+			std::vector<uint8_t> level;
+			Visibility::cullContribution(paced, state, glm::vec3(0.0f), scale, meshLODs, row, box, level);
+
+			if (last != UINT32_MAX && level[0] != last) ++switches;
+			last = level[0];
+		}
+		return switches;
+	};
+
+	const uint32_t switchesPlain = countSwitches(0.0f);
+	const uint32_t switchesHysteresis = countSwitches(settings.lodHysteresis);
+	fmt::print("boundary pacing, 600 frames: {} level switches without hysteresis, {} with {:.2f}\n",
+		switchesPlain, switchesHysteresis, settings.lodHysteresis);
+	if (switchesHysteresis >= switchesPlain) {
+		fmt::print("[Contribution] hysteresis didn't cut down level switches\n");
+		ok = false;
+	}
+
+	return ok;
+}
@@ -0,0 +1,133 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+#include "renderer/scene/DrawPreparation.h"
+#include "engine/platform/profiler/FrameCounters.h"
+#include "engine/JobSystem.h"
+
+// 100k uneven rows, one in ten transparent, a run of 1000 rows moving every frame. Each frame
+// refits, culls in parallel, batches and packs staging, then closes the frame's counters. The
+// totals have to equal what the stages report themselves. Also times adds from every worker
+// against one shared atomic, the contention the per thread lines avoid.
+BENCH_SUITE(Counters) {
+	constexpr uint32_t rows = 100'000;
+	constexpr uint32_t frames = 120;
+	constexpr uint32_t movingRows = 1000;
+	constexpr uint32_t meshCount = 64;
+	constexpr size_t alignment = 256;
+
+	const std::vector<AABB> boxes = Bench::makeUnevenScene(rows, 97u);
+	const std::vector<Frustum> frustums = Bench::makeFrustums(8, 41u);
+	Visibility::VisibilityState vs;
+	Bench::fillVisibilityState(vs, boxes);
+	for (uint32_t row = 0; row < rows; row += 10)
+		vs.instances[row].passType = static_cast<uint32_t>(MaterialPass::Transparent);
+
+	std::vector<GPUMeshData> meshes(meshCount);
+	std::vector<MeshLODs> meshLODs(meshCount);
+	for (uint32_t m = 0; m < meshCount; ++m) {
+		meshes[m].indexCount = 36;
+		meshes[m].vertexCount = 24;
+		meshes[m].firstIndex = m * 36;
+		meshes[m].vertexOffset = m * 24;
+		meshLODs[m].levels[0] = { meshes[m].firstIndex, meshes[m].indexCount };
+	}
+
+	FrameContext frame;
+	frame.drawDataPC.totalIndexCount = UINT32_MAX;
+	frame.drawDataPC.totalVertexCount = UINT32_MAX;
+
+	bool ok = true;
+	auto expect = [&ok](uint32_t f, const char* what, uint64_t got, uint64_t want) {
+		if (got == want) return;
+		fmt::print("[Counters] frame {}: {} counted {}, the stage reports {}\n", f, what, got, want);
+		ok = false;
+	};
+
+	// Whatever earlier suites counted goes with this frame
+	FrameCounters::endFrame();
+	Visibility::buildBVH(vs);
+	expect(0, "rebuilds", FrameCounters::endFrame()[static_cast<size_t>(FrameCounter::BVHRebuilds)], 1);
+
+	std::mt19937 rng(5u);
+	Visibility::CullScratch scratch;
+	std::vector<GPUInstance> visible;
+	std::vector<AABB> visibleAABBs;
+	std::vector<uint8_t> staging;
+	std::vector<double> samples;
+	FrameCounters::Totals sums{};
+
+	for (uint32_t f = 0; f < frames; ++f) {
+		const Visibility::RowRun run{ static_cast<uint32_t>(rng() % (rows - movingRows)), movingRows };
+		const glm::vec3 offset(std::sin(f * 0.3f), 0.0f, std::cos(f * 0.3f));
+		for (uint32_t row = run.first; row < run.first + run.count; ++row)
+			vs.worldAABBs[row] = Bench::makeAABB(boxes[row].origin + offset, boxes[row].extent);
+
+		Bench::Timer t;
+		Visibility::markRowsDirty(vs, { run });
+		VisibilitySyncResult sync{};
+		sync.refitOnly = true;
+		Visibility::applySyncResult(vs, sync);
+
+		Visibility::CullStats stats{};
+		Visibility::cullBVHCollectParallel(vs, frustums[f % frustums.size()], visible, visibleAABBs, scratch, &stats);
+
+		frame.clearRenderData();
+		frame.visibleInstances = visible;
+		frame.visibleCount = static_cast<uint32_t>(visible.size());
+		DrawPreparation::buildAndSortIndirectDraws(frame, meshes, meshLODs, visibleAABBs, glm::vec4(0.0f));
+
+		staging.resize(frame.visibleInstances.size() * sizeof(GPUInstance) +
+			frame.indirectDraws.size() * sizeof(VkDrawIndexedIndirectCommand) + sizeof(GPUAddressTable) + 3 * alignment);
+		size_t head = 0;
+		const DrawPreparation::RenderDataStaging packed =
+			DrawPreparation::packRenderData(frame, staging.data(), staging.size(), alignment, head);
+
+		const FrameCounters::Totals& totals = FrameCounters::endFrame();
+		samples.push_back(t.ms());
+
+		auto total = [&totals](FrameCounter c) { return totals[static_cast<size_t>(c)]; };
+		expect(f, "nodes", total(FrameCounter::CullNodesVisited), stats.nodesVisited);
+		expect(f, "plane tests", total(FrameCounter::CullPlaneTests), stats.planeTests);
+		expect(f, "leaves tested", total(FrameCounter::CullLeavesTested), stats.leavesTested);
+		expect(f, "leaves accepted", total(FrameCounter::CullLeavesAccepted), stats.leavesAccepted);
+		expect(f, "rows refit", total(FrameCounter::BVHRowsRefit), movingRows);
+		expect(f, "rebuilds", total(FrameCounter::BVHRebuilds), 0);
+		expect(f, "transparent draws", total(FrameCounter::TransparentDraws), frame.transparentRange.visibleCount);
+		expect(f, "opaque batches", total(FrameCounter::OpaqueBatches), frame.indirectDraws.size() - frame.transparentRange.visibleCount);
+		expect(f, "bytes staged", total(FrameCounter::BytesStaged), packed.instanceBytes + packed.drawBytes + sizeof(GPUAddressTable));
+		if (!ok) break;
+
+		for (size_t c = 0; c < FrameCounters::COUNTER_COUNT; ++c) sums[c] += totals[c];
+	}
+
+	const Bench::Timing timing = Bench::summarize(samples);
+	Bench::record("Counters", "uneven", rows, "frame", timing);
+	fmt::print("frame {:.3f} ms median, {:.3f} ms p99, per frame on average:\n", timing.median, timing.p99);
+	for (size_t c = 0; c < FrameCounters::COUNTER_COUNT; ++c)
+		fmt::print("{:>20} {:>12}\n", FrameCounters::name(static_cast<FrameCounter>(c)), sums[c] / frames);
+
+	// Adds from every worker, the per thread lines against one counter they all hit
+	constexpr uint32_t adds = 1u << 22;
+	std::atomic<uint64_t> shared{ 0 };
+	const double sharedMs = Bench::medianMs(5, [&] {
+		JobSystem::parallelFor(adds, 4096, [&](uint32_t begin, uint32_t end, uint32_t) {
+			for (uint32_t i = begin; i < end; ++i) shared.fetch_add(1, std::memory_order_relaxed);
+		});
+	});
+	FrameCounters::endFrame();
+	const double linesMs = Bench::medianMs(5, [&] {
+		JobSystem::parallelFor(adds, 4096, [&](uint32_t begin, uint32_t end, uint32_t) {
+			for (uint32_t i = begin; i < end; ++i) FrameCounters::add(FrameCounter::BVHRebuilds, 1);
+		});
+	});
+	const uint64_t counted = FrameCounters::endFrame()[static_cast<size_t>(FrameCounter::BVHRebuilds)];
+	if (counted != 5ull * adds) {
+		fmt::print("[Counters] {} adds over {} threads summed to {}\n", 5ull * adds, JobSystem::getThreadCount(), counted);
+		ok = false;
+	}
+	fmt::print("{} adds on {} threads: shared atomic {:.3f} ms, thread lines {:.3f} ms\n",
+		adds, JobSystem::getThreadCount(), sharedMs, linesMs);
+
+	return ok;
+}
@@ -0,0 +1,81 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+
+// Every kernel against boxInFrustum on a randomized corpus, then raw throughput.
+BENCH_SUITE(CullKernels) {
+	constexpr uint32_t boxCount = 1'000'000;
+	constexpr uint32_t frustumCount = 32;
+
+	// Mix of scene-like boxes and boxes straddling the frustum planes at every scale
+	std::vector<AABB> boxes = Bench::makeUnevenScene(boxCount / 2, 99u);
+	std::mt19937 rng(2024u);
+	std::uniform_real_distribution<float> pos(-600.0f, 600.0f);
+	std::uniform_real_distribution<float> logSize(-4.0f, 3.0f);
+	while (boxes.size() < boxCount) {
+		const glm::vec3 c(pos(rng), pos(rng) * 0.2f, pos(rng));
+		const glm::vec3 e(std::pow(10.0f, logSize(rng)), std::pow(10.0f, logSize(rng)), std::pow(10.0f, logSize(rng)));
+		boxes.push_back(Bench::makeAABB(c, e));
+	}
+	std::shuffle(boxes.begin(), boxes.end(), rng);
+
+	Visibility::BoundsSoA bounds;
+	bounds.resize(boxCount);
+	for (uint32_t i = 0; i < boxCount; ++i) bounds.set(i, boxes[i]);
+
+	const std::vector<Frustum> frustums = Bench::makeFrustums(frustumCount, 31u);
+
+	std::vector<std::vector<uint32_t>> reference(frustumCount);
+	for (uint32_t f = 0; f < frustumCount; ++f)
+		for (uint32_t i = 0; i < boxCount; ++i)
+			if (Visibility::boxInFrustum(boxes[i], frustums[f])) reference[f].push_back(i);
+
+	bool ok = true;
+	std::vector<uint32_t> out(boxCount);
+
+	for (uint8_t k = 0; k < static_cast<uint8_t>(Visibility::CullKernel::Count); ++k) {
+		const auto kernel = static_cast<Visibility::CullKernel>(k);
+		if (!Visibility::cullKernelSupported(kernel)) {
+			fmt::print("{:>7}: not supported on this CPU\n", Visibility::cullKernelName(kernel));
+			continue;
+		}
+
+		uint32_t mismatches = 0;
+		for (uint32_t f = 0; f < frustumCount; ++f) {
+			const Visibility::CullFrustum cf = Visibility::prepareCullFrustum(frustums[f]);
+
+			// Odd range sizes so the partial register tails get exercised too
+			uint32_t written = 0;
+			for (uint32_t first = 0; first < boxCount; first += 7) {
+				const uint32_t count = std::min(7u, boxCount - first);
+				written += Visibility::cullBounds(bounds, first, count, cf, kernel, out.data() + written);
+			}
+			if (written != reference[f].size() || !std::equal(reference[f].begin(), reference[f].end(), out.begin()))
+				++mismatches;
+		}
+
+		const double ms = Bench::medianMs(5, [&] {
+			for (const Frustum& frus : frustums) {
+				const Visibility::CullFrustum cf = Visibility::prepareCullFrustum(frus);
+				Visibility::cullBounds(bounds, 0, boxCount, cf, kernel, out.data());
+			}
+		});
+		const double boxesPerSec = static_cast<double>(boxCount) * frustumCount / (ms * 1e-3);
+
+		fmt::print("{:>7}: {:>8.1f} Mboxes/s, {} of {} frustums mismatched\n",
+			Visibility::cullKernelName(kernel), boxesPerSec * 1e-6, mismatches, frustumCount);
+		ok = ok && mismatches == 0;
+	}
+
+	// Same thing with the scalar AABB test for scale
+	const double aabbMs = Bench::medianMs(3, [&] {
+		uint32_t n = 0;
+		for (const Frustum& frus : frustums)
+			for (const AABB& b : boxes) n += Visibility::boxInFrustum(b, frus);
+		out[0] = n;
+	});
+	fmt::print("{:>7}: {:>8.1f} Mboxes/s (boxInFrustum over AABB)\n", "AoS",
+		static_cast<double>(boxCount) * frustumCount / (aabbMs * 1e-3) * 1e-6);
+
+	return ok;
+}
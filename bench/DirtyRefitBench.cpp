@@ -0,0 +1,84 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+
+namespace {
+	bool sameBounds(const Visibility::BoundsSoA& a, const Visibility::BoundsSoA& b) {
+		if (a.count != b.count) return false;
+		for (const auto member : { &Visibility::BoundsSoA::minX, &Visibility::BoundsSoA::minY, &Visibility::BoundsSoA::minZ,
+			&Visibility::BoundsSoA::maxX, &Visibility::BoundsSoA::maxY, &Visibility::BoundsSoA::maxZ, &Visibility::BoundsSoA::radius }) {
+			if (memcmp((a.*member).data(), (b.*member).data(), a.count * sizeof(float)) != 0) return false;
+		}
+		return true;
+	}
+}
+
+// 100k static rows with a handful up to half of them moving every frame. Full refit against
+// the walk up from the moved rows: time and nodes touched. After every frame the dirty refit's
+// node boxes and leaf bounds have to be bit for bit what a full refit of the same tree gives.
+BENCH_SUITE(DirtyRefit) {
+	constexpr uint32_t rows = 100'000;
+	constexpr uint32_t frames = 16;
+
+	const std::vector<AABB> boxes = Bench::makeUnevenScene(rows, 41u);
+	bool ok = true;
+
+	fmt::print("{:>8} {:>10} {:>10} {:>11} {:>11}\n", "moving", "full ms", "dirty ms", "full nodes", "dirty nodes");
+
+	for (uint32_t moving : { 50u, 500u, 5'000u, 10'000u, 50'000u }) {
+		Visibility::VisibilityState vs, reference;
+		Bench::fillVisibilityState(vs, boxes);
+		Visibility::buildBVH(vs);
+		reference = vs;
+
+		// Scattered rows, the worst case, every one on its own path up to the root
+		std::mt19937 rng(moving);
+		std::vector<uint32_t> order(rows);
+		std::iota(order.begin(), order.end(), 0u);
+		std::shuffle(order.begin(), order.end(), rng);
+		std::vector<Visibility::RowRun> runs;
+		for (uint32_t i = 0; i < moving; ++i) runs.push_back({ order[i], 1 });
+
+		auto step = [&](Visibility::VisibilityState& state, uint32_t frame) {
+			const glm::vec3 offset(std::sin(frame * 0.3f), 0.0f, std::cos(frame * 0.3f));
+			for (const Visibility::RowRun& run : runs) {
+				const AABB& b = boxes[run.first];
+				state.worldAABBs[run.first] = Bench::makeAABB(b.origin + offset, b.extent);
+			}
+		};
+
+		std::vector<double> fullSamples, dirtySamples;
+		uint32_t dirtyNodes = 0;
+		for (uint32_t f = 0; f < frames; ++f) {
+			step(reference, f);
+			Bench::Timer full;
+			Visibility::refitBVH(reference.worldAABBs, reference.leafIndex, reference.bvh);
+			Visibility::gatherLeafBounds(reference);
+			fullSamples.push_back(full.ms());
+
+			step(vs, f);
+			Bench::Timer dirty;
+			Visibility::markRowsDirty(vs, runs);
+			dirtyNodes = Visibility::refitDirtyBVH(vs);
+			dirtySamples.push_back(dirty.ms());
+
+			const bool sameNodes = std::equal(vs.bvh.begin(), vs.bvh.end(), reference.bvh.begin(), reference.bvh.end(),
+				[](const Visibility::BVHNode& a, const Visibility::BVHNode& b) { return memcmp(&a.box, &b.box, sizeof(AABB)) == 0; });
+			if (!sameNodes || !sameBounds(vs.leafBounds, reference.leafBounds) || !vs.dirtyRows.empty()) {
+				fmt::print("[DirtyRefit] {} moving, frame {}: differs from a full refit\n", moving, f);
+				ok = false;
+				break;
+			}
+		}
+
+		const Bench::Timing fullTiming = Bench::summarize(fullSamples);
+		const Bench::Timing dirtyTiming = Bench::summarize(dirtySamples);
+		Bench::record("DirtyRefit", fmt::format("{} moving", moving), rows, "full_refit", fullTiming);
+		Bench::record("DirtyRefit", fmt::format("{} moving", moving), rows, "dirty_refit", dirtyTiming);
+
+		fmt::print("{:>8} {:>10.3f} {:>10.3f} {:>11} {:>11}\n",
+			moving, fullTiming.median, dirtyTiming.median, vs.bvh.size(), dirtyNodes);
+	}
+
+	return ok;
+}
@@ -0,0 +1,234 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+#include "renderer/scene/DrawPreparation.h"
+
+#include <map>
+#include <new>
+
+// Every heap allocation in the process, so a stage can be checked for none
+static std::atomic<uint64_t> allocationCount{ 0 };
+
+void* operator new(size_t size) {
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+	constexpr uint32_t MESH_COUNT = 512;
+	constexpr uint32_t MATERIAL_COUNT = 64;
+
+	struct OpaqueBatchKey {
+		uint32_t meshID;
+		uint32_t materialID;
+		uint32_t lod;
+
+		bool operator==(const OpaqueBatchKey& other) const {
+			return meshID == other.meshID && materialID == other.materialID && lod == other.lod;
+		}
+	};
+
+	struct OpaqueBatchKeyHash {
+		std::size_t operator()(const OpaqueBatchKey& k) const {
+			std::size_t h1 = std::hash<uint32_t>{}(k.meshID);
+			std::size_t h2 = std::hash<uint32_t>{}(k.materialID ^ (k.lod << 29));
+			return h1 ^ (h2 + 0x9e3779b9 + (h1 << 6) + (h1 >> 2));
+		}
+	};
+
+	// The batching this replaced: a map of row lists per batch, batches in hash order
+	void hashMapBatches(
+		FrameContext& frameCtx,
+		const std::vector<GPUMeshData>& meshes,
+		const std::vector<MeshLODs>& meshLODs,
+		const std::vector<AABB>& worldAABBs,
+		const glm::vec4 cameraPos)
+	{
+		const auto& lods = frameCtx.visibleLODs;
+		std::vector<GPUInstance> opaqueInstances;
+		std::vector<GPUInstance> transparentInstances;
+		std::vector<uint32_t> transparentVisIdx;
+		opaqueInstances.reserve(frameCtx.visibleInstances.size());
+		transparentInstances.reserve(frameCtx.visibleInstances.size());
+		transparentVisIdx.reserve(frameCtx.visibleInstances.size());
+
+		std::unordered_map<OpaqueBatchKey, std::vector<uint32_t>, OpaqueBatchKeyHash> opaqueBatches;
+		for (uint32_t i = 0; i < frameCtx.visibleInstances.size(); ++i) {
+			const auto& inst = frameCtx.visibleInstances[i];
+			if (static_cast<MaterialPass>(inst.passType) == MaterialPass::Opaque) {
+				const OpaqueBatchKey key{ inst.meshID, inst.materialID, lods.empty() ? 0u : lods[i] };
+				opaqueBatches[key].push_back(static_cast<uint32_t>(opaqueInstances.size()));
+				opaqueInstances.push_back(inst);
+			}
+			else {
+				transparentInstances.push_back(inst);
+				transparentVisIdx.push_back(i);
+			}
+		}
+
+		frameCtx.indirectDraws.reserve(opaqueBatches.size() + transparentInstances.size());
+		frameCtx.visibleInstances.clear();
+		frameCtx.visibleInstances.reserve(opaqueInstances.size() + transparentInstances.size());
+
+		frameCtx.opaqueRange.first = 0;
+		for (const auto& [key, instanceIndices] : opaqueBatches) {
+			const GPUMeshData& mesh = meshes[key.meshID];
+			const MeshLODRange& range = meshLODs[key.meshID].levels[key.lod];
+			frameCtx.indirectDraws.push_back({ range.indexCount, static_cast<uint32_t>(instanceIndices.size()),
+				range.firstIndex, static_cast<int32_t>(mesh.vertexOffset), frameCtx.opaqueRange.visibleCount });
+			for (uint32_t idx : instanceIndices) frameCtx.visibleInstances.push_back(opaqueInstances[idx]);
+			frameCtx.opaqueRange.visibleCount += static_cast<uint32_t>(instanceIndices.size());
+		}
+
+		if (!transparentInstances.empty()) {
+			frameCtx.transparentRange.first = frameCtx.opaqueRange.visibleCount;
+			frameCtx.transparentRange.visibleCount = static_cast<uint32_t>(transparentInstances.size());
+
+			std::vector<uint32_t> order(transparentInstances.size());
+			std::iota(order.begin(), order.end(), 0);
+			const glm::vec3 camPos = glm::vec3(cameraPos);
+			std::sort(order.begin(), order.end(), [&](uint32_t ia, uint32_t ib) {
+				const auto& aabbA = worldAABBs[transparentVisIdx[ia]];
+				const auto& aabbB = worldAABBs[transparentVisIdx[ib]];
+				return glm::length(aabbA.origin - camPos) > glm::length(aabbB.origin - camPos);
+			});
+
+			for (uint32_t i = 0; i < order.size(); ++i) {
+				const GPUInstance& inst = transparentInstances[order[i]];
+				const GPUMeshData& mesh = meshes[inst.meshID];
+				const uint32_t lod = lods.empty() ? 0u : lods[transparentVisIdx[order[i]]];
+				const MeshLODRange& range = meshLODs[inst.meshID].levels[lod];
+				frameCtx.indirectDraws.push_back({ range.indexCount, 1, range.firstIndex,
+					static_cast<int32_t>(mesh.vertexOffset), frameCtx.transparentRange.first + i });
+				frameCtx.visibleInstances.push_back(inst);
+			}
+		}
+		frameCtx.visibleLODs.clear();
+	}
+
+	// Each opaque draw's rows by index range and material, batch order left out
+	std::map<std::pair<uint32_t, uint32_t>, std::vector<uint32_t>> opaqueRowsByDraw(const FrameContext& frame) {
+		std::map<std::pair<uint32_t, uint32_t>, std::vector<uint32_t>> out;
+		for (const VkDrawIndexedIndirectCommand& cmd : frame.indirectDraws) {
+			if (cmd.firstInstance >= frame.opaqueRange.visibleCount) break;
+			std::vector<uint32_t>& rows = out[{ cmd.firstIndex, frame.visibleInstances[cmd.firstInstance].materialID }];
+			for (uint32_t i = cmd.firstInstance; i < cmd.firstInstance + cmd.instanceCount; ++i)
+				rows.push_back(frame.visibleInstances[i].transformID);
+		}
+		return out;
+	}
+
+	// Transparent draws back to front by the old distance, and the same draws with the same rows.
+	// The comparator sort put equal distances in any order.
+	bool sameTransparents(const FrameContext& a, const FrameContext& b, const std::vector<AABB>& aabbs, const glm::vec3& camPos) {
+		if (a.transparentRange.visibleCount != b.transparentRange.visibleCount) return false;
+		const uint32_t count = a.transparentRange.visibleCount;
+		std::vector<std::tuple<uint32_t, uint32_t, uint32_t>> drawsA, drawsB;
+		for (uint32_t i = 0; i < count; ++i) {
+			const GPUInstance& instA = a.visibleInstances[a.transparentRange.first + i];
+			const GPUInstance& instB = b.visibleInstances[b.transparentRange.first + i];
+			// Rows are their own transform ids in the bench lists
+			if (glm::length(aabbs[instA.transformID].origin - camPos) != glm::length(aabbs[instB.transformID].origin - camPos))
+				return false;
+			const VkDrawIndexedIndirectCommand& cmdA = a.indirectDraws[a.indirectDraws.size() - count + i];
+			const VkDrawIndexedIndirectCommand& cmdB = b.indirectDraws[b.indirectDraws.size() - count + i];
+			if (cmdA.firstInstance != a.transparentRange.first + i || cmdB.firstInstance != b.transparentRange.first + i)
+				return false;
+			drawsA.emplace_back(instA.transformID, cmdA.firstIndex, cmdA.indexCount);
+			drawsB.emplace_back(instB.transformID, cmdB.firstIndex, cmdB.indexCount);
+		}
+		std::sort(drawsA.begin(), drawsA.end());
+		std::sort(drawsB.begin(), drawsB.end());
+		return drawsA == drawsB;
+	}
+
+	bool sameFrame(const FrameContext& a, const FrameContext& b) {
+		return a.indirectDraws.size() == b.indirectDraws.size() && a.visibleInstances.size() == b.visibleInstances.size() &&
+			memcmp(a.indirectDraws.data(), b.indirectDraws.data(), a.indirectDraws.size() * sizeof(VkDrawIndexedIndirectCommand)) == 0 &&
+			memcmp(a.visibleInstances.data(), b.visibleInstances.data(), a.visibleInstances.size() * sizeof(GPUInstance)) == 0;
+	}
+}
+
+// Visible lists of 10k to 500k rows over 512 meshes with 4 levels and 64 materials. Radix sorted keys against the hash map of row lists: time and allocations per
+// frame once the lists are warm. Both have to give every draw the same rows, the radix build
+// the same bytes every frame.
+BENCH_SUITE(DrawBatching) {
+	std::vector<GPUMeshData> meshes;
+	std::vector<MeshLODs> meshLODs;
+	Bench::makeLODMeshes(MESH_COUNT, meshes, meshLODs);
+
+	bool ok = true;
+	fmt::print("{:>8} {:>8} {:>10} {:>10} {:>8} {:>12} {:>12}\n",
+		"rows", "batches", "hash ms", "radix ms", "speedup", "hash allocs", "radix allocs");
+
+	for (uint32_t rows : { 10'000u, 50'000u, 100'000u, 200'000u, 500'000u }) {
+		const Bench::VisibleRows input = Bench::makeVisibleRows(rows, MESH_COUNT, MATERIAL_COUNT, rows);
+		const std::vector<GPUInstance>& visible = input.instances;
+		const std::vector<uint8_t>& lods = input.lods;
+		const std::vector<AABB>& aabbs = input.aabbs;
+		const glm::vec4 camPos(500.0f, 50.0f, 500.0f, 0.0f);
+
+		const uint32_t reps = rows >= 200'000 ? 9 : 21;
+		FrameContext hashFrame, radixFrame, firstRadix;
+		for (FrameContext* f : { &hashFrame, &radixFrame })
+			f->drawDataPC = { UINT32_MAX, UINT32_MAX, MESH_COUNT, MATERIAL_COUNT };
+
+		auto run = [&](FrameContext& frame, auto&& build, std::vector<double>& samples) {
+			frame.clearRenderData();
+			frame.visibleInstances = visible;
+			frame.visibleLODs = lods;
+			const uint64_t before = allocationCount.load();
+			Bench::Timer t;
+			build(frame, meshes, meshLODs, aabbs, camPos);
+			const double ms = t.ms();
+			const uint64_t allocs = allocationCount.load() - before;
+			samples.push_back(ms);
+			return allocs;
+		};
+
+		std::vector<double> hashSamples, radixSamples;
+		uint64_t hashAllocs = 0, radixAllocs = 0;
+		for (uint32_t r = 0; r < reps; ++r) {
+			// First frame of each grows the lists, the rest are steady
+			const uint64_t h = run(hashFrame, hashMapBatches, hashSamples);
+			const uint64_t x = run(radixFrame, DrawPreparation::buildAndSortIndirectDraws, radixSamples);
+			if (r == 0) {
+				firstRadix.indirectDraws = radixFrame.indirectDraws;
+				firstRadix.visibleInstances = radixFrame.visibleInstances;
+				continue;
+			}
+			hashAllocs += h;
+			radixAllocs += x;
+			if (!sameFrame(radixFrame, firstRadix)) {
+				fmt::print("[DrawBatching] {} rows: frame {} built different draws from the same rows\n", rows, r);
+				ok = false;
+			}
+		}
+
+		if (opaqueRowsByDraw(radixFrame) != opaqueRowsByDraw(hashFrame) ||
+			radixFrame.opaqueRange.visibleCount != hashFrame.opaqueRange.visibleCount ||
+			!sameTransparents(radixFrame, hashFrame, aabbs, glm::vec3(camPos))) {
+			fmt::print("[DrawBatching] {} rows: draws differ from the hash map batching\n", rows);
+			ok = false;
+		}
+		if (radixAllocs) {
+			fmt::print("[DrawBatching] {} rows: {} allocations over {} steady frames\n", rows, radixAllocs, reps - 1);
+			ok = false;
+		}
+
+		hashSamples.erase(hashSamples.begin());
+		radixSamples.erase(radixSamples.begin());
+		const Bench::Timing hash = Bench::summarize(hashSamples);
+		const Bench::Timing radix = Bench::summarize(radixSamples);
+		Bench::record("DrawBatching", "hash map", rows, "batch", hash);
+		Bench::record("DrawBatching", "radix", rows, "batch", radix);
+		fmt::print("{:>8} {:>8} {:>10.3f} {:>10.3f} {:>7.2f}x {:>12.1f} {:>12.1f}\n",
+			rows, radixFrame.indirectDraws.size() - radixFrame.transparentRange.visibleCount, hash.median, radix.median,
+			hash.median / radix.median, static_cast<double>(hashAllocs) / (reps - 1), static_cast<double>(radixAllocs) / (reps - 1));
+	}
+
+	return ok;
+}
@@ -0,0 +1,325 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+#include "renderer/scene/DrawPreparation.h"
+#include "renderer/scene/SceneGraph.h"
+
+namespace {
+	constexpr uint32_t MESH_COUNT = 64;
+	constexpr uint32_t MATERIAL_COUNT = 16;
+	constexpr uint32_t VIEW_COUNT = 8;
+
+	// What the sync path leaves behind for a loaded scene: global instances over a transform
+	// list, the meshes they draw, and one visibility row per primitive of every copy
+	struct SyntheticScene {
+		std::vector<GlobalInstance> globalInstances;
+		std::vector<glm::mat4> transforms;
+		std::vector<GPUMeshData> meshes;
+		std::vector<MeshLODs> meshLODs;
+		Visibility::VisibilityState vs;
+		std::vector<Visibility::RowRun> dynamicRuns; // rows whose transforms move every frame
+		float worldSize = 0.0f;
+	};
+
+	void makeMeshes(SyntheticScene& scene, std::mt19937& rng) {
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		uint32_t firstIndex = 0, vertexOffset = 0;
+
+		for (uint32_t m = 0; m < MESH_COUNT; ++m) {
+			GPUMeshData mesh{};
+			mesh.indexCount = 3 * (64 + static_cast<uint32_t>(unit(rng) * 2000.0f));
+			mesh.vertexCount = mesh.indexCount / 2;
+			mesh.firstIndex = firstIndex;
+			mesh.vertexOffset = vertexOffset;
+			mesh.localAABB = Bench::makeAABB(glm::vec3(0.0f, 0.5f, 0.0f), glm::vec3(0.3f + unit(rng), 0.5f, 0.3f + unit(rng)));
+			firstIndex += mesh.indexCount;
+			vertexOffset += mesh.vertexCount;
+
+			MeshLODs lods{};
+			lods.levels[0] = { mesh.firstIndex, mesh.indexCount };
+			scene.meshes.push_back(mesh);
+			scene.meshLODs.push_back(lods);
+		}
+	}
+
+	// Adds a global instance of copies x stride rows, one transform per copy, one in ten
+	// primitives transparent
+	void addRows(SyntheticScene& scene, const std::vector<glm::mat4>& copies, uint32_t stride, DrawType drawType, std::mt19937& rng) {
+		GlobalInstance gi{};
+		gi.instanceID = static_cast<uint32_t>(scene.globalInstances.size());
+		gi.sceneID = static_cast<uint8_t>(gi.instanceID);
+		gi.drawType = drawType;
+		gi.firstTransform = static_cast<uint32_t>(scene.transforms.size());
+		gi.transformCount = 1;
+		gi.perInstanceStride = stride;
+		gi.usedCopies = gi.capacityCopies = static_cast<uint32_t>(copies.size());
+		scene.globalInstances.push_back(gi);
+
+		Visibility::VisibilityState& vs = scene.vs;
+		const uint32_t firstRow = static_cast<uint32_t>(vs.instances.size());
+		for (uint32_t c = 0; c < copies.size(); ++c) {
+			const uint32_t transformID = static_cast<uint32_t>(scene.transforms.size());
+			scene.transforms.push_back(copies[c]);
+
+			for (uint32_t p = 0; p < stride; ++p) {
+				GPUInstance row{};
+				row.meshID = rng() % MESH_COUNT;
+				row.materialID = rng() % MATERIAL_COUNT;
+				row.transformID = transformID;
+				row.drawType = static_cast<uint32_t>(drawType);
+				row.passType = static_cast<uint32_t>(rng() % 10 == 0 ? MaterialPass::Transparent : MaterialPass::Opaque);
+				vs.instances.push_back(row);
+				vs.transformIDs.push_back(transformID);
+			}
+		}
+
+		const uint32_t rowCount = static_cast<uint32_t>(vs.instances.size()) - firstRow;
+		vs.worldAABBs.resize(vs.instances.size());
+		Visibility::updateWorldAABBs(vs, { { firstRow, rowCount } }, scene.meshes, scene.transforms);
+		for (uint32_t row = firstRow; row < firstRow + rowCount; ++row)
+			Visibility::setRowActive(vs, row, true);
+
+		if (drawType == DrawType::DrawDynamic || drawType == DrawType::DrawMultiDynamic)
+			scene.dynamicRuns.push_back({ firstRow, rowCount });
+	}
+
+	// Square grid of equal copies, every cell filled
+	SyntheticScene makeGrid(uint32_t rows, uint32_t seed) {
+		SyntheticScene scene;
+		std::mt19937 rng(seed);
+		makeMeshes(scene, rng);
+
+		constexpr uint32_t stride = 4;
+		constexpr float spacing = 6.0f;
+		const uint32_t copyCount = std::max(rows / stride, 1u);
+		const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(copyCount))));
+		scene.worldSize = side * spacing;
+
+		std::vector<glm::mat4> copies;
+		for (uint32_t i = 0; i < copyCount; ++i) {
+			const glm::vec3 p((i % side + 0.5f) * spacing - scene.worldSize * 0.5f, 0.0f, (i / side + 0.5f) * spacing - scene.worldSize * 0.5f);
+			copies.push_back(glm::translate(glm::mat4(1.0f), p));
+		}
+		addRows(scene, copies, stride, DrawType::DrawMultiStatic, rng);
+		return scene;
+	}
+
+	// City blocks as scene graph trees: block node, buildings on it, props on the buildings.
+	// Leaf world transforms come from refreshTransform the way loaded models get theirs.
+	SyntheticScene makeCity(uint32_t rows, uint32_t seed) {
+		SyntheticScene scene;
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		makeMeshes(scene, rng);
+
+		constexpr uint32_t stride = 2;
+		constexpr uint32_t propsPerBlock = 64;
+		constexpr float blockSize = 40.0f;
+		const uint32_t copyCount = std::max(rows / stride, 1u);
+		const uint32_t blocks = std::max(copyCount / propsPerBlock, 1u);
+		const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(blocks))));
+		scene.worldSize = side * blockSize;
+
+		std::vector<glm::mat4> copies;
+		copies.reserve(copyCount);
+		for (uint32_t b = 0; b < blocks && copies.size() < copyCount; ++b) {
+			auto block = std::make_shared<SceneGraph::Node>();
+			block->localTransform = glm::translate(glm::mat4(1.0f),
+				glm::vec3((b % side + 0.5f) * blockSize - scene.worldSize * 0.5f, 0.0f, (b / side + 0.5f) * blockSize - scene.worldSize * 0.5f));
+
+			std::vector<std::shared_ptr<SceneGraph::Node>> leaves;
+			for (uint32_t k = 0; k < 4; ++k) {
+				auto building = std::make_shared<SceneGraph::Node>();
+				building->parent = block;
+				building->localTransform = glm::translate(glm::mat4(1.0f), glm::vec3((k & 1) ? 10.0f : -10.0f, 0.0f, (k & 2) ? 10.0f : -10.0f))
+					* glm::scale(glm::mat4(1.0f), glm::vec3(4.0f, 10.0f + unit(rng) * 30.0f, 4.0f));
+				block->children.push_back(building);
+
+				for (uint32_t p = 0; p < propsPerBlock / 4; ++p) {
+					auto prop = std::make_shared<SceneGraph::Node>();
+					prop->parent = building;
+					prop->localTransform = glm::translate(glm::mat4(1.0f), glm::vec3(unit(rng) - 0.5f, unit(rng), unit(rng) - 0.5f) * 2.0f)
+						* glm::scale(glm::mat4(1.0f), glm::vec3(0.05f));
+					building->children.push_back(prop);
+					leaves.push_back(prop);
+				}
+			}
+
+			block->refreshTransform(glm::mat4(1.0f));
+			for (const auto& leaf : leaves) {
+				if (copies.size() == copyCount) break;
+				copies.push_back(leaf->worldTransform);
+			}
+		}
+		addRows(scene, copies, stride, DrawType::DrawMultiStatic, rng);
+		return scene;
+	}
+
+	// Rows scattered at random, spinning every frame
+	SyntheticScene makeDynamic(uint32_t rows, uint32_t seed) {
+		SyntheticScene scene;
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		makeMeshes(scene, rng);
+
+		constexpr uint32_t stride = 1;
+		scene.worldSize = std::sqrt(static_cast<float>(rows)) * 4.0f;
+
+		std::vector<glm::mat4> copies(rows);
+		for (glm::mat4& m : copies) {
+			const glm::vec3 p = (glm::vec3(unit(rng), unit(rng) * 0.05f, unit(rng)) - glm::vec3(0.5f, 0.0f, 0.5f)) * scene.worldSize;
+			m = glm::translate(glm::mat4(1.0f), p) * glm::rotate(glm::mat4(1.0f), unit(rng) * glm::two_pi<float>(), glm::vec3(0.0f, 1.0f, 0.0f));
+		}
+		addRows(scene, copies, stride, DrawType::DrawMultiDynamic, rng);
+		return scene;
+	}
+
+	uint32_t sampleCount(uint32_t rows, uint32_t small, uint32_t large) {
+		return rows >= 1'000'000 ? large : small;
+	}
+
+	// Instances grouped by draw, each opaque draw one mesh, the lists as long as the cull result
+	bool checkDraws(const FrameContext& frame, const SyntheticScene& scene, size_t visible) {
+		if (frame.visibleInstances.size() != visible) return false;
+
+		uint32_t covered = 0;
+		for (const VkDrawIndexedIndirectCommand& cmd : frame.indirectDraws) {
+			if (cmd.firstInstance != covered) return false;
+			for (uint32_t i = cmd.firstInstance; i < cmd.firstInstance + cmd.instanceCount; ++i)
+				if (scene.meshes[frame.visibleInstances[i].meshID].firstIndex != cmd.firstIndex) return false;
+			covered += cmd.instanceCount;
+		}
+		return covered == visible && frame.opaqueRange.visibleCount + frame.transparentRange.visibleCount == visible;
+	}
+}
+
+// CPU side of a frame over synthetic scenes from 1k to 1M rows, no device: BVH build, world
+// bound refresh and refit, cull, batch and sort, staging pack. Median and p99 per stage go in
+// the --json report. Draws have to cover every culled row and the packed bytes match the frame.
+BENCH_SUITE(FramePipeline) {
+	struct SceneKind { const char* name; SyntheticScene(*make)(uint32_t, uint32_t); };
+	const SceneKind kinds[] = { { "grid", makeGrid }, { "city", makeCity }, { "dynamic", makeDynamic } };
+
+	bool ok = true;
+	FrameContext frame;
+	frame.drawDataPC.totalIndexCount = UINT32_MAX;
+	frame.drawDataPC.totalVertexCount = UINT32_MAX;
+
+	fmt::print("{:>8} {:>8} {:>8} {:>13} {:>13} {:>13} {:>13} {:>13} {:>13}\n",
+		"scene", "rows", "visible", "build", "aabb update", "refit", "cull", "batch", "pack");
+
+	for (const SceneKind& kind : kinds) {
+		for (uint32_t rows : { 1'000u, 10'000u, 100'000u, 1'000'000u }) {
+			SyntheticScene scene = kind.make(rows, 31u + rows);
+			Visibility::VisibilityState& vs = scene.vs;
+			const uint32_t rowCount = static_cast<uint32_t>(vs.instances.size());
+
+			std::vector<double> samples;
+			auto time = [&](auto&& fn) {
+				Bench::Timer t;
+				fn();
+				samples.push_back(t.ms());
+			};
+			auto finish = [&](const char* stage) {
+				const Bench::Timing timing = Bench::summarize(samples);
+				Bench::record("FramePipeline", kind.name, rowCount, stage, timing);
+				samples.clear();
+				return timing;
+			};
+
+			// Engine defaults, see CullingToggles
+			vs.buildMode = BVHBuildMode::BinnedSAH;
+			vs.layout = BVHLayout::Binary;
+
+			for (uint32_t i = 0; i < sampleCount(rows, 9, 3); ++i) time([&] { Visibility::buildBVH(vs); });
+			const Bench::Timing build = finish("bvh_build");
+
+			// Spin like DrawPreparation's dynamic instances, then refresh bounds for the moved rows.
+			// Refit walks up from the rows the update marked, static scenes have nothing to refit.
+			const glm::mat4 spin = glm::rotate(glm::mat4(1.0f), 0.005f, glm::vec3(0.0f, 1.0f, 0.0f));
+			Bench::Timing aabbs{};
+			if (!scene.dynamicRuns.empty()) {
+				for (uint32_t i = 0; i < sampleCount(rows, 33, 9); ++i) {
+					for (const Visibility::RowRun& run : scene.dynamicRuns)
+						for (uint32_t row = run.first; row < run.first + run.count; ++row)
+							scene.transforms[vs.transformIDs[row]] = scene.transforms[vs.transformIDs[row]] * spin;
+					time([&] { Visibility::updateWorldAABBs(vs, scene.dynamicRuns, scene.meshes, scene.transforms); });
+				}
+				aabbs = finish("aabb_update");
+			}
+
+			VisibilitySyncResult refit{};
+			refit.refitOnly = true;
+			for (uint32_t i = 0; i < sampleCount(rows, 33, 9); ++i) {
+				Visibility::markRowsDirty(vs, scene.dynamicRuns);
+				time([&] { Visibility::applySyncResult(vs, refit); });
+			}
+			const Bench::Timing refitTiming = finish("refit");
+
+			// Cameras spread over the scene, every sample the next one
+			const std::vector<glm::mat4> viewProjs = Bench::makeViewProjs(VIEW_COUNT, 7u, scene.worldSize);
+			std::vector<Frustum> frustums;
+			for (const glm::mat4& vp : viewProjs) frustums.push_back(Visibility::extractFrustum(vp));
+
+			Visibility::CullScratch scratch;
+			std::vector<std::vector<GPUInstance>> culled(VIEW_COUNT);
+			std::vector<std::vector<AABB>> culledAABBs(VIEW_COUNT);
+			const uint32_t cullSamples = sampleCount(rows, 4 * VIEW_COUNT, VIEW_COUNT);
+			for (uint32_t i = 0; i < cullSamples; ++i) {
+				const uint32_t v = i % VIEW_COUNT;
+				time([&] { Visibility::cullBVHCollectParallel(vs, frustums[v], culled[v], culledAABBs[v], scratch); });
+			}
+			const Bench::Timing cull = finish("cull");
+
+			// Camera position back out of the inverse view projection
+			std::vector<glm::vec4> camPositions;
+			for (const glm::mat4& vp : viewProjs) {
+				const glm::vec4 eye = glm::inverse(vp) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+				camPositions.push_back(glm::vec4(glm::vec3(eye) / eye.w, 0.0f));
+			}
+
+			uint64_t visibleTotal = 0;
+			std::vector<double> packSamples;
+			std::vector<uint8_t> staging;
+			for (uint32_t i = 0; i < cullSamples; ++i) {
+				const uint32_t v = i % VIEW_COUNT;
+				frame.clearRenderData();
+				frame.visibleInstances = culled[v];
+				frame.visibleCount = static_cast<uint32_t>(culled[v].size());
+				time([&] { DrawPreparation::buildAndSortIndirectDraws(frame, scene.meshes, scene.meshLODs, culledAABBs[v], camPositions[v]); });
+				visibleTotal += culled[v].size();
+
+				if (!checkDraws(frame, scene, culled[v].size())) {
+					fmt::print("[FramePipeline] {} {} rows, view {}: draws don't cover the cull result\n", kind.name, rowCount, v);
+					ok = false;
+				}
+
+				staging.resize(frame.visibleInstances.size() * sizeof(GPUInstance) +
+					frame.indirectDraws.size() * sizeof(VkDrawIndexedIndirectCommand) + sizeof(GPUAddressTable) + 3 * 256);
+				size_t head = 0;
+				DrawPreparation::RenderDataStaging packed{};
+				Bench::Timer t;
+				packed = DrawPreparation::packRenderData(frame, staging.data(), staging.size(), 256, head);
+				packSamples.push_back(t.ms());
+
+				if (memcmp(staging.data() + packed.instanceOffset, frame.visibleInstances.data(), packed.instanceBytes) != 0 ||
+					memcmp(staging.data() + packed.drawOffset, frame.indirectDraws.data(), packed.drawBytes) != 0 ||
+					packed.instanceOffset % 256 || packed.drawOffset % 256 || packed.addressOffset % 256) {
+					fmt::print("[FramePipeline] {} {} rows, view {}: staging doesn't hold the frame's data\n", kind.name, rowCount, v);
+					ok = false;
+				}
+			}
+			const Bench::Timing batch = finish("batch_sort");
+			samples = std::move(packSamples);
+			const Bench::Timing pack = finish("staging_pack");
+
+			auto cell = [](const Bench::Timing& t) { return t.samples ? fmt::format("{:.3f}/{:.3f}", t.median, t.p99) : std::string("-"); };
+			fmt::print("{:>8} {:>8} {:>8} {:>13} {:>13} {:>13} {:>13} {:>13} {:>13}\n",
+				kind.name, rowCount, visibleTotal / cullSamples,
+				cell(build), cell(aabbs), cell(refitTiming), cell(cull), cell(batch), cell(pack));
+		}
+	}
+	fmt::print("times are median/p99 ms\n");
+
+	return ok;
+}
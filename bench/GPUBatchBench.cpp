@@ -0,0 +1,213 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+#include "renderer/scene/CullBatches.h"
+#include "renderer/scene/DrawPreparation.h"
+
+namespace {
+	constexpr uint32_t SCAN_LANES = 64; // batch_scan_comp local_size_x
+
+	struct EmulatedBatching {
+		std::vector<uint32_t> counts;
+		std::vector<GPUInstance> instances;
+		std::vector<VkDrawIndexedIndirectCommand> draws;
+		uint32_t drawCount[2] = {};
+		uint32_t visibleRows = 0;
+	};
+
+	// batch_count_comp, batch_scan_comp and batch_scatter_comp. The scan runs lane by lane in
+	// chunks of 64 like the workgroup does, the scatter takes rows in a shuffled order since the
+	// atomics give no order on the device. Instances land past the transparents' slots.
+	void emulateGPUBatching(
+		const Visibility::CullBatchTable& table,
+		const std::vector<uint32_t>& entries,
+		std::mt19937& rng,
+		EmulatedBatching& out)
+	{
+		const uint32_t batchCount = static_cast<uint32_t>(table.batches.size());
+		out.counts.assign(batchCount, 0);
+		const uint32_t instanceFirst = batchCount ? table.batches[0].firstInstance : 0u;
+		out.instances.assign(instanceFirst + entries.size(), GPUInstance{});
+		out.draws.assign(table.transparentRows.size() + batchCount, VkDrawIndexedIndirectCommand{});
+
+		for (uint32_t entry : entries) ++out.counts[table.rows[entry].batchID];
+
+		uint32_t instanceBase = instanceFirst;
+		uint32_t drawBase[2] = {};
+		for (uint32_t first = 0; first < batchCount; first += SCAN_LANES) {
+			uint32_t count[SCAN_LANES] = {}, instanceSums[SCAN_LANES] = {}, drawSums[SCAN_LANES][2] = {};
+			for (uint32_t lane = 0; lane < SCAN_LANES; ++lane) {
+				const uint32_t index = first + lane;
+				if (index < batchCount) count[lane] = out.counts[index];
+				const uint32_t pass = index < batchCount ? table.batches[index].pass : 0u;
+				instanceSums[lane] = count[lane] + (lane ? instanceSums[lane - 1] : 0u);
+				for (uint32_t p = 0; p < 2; ++p)
+					drawSums[lane][p] = (count[lane] && pass == p ? 1u : 0u) + (lane ? drawSums[lane - 1][p] : 0u);
+			}
+
+			for (uint32_t lane = 0; lane < SCAN_LANES && first + lane < batchCount; ++lane) {
+				const uint32_t index = first + lane;
+				const Visibility::CullBatch& batch = table.batches[index];
+				const uint32_t instanceOffset = instanceBase + instanceSums[lane] - count[lane];
+				if (count[lane])
+					out.draws[batch.drawFirst + drawBase[batch.pass] + drawSums[lane][batch.pass] - 1] = {
+						batch.indexCount, count[lane], batch.firstIndex, batch.vertexOffset, instanceOffset };
+				out.counts[index] = instanceOffset;
+			}
+			instanceBase += instanceSums[SCAN_LANES - 1];
+			drawBase[0] += drawSums[SCAN_LANES - 1][0];
+			drawBase[1] += drawSums[SCAN_LANES - 1][1];
+		}
+		out.drawCount[0] = drawBase[0];
+		out.drawCount[1] = drawBase[1];
+		out.visibleRows = instanceBase - instanceFirst;
+
+		std::vector<uint32_t> order(entries.size());
+		std::iota(order.begin(), order.end(), 0u);
+		std::shuffle(order.begin(), order.end(), rng);
+		for (uint32_t i : order) {
+			const Visibility::CullRow& row = table.rows[entries[i]];
+			out.instances[out.counts[row.batchID]++] = row.instance;
+		}
+	}
+
+	// Transform ids of each draw's rows, sorted since neither side orders rows the same way
+	std::vector<uint32_t> drawRows(const std::vector<GPUInstance>& instances, const VkDrawIndexedIndirectCommand& cmd) {
+		std::vector<uint32_t> ids;
+		for (uint32_t i = cmd.firstInstance; i < cmd.firstInstance + cmd.instanceCount; ++i) ids.push_back(instances[i].transformID);
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	}
+}
+
+// CPU frustum cull of 10k and 100k rows through 16 views, then the visible rows batched twice:
+// by the CPU build, and by the batch shaders emulated here. Opaque draws have to match the
+// CPU's command for command with the same rows in each, shifted past the transparents' slots.
+// The transparents stay on the CPU and have to come out in the CPU path's back to front order.
+// Timed is what stays on the CPU per frame, and the bytes it uploads.
+BENCH_SUITE(GPUBatch) {
+	constexpr uint32_t meshCount = 64;
+
+	std::vector<GPUMeshData> meshes(meshCount);
+	std::vector<MeshLODs> meshLODs(meshCount);
+	for (uint32_t m = 0; m < meshCount; ++m) {
+		meshes[m].firstIndex = m * 300;
+		meshes[m].indexCount = 300;
+		meshes[m].vertexOffset = m * 100;
+		meshes[m].vertexCount = 100;
+		meshLODs[m].levels[0] = { meshes[m].firstIndex, meshes[m].indexCount };
+	}
+
+	FrameContext frame, gpuFrame;
+	for (FrameContext* ctx : { &frame, &gpuFrame }) {
+		ctx->drawDataPC.totalIndexCount = meshCount * 300;
+		ctx->drawDataPC.totalVertexCount = meshCount * 100;
+	}
+
+	const std::vector<Frustum> frustums = Bench::makeFrustums(16, 19u);
+	const glm::vec4 camPos(500.0f, 50.0f, 500.0f, 0.0f);
+	std::mt19937 rng(5u);
+	bool ok = true;
+
+	fmt::print("{:>8} {:>9} {:>9} {:>12} {:>12} {:>12} {:>12}\n",
+		"rows", "visible", "draws", "cpu batch", "gpu upload", "cpu bytes", "gpu bytes");
+
+	for (uint32_t rows : { 10'000u, 100'000u }) {
+		Visibility::VisibilityState vs;
+		Bench::fillVisibilityState(vs, Bench::makeUnevenScene(rows, 47u));
+		for (uint32_t i = 0; i < rows; i += 8) vs.instances[i].passType = static_cast<uint32_t>(MaterialPass::Transparent);
+		Visibility::buildBVH(vs);
+
+		Visibility::CullBatchTable table;
+		Visibility::buildCullBatches(vs, meshes, table);
+
+		std::vector<uint32_t> visibleRows, entries;
+		std::vector<AABB> aabbs, gpuAABBs;
+		EmulatedBatching gpu;
+		std::vector<double> cpuSamples, uploadSamples;
+		uint64_t visibleTotal = 0, drawTotal = 0, cpuBytes = 0, gpuBytes = 0;
+
+		for (size_t f = 0; f < frustums.size(); ++f) {
+			Visibility::cullBVHCollectRows(vs, frustums[f], visibleRows);
+
+			std::vector<GPUInstance> rowInstances;
+			for (uint32_t row : visibleRows) rowInstances.push_back(vs.instances[row]);
+			if (Bench::sortedTransformIDs(rowInstances) != Bench::referenceCull(vs, frustums[f])) {
+				fmt::print("[GPUBatch] {} rows, frustum {}: row cull differs from the reference cull\n", rows, f);
+				ok = false;
+			}
+
+			// CPU path, instances gathered and batched
+			Bench::Timer t;
+			frame.clearRenderData();
+			aabbs.clear();
+			for (uint32_t row : visibleRows) {
+				frame.visibleInstances.push_back(vs.instances[row]);
+				aabbs.push_back(vs.worldAABBs[row]);
+			}
+			DrawPreparation::buildAndSortIndirectDraws(frame, meshes, meshLODs, aabbs, camPos);
+			cpuSamples.push_back(t.ms());
+
+			// GPU path, opaque table entries written where the mapped buffer would be, the
+			// transparents gathered and sorted as RenderScene does
+			t = Bench::Timer();
+			entries.clear();
+			gpuFrame.clearRenderData();
+			gpuAABBs.clear();
+			for (uint32_t row : visibleRows) {
+				if (table.rowEntry[row] != Visibility::ROW_INACTIVE) {
+					entries.push_back(table.rowEntry[row]);
+					continue;
+				}
+				gpuFrame.visibleInstances.push_back(vs.instances[row]);
+				gpuAABBs.push_back(vs.worldAABBs[row]);
+			}
+			DrawPreparation::buildAndSortIndirectDraws(gpuFrame, meshes, meshLODs, gpuAABBs, camPos);
+			uploadSamples.push_back(t.ms());
+
+			emulateGPUBatching(table, entries, rng, gpu);
+
+			const uint32_t opaqueDraws = static_cast<uint32_t>(frame.indirectDraws.size()) - frame.transparentRange.visibleCount;
+			const uint32_t reserved = static_cast<uint32_t>(table.transparentRows.size());
+			bool same = gpu.drawCount[0] == opaqueDraws && gpu.drawCount[1] == 0 && gpu.visibleRows == frame.opaqueRange.visibleCount;
+			for (uint32_t d = 0; same && d < opaqueDraws; ++d) {
+				const VkDrawIndexedIndirectCommand& a = frame.indirectDraws[d];
+				const VkDrawIndexedIndirectCommand& b = gpu.draws[reserved + d];
+				same = a.indexCount == b.indexCount && a.instanceCount == b.instanceCount && a.firstIndex == b.firstIndex &&
+					a.vertexOffset == b.vertexOffset && a.firstInstance + reserved == b.firstInstance &&
+					drawRows(frame.visibleInstances, a) == drawRows(gpu.instances, b);
+			}
+
+			// Same rows in the same order, and within the slots the opaque ranges leave them
+			bool sorted = gpuFrame.visibleInstances.size() <= reserved &&
+				gpuFrame.transparentRange.visibleCount == frame.transparentRange.visibleCount;
+			for (uint32_t i = 0; sorted && i < frame.transparentRange.visibleCount; ++i) {
+				const GPUInstance& a = frame.visibleInstances[frame.indirectDraws[opaqueDraws + i].firstInstance];
+				const GPUInstance& b = gpuFrame.visibleInstances[gpuFrame.indirectDraws[i].firstInstance];
+				sorted = a.transformID == b.transformID;
+			}
+
+			if (!same || !sorted) {
+				fmt::print("[GPUBatch] {} rows, frustum {}: GPU batching differs from the CPU batching ({} + {} draws, CPU {} + {})\n",
+					rows, f, gpu.drawCount[0], gpuFrame.transparentRange.visibleCount, opaqueDraws, frame.transparentRange.visibleCount);
+				ok = false;
+			}
+
+			visibleTotal += visibleRows.size();
+			drawTotal += gpu.drawCount[0] + gpuFrame.indirectDraws.size();
+			cpuBytes += frame.visibleInstances.size() * sizeof(GPUInstance) + frame.indirectDraws.size() * sizeof(VkDrawIndexedIndirectCommand);
+			gpuBytes += entries.size() * sizeof(uint32_t) +
+				gpuFrame.visibleInstances.size() * sizeof(GPUInstance) + gpuFrame.indirectDraws.size() * sizeof(VkDrawIndexedIndirectCommand);
+		}
+
+		const Bench::Timing cpu = Bench::summarize(cpuSamples);
+		const Bench::Timing upload = Bench::summarize(uploadSamples);
+		Bench::record("GPUBatch", "cpu batch", rows, "frame", cpu);
+		Bench::record("GPUBatch", "gpu upload", rows, "frame", upload);
+		const size_t views = frustums.size();
+		fmt::print("{:>8} {:>9} {:>9} {:>9.3f} ms {:>9.3f} ms {:>12} {:>12}\n", rows, visibleTotal / views, drawTotal / views,
+			cpu.median, upload.median, cpuBytes / views, gpuBytes / views);
+	}
+
+	return ok;
+}
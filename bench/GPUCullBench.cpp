@@ -0,0 +1,199 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+#include "renderer/scene/CullBatches.h"
+#include "renderer/scene/DrawPreparation.h"
+
+namespace {
+	struct EmulatedDraw {
+		uint32_t batch;
+		uint32_t instanceCount;
+	};
+
+	// frustum_cull_comp then cull_compact_comp, one row or batch at a time in place of a thread
+	void emulateGPUCull(
+		const Visibility::VisibilityState& vs,
+		const Visibility::CullBatchTable& table,
+		const Frustum& frus,
+		std::vector<uint32_t>& counts,
+		std::vector<GPUInstance>& instances,
+		std::vector<EmulatedDraw>& draws,
+		uint32_t drawCount[2])
+	{
+		counts.assign(table.batches.size(), 0);
+		instances.assign(table.instanceSlots(), GPUInstance{});
+		draws.assign(table.transparentRows.size() + table.batches.size(), EmulatedDraw{ UINT32_MAX, 0 });
+		drawCount[0] = drawCount[1] = 0;
+
+		for (size_t i = 0; i < table.rows.size(); ++i) {
+			if (!Visibility::boxInFrustum(vs.worldAABBs[table.sourceRows[i]], frus)) continue;
+			const Visibility::CullRow& row = table.rows[i];
+			const uint32_t slot = counts[row.batchID]++;
+			instances[table.batches[row.batchID].firstInstance + slot] = row.instance;
+		}
+
+		for (uint32_t b = 0; b < table.batches.size(); ++b) {
+			if (counts[b] == 0) continue;
+			const Visibility::CullBatch& batch = table.batches[b];
+			draws[batch.drawFirst + drawCount[batch.pass]++] = { b, counts[b] };
+		}
+	}
+}
+
+// CPU time the GPU frustum cull takes off the frame: cull plus draw build on the CPU path, the
+// push constant fill and the transparents' cull and sort on the GPU path, batch table build on
+// row set changes. The emulated shaders and the CPU's transparents have to land exactly the
+// reference cull's rows, each inside its own batch range or the transparents' slots, the
+// transparents back to front, and as many opaque draws as the CPU batching of the same frame.
+BENCH_SUITE(GPUCull) {
+	constexpr uint32_t meshCount = 64;
+
+	std::vector<GPUMeshData> meshes(meshCount);
+	for (uint32_t m = 0; m < meshCount; ++m) {
+		meshes[m].firstIndex = m * 300;
+		meshes[m].indexCount = 300;
+		meshes[m].vertexOffset = m * 100;
+		meshes[m].vertexCount = 100;
+	}
+
+	std::vector<MeshLODs> meshLODs(meshCount);
+	for (uint32_t m = 0; m < meshCount; ++m)
+		meshLODs[m].levels[0] = { meshes[m].firstIndex, meshes[m].indexCount };
+
+	FrameContext frame;
+	frame.drawDataPC.totalIndexCount = meshCount * 300;
+	frame.drawDataPC.totalVertexCount = meshCount * 100;
+
+	const std::vector<Frustum> frustums = Bench::makeFrustums(16, 11u);
+	const std::vector<glm::mat4> viewProjs = Bench::makeViewProjs(16, 11u);
+
+	bool ok = true;
+	fmt::print("{:>8} {:>9} {:>11} {:>11} {:>11} {:>11} {:>11} {:>9}\n",
+		"rows", "visible", "cpu cull", "cpu batch", "gpu path", "saved", "table build", "batches");
+
+	for (uint32_t rows : { 10'000u, 100'000u }) {
+		Visibility::VisibilityState vs;
+		Bench::fillVisibilityState(vs, Bench::makeUnevenScene(rows, 41u));
+		for (uint32_t i = 0; i < rows; i += 8) vs.instances[i].passType = static_cast<uint32_t>(MaterialPass::Transparent);
+		Visibility::buildBVH(vs);
+
+		Visibility::CullBatchTable table;
+		const double tableMs = Bench::medianMs(5, [&] { Visibility::buildCullBatches(vs, meshes, table); });
+
+		std::vector<GPUInstance> visible;
+		std::vector<AABB> aabbs;
+		uint64_t visibleTotal = 0;
+
+		const double cullMs = Bench::medianMs(5, [&] {
+			for (const Frustum& frus : frustums)
+				Visibility::cullBVHCollect(vs, frus, visible, aabbs);
+		}) / frustums.size();
+
+		const double batchMs = Bench::medianMs(5, [&] {
+			for (size_t f = 0; f < frustums.size(); ++f) {
+				Visibility::cullBVHCollect(vs, frustums[f], visible, aabbs);
+				frame.clearRenderData();
+				frame.visibleInstances.swap(visible);
+				DrawPreparation::buildAndSortIndirectDraws(frame, meshes, meshLODs, aabbs, glm::inverse(viewProjs[f])[3]);
+				visible.swap(frame.visibleInstances);
+			}
+		}) / frustums.size() - cullMs;
+
+		// Everything the CPU still does per frame with the GPU cull on, the transparents' cull and
+		// back to front draw build included
+		CullingPushConstantsAddrs pc{};
+		const double gpuPathMs = Bench::medianMs(5, [&] {
+			for (size_t f = 0; f < frustums.size(); ++f) {
+				const Frustum& frus = frustums[f];
+				std::copy(std::begin(frus.planes), std::end(frus.planes), std::begin(pc.frusPlanes));
+				std::copy(std::begin(frus.points), std::end(frus.points), std::begin(pc.frusPoints));
+				pc.rowCount = static_cast<uint32_t>(table.rows.size());
+				pc.batchCount = static_cast<uint32_t>(table.batches.size());
+
+				frame.clearRenderData();
+				aabbs.clear();
+				Visibility::cullTransparentRows(vs, table, frus, frame.visibleInstances, aabbs);
+				DrawPreparation::buildAndSortIndirectDraws(frame, meshes, meshLODs, aabbs, glm::inverse(viewProjs[f])[3]);
+			}
+		}) / frustums.size();
+
+		std::vector<uint32_t> counts;
+		std::vector<GPUInstance> gpuInstances;
+		std::vector<EmulatedDraw> draws;
+		uint32_t drawCount[2];
+
+		for (size_t f = 0; f < frustums.size(); ++f) {
+			emulateGPUCull(vs, table, frustums[f], counts, gpuInstances, draws, drawCount);
+
+			// Instances only reachable through a draw count, same as on the device
+			std::vector<GPUInstance> drawn;
+			const uint32_t reserved = static_cast<uint32_t>(table.transparentRows.size());
+			if (drawCount[1] != 0) {
+				fmt::print("[GPUCull] {} rows, frustum {}: {} transparent draws left the GPU cull\n", rows, f, drawCount[1]);
+				ok = false;
+			}
+			for (uint32_t d = 0; d < drawCount[0]; ++d) {
+				const EmulatedDraw& draw = draws[reserved + d];
+				const Visibility::CullBatch& batch = table.batches[draw.batch];
+				if (static_cast<MaterialPass>(batch.pass) != MaterialPass::Opaque || batch.firstInstance < reserved) {
+					fmt::print("[GPUCull] {} rows, frustum {}: batch {} not an opaque batch past the transparents\n", rows, f, draw.batch);
+					ok = false;
+				}
+				drawn.insert(drawn.end(),
+					gpuInstances.begin() + batch.firstInstance,
+					gpuInstances.begin() + batch.firstInstance + draw.instanceCount);
+			}
+
+			// Transparents through the CPU cull and draw build, into the slots the table left them
+			const glm::vec4 camPos = glm::inverse(viewProjs[f])[3];
+			frame.clearRenderData();
+			aabbs.clear();
+			Visibility::cullTransparentRows(vs, table, frustums[f], frame.visibleInstances, aabbs);
+			DrawPreparation::buildAndSortIndirectDraws(frame, meshes, meshLODs, aabbs, camPos);
+			if (frame.visibleInstances.size() > reserved || frame.opaqueRange.visibleCount != 0) {
+				fmt::print("[GPUCull] {} rows, frustum {}: {} CPU transparents overrun their {} slots\n",
+					rows, f, frame.visibleInstances.size(), reserved);
+				ok = false;
+			}
+			float lastDepth = std::numeric_limits<float>::max();
+			for (const VkDrawIndexedIndirectCommand& cmd : frame.indirectDraws) {
+				const GPUInstance& inst = frame.visibleInstances[cmd.firstInstance];
+				const glm::vec3 toRow = vs.worldAABBs[inst.transformID].origin - glm::vec3(camPos);
+				const float depth = glm::dot(toRow, toRow);
+				if (depth > lastDepth) {
+					fmt::print("[GPUCull] {} rows, frustum {}: transparents not drawn back to front\n", rows, f);
+					ok = false;
+					break;
+				}
+				lastDepth = depth;
+			}
+			drawn.insert(drawn.end(), frame.visibleInstances.begin(), frame.visibleInstances.end());
+
+			const std::vector<uint32_t> reference = Bench::referenceCull(vs, frustums[f]);
+			if (Bench::sortedTransformIDs(drawn) != reference) {
+				fmt::print("[GPUCull] {} rows, frustum {}: {} rows drawn, reference cull has {}\n",
+					rows, f, drawn.size(), reference.size());
+				ok = false;
+			}
+			visibleTotal += reference.size();
+
+			// The GPU's opaque draws against the CPU batching of the same frame
+			frame.clearRenderData();
+			Visibility::cullBVHCollect(vs, frustums[f], frame.visibleInstances, aabbs);
+			frame.opaqueOrder = OpaqueOrder::Batched;
+			DrawPreparation::buildAndSortIndirectDraws(frame, meshes, meshLODs, aabbs, camPos);
+			const uint32_t cpuOpaqueDraws = static_cast<uint32_t>(frame.indirectDraws.size()) - frame.transparentRange.visibleCount;
+			if (drawCount[0] != cpuOpaqueDraws) {
+				fmt::print("[GPUCull] {} rows, frustum {}: {} opaque draws, CPU batching has {}\n",
+					rows, f, drawCount[0], cpuOpaqueDraws);
+				ok = false;
+			}
+		}
+
+		fmt::print("{:>8} {:>9} {:>8.3f} ms {:>8.3f} ms {:>8.4f} ms {:>8.3f} ms {:>8.3f} ms {:>9}\n",
+			rows, visibleTotal / frustums.size(), cullMs, batchMs, gpuPathMs,
+			cullMs + batchMs - gpuPathMs, tableMs, table.batches.size());
+	}
+
+	return ok;
+}
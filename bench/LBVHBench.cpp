@@ -0,0 +1,197 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+
+// Every row drifting on its own heading for 120 frames, the DrawMultiDynamic case. A tree built
+// once and refit every frame against an LBVH rebuilt every frame, and against an LBVH going
+// through applySyncResult, refit and rebuilt once its SAH cost drifted: per frame cost, and what
+// the cull walks at the end once the refit tree's nodes have spread out. All have to cull exactly.
+// --threads sets how many workers the radix sort and subtree builds get.
+BENCH_SUITE(LBVH) {
+	constexpr uint32_t frames = 120;
+	const std::vector<Frustum> frustums = Bench::makeFrustums(32, 19u);
+	bool ok = true;
+
+	fmt::print("{:>9} {:>12} {:>13} {:>13} {:>13} {:>12} {:>12}\n",
+		"rows", "tree", "build ms", "per frame ms", "p99 ms", "visits/cull", "cull ms");
+
+	for (uint32_t rows : { 100'000u, 1'000'000u }) {
+		const std::vector<AABB> start = Bench::makeUnevenScene(rows, 91u);
+
+		std::mt19937 rng(rows);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		std::vector<glm::vec3> velocity(rows);
+		for (glm::vec3& v : velocity) v = glm::vec3(unit(rng), 0.0f, unit(rng)) * 2.0f;
+
+		enum class Update { Refit, Rebuild, Sync };
+		struct Variant { const char* name; BVHBuildMode mode; Update update; };
+		const Variant variants[] = {
+			{ "sah + refit", BVHBuildMode::BinnedSAH, Update::Refit },
+			{ "lbvh", BVHBuildMode::LBVH, Update::Rebuild },
+			{ "lbvh + sync", BVHBuildMode::LBVH, Update::Sync },
+		};
+
+		for (const Variant& variant : variants) {
+			Visibility::VisibilityState vs;
+			Bench::fillVisibilityState(vs, start);
+			vs.buildMode = variant.mode;
+
+			const double buildMs = Bench::medianMs(rows >= 1'000'000 ? 3 : 7, [&] { Visibility::buildBVH(vs); });
+
+			std::vector<double> frameSamples;
+			uint32_t rebuilds = 0;
+			VisibilitySyncResult moved{};
+			moved.refitOnly = true;
+			for (uint32_t f = 0; f < frames; ++f) {
+				for (uint32_t i = 0; i < rows; ++i) {
+					const AABB& b = vs.worldAABBs[i];
+					vs.worldAABBs[i] = Bench::makeAABB(b.origin + velocity[i], b.extent);
+				}
+
+				Bench::Timer t;
+				if (variant.update == Update::Rebuild) {
+					Visibility::buildBVH(vs);
+				}
+				else if (variant.update == Update::Sync) {
+					const uint32_t generation = vs.buildGeneration;
+					Visibility::markRowsDirty(vs, { Visibility::RowRun{ 0u, rows } });
+					Visibility::applySyncResult(vs, moved);
+					rebuilds += vs.buildGeneration != generation ? 1u : 0u;
+				}
+				else {
+					Visibility::refitBVH(vs.worldAABBs, vs.leafIndex, vs.bvh);
+					Visibility::gatherLeafBounds(vs);
+				}
+				frameSamples.push_back(t.ms());
+			}
+			if (variant.update == Update::Sync && !vs.builtLinear) {
+				fmt::print("[LBVH] {} rows: tree wasn't built linear\n", rows);
+				ok = false;
+			}
+			const Bench::Timing frame = Bench::summarize(frameSamples);
+			Bench::record("LBVH", variant.name, rows, "frame", frame);
+
+			std::vector<GPUInstance> visible;
+			std::vector<AABB> visibleAABBs;
+			uint64_t visits = 0;
+			const double cullMs = Bench::medianMs(3, [&] {
+				visits = 0;
+				for (const Frustum& frus : frustums) {
+					Visibility::CullStats stats{};
+					Visibility::cullBVHCollect(vs, frus, visible, visibleAABBs, &stats);
+					visits += stats.nodesVisited;
+				}
+			}) / frustums.size();
+
+			for (uint32_t i = 0; i < 8; ++i) {
+				Visibility::cullBVHCollect(vs, frustums[i], visible, visibleAABBs);
+				if (Bench::sortedTransformIDs(visible) != Bench::referenceCull(vs, frustums[i])) {
+					fmt::print("[LBVH] {} rows {}: cull mismatch on frustum {}\n", rows, variant.name, i);
+					ok = false;
+				}
+			}
+
+			fmt::print("{:>9} {:>12} {:>13.3f} {:>13.3f} {:>13.3f} {:>12.1f} {:>12.4f}",
+				rows, variant.name, buildMs, frame.median, frame.p99,
+				static_cast<double>(visits) / frustums.size(), cullMs);
+			if (variant.update == Update::Sync) fmt::print("  {} rebuilds", rebuilds);
+			fmt::print("\n");
+		}
+	}
+
+	// Code width on the uneven scene and on the same scene with one far row stretching the
+	// bounds, where most rows share a 30-bit cell. Auto has to land on the same tree as the
+	// width it picks, 30-bit for the first, 63-bit for the second.
+	fmt::print("\n{:>9} {:>10} {:>6} {:>10} {:>12} {:>12} {:>10}\n",
+		"rows", "scene", "codes", "build ms", "30-bit share", "visits/cull", "cull ms");
+	for (uint32_t rows : { 100'000u, 1'000'000u }) {
+		for (bool stretched : { false, true }) {
+			std::vector<AABB> boxes = Bench::makeUnevenScene(rows, 91u);
+			if (stretched) boxes.back() = Bench::makeAABB(glm::vec3(60000.0f), glm::vec3(1.0f));
+
+			Visibility::VisibilityState vs;
+			Bench::fillVisibilityState(vs, boxes);
+
+			// Rows sharing their 30-bit cell with the row before them
+			glm::vec3 cmin(1e30f), cmax(-1e30f);
+			for (const AABB& b : vs.worldAABBs) {
+				cmin = glm::min(cmin, b.origin);
+				cmax = glm::max(cmax, b.origin);
+			}
+			std::vector<uint32_t> cells;
+			for (const AABB& b : vs.worldAABBs)
+				cells.push_back(Visibility::mortonCode30((b.origin - cmin) / (cmax - cmin)));
+			std::sort(cells.begin(), cells.end());
+			uint32_t shared = 0;
+			for (size_t i = 1; i < cells.size(); ++i)
+				shared += cells[i] == cells[i - 1] ? 1u : 0u;
+
+			using Visibility::MortonCodes;
+			std::vector<uint32_t> leafOrder[2];
+			for (MortonCodes codes : { MortonCodes::Bits30, MortonCodes::Bits63, MortonCodes::Auto }) {
+				const double buildMs = Bench::medianMs(3, [&] {
+					vs.leafIndex = vs.active;
+					vs.bvh.clear();
+					Visibility::buildLBVH(vs.worldAABBs, vs.leafIndex, vs.bvh, codes);
+				});
+				Visibility::linkBVH(vs);
+				Visibility::gatherLeafBounds(vs);
+
+				std::vector<GPUInstance> visible;
+				std::vector<AABB> visibleAABBs;
+				uint64_t visits = 0;
+				const double cullMs = Bench::medianMs(3, [&] {
+					visits = 0;
+					for (const Frustum& frus : frustums) {
+						Visibility::CullStats stats{};
+						Visibility::cullBVHCollect(vs, frus, visible, visibleAABBs, &stats);
+						visits += stats.nodesVisited;
+					}
+				}) / frustums.size();
+
+				const char* name = codes == MortonCodes::Bits30 ? "30" : (codes == MortonCodes::Bits63 ? "63" : "auto");
+				for (uint32_t i = 0; i < 8; ++i) {
+					Visibility::cullBVHCollect(vs, frustums[i], visible, visibleAABBs);
+					if (Bench::sortedTransformIDs(visible) != Bench::referenceCull(vs, frustums[i])) {
+						fmt::print("[LBVH] {} rows {} codes: cull mismatch on frustum {}\n", rows, name, i);
+						ok = false;
+					}
+				}
+
+				if (codes != MortonCodes::Auto) leafOrder[codes == MortonCodes::Bits63] = vs.leafIndex;
+				else if (vs.leafIndex != leafOrder[stretched]) {
+					fmt::print("[LBVH] {} rows: auto codes didn't pick {}-bit\n", rows, stretched ? 63 : 30);
+					ok = false;
+				}
+
+				fmt::print("{:>9} {:>10} {:>6} {:>10.3f} {:>11.1f}% {:>12.1f} {:>10.4f}\n",
+					rows, stretched ? "stretched" : "uneven", name, buildMs, 100.0 * shared / rows,
+					static_cast<double>(visits) / frustums.size(), cullMs);
+			}
+		}
+	}
+
+	// Morton order: consecutive leaf rows must never step back along the curve
+	Visibility::VisibilityState vs;
+	Bench::fillVisibilityState(vs, Bench::makeUnevenScene(50'000, 5u));
+	vs.buildMode = BVHBuildMode::LBVH;
+	Visibility::buildBVH(vs);
+
+	glm::vec3 cmin(1e30f), cmax(-1e30f);
+	for (const AABB& b : vs.worldAABBs) {
+		cmin = glm::min(cmin, b.origin);
+		cmax = glm::max(cmax, b.origin);
+	}
+	uint32_t last = 0;
+	for (uint32_t row : vs.leafIndex) {
+		const uint32_t code = Visibility::mortonCode30((vs.worldAABBs[row].origin - cmin) / (cmax - cmin));
+		if (code < last) {
+			fmt::print("[LBVH] leaf order steps back along the Morton curve\n");
+			ok = false;
+			break;
+		}
+		last = code;
+	}
+
+	return ok;
+}
@@ -0,0 +1,122 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+
+namespace {
+	// Light space boxes around slices of a camera frustum, the way shadow cascades cover it
+	std::vector<Frustum> makeCascades(const glm::vec3& eye, const glm::vec3& dir, const glm::vec3& lightDir) {
+		constexpr float splits[] = { 0.1f, 20.0f, 60.0f, 180.0f, 500.0f };
+		const float tanHalf = std::tan(glm::radians(35.0f));
+
+		std::vector<Frustum> out;
+		for (uint32_t c = 0; c < 4; ++c) {
+			// Bounding sphere of the slice, generous enough for the 16:9 corners
+			const float nearD = splits[c], farD = splits[c + 1];
+			const glm::vec3 center = eye + dir * ((nearD + farD) * 0.5f);
+			const float radius = glm::length(glm::vec3(farD * tanHalf * 16.0f / 9.0f, farD * tanHalf, (farD - nearD) * 0.5f));
+
+			const glm::mat4 view = glm::lookAt(center - lightDir * radius * 2.0f, center, glm::vec3(0.0f, 1.0f, 0.0f));
+			const glm::mat4 proj = glm::ortho(-radius, radius, -radius, radius, 0.0f, radius * 4.0f);
+			out.push_back(Visibility::extractFrustum(proj * view));
+		}
+		return out;
+	}
+
+	std::vector<Frustum> makeCubeProbe(const glm::vec3& p) {
+		static const glm::vec3 dirs[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+		static const glm::vec3 ups[6] = { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+
+		glm::mat4 proj = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 200.0f);
+		proj[1][1] *= -1;
+
+		std::vector<Frustum> out;
+		for (uint32_t f = 0; f < 6; ++f)
+			out.push_back(Visibility::extractFrustum(proj * glm::lookAt(p, p + dirs[f], ups[f])));
+		return out;
+	}
+}
+
+// Shadow cascades and cube probe faces from scattered positions in a 100k row scene.
+// N separate culls against one multi-view walk, with and without splitting the result back
+// into per-view lists. Every view has to come out exactly as its own cullBVHCollect, in order.
+BENCH_SUITE(MultiView) {
+	Visibility::VisibilityState vs;
+	Bench::fillVisibilityState(vs, Bench::makeUnevenScene(100'000, 17u));
+	Visibility::buildBVH(vs);
+
+	std::mt19937 rng(3u);
+	std::uniform_real_distribution<float> unit(-0.5f, 0.5f);
+	const glm::vec3 lightDir = glm::normalize(glm::vec3(-1.0f, -1.0f, 0.787f));
+
+	struct Setup { const char* name; std::vector<std::vector<Frustum>> viewSets; };
+	Setup setups[2] = { { "4 cascades", {} }, { "6 cube faces", {} } };
+	for (uint32_t i = 0; i < 8; ++i) {
+		const glm::vec3 eye(unit(rng) * 1000.0f, 5.0f + (unit(rng) + 0.5f) * 50.0f, unit(rng) * 1000.0f);
+		const glm::vec3 dir = glm::normalize(glm::vec3(unit(rng), -0.1f, unit(rng)));
+		setups[0].viewSets.push_back(makeCascades(eye, dir, lightDir));
+		setups[1].viewSets.push_back(makeCubeProbe(eye));
+	}
+
+	bool ok = true;
+	std::vector<GPUInstance> single, extracted;
+	std::vector<AABB> singleAABBs, extractedAABBs;
+	Visibility::MultiViewCullResult result;
+
+	fmt::print("{:>13} {:>10} {:>12} {:>12} {:>12} {:>11} {:>11}\n",
+		"setup", "view rows", "N culls", "multi", "+ extract", "N nodes", "multi nodes");
+
+	for (const Setup& setup : setups) {
+		uint64_t viewRows = 0, nodesSingle = 0, nodesMulti = 0;
+
+		for (size_t s = 0; s < setup.viewSets.size(); ++s) {
+			const std::vector<Frustum>& views = setup.viewSets[s];
+			const uint32_t viewCount = static_cast<uint32_t>(views.size());
+
+			Visibility::CullStats multiStats{};
+			Visibility::cullBVHCollectMulti(vs, views.data(), viewCount, result, &multiStats);
+			nodesMulti += multiStats.nodesVisited;
+
+			for (uint32_t v = 0; v < viewCount; ++v) {
+				Visibility::CullStats singleStats{};
+				Visibility::cullBVHCollect(vs, views[v], single, singleAABBs, &singleStats);
+				nodesSingle += singleStats.nodesVisited;
+				viewRows += single.size();
+
+				Visibility::extractView(result, v, extracted, extractedAABBs);
+				const bool same = single.size() == extracted.size() &&
+					std::equal(single.begin(), single.end(), extracted.begin(),
+						[](const GPUInstance& a, const GPUInstance& b) { return a.transformID == b.transformID; });
+				if (!same || result.viewRowCounts[v] != single.size()) {
+					fmt::print("[MultiView] {} set {} view {}: {} rows, own cull has {}\n",
+						setup.name, s, v, extracted.size(), single.size());
+					ok = false;
+				}
+			}
+		}
+
+		const double sequentialMs = Bench::medianMs(5, [&] {
+			for (const auto& views : setup.viewSets)
+				for (const Frustum& frus : views)
+					Visibility::cullBVHCollect(vs, frus, single, singleAABBs);
+		});
+		const double multiMs = Bench::medianMs(5, [&] {
+			for (const auto& views : setup.viewSets)
+				Visibility::cullBVHCollectMulti(vs, views.data(), static_cast<uint32_t>(views.size()), result);
+		});
+		const double extractMs = Bench::medianMs(5, [&] {
+			for (const auto& views : setup.viewSets) {
+				Visibility::cullBVHCollectMulti(vs, views.data(), static_cast<uint32_t>(views.size()), result);
+				for (uint32_t v = 0; v < views.size(); ++v)
+					Visibility::extractView(result, v, extracted, extractedAABBs);
+			}
+		});
+
+		const double sets = static_cast<double>(setup.viewSets.size());
+		fmt::print("{:>13} {:>10} {:>9.3f} ms {:>9.3f} ms {:>9.3f} ms {:>11} {:>11}\n",
+			setup.name, static_cast<uint64_t>(viewRows / sets),
+			sequentialMs / sets, multiMs / sets, extractMs / sets,
+			static_cast<uint64_t>(nodesSingle / sets), static_cast<uint64_t>(nodesMulti / sets));
+	}
+
+	return ok;
+}
@@ -0,0 +1,269 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+#include "core/loader/MeshLOD.h"
+#include "renderer/scene/OcclusionCull.h"
+
+// Segment from eye to p passes through a box before reaching p
+static bool segmentBlocked(const glm::vec3& eye, const glm::vec3& p, const AABB& box) {
+	const glm::vec3 dir = p - eye;
+	float t0 = 0.0f, t1 = 1.0f - 1e-4f;
+	for (int a = 0; a < 3; ++a) {
+		if (std::abs(dir[a]) < 1e-12f) {
+			if (eye[a] < box.vmin[a] || eye[a] > box.vmax[a]) return false;
+			continue;
+		}
+		float ta = (box.vmin[a] - eye[a]) / dir[a];
+		float tb = (box.vmax[a] - eye[a]) / dir[a];
+		if (ta > tb) std::swap(ta, tb);
+		t0 = std::max(t0, ta);
+		t1 = std::min(t1, tb);
+		if (t0 > t1) return false;
+	}
+	return true;
+}
+
+// Samples a 3x3x3 grid over the box, every sample has to be hidden behind some occluder
+static bool reallyHidden(const glm::vec3& eye, const AABB& box, const std::vector<AABB>& occluders) {
+	for (int i = 0; i < 27; ++i) {
+		const glm::vec3 f(static_cast<float>(i % 3), static_cast<float>((i / 3) % 3), static_cast<float>(i / 9));
+		const glm::vec3 p = box.vmin + (box.vmax - box.vmin) * (f * 0.5f);
+
+		bool blocked = false;
+		for (const AABB& occ : occluders)
+			if ((blocked = segmentBlocked(eye, p, occ))) break;
+		if (!blocked) return false;
+	}
+	return true;
+}
+
+// Closed mesh over unit voxels: every voxel face without a filled neighbour, as two triangles.
+// openTop leaves the +y faces out, which makes a shell with a hole in it.
+struct VoxelMesh {
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	GPUMeshData mesh;
+};
+
+static VoxelMesh makeVoxelMesh(const std::vector<glm::ivec3>& voxels, bool openTop = false) {
+	auto filled = [&](const glm::ivec3& v) { return std::find(voxels.begin(), voxels.end(), v) != voxels.end(); };
+
+	VoxelMesh out;
+	glm::vec3 vmin(1e30f), vmax(-1e30f);
+	for (const glm::ivec3& v : voxels) {
+		for (int axis = 0; axis < 3; ++axis) {
+			for (int side = 0; side < 2; ++side) {
+				glm::ivec3 n(0);
+				n[axis] = side ? 1 : -1;
+				if (filled(v + n) || (openTop && axis == 1 && side)) continue;
+
+				const int u = (axis + 1) % 3, w = (axis + 2) % 3;
+				const uint32_t base = static_cast<uint32_t>(out.vertices.size());
+				for (int c = 0; c < 4; ++c) {
+					glm::vec3 p(v);
+					p[axis] += static_cast<float>(side);
+					p[u] += static_cast<float>(c & 1);
+					p[w] += static_cast<float>(c >> 1);
+					out.vertices.push_back({ p, glm::vec3(n), glm::vec2(0.0f), glm::vec4(1.0f) });
+					vmin = glm::min(vmin, p);
+					vmax = glm::max(vmax, p);
+				}
+				for (uint32_t i : { 0u, 1u, 3u, 0u, 3u, 2u }) out.indices.push_back(base + i);
+			}
+		}
+	}
+
+	out.mesh.localAABB = Bench::makeAABB((vmin + vmax) * 0.5f, (vmax - vmin) * 0.5f);
+	out.mesh.firstIndex = 0;
+	out.mesh.indexCount = static_cast<uint32_t>(out.indices.size());
+	out.mesh.vertexOffset = 0;
+	out.mesh.vertexCount = static_cast<uint32_t>(out.vertices.size());
+	return out;
+}
+
+static MeshOccluder occluderFor(const VoxelMesh& m) {
+	return MeshLOD::buildOccluder(m.vertices, m.indices, m.mesh);
+}
+
+// Load time occluder boxes: only closed convex meshes get one, and the box has to stay inside
+// the mesh under rotation. Then an arch in front of a prop seen through its opening: it must not
+// hide the prop, while a solid block in front of another prop does.
+static bool checkOccluderShapes(const glm::mat4& proj) {
+	bool ok = true;
+
+	const VoxelMesh cube = makeVoxelMesh({ { 0, 0, 0 } });
+	const VoxelMesh arch = makeVoxelMesh({ { 0, 0, 0 }, { 0, 1, 0 }, { 0, 2, 0 }, { 2, 0, 0 }, { 2, 1, 0 }, { 2, 2, 0 }, { 1, 2, 0 } });
+	const VoxelMesh table = makeVoxelMesh({
+		{ 0, 1, 0 }, { 1, 1, 0 }, { 2, 1, 0 }, { 0, 1, 1 }, { 1, 1, 1 }, { 2, 1, 1 }, { 0, 1, 2 }, { 1, 1, 2 }, { 2, 1, 2 },
+		{ 0, 0, 0 }, { 2, 0, 0 }, { 0, 0, 2 }, { 2, 0, 2 } });
+	const VoxelMesh shell = makeVoxelMesh({ { 0, 0, 0 } }, true);
+	const VoxelMesh slab = makeVoxelMesh({ { 0, 0, 0 }, { 1, 0, 0 }, { 2, 0, 0 }, { 0, 1, 0 }, { 1, 1, 0 }, { 2, 1, 0 } });
+
+	const std::vector<MeshOccluder> meshOccluders = {
+		occluderFor(cube), occluderFor(arch), occluderFor(table), occluderFor(shell), occluderFor(slab) };
+	const char* names[] = { "cube", "arch", "table", "open shell", "slab" };
+	const bool expectSolid[] = { true, false, false, false, true };
+
+	for (size_t m = 0; m < meshOccluders.size(); ++m) {
+		fmt::print("{:>10} mesh: {}\n", names[m], meshOccluders[m].solid ? "solid occluder" : "never occludes");
+		if (meshOccluders[m].solid != expectSolid[m]) {
+			fmt::print("[Occlusion] {} mesh {} an occluder box\n", names[m], expectSolid[m] ? "didn't get" : "got");
+			ok = false;
+		}
+	}
+
+	// Every corner of the world box has to map back inside the rotated, stretched slab
+	const AABB& slabBox = meshOccluders[4].box;
+	const glm::mat4 turned = glm::translate(glm::mat4(1.0f), glm::vec3(3.0f, 0.0f, 5.0f)) *
+		glm::rotate(glm::mat4(1.0f), glm::radians(37.0f), glm::normalize(glm::vec3(0.3f, 1.0f, 0.2f))) *
+		glm::scale(glm::mat4(1.0f), glm::vec3(2.0f, 1.0f, 4.0f));
+	const AABB worldBox = Visibility::occluderWorldBox(slabBox, turned);
+	const glm::mat4 back = glm::inverse(turned);
+	for (uint32_t c = 0; c < 8; ++c) {
+		const glm::vec3 corner = worldBox.origin + worldBox.extent * glm::vec3((c & 1) ? 1.0f : -1.0f, (c & 2) ? 1.0f : -1.0f, (c & 4) ? 1.0f : -1.0f);
+		const glm::vec3 local = glm::vec3(back * glm::vec4(corner, 1.0f));
+		if (glm::any(glm::greaterThan(glm::abs(local - slabBox.origin), slabBox.extent + 1e-4f))) {
+			fmt::print("[Occlusion] rotated occluder box pokes out of its mesh\n");
+			ok = false;
+			break;
+		}
+	}
+
+	// Eye looks down +z. Row 0 is the arch with its opening on the view axis, row 1 a prop seen
+	// through it. Row 2 is a block on the diagonal, row 3 a prop straight behind it.
+	const glm::vec3 eye(0.0f, 1.0f, 0.0f);
+	const glm::mat4 viewProj = proj * glm::lookAt(eye, eye + glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	std::vector<glm::mat4> transforms = {
+		glm::translate(glm::mat4(1.0f), glm::vec3(-1.5f, 0.0f, 10.0f)),
+		glm::mat4(1.0f),
+		glm::translate(glm::mat4(1.0f), glm::vec3(4.0f, -1.0f, 10.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(4.0f)),
+		glm::mat4(1.0f),
+	};
+	std::vector<GPUInstance> visible(4);
+	const uint32_t meshes[] = { 1, 0, 0, 0 };
+	for (uint32_t i = 0; i < 4; ++i) {
+		visible[i].meshID = meshes[i];
+		visible[i].transformID = i;
+	}
+	// The props aren't solid as far as selection goes, only rows 0 and 2 can occlude
+	std::vector<MeshOccluder> sceneOccluders = meshOccluders;
+	sceneOccluders.push_back({});
+	visible[1].meshID = visible[3].meshID = static_cast<uint32_t>(sceneOccluders.size() - 1);
+
+	std::vector<AABB> visibleAABBs = {
+		Visibility::transformAABB(arch.mesh.localAABB, transforms[0]),
+		Bench::makeAABB(glm::vec3(0.0f, 1.0f, 20.0f), glm::vec3(0.2f)),
+		Visibility::transformAABB(cube.mesh.localAABB, transforms[2]),
+		Bench::makeAABB(glm::vec3(12.0f, 1.0f, 30.0f), glm::vec3(0.2f)),
+	};
+
+	std::vector<AABB> occluders;
+	Visibility::OcclusionBuffer ob;
+	Visibility::selectOccluders(visible, sceneOccluders, transforms, viewProj, Visibility::OCCLUSION_MAX_OCCLUDERS, occluders);
+	Visibility::rasterizeOccluders(ob, occluders, viewProj, eye);
+
+	const bool propThroughArch = !Visibility::isOccluded(ob, visibleAABBs[1], viewProj);
+	const bool propBehindBlock = Visibility::isOccluded(ob, visibleAABBs[3], viewProj);
+
+	// What the old stand-in did: the arch's bounds shrunk by half cover its opening
+	AABB standIn = visibleAABBs[0];
+	standIn.extent *= 0.5f;
+	standIn.vmin = standIn.origin - standIn.extent;
+	standIn.vmax = standIn.origin + standIn.extent;
+	Visibility::OcclusionBuffer boxOb;
+	Visibility::rasterizeOccluders(boxOb, { standIn }, viewProj, eye);
+	const bool standInHides = Visibility::isOccluded(boxOb, visibleAABBs[1], viewProj);
+
+	fmt::print("arch: {} occluders picked, prop through the opening {}, prop behind the block {}"
+		" (half size bounds would {}hide the first)\n",
+		occluders.size(), propThroughArch ? "kept" : "dropped", propBehindBlock ? "dropped" : "kept",
+		standInHides ? "" : "not ");
+	if (!propThroughArch) {
+		fmt::print("[Occlusion] prop seen through an arch was occluded\n");
+		ok = false;
+	}
+	if (!propBehindBlock) {
+		fmt::print("[Occlusion] solid block didn't hide the prop behind it\n");
+		ok = false;
+	}
+
+	return ok;
+}
+
+// Street level cameras in a city: buildings rasterized as occluders, every frustum survivor
+// tested against them. Each rejected row is checked with rays against the occluder boxes.
+BENCH_SUITE(Occlusion) {
+	const Bench::CityScene city = Bench::makeCityScene(24, 60'000, 31u);
+
+	Visibility::VisibilityState vs;
+	Bench::fillVisibilityState(vs, city.boxes);
+	Visibility::buildBVH(vs);
+
+	glm::mat4 proj = glm::perspective(glm::radians(70.f), 16.0f / 9.0f, 0.1f, 500.f);
+	proj[1][1] *= -1;
+
+	bool ok = checkOccluderShapes(proj);
+
+	// Synthetic boxes are solid: every row draws a unit cube stretched over its box, so the
+	// occluder boxes come out exact
+	const VoxelMesh cube = makeVoxelMesh({ { 0, 0, 0 } });
+	const std::vector<MeshOccluder> meshOccluders = { occluderFor(cube) };
+	std::vector<glm::mat4> transforms(vs.instances.size());
+	for (uint32_t row = 0; row < vs.instances.size(); ++row) {
+		const AABB& b = vs.worldAABBs[row];
+		transforms[row] = glm::translate(glm::mat4(1.0f), b.origin) * glm::scale(glm::mat4(1.0f), b.extent * 2.0f) *
+			glm::translate(glm::mat4(1.0f), -cube.mesh.localAABB.origin);
+		vs.instances[row].meshID = 0;
+	}
+	Visibility::OcclusionBuffer ob;
+	std::vector<GPUInstance> visible;
+	std::vector<AABB> visibleAABBs, occluders;
+
+	fmt::print("{:>5} {:>9} {:>9} {:>9} {:>10} {:>9} {:>9}\n",
+		"view", "frustum", "occluded", "fraction", "occluders", "raster ms", "test ms");
+
+	constexpr uint32_t views = 8;
+	for (uint32_t v = 0; v < views; ++v) {
+		// Down the middle of a street, turning a little each view
+		const float street = -city.blockSize * (static_cast<float>(city.blocks) * 0.5f - 3.0f);
+		const glm::vec3 eye(street, 1.7f + (v % 2) * 8.0f, -200.0f + 50.0f * v);
+		const float yaw = glm::radians(10.0f * static_cast<float>(v) - 35.0f);
+		const glm::vec3 dir(std::sin(yaw) * 0.3f + 1.0f, -0.02f, std::cos(yaw) * 0.3f);
+		const glm::mat4 viewProj = proj * glm::lookAt(eye, eye + dir, glm::vec3(0.0f, 1.0f, 0.0f));
+		const Frustum frus = Visibility::extractFrustum(viewProj);
+
+		Visibility::cullBVHCollect(vs, frus, visible, visibleAABBs);
+		const std::vector<uint32_t> before = Bench::sortedTransformIDs(visible);
+
+		Visibility::OcclusionStats stats{};
+		Visibility::selectOccluders(visible, meshOccluders, transforms, viewProj, Visibility::OCCLUSION_MAX_OCCLUDERS, occluders);
+		Visibility::rasterizeOccluders(ob, occluders, viewProj, eye, &stats);
+		Visibility::cullOccluded(ob, viewProj, visible, visibleAABBs, &stats);
+
+		fmt::print("{:>5} {:>9} {:>9} {:>8.1f}% {:>10} {:>9.3f} {:>9.3f}\n",
+			v, stats.tested, stats.occluded, 100.0 * stats.occluded / std::max(1u, stats.tested),
+			stats.occluders, stats.rasterMs, stats.testMs);
+
+		// Survivors keep their frustum cull order and nothing new shows up
+		const std::vector<uint32_t> after = Bench::sortedTransformIDs(visible);
+		if (!std::includes(before.begin(), before.end(), after.begin(), after.end())) {
+			fmt::print("[Occlusion] view {}: rows appeared that the frustum cull dropped\n", v);
+			ok = false;
+		}
+
+		uint32_t wrong = 0;
+		std::vector<uint8_t> kept(vs.instances.size(), 0);
+		for (const GPUInstance& row : visible) kept[row.transformID] = 1;
+		for (uint32_t id : before) {
+			if (kept[id]) continue;
+			if (!reallyHidden(eye, vs.worldAABBs[id], occluders)) ++wrong;
+		}
+		if (wrong) {
+			fmt::print("[Occlusion] view {}: {} rows dropped that a ray can still reach\n", v, wrong);
+			ok = false;
+		}
+	}
+
+	return ok;
+}
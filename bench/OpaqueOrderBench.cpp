@@ -0,0 +1,163 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+#include "renderer/scene/DrawPreparation.h"
+
+namespace {
+	constexpr uint32_t RASTER_WIDTH = 320;
+	constexpr uint32_t RASTER_HEIGHT = 180;
+
+	// The eye is the point the projection sends to w = 0 on the view axis
+	glm::vec3 eyeOf(const glm::mat4& viewProj) {
+		const glm::vec4 e = glm::inverse(viewProj) * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+		return glm::vec3(e) / e.w;
+	}
+
+	// Stand-in for the fragment work of the opaque draws: each row's box drawn in draw order as
+	// its screen rectangle at its nearest depth, with an early depth test. Fragments passing the
+	// test count as shaded. Boxes reaching behind the near plane cover the screen at depth 0.
+	uint64_t shadedFragments(const FrameContext& frame, const std::vector<AABB>& boxes, const glm::mat4& viewProj, std::vector<float>& depth) {
+		depth.assign(static_cast<size_t>(RASTER_WIDTH) * RASTER_HEIGHT, 1.0f);
+		uint64_t shaded = 0;
+		const uint32_t opaqueDraws = static_cast<uint32_t>(frame.indirectDraws.size()) - frame.transparentRange.visibleCount;
+
+		for (uint32_t d = 0; d < opaqueDraws; ++d) {
+			const VkDrawIndexedIndirectCommand& cmd = frame.indirectDraws[d];
+			for (uint32_t i = cmd.firstInstance; i < cmd.firstInstance + cmd.instanceCount; ++i) {
+				const AABB& box = boxes[frame.visibleInstances[i].transformID];
+				glm::vec2 lo(1.0f), hi(-1.0f);
+				float z = 1.0f;
+				bool straddles = false;
+				for (uint32_t c = 0; c < 8; ++c) {
+					const glm::vec3 p((c & 1) ? box.vmax.x : box.vmin.x, (c & 2) ? box.vmax.y : box.vmin.y, (c & 4) ? box.vmax.z : box.vmin.z);
+					const glm::vec4 clip = viewProj * glm::vec4(p, 1.0f);
+					if (clip.w <= 0.1f) {
+						straddles = true;
+						break;
+					}
+					const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+					lo = glm::min(lo, glm::vec2(ndc));
+					hi = glm::max(hi, glm::vec2(ndc));
+					z = std::min(z, ndc.z);
+				}
+				if (straddles) {
+					lo = glm::vec2(-1.0f);
+					hi = glm::vec2(1.0f);
+					z = 0.0f;
+				}
+
+				const int x0 = std::max(static_cast<int>((lo.x * 0.5f + 0.5f) * RASTER_WIDTH), 0);
+				const int x1 = std::min(static_cast<int>((hi.x * 0.5f + 0.5f) * RASTER_WIDTH), static_cast<int>(RASTER_WIDTH) - 1);
+				const int y0 = std::max(static_cast<int>((lo.y * 0.5f + 0.5f) * RASTER_HEIGHT), 0);
+				const int y1 = std::min(static_cast<int>((hi.y * 0.5f + 0.5f) * RASTER_HEIGHT), static_cast<int>(RASTER_HEIGHT) - 1);
+				for (int y = y0; y <= y1; ++y) {
+					float* line = depth.data() + static_cast<size_t>(y) * RASTER_WIDTH;
+					for (int x = x0; x <= x1; ++x) {
+						if (z >= line[x]) continue;
+						line[x] = z;
+						++shaded;
+					}
+				}
+			}
+		}
+		return shaded;
+	}
+
+	// Opaque draws have to cover the opaque rows once each, in order, every row under a draw
+	// of its own mesh
+	bool validOpaqueDraws(const FrameContext& frame, const std::vector<GPUMeshData>& meshes) {
+		const uint32_t opaqueDraws = static_cast<uint32_t>(frame.indirectDraws.size()) - frame.transparentRange.visibleCount;
+		uint32_t next = frame.opaqueRange.first;
+		for (uint32_t d = 0; d < opaqueDraws; ++d) {
+			const VkDrawIndexedIndirectCommand& cmd = frame.indirectDraws[d];
+			if (cmd.firstInstance != next || cmd.instanceCount == 0) return false;
+			for (uint32_t i = cmd.firstInstance; i < cmd.firstInstance + cmd.instanceCount; ++i)
+				if (meshes[frame.visibleInstances[i].meshID].firstIndex != cmd.firstIndex) return false;
+			next += cmd.instanceCount;
+		}
+		return next == frame.opaqueRange.first + frame.opaqueRange.visibleCount;
+	}
+}
+
+// 100k rows over 64 meshes and 16 materials, culled through 8 views. Every opaque order builds
+// the same visible lists, serial and parallel. Timed is the draw build, then fragments shaded
+// per pixel of a small depth buffer when each row's box is drawn in draw order, the early
+// depth test's share of the work. All orders have to draw the same rows, with the serial and
+// parallel builds giving the same bytes.
+BENCH_SUITE(OpaqueDrawOrder) {
+	constexpr uint32_t rows = 100'000;
+	constexpr uint32_t views = 8;
+	static const char* names[] = { "batched", "front to back", "sorted rows", "depth slices" };
+
+	std::vector<GPUMeshData> meshes;
+	std::vector<MeshLODs> meshLODs;
+	Bench::makeLODMeshes(64, meshes, meshLODs);
+
+	Visibility::VisibilityState vs;
+	Bench::fillVisibilityState(vs, Bench::makeUnevenScene(rows, 61u));
+	Visibility::buildBVH(vs);
+
+	const std::vector<glm::mat4> viewProjs = Bench::makeViewProjs(views, 37u);
+	const std::vector<Frustum> frustums = Bench::makeFrustums(views, 37u);
+
+	std::vector<std::vector<GPUInstance>> visible(views);
+	std::vector<std::vector<AABB>> visibleAABBs(views);
+	for (uint32_t v = 0; v < views; ++v)
+		Visibility::cullBVHCollect(vs, frustums[v], visible[v], visibleAABBs[v]);
+
+	bool ok = true;
+	std::vector<float> depth;
+	size_t visibleTotal = 0;
+	for (const auto& list : visible) visibleTotal += list.size();
+	fmt::print("{} visible rows per view\n", visibleTotal / views);
+	fmt::print("{:>14} {:>8} {:>10} {:>12} {:>14}\n", "order", "draws", "build ms", "parallel ms", "shaded/pixel");
+
+	for (uint32_t o = 0; o < static_cast<uint32_t>(OpaqueOrder::Count); ++o) {
+		FrameContext serial, parallel;
+		for (FrameContext* f : { &serial, &parallel }) {
+			f->drawDataPC = { UINT32_MAX, UINT32_MAX, 64, 16 };
+			f->opaqueOrder = static_cast<OpaqueOrder>(o);
+		}
+
+		std::vector<double> serialSamples, parallelSamples;
+		uint64_t draws = 0, shaded = 0;
+		for (uint32_t v = 0; v < views; ++v) {
+			const glm::vec4 camPos(eyeOf(viewProjs[v]), 0.0f);
+			for (uint32_t r = 0; r < 5; ++r) {
+				serial.clearRenderData();
+				serial.visibleInstances = visible[v];
+				Bench::Timer t;
+				DrawPreparation::buildAndSortIndirectDraws(serial, meshes, meshLODs, visibleAABBs[v], camPos);
+				serialSamples.push_back(t.ms());
+
+				parallel.clearRenderData();
+				parallel.visibleInstances = visible[v];
+				t = Bench::Timer();
+				DrawPreparation::buildIndirectDrawsParallel(parallel, meshes, meshLODs, visibleAABBs[v], camPos);
+				parallelSamples.push_back(t.ms());
+			}
+
+			const bool same = serial.indirectDraws.size() == parallel.indirectDraws.size() &&
+				serial.visibleInstances.size() == parallel.visibleInstances.size() &&
+				memcmp(serial.indirectDraws.data(), parallel.indirectDraws.data(), serial.indirectDraws.size() * sizeof(VkDrawIndexedIndirectCommand)) == 0 &&
+				memcmp(serial.visibleInstances.data(), parallel.visibleInstances.data(), serial.visibleInstances.size() * sizeof(GPUInstance)) == 0;
+			if (!same || !validOpaqueDraws(serial, meshes) ||
+				Bench::sortedTransformIDs(serial.visibleInstances) != Bench::sortedTransformIDs(visible[v])) {
+				fmt::print("[OpaqueDrawOrder] {}, view {}: draws don't cover the visible rows or the builds differ\n", names[o], v);
+				ok = false;
+			}
+
+			draws += serial.indirectDraws.size();
+			shaded += shadedFragments(serial, vs.worldAABBs, viewProjs[v], depth);
+		}
+
+		const Bench::Timing build = Bench::summarize(serialSamples);
+		const Bench::Timing parallelBuild = Bench::summarize(parallelSamples);
+		Bench::record("OpaqueDrawOrder", names[o], rows, "build", build);
+		Bench::record("OpaqueDrawOrder", names[o], rows, "parallel build", parallelBuild);
+		const double perPixel = static_cast<double>(shaded) / (static_cast<double>(views) * RASTER_WIDTH * RASTER_HEIGHT);
+		fmt::print("{:>14} {:>8} {:>10.3f} {:>12.3f} {:>14.2f}\n", names[o], draws / views, build.median, parallelBuild.median, perPixel);
+	}
+
+	return ok;
+}
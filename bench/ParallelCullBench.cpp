@@ -0,0 +1,65 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+#include "engine/JobSystem.h"
+
+// Serial vs parallel BVH cull at several scheduler sizes. The parallel output has to be
+// identical to the serial one, same rows in the same order.
+BENCH_SUITE(ParallelCull) {
+	constexpr uint32_t rows = 200'000;
+
+	Visibility::VisibilityState vs;
+	Bench::fillVisibilityState(vs, Bench::makeUnevenScene(rows, 77u));
+	Visibility::buildBVH(vs);
+
+	const std::vector<Frustum> frustums = Bench::makeFrustums(32, 5u);
+
+	std::vector<std::vector<GPUInstance>> serial(frustums.size());
+	std::vector<AABB> aabbs;
+	const double serialMs = Bench::medianMs(5, [&] {
+		for (size_t f = 0; f < frustums.size(); ++f)
+			Visibility::cullBVHCollect(vs, frustums[f], serial[f], aabbs);
+	}) / frustums.size();
+
+	fmt::print("{} rows, serial cull {:.3f} ms\n", rows, serialMs);
+	fmt::print("{:>8} {:>10} {:>8}\n", "threads", "ms", "speedup");
+
+	const uint32_t hw = std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<uint32_t> threadCounts = { 1, 2, 4, 8 };
+	if (std::find(threadCounts.begin(), threadCounts.end(), hw) == threadCounts.end())
+		threadCounts.push_back(hw);
+
+	bool ok = true;
+	Visibility::CullScratch scratch;
+	std::vector<GPUInstance> visible;
+
+	// The suites after this one run on whatever --threads asked for
+	const uint32_t requestedThreads = JobSystem::getThreadCount();
+
+	for (uint32_t threads : threadCounts) {
+		JobSystem::shutdownScheduler();
+		JobSystem::initScheduler(threads);
+
+		const double ms = Bench::medianMs(5, [&] {
+			for (const Frustum& frus : frustums)
+				Visibility::cullBVHCollectParallel(vs, frus, visible, aabbs, scratch);
+		}) / frustums.size();
+
+		for (size_t f = 0; f < frustums.size(); ++f) {
+			Visibility::cullBVHCollectParallel(vs, frustums[f], visible, aabbs, scratch);
+			const bool same = visible.size() == serial[f].size() &&
+				std::equal(visible.begin(), visible.end(), serial[f].begin(),
+					[](const GPUInstance& a, const GPUInstance& b) { return a.transformID == b.transformID; });
+			if (!same) {
+				fmt::print("[ParallelCull] {} threads: output differs from serial on frustum {}\n", threads, f);
+				ok = false;
+			}
+		}
+
+		fmt::print("{:>8} {:>10.3f} {:>7.2f}x\n", threads, ms, serialMs / ms);
+	}
+
+	JobSystem::shutdownScheduler();
+	JobSystem::initScheduler(requestedThreads);
+	return ok;
+}
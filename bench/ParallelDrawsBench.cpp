@@ -0,0 +1,64 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+#include "renderer/scene/DrawPreparation.h"
+#include "engine/JobSystem.h"
+
+namespace {
+	bool sameDraws(const FrameContext& a, const FrameContext& b) {
+		return a.indirectDraws.size() == b.indirectDraws.size() && a.visibleInstances.size() == b.visibleInstances.size() &&
+			a.opaqueRange.first == b.opaqueRange.first && a.opaqueRange.visibleCount == b.opaqueRange.visibleCount &&
+			a.transparentRange.first == b.transparentRange.first && a.transparentRange.visibleCount == b.transparentRange.visibleCount &&
+			memcmp(a.indirectDraws.data(), b.indirectDraws.data(), a.indirectDraws.size() * sizeof(VkDrawIndexedIndirectCommand)) == 0 &&
+			memcmp(a.visibleInstances.data(), b.visibleInstances.data(), a.visibleInstances.size() * sizeof(GPUInstance)) == 0;
+	}
+}
+
+// Visible lists of 50k to 500k rows over 512 meshes and 64 materials, the serial draw build
+// against the parallel one on every scheduler thread. Draws, instances and ranges have to
+// match byte for byte. Rerun with --threads 1, 2, 4, 8 for the scaling.
+BENCH_SUITE(ParallelDraws) {
+	std::vector<GPUMeshData> meshes;
+	std::vector<MeshLODs> meshLODs;
+	Bench::makeLODMeshes(512, meshes, meshLODs);
+
+	bool ok = true;
+	fmt::print("{:>8} {:>8} {:>11} {:>13} {:>8}\n", "rows", "threads", "serial ms", "parallel ms", "speedup");
+
+	for (uint32_t rows : { 50'000u, 200'000u, 500'000u }) {
+		const Bench::VisibleRows input = Bench::makeVisibleRows(rows, 512, 64, 7u + rows);
+		const glm::vec4 camPos(500.0f, 50.0f, 500.0f, 0.0f);
+
+		FrameContext serial, parallel;
+		for (FrameContext* f : { &serial, &parallel })
+			f->drawDataPC = { UINT32_MAX, UINT32_MAX, 512, 64 };
+
+		auto run = [&](FrameContext& frame, auto&& build) {
+			std::vector<double> samples;
+			for (uint32_t r = 0; r < 11; ++r) {
+				frame.clearRenderData();
+				frame.visibleInstances = input.instances;
+				frame.visibleLODs = input.lods;
+				Bench::Timer t;
+				build(frame, meshes, meshLODs, input.aabbs, camPos);
+				samples.push_back(t.ms());
+			}
+			samples.erase(samples.begin()); // lists growing
+			return Bench::summarize(samples);
+		};
+
+		const Bench::Timing serialTiming = run(serial, DrawPreparation::buildAndSortIndirectDraws);
+		const Bench::Timing parallelTiming = run(parallel, DrawPreparation::buildIndirectDrawsParallel);
+		if (!sameDraws(serial, parallel)) {
+			fmt::print("[ParallelDraws] {} rows: parallel build differs from the serial one\n", rows);
+			ok = false;
+		}
+
+		Bench::record("ParallelDraws", "serial", rows, "draw_build", serialTiming);
+		Bench::record("ParallelDraws", fmt::format("{} threads", JobSystem::getThreadCount()), rows, "draw_build", parallelTiming);
+		fmt::print("{:>8} {:>8} {:>11.3f} {:>13.3f} {:>7.2f}x\n", rows, JobSystem::getThreadCount(),
+			serialTiming.median, parallelTiming.median, serialTiming.median / parallelTiming.median);
+	}
+
+	return ok;
+}
@@ -0,0 +1,58 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+
+// Plane masks, fully inside subtrees and the last-failed-plane hints against testing every
+// node on all 6 planes, over a camera flying through the scene.
+BENCH_SUITE(PlaneMasks) {
+	constexpr uint32_t rows = 200'000;
+	constexpr uint32_t frames = 240;
+
+	const std::vector<AABB> boxes = Bench::makeUnevenScene(rows, 77u);
+	const std::vector<Frustum> path = Bench::makeFlyPath(frames);
+
+	Visibility::VisibilityState vs;
+	Bench::fillVisibilityState(vs, boxes);
+	Visibility::buildBVH(vs);
+
+	bool ok = true;
+	std::vector<GPUInstance> visible;
+	std::vector<AABB> visibleAABBs;
+
+	fmt::print("{:>6} {:>13} {:>12} {:>11} {:>9}\n", "masks", "plane tests", "nodes", "subtrees", "ms/frame");
+
+	for (bool masks : { false, true }) {
+		vs.planeMasks = masks;
+		Visibility::CullScratch scratch;
+		uint64_t planeTests = 0, nodes = 0, subtrees = 0;
+
+		Bench::Timer t;
+		for (const Frustum& frus : path) {
+			Visibility::CullStats stats{};
+			Visibility::cullBVHCollect(vs, frus, visible, visibleAABBs, &stats, &scratch);
+			planeTests += stats.planeTests;
+			nodes += stats.nodesVisited;
+			subtrees += stats.subtreesAccepted;
+		}
+		const double ms = t.ms() / frames;
+
+		fmt::print("{:>6} {:>13} {:>12} {:>11} {:>9.4f}\n", masks ? "on" : "off",
+			planeTests / frames, nodes / frames, subtrees / frames, ms);
+
+		for (uint32_t f = 0; f < frames; f += frames / 8) {
+			Visibility::cullBVHCollect(vs, path[f], visible, visibleAABBs, nullptr, &scratch);
+			if (Bench::sortedTransformIDs(visible) != Bench::referenceCull(vs, path[f])) {
+				fmt::print("[PlaneMasks] masks {} cull mismatch on frame {}\n", masks ? "on" : "off", f);
+				ok = false;
+			}
+
+			Visibility::cullBVHCollectParallel(vs, path[f], visible, visibleAABBs, scratch);
+			if (Bench::sortedTransformIDs(visible) != Bench::referenceCull(vs, path[f])) {
+				fmt::print("[PlaneMasks] masks {} parallel cull mismatch on frame {}\n", masks ? "on" : "off", f);
+				ok = false;
+			}
+		}
+	}
+
+	return ok;
+}
@@ -0,0 +1,245 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+#include "renderer/scene/SpatialQuery.h"
+#include "engine/JobSystem.h"
+
+namespace {
+	Visibility::RayHit bruteRaycast(const Visibility::VisibilityState& vs, const Visibility::Ray& ray) {
+		Visibility::RayHit best{};
+		for (uint32_t row : vs.active) {
+			float t = 0.0f;
+			if (!Visibility::rayHitsAABB(ray, vs.worldAABBs[row], t)) continue;
+			if (t < best.t || (t == best.t && row < best.row)) best = { row, t };
+		}
+		return best;
+	}
+
+	// Per query ms of every rep
+	template<typename Fn>
+	Bench::Timing timeQueries(uint32_t reps, uint32_t queries, Fn&& fn) {
+		std::vector<double> samples;
+		for (uint32_t r = 0; r < reps; ++r) {
+			Bench::Timer t;
+			fn();
+			samples.push_back(t.ms() / queries);
+		}
+		return Bench::summarize(samples);
+	}
+
+	std::vector<uint32_t> sortedRows(std::vector<uint32_t> rows) {
+		std::sort(rows.begin(), rows.end());
+		return rows;
+	}
+}
+
+// 100k uneven rows. Picking style rays from above the scene, box and sphere overlaps of a few
+// meters up to a district, and k nearest around points inside the clusters, each against a
+// linear scan over every live row. Results have to match the scan exactly, rows and distances.
+BENCH_SUITE(SpatialQuery) {
+	constexpr uint32_t rows = 100'000;
+	constexpr uint32_t queries = 512;
+	constexpr uint32_t batchRays = 16'384;
+	constexpr uint32_t k = 16;
+
+	const std::vector<AABB> boxes = Bench::makeUnevenScene(rows, 63u);
+	Visibility::VisibilityState vs;
+	Bench::fillVisibilityState(vs, boxes);
+	Visibility::buildBVH(vs);
+
+	std::mt19937 rng(7u);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	auto scenePoint = [&] { return boxes[rng() % rows].origin + (glm::vec3(unit(rng), unit(rng), unit(rng)) - 0.5f) * 20.0f; };
+
+	std::vector<Visibility::Ray> rays(batchRays);
+	for (Visibility::Ray& ray : rays) {
+		ray.origin = glm::vec3(unit(rng) * 1000.0f - 500.0f, 150.0f + unit(rng) * 100.0f, unit(rng) * 1000.0f - 500.0f);
+		ray.dir = scenePoint() - ray.origin;
+		ray.tMax = 2.0f;
+	}
+	// A few axis aligned ones, zero direction components take the other slab path
+	rays[0].dir = glm::vec3(0.0f, -1.0f, 0.0f);
+	rays[1].dir = glm::vec3(1.0f, 0.0f, 0.0f);
+	rays[1].origin.y = boxes[0].origin.y;
+
+	bool ok = true;
+	fmt::print("{:>14} {:>12} {:>12} {:>12} {:>12}\n", "query", "scan ms", "bvh ms", "nodes", "rows tested");
+
+	auto report = [&](const char* name, const Bench::Timing& scan, const Bench::Timing& bvh, uint64_t nodes, uint64_t tested) {
+		Bench::record("SpatialQuery", name, rows, "scan", scan);
+		Bench::record("SpatialQuery", name, rows, "bvh", bvh);
+		fmt::print("{:>14} {:>12.4f} {:>12.4f} {:>12.1f} {:>12.1f}\n",
+			name, scan.median, bvh.median, static_cast<double>(nodes) / queries, static_cast<double>(tested) / queries);
+	};
+
+	// Rays
+	{
+		std::vector<Visibility::RayHit> expected(queries), got(queries);
+		const Bench::Timing scan = timeQueries(3, queries, [&] {
+			for (uint32_t i = 0; i < queries; ++i) expected[i] = bruteRaycast(vs, rays[i]);
+		});
+
+		uint64_t nodes = 0, tested = 0;
+		const Bench::Timing bvh = timeQueries(5, queries, [&] {
+			nodes = tested = 0;
+			for (uint32_t i = 0; i < queries; ++i) {
+				Visibility::QueryStats stats{};
+				got[i] = Visibility::raycastBVH(vs, rays[i], &stats);
+				nodes += stats.nodesVisited;
+				tested += stats.rowsTested;
+			}
+		});
+
+		uint32_t hits = 0;
+		for (uint32_t i = 0; i < queries; ++i) {
+			hits += expected[i].row != Visibility::ROW_INACTIVE;
+			if (got[i].row != expected[i].row || got[i].t != expected[i].t) {
+				fmt::print("[SpatialQuery] ray {}: row {} t {} vs scan row {} t {}\n", i, got[i].row, got[i].t, expected[i].row, expected[i].t);
+				ok = false;
+				break;
+			}
+		}
+		if (hits == 0) {
+			fmt::print("[SpatialQuery] no ray hit anything, the ray setup is off\n");
+			ok = false;
+		}
+		report("raycast", scan, bvh, nodes, tested);
+	}
+
+	// Batched rays against the same rays one at a time
+	{
+		std::vector<Visibility::RayHit> serial(batchRays), batched;
+		const Bench::Timing serialTiming = timeQueries(3, 1, [&] {
+			for (uint32_t i = 0; i < batchRays; ++i) serial[i] = Visibility::raycastBVH(vs, rays[i]);
+		});
+		const Bench::Timing batchTiming = timeQueries(3, 1, [&] { Visibility::raycastBVHBatch(vs, rays, batched); });
+
+		for (uint32_t i = 0; i < batchRays; ++i) {
+			if (batched[i].row != serial[i].row || batched[i].t != serial[i].t) {
+				fmt::print("[SpatialQuery] batched ray {} differs from the single ray query\n", i);
+				ok = false;
+				break;
+			}
+		}
+		Bench::record("SpatialQuery", "raycast batch", rows, "serial", serialTiming);
+		Bench::record("SpatialQuery", "raycast batch", rows, "batched", batchTiming);
+		fmt::print("{:>14} {} rays: serial {:.3f} ms, batched {:.3f} ms on {} threads\n",
+			"raycast batch", batchRays, serialTiming.median, batchTiming.median, JobSystem::getThreadCount());
+	}
+
+	// Box and sphere overlaps, radius 1 to 100
+	{
+		std::vector<glm::vec3> centers(queries);
+		std::vector<float> radii(queries);
+		for (uint32_t i = 0; i < queries; ++i) {
+			centers[i] = scenePoint();
+			radii[i] = std::pow(100.0f, unit(rng));
+		}
+
+		std::vector<std::vector<uint32_t>> expectedBox(queries), expectedSphere(queries);
+		const Bench::Timing boxScan = timeQueries(3, queries, [&] {
+			for (uint32_t i = 0; i < queries; ++i) {
+				const AABB q = Bench::makeAABB(centers[i], glm::vec3(radii[i]));
+				expectedBox[i].clear();
+				for (uint32_t row : vs.active) {
+					const AABB& b = vs.worldAABBs[row];
+					if (glm::all(glm::lessThanEqual(b.vmin, q.vmax)) && glm::all(glm::lessThanEqual(q.vmin, b.vmax)))
+						expectedBox[i].push_back(row);
+				}
+			}
+		});
+		const Bench::Timing sphereScan = timeQueries(3, queries, [&] {
+			for (uint32_t i = 0; i < queries; ++i) {
+				expectedSphere[i].clear();
+				for (uint32_t row : vs.active)
+					if (Visibility::distanceSqToAABB(centers[i], vs.worldAABBs[row]) <= radii[i] * radii[i])
+						expectedSphere[i].push_back(row);
+			}
+		});
+
+		std::vector<std::vector<uint32_t>> gotBox(queries), gotSphere(queries);
+		uint64_t boxNodes = 0, boxTested = 0, sphereNodes = 0, sphereTested = 0;
+		const Bench::Timing box = timeQueries(5, queries, [&] {
+			boxNodes = boxTested = 0;
+			for (uint32_t i = 0; i < queries; ++i) {
+				Visibility::QueryStats stats{};
+				Visibility::overlapBoxBVH(vs, Bench::makeAABB(centers[i], glm::vec3(radii[i])), gotBox[i], &stats);
+				boxNodes += stats.nodesVisited;
+				boxTested += stats.rowsTested;
+			}
+		});
+		const Bench::Timing sphere = timeQueries(5, queries, [&] {
+			sphereNodes = sphereTested = 0;
+			for (uint32_t i = 0; i < queries; ++i) {
+				Visibility::QueryStats stats{};
+				Visibility::overlapSphereBVH(vs, centers[i], radii[i], gotSphere[i], &stats);
+				sphereNodes += stats.nodesVisited;
+				sphereTested += stats.rowsTested;
+			}
+		});
+
+		for (uint32_t i = 0; i < queries; ++i) {
+			if (sortedRows(gotBox[i]) != sortedRows(expectedBox[i]) || sortedRows(gotSphere[i]) != sortedRows(expectedSphere[i])) {
+				fmt::print("[SpatialQuery] overlap {} (radius {}) differs from the scan\n", i, radii[i]);
+				ok = false;
+				break;
+			}
+		}
+		report("overlap box", boxScan, box, boxNodes, boxTested);
+		report("overlap sphere", sphereScan, sphere, sphereNodes, sphereTested);
+	}
+
+	// k nearest
+	{
+		std::vector<glm::vec3> points(queries);
+		for (glm::vec3& p : points) p = scenePoint();
+
+		std::vector<std::vector<Visibility::RowDistance>> expected(queries), got(queries);
+		const Bench::Timing scan = timeQueries(3, queries, [&] {
+			for (uint32_t i = 0; i < queries; ++i) {
+				std::vector<Visibility::RowDistance>& all = expected[i];
+				all.clear();
+				for (uint32_t row : vs.active)
+					all.push_back({ row, Visibility::distanceSqToAABB(points[i], vs.worldAABBs[row]) });
+				auto closer = [](const Visibility::RowDistance& a, const Visibility::RowDistance& b) {
+					return a.distSq < b.distSq || (a.distSq == b.distSq && a.row < b.row);
+				};
+				std::partial_sort(all.begin(), all.begin() + k, all.end(), closer);
+				all.resize(k);
+			}
+		});
+
+		uint64_t nodes = 0, tested = 0;
+		const Bench::Timing bvh = timeQueries(5, queries, [&] {
+			nodes = tested = 0;
+			for (uint32_t i = 0; i < queries; ++i) {
+				Visibility::QueryStats stats{};
+				Visibility::nearestBVH(vs, points[i], k, got[i], &stats);
+				nodes += stats.nodesVisited;
+				tested += stats.rowsTested;
+			}
+		});
+
+		for (uint32_t i = 0; i < queries; ++i) {
+			const bool same = std::equal(got[i].begin(), got[i].end(), expected[i].begin(), expected[i].end(),
+				[](const Visibility::RowDistance& a, const Visibility::RowDistance& b) { return a.row == b.row && a.distSq == b.distSq; });
+			if (!same) {
+				fmt::print("[SpatialQuery] {} nearest around point {} differ from the scan\n", k, i);
+				ok = false;
+				break;
+			}
+		}
+		report("nearest 16", scan, bvh, nodes, tested);
+
+		// k = 0 finds nothing and has to say so, not leave a reused stats block as it was
+		Visibility::QueryStats stats{};
+		Visibility::nearestBVH(vs, points[0], k, got[0], &stats);
+		Visibility::nearestBVH(vs, points[0], 0, got[0], &stats);
+		if (!got[0].empty() || stats.nodesVisited || stats.rowsTested) {
+			fmt::print("[SpatialQuery] nearest with k = 0 left rows or stats from the last query\n");
+			ok = false;
+		}
+	}
+
+	return ok;
+}
@@ -0,0 +1,83 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+#include "renderer/scene/DrawPreparation.h"
+
+namespace {
+	float distSq(const AABB& box, const glm::vec3& camPos) {
+		const glm::vec3 d = box.origin - camPos;
+		return glm::dot(d, d);
+	}
+}
+
+// 10k to 100k transparent rows spread over the world, 60 frames each. The comparator sort this
+// replaced, the radix sort on every frame, and the sort as the frame runs it: a camera walking
+// 0.1 units a frame, then one jumping 200 units a frame. Both orders have to be the same as a
+// stable sort on squared distance.
+BENCH_SUITE(TransparentSort) {
+	constexpr uint32_t frames = 60;
+	bool ok = true;
+
+	fmt::print("{:>8} {:>9} {:>11} {:>9} {:>11} {:>13} {:>10} {:>14}\n",
+		"rows", "camera", "compare ms", "radix ms", "frame ms", "insert frames", "vs radix", "vs comparator");
+
+	for (uint32_t count : { 10'000u, 25'000u, 50'000u, 100'000u }) {
+		const Bench::VisibleRows input = Bench::makeVisibleRows(count, 512, 64, 11u + count);
+		std::vector<uint32_t> rows(count);
+		std::iota(rows.begin(), rows.end(), 0u);
+
+		for (const bool walk : { true, false }) {
+			DrawBatchScratch radixScratch, frameScratch;
+			std::vector<uint32_t> compareOrder(count), reference(count);
+			std::vector<double> compareSamples, radixSamples, frameSamples;
+			uint32_t insertFrames = 0;
+
+			for (uint32_t f = 0; f < frames; ++f) {
+				const float step = walk ? 0.1f : 200.0f;
+				const glm::vec3 camPos(100.0f + step * f, 40.0f, 500.0f + std::sin(f * 0.7f) * step);
+
+				Bench::Timer t;
+				std::iota(compareOrder.begin(), compareOrder.end(), 0u);
+				std::sort(compareOrder.begin(), compareOrder.end(), [&](uint32_t ia, uint32_t ib) {
+					return glm::length(input.aabbs[rows[ia]].origin - camPos) > glm::length(input.aabbs[rows[ib]].origin - camPos);
+				});
+				compareSamples.push_back(t.ms());
+
+				// No history, so the radix sort runs every time
+				radixScratch.lastTransparentOrder.clear();
+				t = Bench::Timer();
+				DrawPreparation::sortTransparentRows(radixScratch, rows.data(), count, input.aabbs, camPos);
+				radixSamples.push_back(t.ms());
+
+				t = Bench::Timer();
+				insertFrames += DrawPreparation::sortTransparentRows(frameScratch, rows.data(), count, input.aabbs, camPos) ? 1u : 0u;
+				frameSamples.push_back(t.ms());
+
+				std::iota(reference.begin(), reference.end(), 0u);
+				std::stable_sort(reference.begin(), reference.end(), [&](uint32_t ia, uint32_t ib) {
+					return distSq(input.aabbs[rows[ia]], camPos) > distSq(input.aabbs[rows[ib]], camPos);
+				});
+				if (ok && (radixScratch.transparentOrder != reference || frameScratch.transparentOrder != reference)) {
+					fmt::print("[TransparentSort] {} rows frame {}: order isn't a stable back to front sort\n", count, f);
+					ok = false;
+				}
+			}
+			if (walk && insertFrames < frames - 1) {
+				fmt::print("[TransparentSort] {} rows: only {} of {} walking frames took the insertion pass\n", count, insertFrames, frames);
+				ok = false;
+			}
+
+			const char* camera = walk ? "walk" : "jump";
+			const Bench::Timing compare = Bench::summarize(compareSamples);
+			const Bench::Timing radix = Bench::summarize(radixSamples);
+			const Bench::Timing frame = Bench::summarize(frameSamples);
+			Bench::record("TransparentSort", fmt::format("comparator {}", camera), count, "sort", compare);
+			Bench::record("TransparentSort", fmt::format("radix {}", camera), count, "sort", radix);
+			Bench::record("TransparentSort", fmt::format("frame {}", camera), count, "sort", frame);
+			fmt::print("{:>8} {:>9} {:>11.3f} {:>9.3f} {:>11.3f} {:>13} {:>9.2f}x {:>13.2f}x\n", count, camera,
+				compare.median, radix.median, frame.median, insertFrames, radix.median / frame.median, compare.median / frame.median);
+		}
+	}
+
+	return ok;
+}
@@ -0,0 +1,299 @@
+#include "pch.h"
+
+#include "BenchCommon.h"
+#include "renderer/scene/TwoLevelBVH.h"
+
+namespace {
+	constexpr uint32_t MODEL_COUNT = 4;
+	constexpr uint32_t PRIMITIVES = 100;
+	constexpr uint32_t CAPACITY_COPIES = 512;
+
+	// Models of PRIMITIVES parts under their own node transforms, copies scattered over the
+	// ground with a random turn. Rows and transforms are laid out like syncFromGlobalInstances
+	// bakes them, every part has its own transform slot.
+	struct CopyScene {
+		Visibility::VisibilityState vs;
+		std::vector<GlobalInstance> gis;
+		std::vector<GPUMeshData> meshes;
+		std::vector<glm::mat4> transforms;
+		std::vector<glm::mat4> nodes; // per model and slot, relative to the copy's placement
+		std::mt19937 rng{ 12u };
+	};
+
+	glm::mat4 randomPlacement(std::mt19937& rng) {
+		std::uniform_real_distribution<float> unit(-0.5f, 0.5f);
+		return glm::translate(glm::mat4(1.0f), glm::vec3(unit(rng) * 1000.0f, 0.0f, unit(rng) * 1000.0f))
+			* glm::rotate(glm::mat4(1.0f), unit(rng) * glm::two_pi<float>(), glm::vec3(0.0f, 1.0f, 0.0f))
+			* glm::scale(glm::mat4(1.0f), glm::vec3(1.0f + unit(rng)));
+	}
+
+	// Places the next copy of model m and writes its rows at the end
+	void addCopy(CopyScene& scene, uint32_t m) {
+		GlobalInstance& gi = scene.gis[m];
+		Visibility::VisibilityState& vs = scene.vs;
+		Visibility::CoreSlab& slab = vs.slabs[static_cast<SceneID>(m)];
+		const uint32_t c = gi.usedCopies;
+		ASSERT(c < CAPACITY_COPIES);
+
+		const glm::mat4 placement = randomPlacement(scene.rng);
+		const uint32_t first = static_cast<uint32_t>(vs.instances.size());
+		slab.copyFirst.push_back(first);
+
+		for (uint32_t local = 0; local < PRIMITIVES; ++local) {
+			const uint32_t tid = gi.firstTransform + c * gi.transformCount + local;
+			scene.transforms[tid] = placement * scene.nodes[m * PRIMITIVES + local];
+
+			GPUInstance row{};
+			row.meshID = (m * 17 + local) % scene.meshes.size();
+			row.materialID = local % 8;
+			row.transformID = tid;
+			vs.instances.push_back(row);
+			vs.transformIDs.push_back(tid);
+			vs.worldAABBs.push_back(Visibility::transformAABB(scene.meshes[row.meshID].localAABB, scene.transforms[tid]));
+			Visibility::setRowActive(vs, first + local, true);
+		}
+
+		gi.usedCopies = c + 1;
+		slab.usedCopies = gi.usedCopies;
+	}
+
+	CopyScene makeCopyScene(uint32_t copiesPerModel) {
+		CopyScene scene;
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+		scene.meshes.resize(64);
+		for (GPUMeshData& mesh : scene.meshes) {
+			const glm::vec3 e = glm::abs(glm::vec3(unit(scene.rng), unit(scene.rng), unit(scene.rng))) * 0.6f + 0.1f;
+			mesh.localAABB = Bench::makeAABB(glm::vec3(unit(scene.rng), unit(scene.rng), unit(scene.rng)) * 0.2f, e);
+		}
+
+		// Parts spread over a few meters and turned against each other, a prop or a vehicle
+		for (uint32_t i = 0; i < MODEL_COUNT * PRIMITIVES; ++i) {
+			const glm::vec3 axis = glm::normalize(glm::vec3(unit(scene.rng), unit(scene.rng), unit(scene.rng)) + glm::vec3(0.0f, 1e-3f, 0.0f));
+			scene.nodes.push_back(
+				glm::translate(glm::mat4(1.0f), glm::vec3(unit(scene.rng) * 3.0f, 1.0f + unit(scene.rng), unit(scene.rng) * 3.0f))
+				* glm::rotate(glm::mat4(1.0f), unit(scene.rng) * glm::pi<float>(), axis));
+		}
+
+		scene.transforms.resize(MODEL_COUNT * CAPACITY_COPIES * PRIMITIVES);
+		for (uint32_t m = 0; m < MODEL_COUNT; ++m) {
+			GlobalInstance gi{};
+			gi.instanceID = m;
+			gi.sceneID = static_cast<uint8_t>(m);
+			gi.drawType = DrawType::DrawMultiStatic;
+			gi.firstTransform = m * CAPACITY_COPIES * PRIMITIVES;
+			gi.transformCount = PRIMITIVES;
+			gi.perInstanceStride = PRIMITIVES;
+			gi.usedCopies = 0;
+			gi.capacityCopies = CAPACITY_COPIES;
+			scene.gis.push_back(gi);
+
+			Visibility::CoreSlab slab{ static_cast<uint32_t>(scene.vs.instances.size()), PRIMITIVES, 0 };
+			scene.vs.slabs[static_cast<SceneID>(m)] = slab;
+			for (uint32_t c = 0; c < copiesPerModel; ++c) addCopy(scene, m);
+		}
+		return scene;
+	}
+
+	// Separating plane or axis between a part's oriented box and the frustum: the box corners
+	// behind a world plane, or the frustum corners past one face of the box in model space or
+	// of its world bounds. A cull may drop the part only when one exists.
+	bool provablyOutside(const AABB& local, const glm::mat4& modelToWorld, const Frustum& frus) {
+		constexpr float eps = 1e-3f;
+
+		glm::vec3 corners[8];
+		for (uint32_t c = 0; c < 8; ++c) {
+			const glm::vec3 p((c & 1) ? local.vmax.x : local.vmin.x, (c & 2) ? local.vmax.y : local.vmin.y, (c & 4) ? local.vmax.z : local.vmin.z);
+			corners[c] = glm::vec3(modelToWorld * glm::vec4(p, 1.0f));
+		}
+		for (const glm::vec4& plane : frus.planes) {
+			bool behind = true;
+			for (const glm::vec3& p : corners) behind = behind && glm::dot(glm::vec3(plane), p) + plane.w < eps;
+			if (behind) return true;
+		}
+
+		const AABB world = Visibility::transformAABB(local, modelToWorld);
+		const glm::mat4 worldToModel = glm::inverse(modelToWorld);
+		for (int axis = 0; axis < 3; ++axis) {
+			bool above = true, below = true, aboveLocal = true, belowLocal = true;
+			for (const glm::vec4& point : frus.points) {
+				const glm::vec3 p(point);
+				const glm::vec3 q(worldToModel * glm::vec4(p, 1.0f));
+				above = above && p[axis] > world.vmax[axis] - eps;
+				below = below && p[axis] < world.vmin[axis] + eps;
+				aboveLocal = aboveLocal && q[axis] > local.vmax[axis] - eps;
+				belowLocal = belowLocal && q[axis] < local.vmin[axis] + eps;
+			}
+			if (above || below || aboveLocal || belowLocal) return true;
+		}
+		return false;
+	}
+
+	// Brute force reference for the two-level cull: every live copy's primitives as model space
+	// boxes against the frustum moved into model space, no trees involved
+	std::vector<uint32_t> referenceTwoLevel(const Visibility::SceneTLAS& tlas, const Visibility::VisibilityState& vs, const Frustum& frus) {
+		std::vector<uint32_t> ids;
+		for (uint32_t row : tlas.top.active) {
+			const Visibility::ModelBLAS& blas = tlas.models[tlas.rowModel[row]];
+			if (!Visibility::boxInFrustum(tlas.top.worldAABBs[row], frus)) continue;
+
+			const Frustum local = Visibility::transformFrustum(frus, tlas.modelToWorld[row], tlas.worldToModel[row]);
+			for (uint32_t prim = 0; prim < blas.stride; ++prim)
+				if (Visibility::boxInFrustum(blas.tree.worldAABBs[prim], local))
+					ids.push_back(vs.instances[tlas.rowFirst[row] + prim].transformID);
+		}
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	}
+}
+
+// 4 models of 100 parts, 250 copies each (100k rows): flat tree against a bottom-level tree per
+// model under a top level of copies. Build, adding copies one at a time, dropping them, cull.
+// The two-level cull has to match its brute force reference after every edit.
+BENCH_SUITE(TwoLevel) {
+	bool ok = true;
+	constexpr uint32_t copies = 250;
+	constexpr uint32_t grow = 64;
+
+	CopyScene scene = makeCopyScene(copies);
+	Visibility::VisibilityState& vs = scene.vs;
+	Visibility::SceneTLAS tlas;
+
+	const double flatBuildMs = Bench::medianMs(3, [&] { Visibility::buildBVH(vs); });
+	const double tlasBuildMs = Bench::medianMs(3, [&] {
+		tlas.cleanup();
+		Visibility::syncSceneTLAS(tlas, vs, scene.gis, scene.meshes, scene.transforms);
+	});
+
+	const std::vector<Frustum> frustums = Bench::makeFrustums(32, 5u);
+	std::vector<GPUInstance> flat, twoLevel;
+	std::vector<AABB> flatAABBs, twoLevelAABBs;
+	Visibility::TwoLevelCullScratch scratch;
+
+	auto check = [&](const char* when) {
+		for (uint32_t i = 0; i < 8; ++i) {
+			Visibility::cullTwoLevelCollect(tlas, vs, frustums[i], twoLevel, twoLevelAABBs, scratch);
+			if (Bench::sortedTransformIDs(twoLevel) != referenceTwoLevel(tlas, vs, frustums[i])) {
+				fmt::print("[TwoLevel] {}: frustum {} differs from its reference\n", when, i);
+				ok = false;
+			}
+		}
+	};
+	check("build");
+
+	// Copies one at a time: rows for the flat tree, one row for the top level
+	std::vector<double> flatAdd, tlasAdd;
+	for (uint32_t i = 0; i < grow; ++i) {
+		const uint32_t firstRow = static_cast<uint32_t>(vs.instances.size());
+		addCopy(scene, i % MODEL_COUNT);
+
+		VisibilitySyncResult added{};
+		added.topologyChanged = true;
+		for (uint32_t row = firstRow; row < vs.instances.size(); ++row) added.addedRows.push_back(row);
+
+		Bench::Timer flatTimer;
+		Visibility::applySyncResult(vs, added);
+		flatAdd.push_back(flatTimer.ms());
+
+		Bench::Timer tlasTimer;
+		Visibility::syncSceneTLAS(tlas, vs, scene.gis, scene.meshes, scene.transforms);
+		tlasAdd.push_back(tlasTimer.ms());
+	}
+	check("grow");
+
+	// And back down, the lazy shrink keeps the rows for regrowth
+	std::vector<double> flatDrop, tlasDrop;
+	for (uint32_t i = 0; i < grow; ++i) {
+		GlobalInstance& gi = scene.gis[i % MODEL_COUNT];
+		Visibility::CoreSlab& slab = vs.slabs[static_cast<SceneID>(gi.sceneID)];
+		--gi.usedCopies;
+		--slab.usedCopies;
+
+		VisibilitySyncResult dropped{};
+		dropped.topologyChanged = true;
+		const uint32_t first = slab.copyFirst[gi.usedCopies];
+		for (uint32_t row = first; row < first + PRIMITIVES; ++row) {
+			Visibility::setRowActive(vs, row, false);
+			dropped.removedRows.push_back(row);
+		}
+
+		Bench::Timer flatTimer;
+		Visibility::applySyncResult(vs, dropped);
+		flatDrop.push_back(flatTimer.ms());
+
+		Bench::Timer tlasTimer;
+		Visibility::syncSceneTLAS(tlas, vs, scene.gis, scene.meshes, scene.transforms);
+		tlasDrop.push_back(tlasTimer.ms());
+	}
+	check("shrink");
+
+	// The row counts aren't expected to match. The flat cull tests each part's world AABB, loose
+	// around the turned part, so it keeps parts whose oriented box misses the frustum. The two-level
+	// cull tests the tight model space box against the moved planes, but takes the frustum corner
+	// check along model axes only, so it keeps parts the world axes separate. Neither set holds
+	// the other: every row only one of them keeps has to be provably outside the frustum.
+	std::vector<uint32_t> rowOfTransform(scene.transforms.size(), UINT32_MAX);
+	for (uint32_t row : vs.active) rowOfTransform[vs.transformIDs[row]] = row;
+
+	uint64_t flatRows = 0, twoLevelRows = 0, flatNodes = 0, twoLevelNodes = 0, flatOnly = 0, twoLevelOnly = 0;
+	std::vector<uint32_t> flatOnlyIDs, twoLevelOnlyIDs;
+	for (uint32_t f = 0; f < frustums.size(); ++f) {
+		const Frustum& frus = frustums[f];
+		Visibility::CullStats flatStats{}, twoLevelStats{};
+		Visibility::cullBVHCollect(vs, frus, flat, flatAABBs, &flatStats);
+		Visibility::cullTwoLevelCollect(tlas, vs, frus, twoLevel, twoLevelAABBs, scratch, &twoLevelStats);
+		flatRows += flat.size();
+		twoLevelRows += twoLevel.size();
+		flatNodes += flatStats.nodesVisited;
+		twoLevelNodes += twoLevelStats.nodesVisited;
+
+		const std::vector<uint32_t> flatIDs = Bench::sortedTransformIDs(flat);
+		const std::vector<uint32_t> twoLevelIDs = Bench::sortedTransformIDs(twoLevel);
+		flatOnlyIDs.clear();
+		twoLevelOnlyIDs.clear();
+		std::set_difference(flatIDs.begin(), flatIDs.end(), twoLevelIDs.begin(), twoLevelIDs.end(), std::back_inserter(flatOnlyIDs));
+		std::set_difference(twoLevelIDs.begin(), twoLevelIDs.end(), flatIDs.begin(), flatIDs.end(), std::back_inserter(twoLevelOnlyIDs));
+		flatOnly += flatOnlyIDs.size();
+		twoLevelOnly += twoLevelOnlyIDs.size();
+
+		for (const std::vector<uint32_t>* ids : { &flatOnlyIDs, &twoLevelOnlyIDs }) {
+			for (uint32_t tid : *ids) {
+				const uint32_t row = rowOfTransform[tid];
+				if (row != UINT32_MAX && provablyOutside(scene.meshes[vs.instances[row].meshID].localAABB, scene.transforms[tid], frus))
+					continue;
+				fmt::print("[TwoLevel] frustum {}: the {} cull dropped transform {}, which may be visible\n",
+					f, ids == &flatOnlyIDs ? "two-level" : "flat", tid);
+				ok = false;
+			}
+		}
+	}
+
+	const double flatCullMs = Bench::medianMs(5, [&] {
+		for (const Frustum& frus : frustums) Visibility::cullBVHCollect(vs, frus, flat, flatAABBs);
+	}) / frustums.size();
+	const double tlasCullMs = Bench::medianMs(5, [&] {
+		for (const Frustum& frus : frustums) Visibility::cullTwoLevelCollect(tlas, vs, frus, twoLevel, twoLevelAABBs, scratch);
+	}) / frustums.size();
+
+	const uint32_t rows = static_cast<uint32_t>(vs.active.size());
+	const Bench::Timing flatAddTiming = Bench::summarize(flatAdd), tlasAddTiming = Bench::summarize(tlasAdd);
+	const Bench::Timing flatDropTiming = Bench::summarize(flatDrop), tlasDropTiming = Bench::summarize(tlasDrop);
+	Bench::record("TwoLevel", "flat", rows, "add_copy", flatAddTiming);
+	Bench::record("TwoLevel", "two_level", rows, "add_copy", tlasAddTiming);
+	Bench::record("TwoLevel", "flat", rows, "drop_copy", flatDropTiming);
+	Bench::record("TwoLevel", "two_level", rows, "drop_copy", tlasDropTiming);
+
+	const double views = static_cast<double>(frustums.size());
+	fmt::print("{:>10} {:>9} {:>9} {:>10} {:>10} {:>9} {:>10} {:>10}\n",
+		"tree", "nodes", "build ms", "add copy", "drop copy", "cull ms", "rows/view", "nodes/view");
+	fmt::print("{:>10} {:>9} {:>9.3f} {:>10.4f} {:>10.4f} {:>9.3f} {:>10.0f} {:>10.0f}\n",
+		"flat", vs.bvh.size(), flatBuildMs, flatAddTiming.median, flatDropTiming.median,
+		flatCullMs, flatRows / views, flatNodes / views);
+	fmt::print("{:>10} {:>9} {:>9.3f} {:>10.4f} {:>10.4f} {:>9.3f} {:>10.0f} {:>10.0f}\n",
+		"two-level", tlas.top.bvh.size() + tlas.models.size() * tlas.models[0].tree.bvh.size(), tlasBuildMs,
+		tlasAddTiming.median, tlasDropTiming.median, tlasCullMs, twoLevelRows / views, twoLevelNodes / views);
+	fmt::print("rows/view only one cull keeps: flat {:.1f}, two-level {:.1f}\n",
+		flatOnly / views, twoLevelOnly / views);
+
+	return ok;
+}
@@ -6,6 +6,7 @@
 constexpr uint32_t MAX_DRAWS = 65536;
 constexpr uint32_t MAX_VISIBLE_TRANSFORMS = MAX_DRAWS;
 constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+constexpr uint32_t MAX_MESH_LODS = 4; // level 0 is the source mesh
 
 // Default spawn with loading
 constexpr glm::vec3 SPAWNPOINT(1, 1, 1);
@@ -48,4 +49,5 @@ constexpr uint32_t JOB_WORKER_COUNT = MAX_THREADS;
 // add gpu sorting, fix the visible count and visiblemeshIds read and write buffer shit
 // draws will have to be fully built on gpu for this to properly work
 // gpu accel is fucking busted
+// Async compute queue only, GPUCull runs the frustum cull inline on the graphics queue
 const static bool GPU_ACCELERATION_ENABLED = false;
\ No newline at end of file
@@ -289,17 +289,29 @@ struct AllocatedBuffer {
 	uint8_t qmask = 0; // bit0=graphics, bit1=transfer, bit2=compute
 };
 
+// GPU frustum cull push constants, shared by frustum_cull_comp and cull_compact_comp
 struct alignas(16) CullingPushConstantsAddrs {
 	glm::vec4 frusPlanes[6];
-	uint64_t meshIDBufferAddr;
-	uint64_t visibleMeshOutBufferAddr;
+	uint64_t rowBufferAddr;   // Visibility::CullRow per active row
+	uint64_t batchBufferAddr; // Visibility::CullBatch per batch
 	glm::vec4 frusPoints[8];
-	uint64_t visibleCountOutBufferAddr;
-	uint32_t meshCount;
-	uint32_t rebuildTransforms;
+	uint64_t countBufferAddr; // draw counts, then instance counts per batch
+	uint32_t rowCount;
+	uint32_t batchCount;
 };
 static_assert(sizeof(CullingPushConstantsAddrs) == 256);
 
+// GPU batching push constants, shared by batch_count_comp, batch_scan_comp and batch_scatter_comp
+struct BatchPushConstantsAddrs {
+	uint64_t rowBufferAddr;     // Visibility::CullRow per active row
+	uint64_t batchBufferAddr;   // Visibility::CullBatch per batch
+	uint64_t countBufferAddr;   // draw counts, then instance counts per batch
+	uint64_t visibleRowsAddr;   // batch table entry of each visible row
+	uint32_t visibleCount;
+	uint32_t batchCount;
+};
+static_assert(sizeof(BatchPushConstantsAddrs) == 40);
+
 // Opaque and transparent distinction in shared instance/indirectcmd buffers
 struct PassRange {
 	uint32_t first = 0;
@@ -312,17 +324,45 @@ struct DirtyRange { uint32_t offset; uint32_t count; };
 
 // === Per-frame sync ===
 // Compares current GlobalInstance.usedCopies/firstTransform to visState.slabs and decides:
-//  - grow: appendSceneCopies + buildBVH()
-//  - shrink: shrinkSceneCopiesLazy + buildBVH()
+//  - first bake / grow: bakeCoreSceneMeshes or appendSceneCopies, rows go in addedRows
+//  - shrink: shrinkSceneCopiesLazy, rows go in removedRows
 //  - relocate-only: rewriteSceneSlice + refitBVH()
 //  - no change: do nothing
-// Returns whether topology changed or a refit-only is needed, plus any transform upload ranges.
+// Returns the rows that entered or left the tree, whether a refit is needed, plus any transform upload ranges.
 struct VisibilitySyncResult {
-	bool topologyChanged = false;   // grew/shrank -> call buildBVH()
-	bool refitOnly = false;         // only transforms changed -> call refitBVH()
+	bool topologyChanged = false;   // rows added/removed -> BVH edited in place, or rebuilt when the delta is large
+	bool refitOnly = false;         // transforms changed -> call refitBVH()
+	std::vector<uint32_t> addedRows;
+	std::vector<uint32_t> removedRows;
 	std::vector<DirtyRange> dirtyTransformRanges; // for GPU uploads
 };
 
+// How Visibility::buildBVH splits rows when the tree is rebuilt
+enum class BVHBuildMode : uint8_t {
+	Median,    // centroid median on the longest axis, cheapest build
+	BinnedSAH, // binned surface area heuristic, tighter nodes for uneven object sizes
+	LBVH,      // Morton order of the centroids, a sort and one pass, for scenes that all move
+	Count
+};
+
+// Node layout the CPU cull walks, the binary tree is always built first
+enum class BVHLayout : uint8_t {
+	Binary,        // BVHNode tree, also used by the parallel cull
+	BVH4,          // collapsed 4-wide nodes, SoA child bounds, stackless walk
+	BVH4Quantized, // same with child bounds as 16-bit steps inside the parent
+	Count
+};
+
+// Order of the CPU path's opaque draws, front to back cuts fragment work behind early depth
+// tests against keeping batches whole
+enum class OpaqueOrder : uint8_t {
+	Batched,     // material, mesh, level order
+	FrontToBack, // whole batches, nearest first by their nearest row
+	SortedRows,  // same, with the rows inside each batch nearest first too
+	DepthSlices, // sorted rows, batches cut where the rows' depth bucket changes
+	Count
+};
+
 // Virtual control over instances, enables true instancing with unique transforms
 struct GlobalInstance {
 	uint32_t instanceID = UINT32_MAX; // flat list
@@ -343,8 +383,28 @@ struct UploadMeshContext {
 	std::vector<Vertex> globalVertices;
 };
 
+// Index range of one detail level, every level shares the mesh's vertices
+struct MeshLODRange {
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+};
+
+struct MeshLODs {
+	MeshLODRange levels[MAX_MESH_LODS];
+	uint32_t count = 1;
+};
+
+// Box in mesh space that the mesh covers on screen from every side, only closed convex meshes
+// have one. The CPU occlusion cull rasterizes it in place of the mesh.
+struct MeshOccluder {
+	AABB box{};
+	bool solid = false;
+};
+
 struct MeshRegistry {
 	std::vector<GPUMeshData> meshData;
+	std::vector<MeshLODs> meshLODs; // parallel to meshData, CPU only
+	std::vector<MeshOccluder> meshOccluders; // parallel to meshData, CPU only
 
 	// holds a linear list of meshIDs for gpu access
 	AllocatedBuffer meshIDBuffer;
@@ -360,11 +420,13 @@ struct MeshRegistry {
 		return ids;
 	}
 
-	inline uint32_t registerMesh(const GPUMeshData& data) {
+	inline uint32_t registerMesh(const GPUMeshData& data, const MeshLODs& lods, const MeshOccluder& occluder) {
 		uint32_t id = static_cast<uint32_t>(meshData.size());
 		ASSERT(id != std::numeric_limits<uint32_t>::max() && "MeshRegistry: MeshID overflow!");
 
 		meshData.push_back(data);
+		meshLODs.push_back(lods);
+		meshOccluders.push_back(occluder);
 		return id;
 	}
 };
@@ -428,7 +490,15 @@ struct DescriptorWriter {
 	void writeBuffer(uint32_t binding, VkBuffer buffer, size_t size, size_t offset, VkDescriptorType type, VkDescriptorSet set);
 	void writeImages(uint32_t binding, DescriptorImageType type, VkDescriptorSet set);
 
-	void clear();
+	void clear() {
+		imageWriteGroups.clear();
+		bufferWrites.clear();
+		writeBufferIndices.clear();
+		bufferInfos.clear();
+		samplerCubeDescriptors.clear();
+		storageDescriptors.clear();
+		combinedDescriptors.clear();
+	}
 
 	~DescriptorWriter() { clear(); }
 
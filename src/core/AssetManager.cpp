@@ -5,6 +5,7 @@
 #include "renderer/Renderer.h"
 #include "utils/VulkanUtils.h"
 #include "utils/BufferUtils.h"
+#include "core/loader/MeshLOD.h"
 
 namespace AssetManager {
 	bool isValidMaterial(const fastgltf::Material& mat, const fastgltf::Asset& gltf);
@@ -581,7 +582,11 @@ void AssetManager::processMeshes(
 				newMesh.localAABB.extent = (vmax - vmin) * 0.5f;
 				newMesh.localAABB.sphereRadius = glm::length(newMesh.localAABB.extent);
 
-				inst->meshID = meshes.registerMesh(newMesh);
+				// Coarser levels go on the end of the index list, behind this primitive's own range
+				const MeshLODs lods = MeshLOD::buildLODs(vertices, indices, newMesh);
+				const MeshOccluder occluder = MeshLOD::buildOccluder(vertices, indices, newMesh);
+
+				inst->meshID = meshes.registerMesh(newMesh, lods, occluder);
 				scene.runtime.bakedInstances.push_back(inst);
 				scene.runtime.bakedNodeIDs.push_back(nodeIdx);
 			}
@@ -20,6 +20,10 @@ namespace ResourceManager {
 	AllocatedImage& getMSAAImage() { return _msaaImage; }
 	AllocatedImage _toneMappingImage;
 	AllocatedImage& getToneMappingImage() { return _toneMappingImage; }
+	AllocatedImage _depthResolveImage;
+	AllocatedImage& getDepthResolveImage() { return _depthResolveImage; }
+	AllocatedImage _depthPyramidImage;
+	AllocatedImage& getDepthPyramidImage() { return _depthPyramidImage; }
 	ColorData toneMappingData;
 
 	// Grabbed during physical device selection
@@ -217,6 +221,8 @@ void ResourceManager::initRenderImages(
 
 	VkImageUsageFlags depthImageUsages{};
 	depthImageUsages |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	if (!MSAA_ENABLED)
+		depthImageUsages |= VK_IMAGE_USAGE_SAMPLED_BIT; // read directly by the depth pyramid
 
 	ImageUtils::createRenderImage(
 		device,
@@ -225,6 +231,42 @@ void ResourceManager::initRenderImages(
 		sampleCount,
 		queue,
 		allocator);
+
+	// single sample depth the msaa depth resolves into, source of the depth pyramid
+	if (MSAA_ENABLED) {
+		_depthResolveImage.imageFormat = _depthImage.imageFormat;
+		_depthResolveImage.imageExtent = drawExtent;
+
+		VkImageUsageFlags depthResolveUsages{};
+		depthResolveUsages |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		depthResolveUsages |= VK_IMAGE_USAGE_SAMPLED_BIT;
+
+		ImageUtils::createRenderImage(
+			device,
+			_depthResolveImage,
+			depthResolveUsages,
+			VK_SAMPLE_COUNT_1_BIT,
+			queue,
+			allocator);
+	}
+
+	// max depth pyramid for gpu occlusion culling, one storage view per level
+	_depthPyramidImage.imageFormat = VK_FORMAT_R32_SFLOAT;
+	_depthPyramidImage.imageExtent = drawExtent;
+	_depthPyramidImage.mipmapped = true;
+	_depthPyramidImage.perMipStorageViews = true;
+
+	VkImageUsageFlags pyramidUsages{};
+	pyramidUsages |= VK_IMAGE_USAGE_STORAGE_BIT;
+	pyramidUsages |= VK_IMAGE_USAGE_SAMPLED_BIT;
+
+	ImageUtils::createRenderImage(
+		device,
+		_depthPyramidImage,
+		pyramidUsages,
+		VK_SAMPLE_COUNT_1_BIT,
+		queue,
+		allocator);
 }
 
 void ResourceManager::initEnvironmentImages(
@@ -94,6 +94,8 @@ namespace ResourceManager {
 	AllocatedImage& getDepthImage();
 	AllocatedImage& getMSAAImage();
 	AllocatedImage& getToneMappingImage();
+	AllocatedImage& getDepthResolveImage();
+	AllocatedImage& getDepthPyramidImage();
 	extern ColorData toneMappingData;
 	std::vector<VkSampleCountFlags>& getAvailableSampleCounts();
 	void initRenderImages(
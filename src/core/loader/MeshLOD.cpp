@@ -0,0 +1,145 @@
+#include "pch.h"
+
+#include "MeshLOD.h"
+
+#include <map>
+
+MeshLODs MeshLOD::buildLODs(
+	const std::vector<Vertex>& vertices,
+	std::vector<uint32_t>& indices,
+	const GPUMeshData& mesh)
+{
+	MeshLODs lods{};
+	lods.levels[0] = { mesh.firstIndex, mesh.indexCount };
+
+	if (mesh.indexCount / 3 < LOD_MIN_TRIANGLES) return lods;
+
+	const AABB& box = mesh.localAABB;
+	const float longest = std::max({ box.vmax.x - box.vmin.x, box.vmax.y - box.vmin.y, box.vmax.z - box.vmin.z });
+	if (longest <= 0.0f) return lods;
+
+	std::vector<uint32_t> remap(mesh.vertexCount);
+	std::vector<uint32_t> lodIndices;
+	std::unordered_map<uint64_t, uint32_t> cellVertex;
+	cellVertex.reserve(mesh.vertexCount);
+
+	for (uint32_t grid = LOD_BASE_GRID; lods.count < MAX_MESH_LODS && grid >= 2; grid /= 2) {
+		const float cellSize = longest / static_cast<float>(grid);
+
+		// First vertex to land in a cell stands in for the rest of it
+		cellVertex.clear();
+		for (uint32_t v = 0; v < mesh.vertexCount; ++v) {
+			const glm::vec3 cell = glm::floor((vertices[mesh.vertexOffset + v].position - box.vmin) / cellSize);
+			const uint64_t key =
+				(static_cast<uint64_t>(static_cast<uint32_t>(cell.x) & 0x1FFFFF) << 42) |
+				(static_cast<uint64_t>(static_cast<uint32_t>(cell.y) & 0x1FFFFF) << 21) |
+				static_cast<uint64_t>(static_cast<uint32_t>(cell.z) & 0x1FFFFF);
+			remap[v] = cellVertex.try_emplace(key, v).first->second;
+		}
+
+		const MeshLODRange prev = lods.levels[lods.count - 1];
+		lodIndices.clear();
+		for (uint32_t i = 0; i + 2 < prev.indexCount; i += 3) {
+			const uint32_t a = remap[indices[prev.firstIndex + i]];
+			const uint32_t b = remap[indices[prev.firstIndex + i + 1]];
+			const uint32_t c = remap[indices[prev.firstIndex + i + 2]];
+			if (a == b || b == c || a == c) continue;
+
+			lodIndices.push_back(a);
+			lodIndices.push_back(b);
+			lodIndices.push_back(c);
+		}
+
+		const auto lodCount = static_cast<uint32_t>(lodIndices.size());
+		if (lodCount == 0 || lodCount > static_cast<uint32_t>(prev.indexCount * (1.0f - LOD_MIN_REDUCTION))) {
+			// A coarser grid only merges more, try it before giving up on this mesh
+			if (lodCount == 0) break;
+			continue;
+		}
+
+		lods.levels[lods.count++] = { static_cast<uint32_t>(indices.size()), lodCount };
+		indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+	}
+
+	return lods;
+}
+
+MeshOccluder MeshLOD::buildOccluder(
+	const std::vector<Vertex>& vertices,
+	const std::vector<uint32_t>& indices,
+	const GPUMeshData& mesh)
+{
+	MeshOccluder occluder{};
+	const uint32_t triangles = mesh.indexCount / 3;
+	if (triangles < 4 || triangles > OCCLUDER_MAX_TRIANGLES) return occluder;
+
+	const AABB& bounds = mesh.localAABB;
+	const float longest = std::max({ bounds.extent.x, bounds.extent.y, bounds.extent.z }) * 2.0f;
+	if (longest <= 0.0f) return occluder;
+	const float eps = longest * 1e-4f;
+
+	// Seams split vertices by normal and uv, welding by position finds the shared edges again
+	std::vector<uint32_t> weld(mesh.vertexCount);
+	std::vector<glm::vec3> points;
+	{
+		std::map<std::array<float, 3>, uint32_t> byPosition;
+		for (uint32_t v = 0; v < mesh.vertexCount; ++v) {
+			const glm::vec3& p = vertices[mesh.vertexOffset + v].position;
+			const auto [it, added] = byPosition.try_emplace(std::array<float, 3>{ p.x, p.y, p.z }, static_cast<uint32_t>(points.size()));
+			if (added) points.push_back(p);
+			weld[v] = it->second;
+		}
+	}
+
+	// Closed: every edge borders exactly two triangles
+	std::unordered_map<uint64_t, uint32_t> edgeUses;
+	edgeUses.reserve(mesh.indexCount);
+	std::vector<glm::vec4> planes;
+	planes.reserve(triangles);
+	for (uint32_t t = 0; t < triangles; ++t) {
+		const uint32_t* tri = &indices[mesh.firstIndex + t * 3];
+		const uint32_t w[3] = { weld[tri[0]], weld[tri[1]], weld[tri[2]] };
+		if (w[0] == w[1] || w[1] == w[2] || w[0] == w[2]) return occluder;
+
+		for (uint32_t e = 0; e < 3; ++e) {
+			const uint32_t a = std::min(w[e], w[(e + 1) % 3]);
+			const uint32_t b = std::max(w[e], w[(e + 1) % 3]);
+			++edgeUses[(static_cast<uint64_t>(a) << 32) | b];
+		}
+
+		const glm::vec3 n = glm::cross(points[w[1]] - points[w[0]], points[w[2]] - points[w[0]]);
+		const float len = glm::length(n);
+		if (len <= eps * eps) continue; // sliver, its neighbours carry the surface
+		const glm::vec3 unit = n / len;
+		planes.emplace_back(unit, -glm::dot(unit, points[w[0]]));
+	}
+	for (const auto& [edge, uses] : edgeUses)
+		if (uses != 2) return occluder;
+
+	glm::vec3 centroid(0.0f);
+	for (const glm::vec3& p : points) centroid += p;
+	centroid /= static_cast<float>(points.size());
+
+	// Convex: every point on the centroid's side of every plane. The box then fits by its
+	// support distance along each plane normal.
+	float scale = 1.0f;
+	for (glm::vec4 plane : planes) {
+		if (glm::dot(glm::vec3(plane), centroid) + plane.w > 0.0f) plane = -plane;
+
+		for (const glm::vec3& p : points)
+			if (glm::dot(glm::vec3(plane), p) + plane.w > eps) return occluder;
+
+		const float room = -(glm::dot(glm::vec3(plane), centroid) + plane.w) - eps;
+		const float reach = glm::dot(glm::abs(glm::vec3(plane)), bounds.extent);
+		if (reach > 0.0f) scale = std::min(scale, room / reach);
+	}
+	if (scale < OCCLUDER_MIN_SCALE) return occluder;
+
+	occluder.box.origin = centroid;
+	occluder.box.extent = bounds.extent * scale;
+	occluder.box.vmin = centroid - occluder.box.extent;
+	occluder.box.vmax = centroid + occluder.box.extent;
+	occluder.box.sphereRadius = glm::length(occluder.box.extent);
+	occluder.solid = true;
+	return occluder;
+}
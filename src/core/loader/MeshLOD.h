@@ -0,0 +1,35 @@
+#pragma once
+
+#include "common/ResourceTypes.h"
+
+// Coarser index lists for distant draws, made by vertex clustering. Vertices are snapped to a
+// grid over the mesh bounds, each cell keeps one existing vertex, and triangles that collapse
+// are dropped. No new vertices are made, so every level draws with the mesh's vertexOffset.
+namespace MeshLOD {
+	// Grid cells along the longest axis for level 1, halved for each level after it
+	constexpr uint32_t LOD_BASE_GRID = 32;
+	// Meshes below this have nothing worth taking away
+	constexpr uint32_t LOD_MIN_TRIANGLES = 64;
+	// A level has to drop at least this share of the last one's triangles to be kept
+	constexpr float LOD_MIN_REDUCTION = 0.25f;
+
+	// Appends the levels after 0 to indices, level 0 is the mesh's own range.
+	// Indices are local to the mesh like the source ones.
+	MeshLODs buildLODs(
+		const std::vector<Vertex>& vertices,
+		std::vector<uint32_t>& indices,
+		const GPUMeshData& mesh);
+
+	// Meshes above this aren't checked for an occluder box, the convexity test is O(triangles * vertices)
+	constexpr uint32_t OCCLUDER_MAX_TRIANGLES = 4096;
+	// Boxes that shrink below this share of the mesh bounds aren't worth rasterizing
+	constexpr float OCCLUDER_MIN_SCALE = 0.1f;
+
+	// Occluder stand-in from the level 0 triangles. The mesh has to be closed once vertices are
+	// welded by position, and every vertex has to lie behind every triangle's plane. The box is
+	// the mesh bounds shrunk about the vertex centroid until it sits inside all of those planes.
+	MeshOccluder buildOccluder(
+		const std::vector<Vertex>& vertices,
+		const std::vector<uint32_t>& indices,
+		const GPUMeshData& mesh);
+}
@@ -11,6 +11,7 @@
 #include "JobSystem.h"
 #include "renderer/Renderer.h"
 #include "renderer/scene/RenderScene.h"
+#include "renderer/scene/GPUOcclusion.h"
 #include "platform/profiler/EditorImgui.h"
 #include "core/loader/MeshLoader.h"
 
@@ -236,6 +237,9 @@ void EngineState::loadAssets(Profiler& engineProfiler) {
 	ResourceManager::toneMappingData.cmbViewIdx = drawImg.lutEntry.combinedImageIndex;
 	ResourceManager::toneMappingData.storageViewIdx = toneMapImg.lutEntry.storageImageIndex;
 
+	// depth pyramid levels and its depth source
+	GPUOcclusion::registerImages(globalImgManager, _resources);
+
 	// === ENVIRONMENT IMAGE SETUP ===
 	auto& skyboxImg = ResourceManager::getSkyBoxImage();
 	auto& skyboxSmpl = ResourceManager::getSkyBoxSampler();
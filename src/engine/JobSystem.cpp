@@ -31,9 +31,34 @@ private:
 	std::function<void(ThreadContext&)> _fn;
 };
 
-void JobSystem::initScheduler() {
+// Set while a thread runs a background task, its parallel calls stay on that thread
+static thread_local bool inBackgroundTask = false;
+
+class JobSystem::BackgroundTask : public enki::ITaskSet {
+public:
+	BackgroundTask(std::function<void()> fn)
+		: ITaskSet(1), _fn(std::move(fn)) {
+		m_Priority = enki::TASK_PRIORITY_LOW;
+	}
+
+	void ExecuteRange(enki::TaskSetPartition, uint32_t) override {
+		inBackgroundTask = true;
+		_fn();
+		inBackgroundTask = false;
+	}
+
+private:
+	std::function<void()> _fn;
+};
+
+// Frame side waits stop above the background priority
+static constexpr enki::TaskPriority FOREGROUND_WAIT_PRIORITY = enki::TaskPriority(enki::TASK_PRIORITY_LOW - 1);
+
+void JobSystem::initScheduler(uint32_t threadCount) {
+	if (threadCount == 0) threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
 	enki::TaskSchedulerConfig config;
-	config.numTaskThreadsToCreate = std::thread::hardware_concurrency() - 1; // Need one thread for main
+	config.numTaskThreadsToCreate = threadCount - 1; // Need one thread for main
 	scheduler.Initialize(config);
 
 	const uint32_t numEnkiThreads = scheduler.GetNumTaskThreads();
@@ -58,4 +83,60 @@ void JobSystem::submitJob(std::function<void(ThreadContext&)> taskFn) {
 
 void JobSystem::wait() {
 	scheduler.WaitforAll();
-}
\ No newline at end of file
+}
+
+uint32_t JobSystem::getThreadCount() {
+	return std::max(scheduler.GetNumTaskThreads(), 1u);
+}
+
+void JobSystem::parallelFor(
+	uint32_t count,
+	uint32_t minRange,
+	const std::function<void(uint32_t begin, uint32_t end, uint32_t threadID)>& fn)
+{
+	if (count == 0) return;
+
+	// Not worth a task set, run inline
+	if (count <= minRange || getThreadCount() == 1 || inBackgroundTask) {
+		fn(0, count, scheduler.GetThreadNum());
+		return;
+	}
+
+	enki::TaskSet task(count, [&fn](enki::TaskSetPartition range, uint32_t threadnum) {
+		fn(range.start, range.end, threadnum);
+	});
+	task.m_MinRange = std::max(minRange, 1u);
+
+	scheduler.AddTaskSetToPipe(&task);
+	scheduler.WaitforTask(&task, FOREGROUND_WAIT_PRIORITY);
+}
+
+void JobSystem::parallelInvoke(const std::function<void()>& a, const std::function<void()>& b) {
+	if (getThreadCount() == 1 || inBackgroundTask) {
+		a();
+		b();
+		return;
+	}
+
+	enki::TaskSet task(1, [&a](enki::TaskSetPartition, uint32_t) { a(); });
+	scheduler.AddTaskSetToPipe(&task);
+	b();
+	scheduler.WaitforTask(&task, FOREGROUND_WAIT_PRIORITY);
+}
+
+std::shared_ptr<JobSystem::BackgroundTask> JobSystem::submitBackground(std::function<void()> fn) {
+	std::shared_ptr<BackgroundTask> task(new BackgroundTask(std::move(fn)), [](BackgroundTask* t) {
+		scheduler.WaitforTask(t);
+		delete t;
+	});
+	scheduler.AddTaskSetToPipe(task.get());
+	return task;
+}
+
+bool JobSystem::isDone(const BackgroundTask& task) {
+	return task.GetIsComplete();
+}
+
+void JobSystem::waitFor(const BackgroundTask& task) {
+	scheduler.WaitforTask(&task);
+}
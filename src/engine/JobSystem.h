@@ -5,6 +5,8 @@
 
 struct ThreadContext;
 
+namespace JobSystem { class BackgroundTask; }
+
 std::vector<ThreadContext>& getAllThreadContexts();
 
 struct ThreadCommandPool {
@@ -96,10 +98,33 @@ namespace JobSystem {
 		logMessages.clear();
 	}
 
-	void initScheduler();
+	// threadCount includes the main thread, 0 uses every hardware thread
+	void initScheduler(uint32_t threadCount = 0);
 	void shutdownScheduler();
 	void submitJob(std::function<void(ThreadContext&)> taskFn);
 	void wait();
 
+	// Scheduler threads including main, 1 if the scheduler isn't running
+	uint32_t getThreadCount();
+
+	// Splits [0, count) into ranges of at least minRange and runs fn over them on the
+	// scheduler threads, the calling thread joins in. Blocks until every range is done.
+	// Safe to call from inside another job, the waiting thread keeps executing tasks.
+	void parallelFor(
+		uint32_t count,
+		uint32_t minRange,
+		const std::function<void(uint32_t begin, uint32_t end, uint32_t threadID)>& fn);
+
+	// Runs a on a scheduler thread while b runs on the caller, returns once both are done.
+	void parallelInvoke(const std::function<void()>& a, const std::function<void()>& b);
+
+	// Long running work for a worker, at low priority. The waits in parallelFor and
+	// parallelInvoke never pick it up, and parallel calls made inside it run inline, so a frame
+	// can't end up running any of it. Needs more than one scheduler thread to make progress on
+	// its own. Dropping the last handle waits for it.
+	std::shared_ptr<BackgroundTask> submitBackground(std::function<void()> fn);
+	bool isDone(const BackgroundTask& task);
+	void waitFor(const BackgroundTask& task);
+
 	ThreadCommandPoolManager& getThreadPoolManager();
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "pch.h"
 
 #include "EditorImgui.h"
+#include "FrameCounters.h"
 #include "renderer/scene/RenderScene.h"
 #include "engine/platform/input/UserInput.h"
 
@@ -103,9 +104,68 @@ void EditorImgui::renderImgui(Profiler& profiler) {
 		ImGui::Text("Frame Time: %f ms", stats.frameTime.load());
 		ImGui::Text("Draw Time: %f ms", stats.drawTime.load());
 		ImGui::Text("Scene Update Time: %f ms", stats.sceneUpdateTime.load());
-		ImGui::Text("Triangles: %i", stats.triangleCount.load());
-		ImGui::Text("Draws: %i", stats.drawCalls.load());
+		if (stats.gpuCountedDraws.load()) {
+			ImGui::Text("Triangles: n/a with GPU counted draws");
+			ImGui::Text("Draws: %i (GPU counts read back late)", stats.drawCalls.load());
+		}
+		else {
+			ImGui::Text("Triangles: %i", stats.triangleCount.load());
+			ImGui::Text("Draws: %i", stats.drawCalls.load());
+		}
+		ImGui::Text("Subtrees Accepted: %i", stats.cullSubtreesAccepted.load());
+		if (profiler.cullToggles.asyncBVHRebuild)
+			ImGui::Text("BVH Loose Rows: %i", stats.bvhLooseRows.load());
+		ImGui::Text("Occluded: %i / %i (%.3f ms)", stats.occlusionOccluded.load(), stats.occlusionTested.load(), stats.occlusionTime.load());
+		if (profiler.cullToggles.gpuOcclusion) {
+			ImGui::Text("GPU Draws: %i + %i", stats.gpuOcclusionDrawsFirst.load(), stats.gpuOcclusionDrawsSecond.load());
+			ImGui::Text("GPU Occluded: %i / %i (CPU frustum %i)", stats.gpuOcclusionOccluded.load(),
+				stats.gpuOcclusionFrustum.load(), stats.gpuOcclusionCPUFrustum.load());
+		}
+		if (profiler.cullToggles.gpuFrustumCull) {
+			ImGui::Text("GPU Cull: %i opaque rows in %i draws, %i transparent on the CPU", stats.gpuCullVisible.load(),
+				stats.gpuCullOpaqueDraws.load(), stats.gpuCullTransparentDraws.load());
+			if (profiler.cullToggles.gpuCullValidate)
+				ImGui::Text("CPU Cull: %i opaque rows in %i draws", stats.gpuCullCPUVisible.load(),
+					stats.gpuCullCPUOpaqueDraws.load());
+		}
+		else if (profiler.cullToggles.gpuBatching) {
+			ImGui::Text("GPU Batching: %i opaque rows in %i draws, %i transparent on the CPU", stats.gpuCullVisible.load(),
+				stats.gpuCullOpaqueDraws.load(), stats.gpuCullTransparentDraws.load());
+			if (profiler.cullToggles.gpuCullValidate)
+				ImGui::Text("CPU Batching: %i opaque draws, %i differ", stats.gpuCullCPUOpaqueDraws.load(),
+					stats.gpuBatchMismatches.load());
+		}
+		ImGui::Text("Contribution Culled: %i", stats.contributionCulled.load());
+		ImGui::Text("LOD Rows: %i / %i / %i / %i", stats.lodRows[0].load(), stats.lodRows[1].load(),
+			stats.lodRows[2].load(), stats.lodRows[3].load());
+		if (profiler.cullToggles.drawCache) {
+			const uint32_t hits = stats.drawCacheHits.load();
+			const uint32_t lookups = hits + stats.drawCacheMisses.load();
+			const float hitRate = lookups ? 100.0f * static_cast<float>(hits) / static_cast<float>(lookups) : 0.0f;
+			const float uploadRate = hits ? 100.0f * static_cast<float>(stats.drawCacheUploadHits.load()) / static_cast<float>(hits) : 0.0f;
+			ImGui::Text("Draw Cache: %.1f%% of %i frames, uploads skipped %.1f%%", hitRate, lookups, uploadRate);
+			ImGui::SameLine();
+			if (ImGui::SmallButton("Reset")) {
+				stats.drawCacheHits.store(0);
+				stats.drawCacheMisses.store(0);
+				stats.drawCacheUploadHits.store(0);
+			}
+		}
+		if (profiler.debugToggles.measureOverdraw)
+			ImGui::Text("Opaque Fragments: %llu (%.2f per pixel)", stats.opaqueFragments.load(), stats.opaqueOverdraw.load());
 		ImGui::Text("VRAM Used: %llu MB", stats.vramUsed.load() / (1024ull * 1024ull));
+
+		// Last frame's count over the graph, every graph scaled to its own range
+		if (ImGui::CollapsingHeader("Counters", ImGuiTreeNodeFlags_DefaultOpen)) {
+			for (size_t c = 0; c < FrameCounters::COUNTER_COUNT; ++c) {
+				const FrameCounter counter = static_cast<FrameCounter>(c);
+				const std::string overlay = fmt::format("{}: {}", FrameCounters::name(counter), FrameCounters::lastFrame(counter));
+				ImGui::PushID(static_cast<int>(c));
+				ImGui::PlotLines("", FrameCounters::history(counter), static_cast<int>(FrameCounters::HISTORY_FRAMES),
+					static_cast<int>(FrameCounters::historyOffset()), overlay.c_str(), 0.0f, FLT_MAX, ImVec2(260.0f, 36.0f));
+				ImGui::PopID();
+			}
+		}
 		ImGui::End();
 	}
 
@@ -135,10 +195,48 @@ void EditorImgui::renderImgui(Profiler& profiler) {
 
 			if (ImGui::TreeNode("Debug Draw")) {
 				ImGui::Checkbox("Draw OBB", &profiler.debugToggles.showOBBs);
+				ImGui::Checkbox("Measure Overdraw", &profiler.debugToggles.measureOverdraw);
 				ImGui::TreePop();
 			}
 		}
 
+		if (ImGui::CollapsingHeader("Culling")) {
+			static const char* buildModes[] = { "Median", "Binned SAH", "LBVH" };
+			int mode = static_cast<int>(profiler.cullToggles.buildMode);
+			if (ImGui::Combo("BVH Build", &mode, buildModes, static_cast<int>(BVHBuildMode::Count))) {
+				profiler.cullToggles.buildMode = static_cast<BVHBuildMode>(mode);
+			}
+			ImGui::SliderFloat("LBVH Dynamic Fraction", &profiler.cullToggles.lbvhDynamicFraction, 0.0f, 1.0f);
+
+			static const char* layouts[] = { "Binary", "BVH4", "BVH4 16-bit" };
+			int layout = static_cast<int>(profiler.cullToggles.layout);
+			if (ImGui::Combo("BVH Layout", &layout, layouts, static_cast<int>(BVHLayout::Count))) {
+				profiler.cullToggles.layout = static_cast<BVHLayout>(layout);
+			}
+			ImGui::Checkbox("Parallel Cull", &profiler.cullToggles.parallelCull);
+			ImGui::Checkbox("Parallel Draw Build", &profiler.cullToggles.parallelDrawBuild);
+			static const char* opaqueOrders[] = { "Batched", "Front To Back", "Sorted Rows", "Depth Slices" };
+			int opaqueOrder = static_cast<int>(profiler.cullToggles.opaqueOrder);
+			if (ImGui::Combo("Opaque Order", &opaqueOrder, opaqueOrders, static_cast<int>(OpaqueOrder::Count))) {
+				profiler.cullToggles.opaqueOrder = static_cast<OpaqueOrder>(opaqueOrder);
+			}
+			ImGui::Checkbox("Two-Level BVH", &profiler.cullToggles.twoLevelBVH);
+			ImGui::Checkbox("Async BVH Rebuild", &profiler.cullToggles.asyncBVHRebuild);
+			ImGui::Checkbox("Plane Masks", &profiler.cullToggles.planeMasks);
+			ImGui::Checkbox("Occlusion Cull", &profiler.cullToggles.occlusionCull);
+			ImGui::Checkbox("GPU Occlusion", &profiler.cullToggles.gpuOcclusion);
+			ImGui::Checkbox("GPU Hi-Z Test", &profiler.cullToggles.gpuHiZTest);
+			ImGui::Checkbox("GPU Frustum Cull", &profiler.cullToggles.gpuFrustumCull);
+			ImGui::Checkbox("GPU Batching", &profiler.cullToggles.gpuBatching);
+			ImGui::Checkbox("Validate GPU Cull", &profiler.cullToggles.gpuCullValidate);
+			ImGui::Checkbox("Contribution Cull", &profiler.cullToggles.contributionCull);
+			ImGui::SliderFloat("Min Pixel Size", &profiler.cullToggles.minPixelSize, 0.0f, 16.0f);
+			ImGui::Checkbox("LOD Selection", &profiler.cullToggles.lodSelection);
+			ImGui::SliderFloat("LOD Bias", &profiler.cullToggles.lodBias, 0.25f, 4.0f);
+			ImGui::SliderFloat("LOD Hysteresis", &profiler.cullToggles.lodHysteresis, 0.0f, 0.5f);
+			ImGui::Checkbox("Draw Cache", &profiler.cullToggles.drawCache);
+		}
+
 		// "tone map", not a very good one
 		if (ImGui::CollapsingHeader("Options", ImGuiTreeNodeFlags_DefaultOpen)) {
 			auto& color = ResourceManager::toneMappingData;
@@ -0,0 +1,84 @@
+#include "pch.h"
+
+#include "FrameCounters.h"
+
+namespace FrameCounters {
+	// Counts only ever grow. Each line has one writer, so adds are a plain load and store, and
+	// the frame end takes the difference to what it took last time.
+	struct alignas(64) ThreadCounters {
+		std::atomic<uint64_t> values[COUNTER_COUNT] = {};
+	};
+
+	static ThreadCounters threadCounters[MAX_COUNTER_THREADS];
+	static std::atomic<uint32_t> nextThreadSlot{ 0 };
+	static uint64_t taken[MAX_COUNTER_THREADS][COUNTER_COUNT] = {};
+
+	static Totals last{};
+	static float historyValues[COUNTER_COUNT][HISTORY_FRAMES] = {};
+	static uint32_t historyHead = 0;
+
+	static const char* counterNames[COUNTER_COUNT] = {
+		"Cull Nodes",
+		"Plane Tests",
+		"Leaves Tested",
+		"Leaves Accepted",
+		"Rows Refit",
+		"BVH Rebuilds",
+		"Opaque Batches",
+		"Transparent Draws",
+		"Bytes Staged",
+	};
+
+	// Handed out on a thread's first count and kept for its lifetime
+	static thread_local uint32_t threadSlot = MAX_COUNTER_THREADS;
+}
+
+void FrameCounters::add(FrameCounter counter, uint64_t amount) {
+	if (!amount) return;
+	if (threadSlot == MAX_COUNTER_THREADS)
+		threadSlot = std::min(nextThreadSlot.fetch_add(1, std::memory_order_relaxed), MAX_COUNTER_THREADS - 1);
+
+	std::atomic<uint64_t>& value = threadCounters[threadSlot].values[static_cast<size_t>(counter)];
+	// The last line is shared by every thread past the limit
+	if (threadSlot == MAX_COUNTER_THREADS - 1)
+		value.fetch_add(amount, std::memory_order_relaxed);
+	else
+		value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+const FrameCounters::Totals& FrameCounters::endFrame() {
+	last.fill(0);
+	const uint32_t lines = std::min(nextThreadSlot.load(std::memory_order_relaxed), MAX_COUNTER_THREADS);
+	for (uint32_t t = 0; t < lines; ++t) {
+		for (size_t c = 0; c < COUNTER_COUNT; ++c) {
+			const uint64_t value = threadCounters[t].values[c].load(std::memory_order_relaxed);
+			last[c] += value - taken[t][c];
+			taken[t][c] = value;
+		}
+	}
+
+	for (size_t c = 0; c < COUNTER_COUNT; ++c)
+		historyValues[c][historyHead] = static_cast<float>(last[c]);
+	historyHead = (historyHead + 1) % HISTORY_FRAMES;
+	return last;
+}
+
+const FrameCounters::Totals& FrameCounters::lastFrame() {
+	return last;
+}
+
+uint64_t FrameCounters::lastFrame(FrameCounter counter) {
+	return last[static_cast<size_t>(counter)];
+}
+
+const float* FrameCounters::history(FrameCounter counter) {
+	return historyValues[static_cast<size_t>(counter)];
+}
+
+uint32_t FrameCounters::historyOffset() {
+	return historyHead;
+}
+
+const char* FrameCounters::name(FrameCounter counter) {
+	return counterNames[static_cast<size_t>(counter)];
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// Work counters for tuning the cull and the draw setup. Any thread adds to its own cache line,
+// so workers counting at once never share one. Profiler::endFrame sums the lines into the last
+// frame's totals and a rolling history for the stats window. No device or platform code, the
+// headless bench reads the same totals.
+enum class FrameCounter : uint8_t {
+	CullNodesVisited,
+	CullPlaneTests,
+	CullLeavesTested,
+	CullLeavesAccepted,
+	BVHRowsRefit,
+	BVHRebuilds,
+	OpaqueBatches,
+	TransparentDraws,
+	BytesStaged,
+	Count
+};
+
+namespace FrameCounters {
+	constexpr size_t COUNTER_COUNT = static_cast<size_t>(FrameCounter::Count);
+	constexpr uint32_t MAX_COUNTER_THREADS = 64; // threads past this share the last line
+	constexpr uint32_t HISTORY_FRAMES = 240;
+
+	using Totals = std::array<uint64_t, COUNTER_COUNT>;
+
+	void add(FrameCounter counter, uint64_t amount);
+
+	// Takes every thread's counts since the last call as the frame's totals and pushes them
+	// onto the history. Counts added while it runs land in this frame or the next, never both.
+	const Totals& endFrame();
+
+	// Totals of the frame endFrame closed last
+	const Totals& lastFrame();
+	uint64_t lastFrame(FrameCounter counter);
+
+	// HISTORY_FRAMES values, oldest at historyOffset() and wrapping, the layout
+	// ImGui::PlotLines takes with values_offset
+	const float* history(FrameCounter counter);
+	uint32_t historyOffset();
+
+	const char* name(FrameCounter counter);
+}
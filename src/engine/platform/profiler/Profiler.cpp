@@ -1,6 +1,7 @@
 #include "pch.h"
 
 #include "Profiler.h"
+#include "FrameCounters.h"
 #include "engine/Engine.h"
 
 void Profiler::enablePlatformTimerPrecision() {
@@ -44,6 +45,8 @@ void Profiler::beginFrame() {
 }
 
 void Profiler::endFrame() {
+	FrameCounters::endFrame();
+
 	const bool capOn = (_stats.capFramerate && _stats.targetFrameRate > 0.0f);
 
 	// schedule-based limiter in integer QPC ticks
@@ -11,12 +11,49 @@
 struct FrameStats {
 	std::atomic<uint32_t> drawCalls = 0;
 	std::atomic<uint32_t> triangleCount = 0;
+	std::atomic<bool> gpuCountedDraws = false; // some draws came from GPU counts, triangles leave them out
 	std::atomic<float> deltaTime = 0.0f;
 	std::atomic<float> frameTime = 0.0f;
 	std::atomic<float> fps = 0.0f;
 	std::atomic<float> sceneUpdateTime = 0.0f;
 	std::atomic<float> drawTime = 0.0f;
 
+	// CPU cull of the last frame, nodes and plane tests are in FrameCounters
+	std::atomic<uint32_t> cullSubtreesAccepted = 0;
+	std::atomic<uint32_t> bvhLooseRows = 0; // culled flat until the background build lands
+	std::atomic<uint32_t> occlusionTested = 0;
+	std::atomic<uint32_t> occlusionOccluded = 0;
+	std::atomic<float> occlusionTime = 0.0f;
+
+	// GPU occlusion, read back a few frames late
+	std::atomic<uint32_t> gpuOcclusionDrawsFirst = 0;
+	std::atomic<uint32_t> gpuOcclusionDrawsSecond = 0;
+	std::atomic<uint32_t> gpuOcclusionFrustum = 0;
+	std::atomic<uint32_t> gpuOcclusionOccluded = 0;
+	std::atomic<uint32_t> gpuOcclusionCPUFrustum = 0; // CPU cull of the same frame, should match gpuOcclusionFrustum
+
+	// GPU frustum cull, read back a few frames late
+	std::atomic<uint32_t> gpuCullVisible = 0;
+	std::atomic<uint32_t> gpuCullOpaqueDraws = 0;
+	std::atomic<uint32_t> gpuCullTransparentDraws = 0;
+	std::atomic<uint32_t> gpuCullCPUVisible = 0; // CPU cull of the same frame when validating
+	std::atomic<uint32_t> gpuCullCPUOpaqueDraws = 0; // CPU batching of the same rows when validating
+	std::atomic<uint32_t> gpuBatchMismatches = 0; // GPU batching's draws that differ from the CPU's when validating
+
+	// Screen size stage of the CPU path
+	std::atomic<uint32_t> contributionCulled = 0;
+	std::atomic<uint32_t> lodRows[MAX_MESH_LODS] = {};
+
+	// Draw cache, counted since the last reset. Upload hits are the hits where the frame's
+	// own buffers already held the cached draws.
+	std::atomic<uint32_t> drawCacheHits = 0;
+	std::atomic<uint32_t> drawCacheMisses = 0;
+	std::atomic<uint32_t> drawCacheUploadHits = 0;
+
+	// Overdraw readout, fragment shader invocations of the CPU path's opaque draws, a few frames late
+	std::atomic<uint64_t> opaqueFragments = 0;
+	std::atomic<float> opaqueOverdraw = 0.0f; // invocations per pixel of the draw extent
+
 	std::atomic<size_t> vramUsed = 0;
 
 	// V-sync is default present mode for now
@@ -39,6 +76,33 @@ struct DebugToggles {
 	//bool showMetallic = false;
 	//bool showRoughness = false;
 	bool forceWireframe = false;
+	bool measureOverdraw = false; // pipeline statistics query around the CPU path's opaque draws
+};
+
+struct CullingToggles {
+	BVHBuildMode buildMode = BVHBuildMode::BinnedSAH;
+	float lbvhDynamicFraction = 0.5f; // dynamic share of the rows past which the tree is built linear
+	BVHLayout layout = BVHLayout::Binary;
+	bool parallelCull = true;
+	bool parallelDrawBuild = true; // batch keys, sort and opaque draws on JobSystem workers
+	OpaqueOrder opaqueOrder = OpaqueOrder::Batched;
+	bool twoLevelBVH = false; // per model trees under a tree of copies, culls on the CPU path only
+	bool asyncBVHRebuild = false; // large topology changes rebuild on a worker, the old tree culls meanwhile
+	bool planeMasks = true;
+	bool occlusionCull = false;
+	bool gpuOcclusion = false;
+	bool gpuHiZTest = true; // off leaves the GPU path frustum only, its counts should then match the CPU cull
+	bool gpuFrustumCull = false; // takes over from the CPU cull and the GPU occlusion path
+	bool gpuCullValidate = false; // still runs the CPU cull to compare counts, gives back the savings
+	bool gpuBatching = false; // CPU frustum cull only, batches and draws built on the GPU from the visible rows
+	bool contributionCull = false; // opt in, drops rows from what the scene renders
+	float minPixelSize = 2.0f; // rows smaller than this on screen aren't drawn
+	bool lodSelection = false; // opt in, swaps decimated levels in for the full meshes
+	float lodBias = 1.0f;
+	float lodHysteresis = 0.1f;
+	bool drawCache = true; // reuses the last visible set and draws while view, scene and toggles hold
+
+	bool operator==(const CullingToggles&) const = default;
 };
 
 class Profiler {
@@ -58,6 +122,7 @@ public:
 	void resetDrawCalls() {
 		_stats.drawCalls.store(0);
 		_stats.triangleCount.store(0);
+		_stats.gpuCountedDraws.store(false);
 	}
 
 	void addDrawCall(uint32_t tris) {
@@ -65,6 +130,12 @@ public:
 		_stats.triangleCount += tris;
 	}
 
+	// Indirect count draws, the count is the last one read back from the GPU
+	void addGPUCountedDraws(uint32_t draws) {
+		_stats.drawCalls += draws;
+		_stats.gpuCountedDraws.store(true);
+	}
+
 	void resetRenderTimers() {
 		_stats.drawTime.store(0);
 		_stats.sceneUpdateTime.store(0);
@@ -77,6 +148,7 @@ public:
 
 	DebugToggles debugToggles;
 	PipelineOverride pipeOverride;
+	CullingToggles cullToggles;
 
 	VkDeviceSize GetTotalVRAMUsage(VkPhysicalDevice device, VmaAllocator allocator);
 
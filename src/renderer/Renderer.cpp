@@ -3,6 +3,8 @@
 #include "Renderer.h"
 #include "engine/platform/profiler/EditorImgui.h"
 #include "scene/RenderScene.h"
+#include "scene/GPUOcclusion.h"
+#include "scene/GPUCull.h"
 #include "utils/BufferUtils.h"
 #include "core/AssetManager.h"
 #include "utils/SyncUtils.h"
@@ -34,7 +36,7 @@ namespace Renderer {
 	TimelineSync _computeSync;
 
 	void toneMapPass(FrameContext& frame, ColorData& toneMappingData);
-	void geometryPass(std::array<VkImageView, 3> imageViews, FrameContext& frameCtx, Profiler& profiler);
+	void geometryPass(std::array<VkImageView, 4> imageViews, FrameContext& frameCtx, Profiler& profiler, GeometryPhase phase);
 }
 
 void Renderer::initRenderer(
@@ -123,7 +125,8 @@ void Renderer::submitFrame(FrameContext& frameCtx) {
 		waitTransfer.stageMask =
 			VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT |
 			VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT |
-			VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT; // earliest consumers of uploaded data
+			VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT |
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT; // earliest consumers of uploaded data, gpu occlusion culls first
 		waitInfos.push_back(waitTransfer);
 	}
 
@@ -190,6 +193,7 @@ void Renderer::recordRenderCommand(FrameContext& frameCtx, Profiler& profiler) {
 	auto& draw = ResourceManager::getDrawImage();
 	auto& msaa = ResourceManager::getMSAAImage();
 	auto& depth = ResourceManager::getDepthImage();
+	auto& depthResolve = ResourceManager::getDepthResolveImage();
 	auto& toneMap = ResourceManager::getToneMappingImage();
 
 	_drawExtent.width = std::min(swp.extent.width, draw.imageExtent.width);
@@ -227,7 +231,8 @@ void Renderer::recordRenderCommand(FrameContext& frameCtx, Profiler& profiler) {
 		frameCtx.descriptorWriter.updateSet(device, unifiedSet);
 	}
 
-	if (frameCtx.visibleCount > 0) {
+	// Draw cache hits can leave the frame's buffers as they are, then there is nothing to acquire
+	if (frameCtx.renderDataUploaded) {
 		BarrierUtils::acquireShaderReadQ(frameCtx.commandBuffer, frameCtx.addressTableBuffer);
 	}
 
@@ -252,7 +257,53 @@ void Renderer::recordRenderCommand(FrameContext& frameCtx, Profiler& profiler) {
 		frameCtx.commandBuffer, depth.image, depth.imageFormat,
 		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
 
-	geometryPass({ draw.imageView, msaa.imageView, depth.imageView }, frameCtx, profiler);
+	const std::array<VkImageView, 4> geometryViews{ draw.imageView, msaa.imageView, depth.imageView, depthResolve.imageView };
+
+	if (frameCtx.gpuOcclusionActive) {
+		// The last frame's pyramid build may still be sampling the resolve, its reads are waited on
+		if (MSAA_ENABLED) {
+			VkImageMemoryBarrier2 resolveBarrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+			resolveBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+			resolveBarrier.srcAccessMask = VK_ACCESS_2_NONE;
+			resolveBarrier.dstStageMask = VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+			resolveBarrier.dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+			resolveBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			resolveBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+			resolveBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			resolveBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			resolveBarrier.image = depthResolve.image;
+			resolveBarrier.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+
+			VkDependencyInfo dep{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+			dep.imageMemoryBarrierCount = 1;
+			dep.pImageMemoryBarriers = &resolveBarrier;
+			vkCmdPipelineBarrier2(frameCtx.commandBuffer, &dep);
+		}
+
+		// last frame's visible set, its depth builds the pyramid, then everything else is tested against it
+		GPUOcclusion::beginFrame(frameCtx.commandBuffer, frameCtx);
+		GPUOcclusion::cullPhase(frameCtx.commandBuffer, frameCtx, 0);
+		geometryPass(geometryViews, frameCtx, profiler, GeometryPhase::OcclusionFirst);
+
+		GPUOcclusion::buildDepthPyramid(frameCtx.commandBuffer, { _drawExtent.width, _drawExtent.height });
+		GPUOcclusion::cullPhase(frameCtx.commandBuffer, frameCtx, 1);
+
+		// second pass loads what the first one left in the attachments
+		BarrierUtils::memoryBarrier(frameCtx.commandBuffer,
+			VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+
+		geometryPass(geometryViews, frameCtx, profiler, GeometryPhase::OcclusionSecond);
+	}
+	else {
+		if (frameCtx.gpuCullActive)
+			GPUCull::recordCull(frameCtx.commandBuffer, frameCtx);
+
+		geometryPass(geometryViews, frameCtx, profiler, GeometryPhase::Full);
+	}
 
 	// ToneMapImage transition
 	ImageUtils::transitionImage(
@@ -306,11 +357,16 @@ void Renderer::recordRenderCommand(FrameContext& frameCtx, Profiler& profiler) {
 	VK_CHECK(vkEndCommandBuffer(frameCtx.commandBuffer));
 }
 
-// draw[0], msaa[1], depth[2]
-void Renderer::geometryPass(std::array<VkImageView, 3> imageViews, FrameContext& frameCtx, Profiler& profiler) {
+// draw[0], msaa[1], depth[2], depth resolve[3]
+// The occlusion phases split one pass in two, the second loads what the first stored
+void Renderer::geometryPass(std::array<VkImageView, 4> imageViews, FrameContext& frameCtx, Profiler& profiler, GeometryPhase phase) {
+	const VkAttachmentLoadOp loadOp = phase == GeometryPhase::OcclusionSecond
+		? VK_ATTACHMENT_LOAD_OP_LOAD
+		: VK_ATTACHMENT_LOAD_OP_CLEAR;
+
 	VkRenderingAttachmentInfo colorAttachment{ VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO };
 	colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachment.loadOp = loadOp;
 	colorAttachment.clearValue.color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
 
 	// MSAA branch
@@ -319,7 +375,9 @@ void Renderer::geometryPass(std::array<VkImageView, 3> imageViews, FrameContext&
 		colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
 		colorAttachment.resolveImageView = imageViews[0];
 		colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		colorAttachment.storeOp = phase == GeometryPhase::OcclusionFirst
+			? VK_ATTACHMENT_STORE_OP_STORE
+			: VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	}
 	else {
 		colorAttachment.imageView = imageViews[0];
@@ -334,10 +392,17 @@ void Renderer::geometryPass(std::array<VkImageView, 3> imageViews, FrameContext&
 	depthAttachment.resolveMode = VK_RESOLVE_MODE_NONE;
 	depthAttachment.resolveImageView = VK_NULL_HANDLE;
 	depthAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.loadOp = loadOp;
 	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	depthAttachment.clearValue.depthStencil.depth = 1.0f;
 
+	// msaa depth can't be sampled, the pyramid is built from its resolve
+	if (MSAA_ENABLED && phase == GeometryPhase::OcclusionFirst) {
+		depthAttachment.resolveMode = GPUOcclusion::getDepthResolveMode();
+		depthAttachment.resolveImageView = imageViews[3];
+		depthAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+	}
+
 	VkRenderingInfo renderInfo{ VK_STRUCTURE_TYPE_RENDERING_INFO };
 	renderInfo.flags = 0,
 	renderInfo.renderArea = { { 0, 0 }, { _drawExtent.width, _drawExtent.height } },
@@ -349,7 +414,7 @@ void Renderer::geometryPass(std::array<VkImageView, 3> imageViews, FrameContext&
 
 	vkCmdBeginRendering(frameCtx.commandBuffer, &renderInfo);
 	VulkanUtils::defineViewportAndScissor(frameCtx.commandBuffer, { _drawExtent.width, _drawExtent.height });
-	RenderScene::renderGeometry(frameCtx, profiler);
+	RenderScene::renderGeometry(frameCtx, profiler, phase);
 	vkCmdEndRendering(frameCtx.commandBuffer);
 }
 
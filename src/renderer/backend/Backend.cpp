@@ -197,6 +197,7 @@ void Backend::createLogicalDevice() {
 	baseFeatures.features.drawIndirectFirstInstance = VK_TRUE;
 	baseFeatures.features.imageCubeArray = VK_TRUE;
 	baseFeatures.features.occlusionQueryPrecise = VK_TRUE;
+	baseFeatures.features.pipelineStatisticsQuery = VK_TRUE;           // fragment invocations for the overdraw readout
 	baseFeatures.features.shaderStorageImageExtendedFormats = VK_TRUE;
 
 	VkPhysicalDeviceVulkan11Features features11{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES };
@@ -220,6 +221,7 @@ void Backend::createLogicalDevice() {
 	features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
 	features12.shaderStorageImageArrayNonUniformIndexing = VK_TRUE;
 	features12.drawIndirectCount = VK_TRUE;
+	features12.hostQueryReset = VK_TRUE;
 	features12.shaderFloat16 = VK_TRUE;
 
 	if (features12.shaderBufferInt64Atomics)
@@ -193,6 +193,9 @@ void cleanupFrameContexts(
 		if (frame.computePool != VK_NULL_HANDLE)
 			vkDestroyCommandPool(device, frame.computePool, nullptr);
 
+		if (frame.overdrawQueries != VK_NULL_HANDLE)
+			vkDestroyQueryPool(device, frame.overdrawQueries, nullptr);
+
 		if (frame.combinedGPUStaging.buffer != VK_NULL_HANDLE)
 			BufferUtils::destroyAllocatedBuffer(frame.combinedGPUStaging, alloc);
 
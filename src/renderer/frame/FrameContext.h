@@ -9,6 +9,27 @@ constexpr size_t INDIRECT_SIZE_BYTES = MAX_DRAWS * sizeof(VkDrawIndexedIndirectC
 // Frames perform staging uploads on the global transforms buffer.
 constexpr size_t TRANSFORMS_SIZE_BYTES = MAX_VISIBLE_TRANSFORMS * sizeof(glm::mat4);
 
+// Lists buildAndSortIndirectDraws keeps between frames, a frame no bigger than the ones
+// before it builds its draws without allocating
+struct DrawBatchScratch {
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> rows; // visible list index behind each key
+	std::vector<uint64_t> tmpKeys;
+	std::vector<uint32_t> tmpRows;
+	std::vector<GPUInstance> sourceInstances; // the culled list, swapped out while draws are built
+	std::vector<uint32_t> transparentOrder; // positions among the transparent rows, back to front
+	std::vector<uint64_t> depthKeys;
+	std::vector<uint32_t> lastTransparentOrder; // where the next transparent sort starts from
+	std::vector<uint32_t> sliceCounts; // parallel build, a bucket histogram per slice
+	std::vector<uint32_t> sliceRuns;   // parallel build, first opaque draw of each slice
+	std::vector<uint64_t> orderKeys; // opaque ordering, draw and depth bucket per opaque row
+	std::vector<uint32_t> orderRows;
+	std::vector<uint64_t> segmentKeys; // nearest depth bucket of each drawn segment
+	std::vector<uint32_t> segmentOrder;
+	std::vector<uint32_t> segmentStarts;
+	std::vector<VkDrawIndexedIndirectCommand> batchDraws; // opaque draws before ordering
+};
+
 struct FrameContext {
 	uint32_t frameIndex = 0;
 
@@ -41,15 +62,21 @@ struct FrameContext {
 
 	// Flattened instance + command buffers
 	std::vector<GPUInstance> visibleInstances;
+	std::vector<uint8_t> visibleLODs; // detail level per visible instance, empty draws level 0
 	AllocatedBuffer visibleInstancesBuffer;
 	std::vector<VkDrawIndexedIndirectCommand> indirectDraws;
 	AllocatedBuffer indirectDrawsBuffer;
 
 	PassRange opaqueRange;
 	PassRange transparentRange;
+	OpaqueOrder opaqueOrder = OpaqueOrder::Batched; // set by the scene before the draws are built
+	DrawBatchScratch batchScratch;
 
 	VisibilitySyncResult visSyncResult;
 
+	uint64_t drawCacheVersion = 0; // draw cache build the instance and draw buffers hold, 0 if none
+	bool renderDataUploaded = false; // this frame released the instance, draw and address buffers
+
 	struct alignas(16) DrawPushConstants {
 		uint32_t totalVertexCount;
 		uint32_t totalIndexCount;
@@ -59,6 +86,7 @@ struct FrameContext {
 
 	void clearRenderData() {
 		visibleInstances.clear();
+		visibleLODs.clear();
 		indirectDraws.clear();
 		visibleCount = 0;
 		opaqueRange = {};
@@ -72,6 +100,48 @@ struct FrameContext {
 	CullingPushConstantsAddrs cullingPCData{};
 	uint32_t visibleCount = 0;
 
+	// GPU occlusion, opaque rows are culled and drawn on the GPU when active
+	bool gpuOcclusionActive = false;
+	bool gpuOcclusionRecorded = false; // counters hold results once this frame's fence is waited on
+	uint32_t gpuOcclusionCPUCount = 0; // CPU frustum cull's opaque count for the recorded frame
+	AllocatedBuffer gpuOcclusionParams;
+	AllocatedBuffer gpuOcclusionCounters;
+	// Frame's copy of the opaque rows and their visible flags, rewritten after this frame's fence
+	// once the rows change. The flags carry what this frame context drew last time.
+	AllocatedBuffer gpuOcclusionCandidates;
+	AllocatedBuffer gpuOcclusionFlags;
+	uint32_t gpuOcclusionCapacity = 0;
+	uint64_t gpuOcclusionVersion = 0; // candidate gather the buffers hold, 0 if none
+	bool gpuOcclusionFlagsReset = false; // new rows, every flag is set before the first cull
+
+	// GPU frustum cull, replaces the CPU cull and draw build when active, see GPUCull.h
+	bool gpuCullActive = false;
+	bool gpuCullRecorded = false;
+	uint32_t gpuCullCPUCount = 0; // CPU cull's count for the recorded frame, 0 unless validating
+	uint32_t gpuCullCPUDraws = 0; // CPU batching's opaque draws for the recorded frame, 0 unless validating
+	AllocatedBuffer gpuCullCounts;
+	// Frame's copy of the batch table, rewritten after this frame's fence once the table changes
+	AllocatedBuffer gpuCullRows;
+	AllocatedBuffer gpuCullBatches;
+	uint32_t gpuCullRowCapacity = 0;
+	uint64_t gpuCullTableVersion = 0; // table build the rows and batches hold, 0 if none
+	// GPU batching, the CPU culls and the same path batches its visible rows into draws
+	bool gpuCullBatching = false;
+	BatchPushConstantsAddrs batchPCData{};
+	AllocatedBuffer gpuBatchRows;
+	// Validation of batching alone, the CPU batching's opaque draws and each draw's sorted transform
+	// ids. The GPU's draws and instances are copied back and compared once this frame's fence is waited on.
+	bool gpuBatchCheck = false;
+	uint32_t gpuBatchInstanceFirst = 0;
+	std::vector<VkDrawIndexedIndirectCommand> gpuBatchCPUDraws;
+	std::vector<uint32_t> gpuBatchCPURows;
+	AllocatedBuffer gpuBatchReadback;
+
+	// Overdraw readout, fragment shader invocations of the CPU path's opaque draws
+	VkQueryPool overdrawQueries = VK_NULL_HANDLE;
+	bool overdrawRecorded = false; // the query holds a result once this frame's fence is waited on
+	uint32_t overdrawPixels = 0; // draw extent of the recorded query
+
 	// frames can update the global transforms
 	bool transformsBufferUploadNeeded = false;
 
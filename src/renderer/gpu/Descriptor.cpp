@@ -392,16 +392,6 @@ void DescriptorWriter::writeImages(uint32_t binding, DescriptorImageType type, V
 	});
 }
 
-void DescriptorWriter::clear() {
-	imageWriteGroups.clear();
-	bufferWrites.clear();
-	writeBufferIndices.clear();
-	bufferInfos.clear();
-	samplerCubeDescriptors.clear();
-	storageDescriptors.clear();
-	combinedDescriptors.clear();
-}
-
 void DescriptorWriter::updateSet(VkDevice device, VkDescriptorSet set) {
 	std::vector<VkWriteDescriptorSet> writes;
 
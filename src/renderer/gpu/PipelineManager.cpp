@@ -93,13 +93,49 @@ void PipelineManager::initShaders(DeletionQueue& dq) {
 	PipelinePresents::getPipelinePresentByID(PipelineID::BRDFLUT).shaderStagesInfo.push_back(brdfLutShaderStage);
 
 
-	// gpu frustum culling
+	// gpu frustum and hi-z occlusion culling
 	ShaderStageInfo visibilityShaderStage {
 		.stage = VK_SHADER_STAGE_COMPUTE_BIT,
 		.filePath = "res/shaders/visibility/visibility_comp.spv"
 	};
 	PipelinePresents::getPipelinePresentByID(PipelineID::Visibility).shaderStagesInfo.push_back(visibilityShaderStage);
 
+	ShaderStageInfo depthPyramidShaderStage {
+		.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+		.filePath = "res/shaders/visibility/depth_pyramid_comp.spv"
+	};
+	PipelinePresents::getPipelinePresentByID(PipelineID::DepthPyramid).shaderStagesInfo.push_back(depthPyramidShaderStage);
+
+	ShaderStageInfo frustumCullShaderStage {
+		.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+		.filePath = "res/shaders/visibility/frustum_cull_comp.spv"
+	};
+	PipelinePresents::getPipelinePresentByID(PipelineID::FrustumCull).shaderStagesInfo.push_back(frustumCullShaderStage);
+
+	ShaderStageInfo cullCompactShaderStage {
+		.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+		.filePath = "res/shaders/visibility/cull_compact_comp.spv"
+	};
+	PipelinePresents::getPipelinePresentByID(PipelineID::CullCompact).shaderStagesInfo.push_back(cullCompactShaderStage);
+
+	ShaderStageInfo batchCountShaderStage {
+		.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+		.filePath = "res/shaders/visibility/batch_count_comp.spv"
+	};
+	PipelinePresents::getPipelinePresentByID(PipelineID::BatchCount).shaderStagesInfo.push_back(batchCountShaderStage);
+
+	ShaderStageInfo batchScanShaderStage {
+		.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+		.filePath = "res/shaders/visibility/batch_scan_comp.spv"
+	};
+	PipelinePresents::getPipelinePresentByID(PipelineID::BatchScan).shaderStagesInfo.push_back(batchScanShaderStage);
+
+	ShaderStageInfo batchScatterShaderStage {
+		.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+		.filePath = "res/shaders/visibility/batch_scatter_comp.spv"
+	};
+	PipelinePresents::getPipelinePresentByID(PipelineID::BatchScatter).shaderStagesInfo.push_back(batchScatterShaderStage);
+
 
 	// Pipeline shaders defined, good to setup
 	for (size_t i = 0; i < static_cast<size_t>(PipelineID::Count); ++i) {
@@ -207,6 +243,12 @@ void PipelineManager::initPipelines(DeletionQueue& queue) {
 	// === COMPUTE PIPELINE SETUP STAGE ===
 
 	createPipeline(PipelineID::Visibility, PipelineCategory::Compute, "Visibility");
+	createPipeline(PipelineID::DepthPyramid, PipelineCategory::Compute, "DepthPyramid");
+	createPipeline(PipelineID::FrustumCull, PipelineCategory::Compute, "FrustumCull");
+	createPipeline(PipelineID::CullCompact, PipelineCategory::Compute, "CullCompact");
+	createPipeline(PipelineID::BatchCount, PipelineCategory::Compute, "BatchCount");
+	createPipeline(PipelineID::BatchScan, PipelineCategory::Compute, "BatchScan");
+	createPipeline(PipelineID::BatchScatter, PipelineCategory::Compute, "BatchScatter");
 	createPipeline(PipelineID::ToneMap, PipelineCategory::Compute, "ToneMap");
 	createPipeline(PipelineID::HDRToCubemap, PipelineCategory::Compute, "HDRToCubemap");
 	createPipeline(PipelineID::SpecularPrefilter, PipelineCategory::Compute, "SpecularPrefilter");
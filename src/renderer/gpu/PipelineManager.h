@@ -9,6 +9,12 @@ enum class PipelineID : uint8_t {
 	BoundingBox,
 	Skybox,
 	Visibility,
+	DepthPyramid,
+	FrustumCull,
+	CullCompact,
+	BatchCount,
+	BatchScan,
+	BatchScatter,
 	ToneMap,
 	HDRToCubemap,
 	SpecularPrefilter,
@@ -0,0 +1,133 @@
+#include "pch.h"
+
+#include "Visibility.h"
+#include "engine/JobSystem.h"
+#include "engine/platform/profiler/FrameCounters.h"
+
+// Background rebuilds. The worker only sees its own copies of the bounds and the live list, the
+// frame keeps editing, refitting and culling the old tree meanwhile. Everything that happened
+// in between is reconciled on the main thread when the new tree is swapped in.
+namespace Visibility {
+	struct PendingBVHBuild {
+		std::vector<AABB> world;
+		std::vector<uint32_t> leafIndex;
+		std::vector<BVHNode> nodes;
+		BVHBuildMode mode = BVHBuildMode::BinnedSAH;
+		bool linear = false;
+		uint32_t generation = 0;
+		// Last member, so it's released first and waits for the job before the lists go
+		std::shared_ptr<JobSystem::BackgroundTask> task;
+	};
+}
+
+void Visibility::setRowLoose(VisibilityState& vs, uint32_t row, bool loose) {
+	if (vs.looseSlot.size() <= row)
+		vs.looseSlot.resize(vs.instances.size(), ROW_INACTIVE);
+
+	const uint32_t slot = vs.looseSlot[row];
+	if (loose == (slot != ROW_INACTIVE)) return;
+
+	if (loose) {
+		vs.looseSlot[row] = static_cast<uint32_t>(vs.looseRows.size());
+		vs.looseRows.push_back(row);
+		return;
+	}
+
+	const uint32_t last = vs.looseRows.back();
+	vs.looseRows[slot] = last;
+	vs.looseSlot[last] = slot;
+	vs.looseRows.pop_back();
+	vs.looseSlot[row] = ROW_INACTIVE;
+}
+
+void Visibility::startAsyncBVHBuild(VisibilityState& vs) {
+	// Nothing would run the job until someone waits on it
+	if (JobSystem::getThreadCount() < 2) {
+		buildBVH(vs);
+		return;
+	}
+
+	auto pending = std::make_shared<PendingBVHBuild>();
+	pending->world = vs.worldAABBs;
+	pending->leafIndex = vs.active;
+	pending->mode = vs.buildMode;
+	pending->linear = prefersLinearBuild(vs, vs.active);
+	pending->generation = vs.buildGeneration;
+
+	PendingBVHBuild* build = pending.get();
+	pending->task = JobSystem::submitBackground([build] {
+		buildBVHNodes(build->world, build->leafIndex, build->mode, build->linear, build->nodes);
+	});
+	vs.pendingBuild = std::move(pending);
+}
+
+bool Visibility::finishAsyncBVHBuild(VisibilityState& vs, bool wait) {
+	if (!vs.pendingBuild) return false;
+	if (!JobSystem::isDone(*vs.pendingBuild->task)) {
+		if (!wait) return false;
+		JobSystem::waitFor(*vs.pendingBuild->task);
+	}
+
+	const std::shared_ptr<PendingBVHBuild> done = std::move(vs.pendingBuild);
+
+	// A synchronous build since the snapshot already held every row then, rows that turned loose
+	// after it were waiting on this build and need one of their own
+	if (done->generation != vs.buildGeneration) {
+		if (!vs.looseRows.empty()) startAsyncBVHBuild(vs);
+		return false;
+	}
+	if (done->nodes.empty()) {
+		buildBVH(vs);
+		return true;
+	}
+
+	vs.leafIndex = std::move(done->leafIndex);
+	vs.bvh = std::move(done->nodes);
+	vs.builtLinear = done->linear;
+	linkBVH(vs);
+
+	// Bounds kept moving after the snapshot, one full refit catches the tree up
+	refitBVH(vs.worldAABBs, vs.leafIndex, vs.bvh);
+	gatherLeafBounds(vs);
+	FrameCounters::add(FrameCounter::BVHRowsRefit, vs.leafIndex.size());
+	for (uint32_t row : vs.dirtyRows) vs.rowDirty[row] = 0;
+	vs.dirtyRows.clear();
+	vs.refitAll = false;
+
+	// Rows that died since the snapshot come out, the ones born since go in
+	std::vector<uint32_t> dead;
+	for (uint32_t row : vs.leafIndex)
+		if (vs.activeSlot[row] == ROW_INACTIVE) dead.push_back(row);
+	for (uint32_t row : dead) removeRowBVH(vs, row);
+
+	for (uint32_t row : vs.looseRows) vs.looseSlot[row] = ROW_INACTIVE;
+	vs.looseRows.clear();
+
+	std::vector<uint32_t> born;
+	for (uint32_t row : vs.active)
+		if (row >= vs.rowLeaf.size() || vs.rowLeaf[row] == BVH_NO_NODE) born.push_back(row);
+
+	if (vs.bvh.empty()) {
+		buildBVH(vs);
+		return true;
+	}
+
+	// Same call updateBVHIncremental makes for a fresh batch
+	if (born.size() >= BVH_ASYNC_MIN_ADDED_ROWS) {
+		for (uint32_t row : born) setRowLoose(vs, row, true);
+		startAsyncBVHBuild(vs);
+	}
+	else {
+		for (uint32_t row : born) insertRowBVH(vs, row);
+	}
+
+	vs.builtSAHCost = computeSAHCost(vs.bvh);
+	vs.editsSinceCheck = 0;
+	vs.refitsSinceCheck = 0;
+
+	if (vs.layout != BVHLayout::Binary)
+		buildBVH4(vs);
+	else
+		vs.bvh4.clear();
+	return true;
+}
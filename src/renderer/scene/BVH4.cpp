@@ -0,0 +1,290 @@
+#include "pch.h"
+
+#include "Visibility.h"
+
+#include <bit>
+
+namespace Visibility {
+	static inline void setSlotBounds(BVH4Node& n, uint32_t slot, const glm::vec3& vmin, const glm::vec3& vmax) {
+		n.minX[slot] = vmin.x; n.minY[slot] = vmin.y; n.minZ[slot] = vmin.z;
+		n.maxX[slot] = vmax.x; n.maxY[slot] = vmax.y; n.maxZ[slot] = vmax.z;
+	}
+
+	// Pulls up to 4 binary nodes under b by repeatedly opening the largest internal one,
+	// then writes the 4-wide node and recurses into its internal slots in slot order.
+	static uint32_t collapseRecursive(
+		const std::vector<BVHNode>& bin,
+		std::vector<BVH4Node>& out,
+		uint32_t b,
+		uint32_t skip)
+	{
+		uint32_t slots[4]{};
+		uint32_t slotCount = 0;
+
+		if (bin[b].count) {
+			slots[slotCount++] = b; // single leaf tree
+		}
+		else {
+			slots[slotCount++] = static_cast<uint32_t>(bin[b].left);
+			slots[slotCount++] = static_cast<uint32_t>(bin[b].right);
+
+			while (slotCount < 4) {
+				int open = -1;
+				float openArea = -1.0f;
+				for (uint32_t i = 0; i < slotCount; ++i) {
+					const BVHNode& n = bin[slots[i]];
+					if (n.count) continue;
+					const float area = aabbHalfArea(n.box.vmin, n.box.vmax);
+					if (area > openArea) {
+						openArea = area;
+						open = static_cast<int>(i);
+					}
+				}
+				if (open < 0) break;
+
+				// keep spatial order: left child takes the slot, right child goes right after it
+				const BVHNode& n = bin[slots[open]];
+				for (uint32_t i = slotCount; i > static_cast<uint32_t>(open) + 1; --i)
+					slots[i] = slots[i - 1];
+				slots[open] = static_cast<uint32_t>(n.left);
+				slots[open + 1] = static_cast<uint32_t>(n.right);
+				++slotCount;
+			}
+		}
+
+		const uint32_t idx = static_cast<uint32_t>(out.size());
+		out.emplace_back();
+		{
+			BVH4Node& node = out[idx];
+			for (uint32_t i = 0; i < 4; ++i) {
+				setSlotBounds(node, i, glm::vec3(1e30f), glm::vec3(-1e30f));
+				node.child[i] = BVH4_EMPTY_SLOT;
+				node.count[i] = 0;
+			}
+			node.skip = skip;
+			node.slots = static_cast<uint8_t>(slotCount);
+
+			for (uint32_t i = 0; i < slotCount; ++i) {
+				const BVHNode& n = bin[slots[i]];
+				setSlotBounds(node, i, n.box.vmin, n.box.vmax);
+				if (n.count) {
+					node.child[i] = n.first;
+					node.count[i] = n.count;
+				}
+			}
+		}
+
+		for (uint32_t i = 0; i < slotCount; ++i) {
+			if (bin[slots[i]].count) continue;
+
+			// once the child's subtree is done the walk comes back for the next slot here
+			const uint32_t childSkip = (i + 1 < slotCount) ? bvh4Cursor(idx, i + 1) : skip;
+			const uint32_t c = collapseRecursive(bin, out, slots[i], childSkip);
+			out[idx].child[i] = c;
+		}
+
+		return idx;
+	}
+
+	static void quantizeNode(const BVH4Node& n, BVH4QNode& q) {
+		glm::vec3 nmin(1e30f), nmax(-1e30f);
+		for (uint32_t i = 0; i < n.slots; ++i) {
+			nmin = glm::min(nmin, glm::vec3(n.minX[i], n.minY[i], n.minZ[i]));
+			nmax = glm::max(nmax, glm::vec3(n.maxX[i], n.maxY[i], n.maxZ[i]));
+		}
+
+		q.origin = nmin;
+		for (int a = 0; a < 3; ++a) {
+			float scale = (nmax[a] - nmin[a]) / 65535.0f;
+			// the top step has to reach the node max after rounding
+			while (scale > 0.0f && nmin[a] + 65535.0f * scale < nmax[a])
+				scale = std::nextafter(scale, std::numeric_limits<float>::max());
+			q.scale[a] = scale;
+		}
+
+		const float* mins[3] = { n.minX, n.minY, n.minZ };
+		const float* maxs[3] = { n.maxX, n.maxY, n.maxZ };
+
+		for (uint32_t i = 0; i < 4; ++i) {
+			for (int a = 0; a < 3; ++a) {
+				uint32_t lo = 0, hi = 0;
+				const float o = q.origin[a], s = q.scale[a];
+				if (i < n.slots && s > 0.0f) {
+					lo = static_cast<uint32_t>(std::clamp(std::floor((mins[a][i] - o) / s), 0.0f, 65535.0f));
+					hi = static_cast<uint32_t>(std::clamp(std::ceil((maxs[a][i] - o) / s), 0.0f, 65535.0f));
+					while (lo > 0 && o + static_cast<float>(lo) * s > mins[a][i]) --lo;
+					while (hi < 65535 && o + static_cast<float>(hi) * s < maxs[a][i]) ++hi;
+				}
+				q.qmin[a][i] = static_cast<uint16_t>(lo);
+				q.qmax[a][i] = static_cast<uint16_t>(hi);
+			}
+			q.child[i] = n.child[i];
+			q.count[i] = n.count[i];
+		}
+		q.skip = n.skip;
+		q.slots = n.slots;
+	}
+
+	static void quantizeBVH4(BVH4& tree) {
+		tree.qnodes.resize(tree.nodes.size());
+		for (size_t i = 0; i < tree.nodes.size(); ++i)
+			quantizeNode(tree.nodes[i], tree.qnodes[i]);
+	}
+
+	// All four slots at once, bit i set when slot i may be visible. Callers mask off unused slots
+	static inline uint32_t testSlots(const BVH4Node& n, const CullFrustum& frus) {
+		return cullBox4(n.minX, n.minY, n.minZ, n.maxX, n.maxY, n.maxZ, frus);
+	}
+
+	static inline uint32_t testSlots(const BVH4QNode& n, const CullFrustum& frus) {
+		float mn[3][4], mx[3][4];
+		for (int a = 0; a < 3; ++a) {
+			for (uint32_t i = 0; i < 4; ++i) {
+				mn[a][i] = n.origin[a] + static_cast<float>(n.qmin[a][i]) * n.scale[a];
+				mx[a][i] = n.origin[a] + static_cast<float>(n.qmax[a][i]) * n.scale[a];
+			}
+		}
+		return cullBox4(mn[0], mn[1], mn[2], mx[0], mx[1], mx[2], frus);
+	}
+
+	// Stackless walk: a cursor names the node and the first slot still to visit. Entering an
+	// internal slot moves the cursor into the child, finishing a node jumps to its skip cursor,
+	// which re-enters the parent at the next slot. A node's slots are tested once, when the walk
+	// first enters it, and the ones still to visit are kept per node for when it comes back.
+	template<typename Node>
+	static void walkBVH4(
+		const VisibilityState& vs,
+		const std::vector<Node>& nodes,
+		const CullFrustum& cullFrus,
+		std::vector<GPUInstance>& visibleInstances,
+		std::vector<AABB>& visibleWorldAABBs,
+		CullStats& stats)
+	{
+		uint32_t accepted[BVH_MAX_LEAF_ROWS];
+		std::vector<uint32_t> bigLeaf; // median leaves of stacked copies can exceed BVH_MAX_LEAF_ROWS
+
+		// Every node is entered at slot 0 before any skip cursor leads back to it, so the
+		// entries never need clearing
+		static thread_local std::vector<uint8_t> pendingSlots;
+		if (pendingSlots.size() < nodes.size()) pendingSlots.resize(nodes.size());
+
+		uint32_t cursor = bvh4Cursor(0, 0);
+		while (cursor != BVH4_CURSOR_END) {
+			const uint32_t nodeIdx = cursor >> 2;
+			const Node& node = nodes[nodeIdx];
+			const uint32_t firstSlot = cursor & 3u;
+
+			uint32_t mask;
+			if (firstSlot == 0) {
+				const uint32_t slotMask = (1u << node.slots) - 1u;
+				stats.nodesVisited += static_cast<uint32_t>(std::popcount(slotMask));
+				stats.planeTests += 6u * static_cast<uint32_t>(std::popcount(slotMask));
+				mask = testSlots(node, cullFrus) & slotMask;
+			}
+			else {
+				mask = pendingSlots[nodeIdx] & ~((1u << firstSlot) - 1u);
+			}
+			cursor = node.skip;
+
+			while (mask) {
+				const uint32_t slot = static_cast<uint32_t>(std::countr_zero(mask));
+				mask &= mask - 1u;
+
+				if (!node.count[slot]) {
+					pendingSlots[nodeIdx] = static_cast<uint8_t>(mask);
+					cursor = bvh4Cursor(node.child[slot], 0);
+					break;
+				}
+
+				const uint32_t count = node.count[slot];
+				uint32_t* out = accepted;
+				if (count > BVH_MAX_LEAF_ROWS) {
+					bigLeaf.resize(count);
+					out = bigLeaf.data();
+				}
+
+				stats.leavesTested += count;
+				stats.planeTests += 6u * count;
+				const uint32_t passed = cullBounds(vs.leafBounds, node.child[slot], count, cullFrus, vs.cullKernel, out);
+				for (uint32_t i = 0; i < passed; ++i) {
+					const uint32_t idx = vs.leafIndex[out[i]];
+					visibleWorldAABBs.push_back(vs.worldAABBs[idx]);
+					visibleInstances.push_back(vs.instances[idx]);
+				}
+				stats.leavesAccepted += passed;
+			}
+		}
+	}
+}
+
+void Visibility::buildBVH4(VisibilityState& vs) {
+	vs.bvh4.clear();
+	vs.bvh4Stale = false;
+	vs.editsSinceCollapse = 0;
+	if (vs.bvh.empty()) return;
+
+	vs.bvh4.nodes.reserve(vs.bvh.size() / 2 + 1);
+	collapseRecursive(vs.bvh, vs.bvh4.nodes, 0u, BVH4_CURSOR_END);
+
+	if (vs.layout == BVHLayout::BVH4Quantized)
+		quantizeBVH4(vs.bvh4);
+}
+
+void Visibility::refitBVH4(VisibilityState& vs) {
+	auto& nodes = vs.bvh4.nodes;
+	const BoundsSoA& lb = vs.leafBounds;
+
+	// Children always sit after their parent, so a reverse sweep sees them first
+	for (size_t n = nodes.size(); n-- > 0;) {
+		BVH4Node& node = nodes[n];
+		for (uint32_t i = 0; i < node.slots; ++i) {
+			glm::vec3 vmin(1e30f), vmax(-1e30f);
+
+			if (node.count[i]) {
+				const uint32_t first = node.child[i];
+				for (uint32_t r = first; r < first + node.count[i]; ++r) {
+					vmin = glm::min(vmin, glm::vec3(lb.minX[r], lb.minY[r], lb.minZ[r]));
+					vmax = glm::max(vmax, glm::vec3(lb.maxX[r], lb.maxY[r], lb.maxZ[r]));
+				}
+			}
+			else {
+				const BVH4Node& c = nodes[node.child[i]];
+				for (uint32_t k = 0; k < c.slots; ++k) {
+					vmin = glm::min(vmin, glm::vec3(c.minX[k], c.minY[k], c.minZ[k]));
+					vmax = glm::max(vmax, glm::vec3(c.maxX[k], c.maxY[k], c.maxZ[k]));
+				}
+			}
+
+			setSlotBounds(node, i, vmin, vmax);
+		}
+	}
+
+	if (vs.layout == BVHLayout::BVH4Quantized)
+		quantizeBVH4(vs.bvh4);
+}
+
+void Visibility::cullBVH4Collect(
+	const VisibilityState& vs,
+	const Frustum& frus,
+	std::vector<GPUInstance>& visibleInstances,
+	std::vector<AABB>& visibleWorldAABBs,
+	CullStats* stats)
+{
+	visibleInstances.clear();
+	visibleWorldAABBs.clear();
+	if (vs.bvh4.nodes.empty()) return;
+
+	visibleInstances.reserve(vs.active.size());
+	visibleWorldAABBs.reserve(vs.active.size());
+
+	CullStats local{};
+	const CullFrustum cullFrus = prepareCullFrustum(frus);
+
+	if (vs.layout == BVHLayout::BVH4Quantized && !vs.bvh4.qnodes.empty())
+		walkBVH4(vs, vs.bvh4.qnodes, cullFrus, visibleInstances, visibleWorldAABBs, local);
+	else
+		walkBVH4(vs, vs.bvh4.nodes, cullFrus, visibleInstances, visibleWorldAABBs, local);
+
+	countCullStats(local);
+	if (stats) *stats = local;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "common/Vk_Types.h"
+
+// 4-wide BVH collapsed from the binary tree. Nodes are stored depth first, every node
+// right after its parent, and carry a skip cursor so the cull walks it without a stack.
+namespace Visibility {
+	// Traversal position: node index in the upper bits, child slot in the low two
+	constexpr uint32_t BVH4_CURSOR_END = UINT32_MAX;
+	constexpr uint32_t BVH4_EMPTY_SLOT = UINT32_MAX;
+
+	inline uint32_t bvh4Cursor(uint32_t node, uint32_t slot) { return (node << 2) | slot; }
+
+	struct BVH4Node {
+		float minX[4], minY[4], minZ[4]; // child bounds, one lane per slot
+		float maxX[4], maxY[4], maxZ[4];
+		uint32_t child[4]; // internal slot: node index, leaf slot: first row in leafIndex
+		uint16_t count[4]; // rows in a leaf slot, 0 for internal slots
+		uint32_t skip;     // cursor to continue from once this subtree is done
+		uint8_t slots;     // used slots, always packed from slot 0
+	};
+
+	// Child bounds as 16-bit steps inside the node's own box, rounded outwards so the
+	// dequantized boxes always contain the real ones
+	struct BVH4QNode {
+		glm::vec3 origin; // node box min
+		glm::vec3 scale;  // size of one step per axis
+		uint16_t qmin[3][4];
+		uint16_t qmax[3][4];
+		uint32_t child[4];
+		uint16_t count[4];
+		uint32_t skip;
+		uint8_t slots;
+	};
+
+	struct BVH4 {
+		std::vector<BVH4Node> nodes;   // build and refit always work on these
+		std::vector<BVH4QNode> qnodes; // traversal copy, only kept for BVHLayout::BVH4Quantized
+
+		inline void clear() {
+			nodes.clear();
+			qnodes.clear();
+		}
+	};
+}
@@ -0,0 +1,328 @@
+#include "pch.h"
+
+#include "Visibility.h"
+
+// In-place edits of the binary BVH. Freed node slots are marked with count 0 and left -1,
+// and the root always stays at index 0 since every walk starts there.
+namespace Visibility {
+	static inline AABB unionBox(const AABB& a, const AABB& b) {
+		AABB r{};
+		r.vmin = glm::min(a.vmin, b.vmin);
+		r.vmax = glm::max(a.vmax, b.vmax);
+		r.origin = 0.5f * (r.vmin + r.vmax);
+		r.extent = 0.5f * (r.vmax - r.vmin);
+		r.sphereRadius = glm::length(r.extent);
+		return r;
+	}
+
+	static inline float areaOf(const AABB& b) { return aabbHalfArea(b.vmin, b.vmax); }
+	static inline float unionArea(const AABB& a, const AABB& b) {
+		return aabbHalfArea(glm::min(a.vmin, b.vmin), glm::max(a.vmax, b.vmax));
+	}
+
+	static uint32_t allocNode(VisibilityState& vs) {
+		if (!vs.freeNodes.empty()) {
+			const uint32_t n = vs.freeNodes.back();
+			vs.freeNodes.pop_back();
+			vs.bvh[n] = BVHNode{};
+			vs.bvhParent[n] = -1;
+			return n;
+		}
+		vs.bvh.emplace_back();
+		vs.bvhParent.push_back(-1);
+		return static_cast<uint32_t>(vs.bvh.size() - 1);
+	}
+
+	static void freeNode(VisibilityState& vs, uint32_t n) {
+		vs.bvh[n] = BVHNode{};
+		vs.bvhParent[n] = -1;
+		vs.freeNodes.push_back(n);
+	}
+
+	static void replaceChild(VisibilityState& vs, uint32_t parent, uint32_t oldChild, uint32_t newChild) {
+		BVHNode& p = vs.bvh[parent];
+		if (p.left == static_cast<int>(oldChild)) p.left = static_cast<int>(newChild);
+		else p.right = static_cast<int>(newChild);
+		vs.bvhParent[newChild] = static_cast<int>(parent);
+	}
+
+	// Moves a node to another slot and repoints everything that referenced it
+	static void moveNode(VisibilityState& vs, uint32_t from, uint32_t to) {
+		vs.bvh[to] = vs.bvh[from];
+		vs.bvhParent[to] = vs.bvhParent[from];
+
+		const BVHNode& n = vs.bvh[to];
+		if (n.count) {
+			for (uint32_t i = n.first; i < n.first + n.count; ++i)
+				vs.rowLeaf[vs.leafIndex[i]] = to;
+		}
+		else {
+			vs.bvhParent[n.left] = static_cast<int>(to);
+			vs.bvhParent[n.right] = static_cast<int>(to);
+		}
+
+		if (vs.bvhParent[to] >= 0)
+			replaceChild(vs, static_cast<uint32_t>(vs.bvhParent[to]), from, to);
+	}
+
+	static void refitLeaf(VisibilityState& vs, uint32_t n) {
+		BVHNode& leaf = vs.bvh[n];
+		AABB b = vs.worldAABBs[vs.leafIndex[leaf.first]];
+		for (uint32_t i = leaf.first + 1; i < leaf.first + leaf.count; ++i)
+			b = unionBox(b, vs.worldAABBs[vs.leafIndex[i]]);
+		leaf.box = b;
+	}
+
+	// Swaps one child of A with a grandchild under its other child when that shrinks the
+	// other child's box the most. A's own box doesn't change.
+	static void rotate(VisibilityState& vs, uint32_t a) {
+		BVHNode& A = vs.bvh[a];
+		const uint32_t b = static_cast<uint32_t>(A.left);
+		const uint32_t c = static_cast<uint32_t>(A.right);
+
+		// child trades places with grand, one of inner's children, other is inner's remaining child
+		struct Rotation { uint32_t child, inner, grand, other; float gain; };
+		Rotation best{ 0, 0, 0, 0, 0.0f };
+
+		auto consider = [&](uint32_t child, uint32_t inner) {
+			const BVHNode& I = vs.bvh[inner];
+			if (I.count) return;
+			const uint32_t g0 = static_cast<uint32_t>(I.left);
+			const uint32_t g1 = static_cast<uint32_t>(I.right);
+			const float base = areaOf(I.box);
+
+			// child takes g0's place, inner then spans child + g1
+			const float gain0 = base - unionArea(vs.bvh[child].box, vs.bvh[g1].box);
+			if (gain0 > best.gain) best = { child, inner, g0, g1, gain0 };
+
+			const float gain1 = base - unionArea(vs.bvh[child].box, vs.bvh[g0].box);
+			if (gain1 > best.gain) best = { child, inner, g1, g0, gain1 };
+		};
+		consider(b, c);
+		consider(c, b);
+
+		if (best.gain <= 0.0f) return;
+
+		// child and grand trade places, inner gets refit around child + other
+		replaceChild(vs, a, best.child, best.grand);
+		replaceChild(vs, best.inner, best.grand, best.child);
+		vs.bvh[best.inner].box = unionBox(vs.bvh[best.child].box, vs.bvh[best.other].box);
+	}
+
+	// Recomputes boxes from n up to the root, rotating on the way
+	static void refitUpward(VisibilityState& vs, int n) {
+		while (n >= 0) {
+			BVHNode& node = vs.bvh[n];
+			node.box = unionBox(vs.bvh[node.left].box, vs.bvh[node.right].box);
+			rotate(vs, static_cast<uint32_t>(n));
+			n = vs.bvhParent[n];
+		}
+	}
+
+	// Branch and bound over the tree: cost of a sibling is the area of the new parent plus
+	// the growth of every ancestor, subtrees whose lower bound can't win are skipped
+	static uint32_t findBestSibling(const VisibilityState& vs, const AABB& box) {
+		struct Candidate {
+			uint32_t node;
+			float inherited;
+			bool operator<(const Candidate& o) const { return inherited > o.inherited; }
+		};
+
+		const float leafArea = areaOf(box);
+		uint32_t best = 0;
+		float bestCost = unionArea(vs.bvh[0].box, box);
+
+		std::vector<Candidate> heap;
+		heap.push_back({ 0u, 0.0f });
+
+		while (!heap.empty()) {
+			std::pop_heap(heap.begin(), heap.end());
+			const Candidate cand = heap.back();
+			heap.pop_back();
+
+			const BVHNode& n = vs.bvh[cand.node];
+			const float direct = unionArea(n.box, box);
+			const float cost = direct + cand.inherited;
+			if (cost < bestCost) {
+				bestCost = cost;
+				best = cand.node;
+			}
+
+			if (n.count) continue;
+
+			const float inherited = cand.inherited + direct - areaOf(n.box);
+			if (leafArea + inherited >= bestCost) continue;
+
+			heap.push_back({ static_cast<uint32_t>(n.left), inherited });
+			std::push_heap(heap.begin(), heap.end());
+			heap.push_back({ static_cast<uint32_t>(n.right), inherited });
+			std::push_heap(heap.begin(), heap.end());
+		}
+
+		return best;
+	}
+}
+
+void Visibility::insertRowBVH(VisibilityState& vs, uint32_t row) {
+	if (vs.rowLeaf.size() < vs.instances.size())
+		vs.rowLeaf.resize(vs.instances.size(), BVH_NO_NODE);
+	ASSERT(vs.rowLeaf[row] == BVH_NO_NODE);
+
+	// one-row leaf in a slot a removal freed, or at the end of leafIndex
+	uint32_t slot;
+	if (!vs.freeLeafSlots.empty()) {
+		slot = vs.freeLeafSlots.back();
+		vs.freeLeafSlots.pop_back();
+		vs.leafIndex[slot] = row;
+	}
+	else {
+		slot = static_cast<uint32_t>(vs.leafIndex.size());
+		vs.leafIndex.push_back(row);
+		vs.leafBounds.resize(slot + 1);
+	}
+	vs.leafBounds.set(slot, vs.worldAABBs[row]);
+
+	const uint32_t leaf = allocNode(vs);
+	vs.bvh[leaf].box = vs.worldAABBs[row];
+	vs.bvh[leaf].first = slot;
+	vs.bvh[leaf].count = 1;
+	vs.rowLeaf[row] = leaf;
+
+	if (leaf == 0) return; // tree was empty
+
+	const uint32_t sibling = findBestSibling(vs, vs.bvh[leaf].box);
+
+	uint32_t parent = allocNode(vs);
+	if (sibling == 0) {
+		// new parent becomes the root, the old root moves out of slot 0
+		moveNode(vs, 0, parent);
+		vs.bvh[0] = BVHNode{};
+		vs.bvhParent[0] = -1;
+		vs.bvh[0].left = static_cast<int>(parent);
+		vs.bvh[0].right = static_cast<int>(leaf);
+		vs.bvhParent[parent] = 0;
+		vs.bvhParent[leaf] = 0;
+		vs.bvh[0].box = unionBox(vs.bvh[parent].box, vs.bvh[leaf].box);
+		return;
+	}
+
+	const uint32_t grand = static_cast<uint32_t>(vs.bvhParent[sibling]);
+	replaceChild(vs, grand, sibling, parent);
+	vs.bvh[parent].left = static_cast<int>(sibling);
+	vs.bvh[parent].right = static_cast<int>(leaf);
+	vs.bvhParent[sibling] = static_cast<int>(parent);
+	vs.bvhParent[leaf] = static_cast<int>(parent);
+
+	refitUpward(vs, static_cast<int>(parent));
+}
+
+void Visibility::removeRowBVH(VisibilityState& vs, uint32_t row) {
+	if (row >= vs.rowLeaf.size() || vs.rowLeaf[row] == BVH_NO_NODE) return;
+
+	const uint32_t leaf = vs.rowLeaf[row];
+	vs.rowLeaf[row] = BVH_NO_NODE;
+
+	// swap the row to the end of the leaf's range and shorten it
+	BVHNode& node = vs.bvh[leaf];
+	const uint32_t last = node.first + node.count - 1;
+	for (uint32_t i = node.first; i <= last; ++i) {
+		if (vs.leafIndex[i] != row) continue;
+		std::swap(vs.leafIndex[i], vs.leafIndex[last]);
+		vs.leafBounds.set(i, vs.worldAABBs[vs.leafIndex[i]]);
+		vs.leafBounds.set(last, vs.worldAABBs[vs.leafIndex[last]]);
+		break;
+	}
+	--node.count;
+	vs.freeLeafSlots.push_back(last);
+
+	if (node.count) {
+		refitLeaf(vs, leaf);
+		refitUpward(vs, vs.bvhParent[leaf]);
+		return;
+	}
+
+	const int parent = vs.bvhParent[leaf];
+	if (parent < 0) {
+		// last row in the tree
+		vs.bvh.clear();
+		vs.bvhParent.clear();
+		vs.freeNodes.clear();
+		vs.freeLeafSlots.clear();
+		vs.leafIndex.clear();
+		vs.leafBounds.clear();
+		return;
+	}
+
+	const BVHNode& p = vs.bvh[parent];
+	const uint32_t sibling = static_cast<uint32_t>(p.left == static_cast<int>(leaf) ? p.right : p.left);
+	const int grand = vs.bvhParent[parent];
+	freeNode(vs, leaf);
+
+	if (grand < 0) {
+		// parent was the root, the sibling takes slot 0
+		vs.bvhParent[sibling] = -1;
+		moveNode(vs, sibling, 0);
+		vs.bvhParent[0] = -1;
+		freeNode(vs, sibling);
+		return;
+	}
+
+	replaceChild(vs, static_cast<uint32_t>(grand), static_cast<uint32_t>(parent), sibling);
+	freeNode(vs, static_cast<uint32_t>(parent));
+	refitUpward(vs, grand);
+}
+
+bool Visibility::updateBVHIncremental(VisibilityState& vs, const VisibilitySyncResult& sync) {
+	const size_t delta = sync.addedRows.size() + sync.removedRows.size();
+	const bool large = static_cast<float>(delta) > static_cast<float>(vs.active.size()) * BVH_INCREMENTAL_MAX_FRACTION;
+	const bool background = vs.asyncRebuild && !vs.bvh.empty();
+	// Inserts cost a tree search each, with background builds a big batch waits for one instead
+	const bool deferAdds = background && (large || sync.addedRows.size() >= BVH_ASYNC_MIN_ADDED_ROWS);
+
+	if (vs.bvh.empty() || (large && !background)) {
+		buildBVH(vs);
+		return true;
+	}
+
+	// Rows can come and go within one sync, the live list has the final word
+	for (uint32_t row : sync.removedRows) {
+		removeRowBVH(vs, row);
+		setRowLoose(vs, row, false);
+	}
+	for (uint32_t row : sync.addedRows) {
+		const bool inTree = row < vs.rowLeaf.size() && vs.rowLeaf[row] != BVH_NO_NODE;
+		if (vs.activeSlot[row] == ROW_INACTIVE || inTree) continue;
+		// A large batch waits for the background build, culled flat until then
+		if (deferAdds) setRowLoose(vs, row, true);
+		else insertRowBVH(vs, row);
+	}
+	if (deferAdds && !vs.pendingBuild) startAsyncBVHBuild(vs);
+
+	// Inserts take freed slots first, only a net shrink leaves many behind for the full passes
+	// over leafIndex to skip
+	const bool sparse = static_cast<float>(vs.freeLeafSlots.size()) > static_cast<float>(vs.leafIndex.size()) * BVH_DEAD_SLOT_MAX_FRACTION;
+
+	// Quality check costs a full pass, spread it over enough edits to stay O(1) per edit
+	vs.editsSinceCheck += static_cast<uint32_t>(delta);
+	if (!vs.bvh.empty() && (sparse || vs.editsSinceCheck * 8 >= vs.bvh.size())) {
+		vs.editsSinceCheck = 0;
+		if (sparse || computeSAHCost(vs.bvh) > vs.builtSAHCost * BVH_REBUILD_COST_RATIO) {
+			if (!background) {
+				buildBVH(vs);
+				return true;
+			}
+			if (!vs.pendingBuild) startAsyncBVHBuild(vs);
+		}
+	}
+
+	// The 4-wide layouts are derived and a collapse is O(n), the edits stay on the binary tree
+	// until they settle or pass an eighth of it, which keeps each edit O(log n) amortized
+	if (vs.layout != BVHLayout::Binary) {
+		vs.bvh4Stale = true;
+		vs.editsSinceCollapse += static_cast<uint32_t>(delta);
+		if (vs.editsSinceCollapse * 8 >= vs.bvh.size())
+			buildBVH4(vs);
+	}
+
+	return false;
+}
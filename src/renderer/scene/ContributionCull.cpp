@@ -0,0 +1,79 @@
+#include "pch.h"
+
+#include "ContributionCull.h"
+
+namespace Visibility {
+	static uint32_t levelForSize(float pixels, uint32_t levelCount) {
+		uint32_t level = 0;
+		while (level + 1 < levelCount && pixels < LOD_PIXEL_SIZES[level]) ++level;
+		return level;
+	}
+}
+
+uint32_t Visibility::selectLOD(float pixels, uint32_t current, uint32_t levelCount, float hysteresis) {
+	current = std::min(current, levelCount - 1);
+
+	// Coarser only if it still holds with the size pushed up, finer only if it holds pushed down
+	const uint32_t coarser = levelForSize(pixels * (1.0f + hysteresis), levelCount);
+	const uint32_t finer = levelForSize(pixels * (1.0f - hysteresis), levelCount);
+
+	if (coarser > current) return coarser;
+	if (finer < current) return finer;
+	return current;
+}
+
+void Visibility::cullContribution(
+	const ContributionSettings& settings,
+	LODState& state,
+	const glm::vec3& camPos,
+	float scale,
+	const std::vector<MeshLODs>& meshLODs,
+	std::vector<GPUInstance>& visibleInstances,
+	std::vector<AABB>& visibleWorldAABBs,
+	std::vector<uint8_t>& visibleLODs,
+	ContributionStats* stats)
+{
+	const size_t count = visibleInstances.size();
+	visibleLODs.resize(count);
+
+	size_t kept = 0;
+	uint32_t levelRows[MAX_MESH_LODS] = {};
+
+	for (size_t i = 0; i < count; ++i) {
+		const float pixels = projectedPixelSize(visibleWorldAABBs[i], camPos, scale);
+		if (settings.contributionCull && pixels < settings.minPixelSize) continue;
+
+		const GPUInstance& inst = visibleInstances[i];
+		uint32_t level = 0;
+
+		if (settings.lodSelection) {
+			const uint32_t levelCount = meshLODs[inst.meshID].count;
+			if (levelCount > 1) {
+				const float biased = pixels * settings.lodBias;
+				const uint64_t key = (static_cast<uint64_t>(inst.transformID) << 32) | inst.meshID;
+
+				auto [it, inserted] = state.levels.try_emplace(key, static_cast<uint8_t>(0));
+				level = inserted
+					? levelForSize(biased, levelCount)
+					: selectLOD(biased, it->second, levelCount, settings.lodHysteresis);
+				it->second = static_cast<uint8_t>(level);
+			}
+		}
+
+		visibleInstances[kept] = inst;
+		visibleWorldAABBs[kept] = visibleWorldAABBs[i];
+		visibleLODs[kept] = static_cast<uint8_t>(level);
+		++levelRows[level];
+		++kept;
+	}
+
+	visibleInstances.resize(kept);
+	visibleWorldAABBs.resize(kept);
+	visibleLODs.resize(kept);
+
+	if (stats) {
+		stats->tested = static_cast<uint32_t>(count);
+		stats->culled = static_cast<uint32_t>(count - kept);
+		std::copy(std::begin(levelRows), std::end(levelRows), std::begin(stats->levelRows));
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "common/ResourceTypes.h"
+
+// Screen size stage after the frustum and occlusion culls. Rows whose bounding sphere covers
+// fewer pixels than the threshold are dropped, the rest get a detail level from the same size.
+// Levels only move once the size is clear of a boundary, so rows sitting on one don't flicker.
+namespace Visibility {
+	// Projected diameter in pixels below which each level after 0 is used
+	constexpr float LOD_PIXEL_SIZES[MAX_MESH_LODS - 1] = { 240.0f, 96.0f, 32.0f };
+
+	struct ContributionSettings {
+		bool contributionCull = true;
+		float minPixelSize = 2.0f;
+		bool lodSelection = true;
+		float lodBias = 1.0f;       // scales the size before picking a level, below 1 picks coarser
+		float lodHysteresis = 0.1f; // fraction a size has to clear a level boundary by
+	};
+
+	// Last level of every row that was drawn, keyed by (transformID, meshID). Rows that go out
+	// of view keep their entry, it only decides which way a boundary is crossed when they're back.
+	struct LODState {
+		std::unordered_map<uint64_t, uint8_t> levels;
+
+		inline void clear() { levels.clear(); }
+	};
+
+	struct ContributionStats {
+		uint32_t tested = 0;
+		uint32_t culled = 0;
+		uint32_t levelRows[MAX_MESH_LODS] = {};
+	};
+
+	// Pixels per world unit at distance 1, the scale projectedPixelSize divides by distance
+	inline float pixelScale(const glm::mat4& proj, float viewportHeight) {
+		return std::abs(proj[1][1]) * 0.5f * viewportHeight;
+	}
+
+	// Bounding sphere diameter on screen, unbounded once the camera is inside the sphere
+	inline float projectedPixelSize(const AABB& box, const glm::vec3& camPos, float scale) {
+		const float dist = glm::length(box.origin - camPos);
+		if (dist <= box.sphereRadius) return std::numeric_limits<float>::max();
+		return 2.0f * box.sphereRadius * scale / dist;
+	}
+
+	// Level for a size given the level drawn last, levelCount is how many the mesh has
+	uint32_t selectLOD(float pixels, uint32_t current, uint32_t levelCount, float hysteresis);
+
+	// Compacts the visible lists in place and fills levels parallel to what's left
+	void cullContribution(
+		const ContributionSettings& settings,
+		LODState& state,
+		const glm::vec3& camPos,
+		float scale,
+		const std::vector<MeshLODs>& meshLODs,
+		std::vector<GPUInstance>& visibleInstances,
+		std::vector<AABB>& visibleWorldAABBs,
+		std::vector<uint8_t>& visibleLODs,
+		ContributionStats* stats = nullptr);
+}
@@ -0,0 +1,65 @@
+#include "pch.h"
+
+#include "CullBatches.h"
+
+void Visibility::buildCullBatches(
+	const VisibilityState& vs,
+	const std::vector<GPUMeshData>& meshes,
+	CullBatchTable& table)
+{
+	table.clear();
+
+	std::vector<std::pair<uint64_t, uint32_t>> keyed;
+	keyed.reserve(vs.active.size());
+	for (uint32_t row : vs.active) {
+		if (static_cast<MaterialPass>(vs.instances[row].passType) != MaterialPass::Opaque)
+			table.transparentRows.push_back(row);
+		else
+			keyed.emplace_back(cullBatchKey(vs.instances[row]), row);
+	}
+
+	// Opaque instances and draws go after every slot the transparents could take
+	const uint32_t reserved = static_cast<uint32_t>(table.transparentRows.size());
+
+	// Stable keeps rows of a batch in VisibilityState order
+	std::stable_sort(keyed.begin(), keyed.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+	table.rows.reserve(keyed.size());
+	table.sourceRows.reserve(keyed.size());
+	table.rowEntry.assign(vs.instances.size(), ROW_INACTIVE);
+
+	for (size_t i = 0; i < keyed.size(); ++i) {
+		const GPUInstance& inst = vs.instances[keyed[i].second];
+
+		if (i == 0 || keyed[i].first != keyed[i - 1].first) {
+			const GPUMeshData& mesh = meshes[inst.meshID];
+
+			table.batches.push_back(CullBatch{
+				.indexCount = mesh.indexCount,
+				.firstIndex = mesh.firstIndex,
+				.vertexOffset = static_cast<int32_t>(mesh.vertexOffset),
+				.firstInstance = reserved + static_cast<uint32_t>(table.rows.size()),
+				.pass = static_cast<uint32_t>(MaterialPass::Opaque),
+				.drawFirst = reserved
+			});
+		}
+
+		table.rowEntry[keyed[i].second] = static_cast<uint32_t>(table.rows.size());
+		table.rows.push_back(CullRow{ inst, static_cast<uint32_t>(table.batches.size() - 1) });
+		table.sourceRows.push_back(keyed[i].second);
+	}
+}
+
+void Visibility::cullTransparentRows(
+	const VisibilityState& vs,
+	const CullBatchTable& table,
+	const Frustum& fr,
+	std::vector<GPUInstance>& visibleInstances,
+	std::vector<AABB>& visibleWorldAABBs)
+{
+	for (uint32_t row : table.transparentRows) {
+		if (!boxInFrustum(vs.worldAABBs[row], fr)) continue;
+		visibleInstances.push_back(vs.instances[row]);
+		visibleWorldAABBs.push_back(vs.worldAABBs[row]);
+	}
+}
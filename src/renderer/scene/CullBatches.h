@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Visibility.h"
+
+// Draw batches for the GPU frustum cull. Opaque rows are grouped by (material, mesh) once per
+// topology change, each batch owns a fixed instance range sized for all of its rows, so the
+// cull can append survivors into it with one atomic and no sort. Transparent rows need a back
+// to front sort every frame, they stay on the CPU and draw from the front of the frame buffers.
+namespace Visibility {
+	// Matches CullRow in frustum_cull_comp.comp
+	struct CullRow {
+		GPUInstance instance;
+		uint32_t batchID;
+	};
+
+	// Matches CullBatch in frustum_cull_comp.comp and cull_compact_comp.comp
+	struct CullBatch {
+		uint32_t indexCount;
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+		uint32_t firstInstance; // start of this batch's instance range
+		uint32_t pass;          // MaterialPass, picks the draw count the batch is compacted into, always opaque
+		uint32_t drawFirst;     // first draw slot of the pass, after the transparents' slots
+	};
+
+	struct CullBatchTable {
+		std::vector<CullRow> rows;        // active opaque rows, batch order
+		std::vector<uint32_t> sourceRows; // VisibilityState row behind each entry in rows
+		std::vector<uint32_t> rowEntry;   // entry in rows of each VisibilityState row, ROW_INACTIVE if not in rows
+		std::vector<CullBatch> batches;
+		// Active transparent rows in VisibilityState order. The first transparentRows.size()
+		// instance and draw slots of the frame are left to their CPU draws.
+		std::vector<uint32_t> transparentRows;
+
+		inline void clear() {
+			rows.clear();
+			sourceRows.clear();
+			rowEntry.clear();
+			batches.clear();
+			transparentRows.clear();
+		}
+
+		// Instance slots the table spans, the transparents' included
+		inline uint32_t instanceSlots() const {
+			return static_cast<uint32_t>(transparentRows.size() + rows.size());
+		}
+	};
+
+	inline uint64_t cullBatchKey(const GPUInstance& inst) {
+		return (static_cast<uint64_t>(inst.passType) << 63)
+			| (static_cast<uint64_t>(inst.materialID & 0x7FFFFFFFu) << 32)
+			| inst.meshID;
+	}
+
+	// Groups every active opaque row, rows keep their VisibilityState order inside a batch
+	void buildCullBatches(
+		const VisibilityState& vs,
+		const std::vector<GPUMeshData>& meshes,
+		CullBatchTable& table);
+
+	// Appends the table's transparent rows inside the frustum, same test as frustum_cull_comp
+	void cullTransparentRows(
+		const VisibilityState& vs,
+		const CullBatchTable& table,
+		const Frustum& fr,
+		std::vector<GPUInstance>& visibleInstances,
+		std::vector<AABB>& visibleWorldAABBs);
+}
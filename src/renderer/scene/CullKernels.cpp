@@ -0,0 +1,576 @@
+#include "pch.h"
+
+#include "CullKernels.h"
+
+#include <bit>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CULL_KERNELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define CULL_KERNELS_X86 0
+#endif
+
+// MSVC hands out AVX intrinsics without /arch, GCC and Clang need the function tagged
+#if CULL_KERNELS_X86 && (defined(__GNUC__) || defined(__clang__))
+#define CULL_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CULL_TARGET_AVX2
+#endif
+
+namespace Visibility {
+	// The arithmetic below mirrors boxInFrustum operation for operation so the
+	// results stay bit exact, don't reorder the adds or fold the sphere test away.
+
+	static uint32_t cullBoundsScalar(
+		const BoundsSoA& b,
+		uint32_t first,
+		uint32_t count,
+		const CullFrustum& f,
+		uint32_t* out)
+	{
+		uint32_t written = 0;
+		for (uint32_t i = first; i < first + count; ++i) {
+			const float cx = (b.maxX[i] + b.minX[i]) * 0.5f;
+			const float cy = (b.maxY[i] + b.minY[i]) * 0.5f;
+			const float cz = (b.maxZ[i] + b.minZ[i]) * 0.5f;
+			const float ex = (b.maxX[i] - b.minX[i]) * 0.5f;
+			const float ey = (b.maxY[i] - b.minY[i]) * 0.5f;
+			const float ez = (b.maxZ[i] - b.minZ[i]) * 0.5f;
+			const float safeRadius = glm::max(b.radius[i], b.radius[i] * 0.01f);
+
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; ++p) {
+				const float dist = f.nx[p] * cx + f.ny[p] * cy + f.nz[p] * cz + f.d[p];
+				const float r = ex * f.ax[p] + ey * f.ay[p] + ez * f.az[p];
+				inside = !(dist < -safeRadius) && !(dist + r < 0.0f);
+			}
+
+			inside = inside &&
+				!(f.pointMin.x > b.maxX[i]) && !(f.pointMax.x < b.minX[i]) &&
+				!(f.pointMin.y > b.maxY[i]) && !(f.pointMax.y < b.minY[i]) &&
+				!(f.pointMin.z > b.maxZ[i]) && !(f.pointMax.z < b.minZ[i]);
+
+			if (inside) out[written++] = i;
+		}
+		return written;
+	}
+
+	// Same operation order as the SIMD lanes
+	static void transformRowBoundsScalar(
+		const GPUInstance* instances,
+		const uint32_t* transformIDs,
+		const std::vector<GPUMeshData>& meshData,
+		const std::vector<glm::mat4>& transforms,
+		uint32_t first,
+		uint32_t count,
+		AABB* out)
+	{
+		for (uint32_t i = first; i < first + count; ++i) {
+			const AABB& local = meshData[instances[i].meshID].localAABB;
+			const glm::mat4& m = transforms[transformIDs[i]];
+			const glm::vec3 col0(m[0]), col1(m[1]), col2(m[2]), col3(m[3]);
+
+			glm::vec3 c = col0 * local.origin.x;
+			c = c + col1 * local.origin.y;
+			c = c + col2 * local.origin.z;
+			c = c + col3;
+
+			glm::vec3 ext = glm::abs(col0) * local.extent.x;
+			ext = ext + glm::abs(col1) * local.extent.y;
+			ext = ext + glm::abs(col2) * local.extent.z;
+
+			const glm::vec3 e2 = ext * ext;
+
+			AABB& o = out[i];
+			o.vmin = c - ext;
+			o.vmax = c + ext;
+			o.origin = c;
+			o.extent = ext;
+			o.sphereRadius = std::sqrt((e2.x + e2.y) + e2.z);
+		}
+	}
+
+#if CULL_KERNELS_X86
+	static uint32_t cullBoundsSSE(
+		const BoundsSoA& b,
+		uint32_t first,
+		uint32_t count,
+		const CullFrustum& f,
+		uint32_t* out)
+	{
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 hundredth = _mm_set1_ps(0.01f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 sign = _mm_set1_ps(-0.0f);
+
+		uint32_t written = 0;
+		for (uint32_t base = first; base < first + count; base += 4) {
+			const __m128 minX = _mm_loadu_ps(&b.minX[base]);
+			const __m128 minY = _mm_loadu_ps(&b.minY[base]);
+			const __m128 minZ = _mm_loadu_ps(&b.minZ[base]);
+			const __m128 maxX = _mm_loadu_ps(&b.maxX[base]);
+			const __m128 maxY = _mm_loadu_ps(&b.maxY[base]);
+			const __m128 maxZ = _mm_loadu_ps(&b.maxZ[base]);
+			const __m128 rad = _mm_loadu_ps(&b.radius[base]);
+
+			const __m128 cx = _mm_mul_ps(_mm_add_ps(maxX, minX), half);
+			const __m128 cy = _mm_mul_ps(_mm_add_ps(maxY, minY), half);
+			const __m128 cz = _mm_mul_ps(_mm_add_ps(maxZ, minZ), half);
+			const __m128 ex = _mm_mul_ps(_mm_sub_ps(maxX, minX), half);
+			const __m128 ey = _mm_mul_ps(_mm_sub_ps(maxY, minY), half);
+			const __m128 ez = _mm_mul_ps(_mm_sub_ps(maxZ, minZ), half);
+			const __m128 negSafe = _mm_xor_ps(_mm_max_ps(_mm_mul_ps(rad, hundredth), rad), sign);
+
+			__m128 outside = zero;
+			for (int p = 0; p < 6; ++p) {
+				const __m128 dist = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(_mm_set1_ps(f.nx[p]), cx),
+					_mm_mul_ps(_mm_set1_ps(f.ny[p]), cy)),
+					_mm_mul_ps(_mm_set1_ps(f.nz[p]), cz)),
+					_mm_set1_ps(f.d[p]));
+				const __m128 r = _mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(ex, _mm_set1_ps(f.ax[p])),
+					_mm_mul_ps(ey, _mm_set1_ps(f.ay[p]))),
+					_mm_mul_ps(ez, _mm_set1_ps(f.az[p])));
+
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, negSafe));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, r), zero));
+			}
+
+			outside = _mm_or_ps(outside, _mm_cmpgt_ps(_mm_set1_ps(f.pointMin.x), maxX));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_set1_ps(f.pointMax.x), minX));
+			outside = _mm_or_ps(outside, _mm_cmpgt_ps(_mm_set1_ps(f.pointMin.y), maxY));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_set1_ps(f.pointMax.y), minY));
+			outside = _mm_or_ps(outside, _mm_cmpgt_ps(_mm_set1_ps(f.pointMin.z), maxZ));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_set1_ps(f.pointMax.z), minZ));
+
+			const uint32_t lanes = std::min(first + count - base, 4u);
+			uint32_t mask = ~static_cast<uint32_t>(_mm_movemask_ps(outside)) & ((1u << lanes) - 1u);
+			while (mask) {
+				out[written++] = base + static_cast<uint32_t>(std::countr_zero(mask));
+				mask &= mask - 1u;
+			}
+		}
+		return written;
+	}
+
+	CULL_TARGET_AVX2 static uint32_t cullBoundsAVX2(
+		const BoundsSoA& b,
+		uint32_t first,
+		uint32_t count,
+		const CullFrustum& f,
+		uint32_t* out)
+	{
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 hundredth = _mm256_set1_ps(0.01f);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 sign = _mm256_set1_ps(-0.0f);
+
+		uint32_t written = 0;
+		for (uint32_t base = first; base < first + count; base += 8) {
+			const __m256 minX = _mm256_loadu_ps(&b.minX[base]);
+			const __m256 minY = _mm256_loadu_ps(&b.minY[base]);
+			const __m256 minZ = _mm256_loadu_ps(&b.minZ[base]);
+			const __m256 maxX = _mm256_loadu_ps(&b.maxX[base]);
+			const __m256 maxY = _mm256_loadu_ps(&b.maxY[base]);
+			const __m256 maxZ = _mm256_loadu_ps(&b.maxZ[base]);
+			const __m256 rad = _mm256_loadu_ps(&b.radius[base]);
+
+			const __m256 cx = _mm256_mul_ps(_mm256_add_ps(maxX, minX), half);
+			const __m256 cy = _mm256_mul_ps(_mm256_add_ps(maxY, minY), half);
+			const __m256 cz = _mm256_mul_ps(_mm256_add_ps(maxZ, minZ), half);
+			const __m256 ex = _mm256_mul_ps(_mm256_sub_ps(maxX, minX), half);
+			const __m256 ey = _mm256_mul_ps(_mm256_sub_ps(maxY, minY), half);
+			const __m256 ez = _mm256_mul_ps(_mm256_sub_ps(maxZ, minZ), half);
+			const __m256 negSafe = _mm256_xor_ps(_mm256_max_ps(_mm256_mul_ps(rad, hundredth), rad), sign);
+
+			__m256 outside = zero;
+			for (int p = 0; p < 6; ++p) {
+				const __m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(_mm256_set1_ps(f.nx[p]), cx),
+					_mm256_mul_ps(_mm256_set1_ps(f.ny[p]), cy)),
+					_mm256_mul_ps(_mm256_set1_ps(f.nz[p]), cz)),
+					_mm256_set1_ps(f.d[p]));
+				const __m256 r = _mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(ex, _mm256_set1_ps(f.ax[p])),
+					_mm256_mul_ps(ey, _mm256_set1_ps(f.ay[p]))),
+					_mm256_mul_ps(ez, _mm256_set1_ps(f.az[p])));
+
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(dist, negSafe, _CMP_LT_OQ));
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(dist, r), zero, _CMP_LT_OQ));
+			}
+
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_set1_ps(f.pointMin.x), maxX, _CMP_GT_OQ));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_set1_ps(f.pointMax.x), minX, _CMP_LT_OQ));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_set1_ps(f.pointMin.y), maxY, _CMP_GT_OQ));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_set1_ps(f.pointMax.y), minY, _CMP_LT_OQ));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_set1_ps(f.pointMin.z), maxZ, _CMP_GT_OQ));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_set1_ps(f.pointMax.z), minZ, _CMP_LT_OQ));
+
+			const uint32_t lanes = std::min(first + count - base, 8u);
+			uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_ps(outside)) & ((1u << lanes) - 1u);
+			while (mask) {
+				out[written++] = base + static_cast<uint32_t>(std::countr_zero(mask));
+				mask &= mask - 1u;
+			}
+		}
+
+		_mm256_zeroupper();
+		return written;
+	}
+
+	// One row per 128-bit lane group: the matrix columns as xyzw, local center and extent
+	// broadcast across them. Loads start at origin and extent, each picks up the next field
+	// too. Stores go in field order, each one overwrites the spare lane the last one wrote.
+	static inline void transformRowSSE(const AABB& local, const glm::mat4& m, AABB& out) {
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		const __m128 o = _mm_loadu_ps(&local.origin.x);
+		const __m128 e = _mm_loadu_ps(&local.extent.x);
+		const __m128 col0 = _mm_loadu_ps(&m[0][0]);
+		const __m128 col1 = _mm_loadu_ps(&m[1][0]);
+		const __m128 col2 = _mm_loadu_ps(&m[2][0]);
+		const __m128 col3 = _mm_loadu_ps(&m[3][0]);
+
+		__m128 c = _mm_mul_ps(col0, _mm_shuffle_ps(o, o, _MM_SHUFFLE(0, 0, 0, 0)));
+		c = _mm_add_ps(c, _mm_mul_ps(col1, _mm_shuffle_ps(o, o, _MM_SHUFFLE(1, 1, 1, 1))));
+		c = _mm_add_ps(c, _mm_mul_ps(col2, _mm_shuffle_ps(o, o, _MM_SHUFFLE(2, 2, 2, 2))));
+		c = _mm_add_ps(c, col3);
+
+		__m128 ext = _mm_mul_ps(_mm_andnot_ps(sign, col0), _mm_shuffle_ps(e, e, _MM_SHUFFLE(0, 0, 0, 0)));
+		ext = _mm_add_ps(ext, _mm_mul_ps(_mm_andnot_ps(sign, col1), _mm_shuffle_ps(e, e, _MM_SHUFFLE(1, 1, 1, 1))));
+		ext = _mm_add_ps(ext, _mm_mul_ps(_mm_andnot_ps(sign, col2), _mm_shuffle_ps(e, e, _MM_SHUFFLE(2, 2, 2, 2))));
+
+		const __m128 e2 = _mm_mul_ps(ext, ext);
+		const __m128 r2 = _mm_add_ss(_mm_add_ss(e2, _mm_shuffle_ps(e2, e2, _MM_SHUFFLE(1, 1, 1, 1))),
+			_mm_shuffle_ps(e2, e2, _MM_SHUFFLE(2, 2, 2, 2)));
+
+		_mm_storeu_ps(&out.vmin.x, _mm_sub_ps(c, ext));
+		_mm_storeu_ps(&out.vmax.x, _mm_add_ps(c, ext));
+		_mm_storeu_ps(&out.origin.x, c);
+		_mm_storeu_ps(&out.extent.x, ext);
+		_mm_store_ss(&out.sphereRadius, _mm_sqrt_ss(r2));
+	}
+
+	static void transformRowBoundsSSE(
+		const GPUInstance* instances,
+		const uint32_t* transformIDs,
+		const std::vector<GPUMeshData>& meshData,
+		const std::vector<glm::mat4>& transforms,
+		uint32_t first,
+		uint32_t count,
+		AABB* out)
+	{
+		for (uint32_t i = first; i < first + count; ++i)
+			transformRowSSE(meshData[instances[i].meshID].localAABB, transforms[transformIDs[i]], out[i]);
+	}
+
+	CULL_TARGET_AVX2 static inline __m256 loadRowPair(const float* a, const float* b) {
+		return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(a)), _mm_loadu_ps(b), 1);
+	}
+
+	CULL_TARGET_AVX2 static inline void storeRowPair(float* a, float* b, __m256 v) {
+		_mm_storeu_ps(a, _mm256_castps256_ps128(v));
+		_mm_storeu_ps(b, _mm256_extractf128_ps(v, 1));
+	}
+
+	// transformRowSSE for two rows at once, one in each 128-bit half
+	CULL_TARGET_AVX2 static void transformRowBoundsAVX2(
+		const GPUInstance* instances,
+		const uint32_t* transformIDs,
+		const std::vector<GPUMeshData>& meshData,
+		const std::vector<glm::mat4>& transforms,
+		uint32_t first,
+		uint32_t count,
+		AABB* out)
+	{
+		const __m256 sign = _mm256_set1_ps(-0.0f);
+		const uint32_t end = first + count;
+
+		uint32_t i = first;
+		for (; i + 2 <= end; i += 2) {
+			const AABB& la = meshData[instances[i].meshID].localAABB;
+			const AABB& lb = meshData[instances[i + 1].meshID].localAABB;
+			const glm::mat4& ma = transforms[transformIDs[i]];
+			const glm::mat4& mb = transforms[transformIDs[i + 1]];
+
+			const __m256 o = loadRowPair(&la.origin.x, &lb.origin.x);
+			const __m256 e = loadRowPair(&la.extent.x, &lb.extent.x);
+			const __m256 col0 = loadRowPair(&ma[0][0], &mb[0][0]);
+			const __m256 col1 = loadRowPair(&ma[1][0], &mb[1][0]);
+			const __m256 col2 = loadRowPair(&ma[2][0], &mb[2][0]);
+			const __m256 col3 = loadRowPair(&ma[3][0], &mb[3][0]);
+
+			__m256 c = _mm256_mul_ps(col0, _mm256_permute_ps(o, _MM_SHUFFLE(0, 0, 0, 0)));
+			c = _mm256_add_ps(c, _mm256_mul_ps(col1, _mm256_permute_ps(o, _MM_SHUFFLE(1, 1, 1, 1))));
+			c = _mm256_add_ps(c, _mm256_mul_ps(col2, _mm256_permute_ps(o, _MM_SHUFFLE(2, 2, 2, 2))));
+			c = _mm256_add_ps(c, col3);
+
+			__m256 ext = _mm256_mul_ps(_mm256_andnot_ps(sign, col0), _mm256_permute_ps(e, _MM_SHUFFLE(0, 0, 0, 0)));
+			ext = _mm256_add_ps(ext, _mm256_mul_ps(_mm256_andnot_ps(sign, col1), _mm256_permute_ps(e, _MM_SHUFFLE(1, 1, 1, 1))));
+			ext = _mm256_add_ps(ext, _mm256_mul_ps(_mm256_andnot_ps(sign, col2), _mm256_permute_ps(e, _MM_SHUFFLE(2, 2, 2, 2))));
+
+			const __m256 e2 = _mm256_mul_ps(ext, ext);
+			const __m256 r = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(e2,
+				_mm256_permute_ps(e2, _MM_SHUFFLE(1, 1, 1, 1))),
+				_mm256_permute_ps(e2, _MM_SHUFFLE(2, 2, 2, 2))));
+
+			AABB& oa = out[i];
+			AABB& ob = out[i + 1];
+			storeRowPair(&oa.vmin.x, &ob.vmin.x, _mm256_sub_ps(c, ext));
+			storeRowPair(&oa.vmax.x, &ob.vmax.x, _mm256_add_ps(c, ext));
+			storeRowPair(&oa.origin.x, &ob.origin.x, c);
+			storeRowPair(&oa.extent.x, &ob.extent.x, ext);
+			oa.sphereRadius = _mm256_cvtss_f32(r);
+			ob.sphereRadius = _mm_cvtss_f32(_mm256_extractf128_ps(r, 1));
+		}
+
+		_mm256_zeroupper();
+
+		if (i < end)
+			transformRowSSE(meshData[instances[i].meshID].localAABB, transforms[transformIDs[i]], out[i]);
+	}
+
+	static bool cpuHasAVX2() {
+#ifdef _MSC_VER
+		int info[4]{};
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx) return false;
+
+		// OS has to save the upper ymm halves on context switch
+		if ((_xgetbv(0) & 0x6) != 0x6) return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+}
+
+Visibility::CullFrustum Visibility::prepareCullFrustum(const Frustum& frus) {
+	CullFrustum f{};
+	for (int p = 0; p < 6; ++p) {
+		f.nx[p] = frus.planes[p].x;
+		f.ny[p] = frus.planes[p].y;
+		f.nz[p] = frus.planes[p].z;
+		f.d[p] = frus.planes[p].w;
+		f.ax[p] = std::abs(frus.planes[p].x);
+		f.ay[p] = std::abs(frus.planes[p].y);
+		f.az[p] = std::abs(frus.planes[p].z);
+	}
+
+	f.pointMin = f.pointMax = glm::vec3(frus.points[0]);
+	for (int i = 1; i < 8; ++i) {
+		f.pointMin = glm::min(f.pointMin, glm::vec3(frus.points[i]));
+		f.pointMax = glm::max(f.pointMax, glm::vec3(frus.points[i]));
+	}
+	return f;
+}
+
+Visibility::MultiCullFrustum Visibility::prepareMultiCullFrustum(const Frustum* frustums, uint32_t viewCount) {
+	ASSERT(viewCount <= MAX_CULL_VIEWS);
+
+	MultiCullFrustum f{};
+	for (int p = 0; p < 6; ++p) {
+		for (uint32_t v = 0; v < MAX_CULL_VIEWS; ++v) {
+			// Spare lanes: 0 * x + 1 is always 1, nothing is ever outside that
+			const glm::vec4 plane = v < viewCount ? frustums[v].planes[p] : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			f.nx[p][v] = plane.x;
+			f.ny[p][v] = plane.y;
+			f.nz[p][v] = plane.z;
+			f.d[p][v] = plane.w;
+			f.ax[p][v] = std::abs(plane.x);
+			f.ay[p][v] = std::abs(plane.y);
+			f.az[p][v] = std::abs(plane.z);
+		}
+	}
+	return f;
+}
+
+void Visibility::classifyBoxMulti(const AABB& box, const MultiCullFrustum& f, uint8_t outside[6], uint8_t inside[6]) {
+	const float cx = (box.vmax.x + box.vmin.x) * 0.5f;
+	const float cy = (box.vmax.y + box.vmin.y) * 0.5f;
+	const float cz = (box.vmax.z + box.vmin.z) * 0.5f;
+	const float ex = (box.vmax.x - box.vmin.x) * 0.5f;
+	const float ey = (box.vmax.y - box.vmin.y) * 0.5f;
+	const float ez = (box.vmax.z - box.vmin.z) * 0.5f;
+	const float safeRadius = glm::max(box.sphereRadius, box.sphereRadius * 0.01f);
+
+#if CULL_KERNELS_X86
+	const __m128 vcx = _mm_set1_ps(cx), vcy = _mm_set1_ps(cy), vcz = _mm_set1_ps(cz);
+	const __m128 vex = _mm_set1_ps(ex), vey = _mm_set1_ps(ey), vez = _mm_set1_ps(ez);
+	const __m128 negSafe = _mm_set1_ps(-safeRadius);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (int p = 0; p < 6; ++p) {
+		uint32_t out = 0, in = 0;
+		for (uint32_t half = 0; half < MAX_CULL_VIEWS; half += 4) {
+			const __m128 dist = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_load_ps(&f.nx[p][half]), vcx),
+				_mm_mul_ps(_mm_load_ps(&f.ny[p][half]), vcy)),
+				_mm_mul_ps(_mm_load_ps(&f.nz[p][half]), vcz)),
+				_mm_load_ps(&f.d[p][half]));
+			const __m128 r = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(vex, _mm_load_ps(&f.ax[p][half])),
+				_mm_mul_ps(vey, _mm_load_ps(&f.ay[p][half]))),
+				_mm_mul_ps(vez, _mm_load_ps(&f.az[p][half])));
+
+			const __m128 past = _mm_or_ps(_mm_cmplt_ps(dist, negSafe), _mm_cmplt_ps(_mm_add_ps(dist, r), zero));
+			const __m128 within = _mm_cmpge_ps(_mm_sub_ps(dist, r), zero);
+			out |= static_cast<uint32_t>(_mm_movemask_ps(past)) << half;
+			in |= static_cast<uint32_t>(_mm_movemask_ps(within)) << half;
+		}
+		outside[p] = static_cast<uint8_t>(out);
+		inside[p] = static_cast<uint8_t>(in);
+	}
+#else
+	for (int p = 0; p < 6; ++p) {
+		outside[p] = inside[p] = 0;
+		for (uint32_t v = 0; v < MAX_CULL_VIEWS; ++v) {
+			const float dist = f.nx[p][v] * cx + f.ny[p][v] * cy + f.nz[p][v] * cz + f.d[p][v];
+			const float r = ex * f.ax[p][v] + ey * f.ay[p][v] + ez * f.az[p][v];
+			if (dist < -safeRadius || dist + r < 0.0f) outside[p] |= static_cast<uint8_t>(1u << v);
+			if (dist - r >= 0.0f) inside[p] |= static_cast<uint8_t>(1u << v);
+		}
+	}
+#endif
+}
+
+Visibility::CullKernel Visibility::detectCullKernel() {
+#if CULL_KERNELS_X86
+	static const CullKernel best = cpuHasAVX2() ? CullKernel::AVX2 : CullKernel::SSE;
+	return best;
+#else
+	return CullKernel::Scalar;
+#endif
+}
+
+bool Visibility::cullKernelSupported(CullKernel kernel) {
+	return static_cast<uint8_t>(kernel) <= static_cast<uint8_t>(detectCullKernel());
+}
+
+const char* Visibility::cullKernelName(CullKernel kernel) {
+	switch (kernel) {
+	case CullKernel::Scalar: return "Scalar";
+	case CullKernel::SSE: return "SSE";
+	case CullKernel::AVX2: return "AVX2";
+	default: return "Unknown";
+	}
+}
+
+uint32_t Visibility::cullBounds(
+	const BoundsSoA& bounds,
+	uint32_t first,
+	uint32_t count,
+	const CullFrustum& frus,
+	CullKernel kernel,
+	uint32_t* out)
+{
+	ASSERT(first + count <= bounds.count);
+
+#if CULL_KERNELS_X86
+	switch (kernel) {
+	case CullKernel::AVX2: return cullBoundsAVX2(bounds, first, count, frus, out);
+	case CullKernel::SSE: return cullBoundsSSE(bounds, first, count, frus, out);
+	default: break;
+	}
+#endif
+	return cullBoundsScalar(bounds, first, count, frus, out);
+}
+
+uint32_t Visibility::cullBox4(
+	const float* minX, const float* minY, const float* minZ,
+	const float* maxX, const float* maxY, const float* maxZ,
+	const CullFrustum& f)
+{
+#if CULL_KERNELS_X86
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 zero = _mm_setzero_ps();
+
+	const __m128 mnX = _mm_loadu_ps(minX), mnY = _mm_loadu_ps(minY), mnZ = _mm_loadu_ps(minZ);
+	const __m128 mxX = _mm_loadu_ps(maxX), mxY = _mm_loadu_ps(maxY), mxZ = _mm_loadu_ps(maxZ);
+
+	const __m128 cx = _mm_mul_ps(_mm_add_ps(mxX, mnX), half);
+	const __m128 cy = _mm_mul_ps(_mm_add_ps(mxY, mnY), half);
+	const __m128 cz = _mm_mul_ps(_mm_add_ps(mxZ, mnZ), half);
+	const __m128 ex = _mm_mul_ps(_mm_sub_ps(mxX, mnX), half);
+	const __m128 ey = _mm_mul_ps(_mm_sub_ps(mxY, mnY), half);
+	const __m128 ez = _mm_mul_ps(_mm_sub_ps(mxZ, mnZ), half);
+
+	__m128 outside = zero;
+	for (int p = 0; p < 6; ++p) {
+		const __m128 dist = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_set1_ps(f.nx[p]), cx),
+			_mm_mul_ps(_mm_set1_ps(f.ny[p]), cy)),
+			_mm_mul_ps(_mm_set1_ps(f.nz[p]), cz)),
+			_mm_set1_ps(f.d[p]));
+		const __m128 r = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(ex, _mm_set1_ps(f.ax[p])),
+			_mm_mul_ps(ey, _mm_set1_ps(f.ay[p]))),
+			_mm_mul_ps(ez, _mm_set1_ps(f.az[p])));
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, r), zero));
+	}
+
+	outside = _mm_or_ps(outside, _mm_cmpgt_ps(_mm_set1_ps(f.pointMin.x), mxX));
+	outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_set1_ps(f.pointMax.x), mnX));
+	outside = _mm_or_ps(outside, _mm_cmpgt_ps(_mm_set1_ps(f.pointMin.y), mxY));
+	outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_set1_ps(f.pointMax.y), mnY));
+	outside = _mm_or_ps(outside, _mm_cmpgt_ps(_mm_set1_ps(f.pointMin.z), mxZ));
+	outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_set1_ps(f.pointMax.z), mnZ));
+
+	return ~static_cast<uint32_t>(_mm_movemask_ps(outside)) & 0xFu;
+#else
+	uint32_t mask = 0;
+	for (uint32_t i = 0; i < 4; ++i) {
+		const float cx = (maxX[i] + minX[i]) * 0.5f, ex = (maxX[i] - minX[i]) * 0.5f;
+		const float cy = (maxY[i] + minY[i]) * 0.5f, ey = (maxY[i] - minY[i]) * 0.5f;
+		const float cz = (maxZ[i] + minZ[i]) * 0.5f, ez = (maxZ[i] - minZ[i]) * 0.5f;
+
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; ++p) {
+			const float dist = f.nx[p] * cx + f.ny[p] * cy + f.nz[p] * cz + f.d[p];
+			inside = !(dist + ex * f.ax[p] + ey * f.ay[p] + ez * f.az[p] < 0.0f);
+		}
+
+		inside = inside &&
+			!(f.pointMin.x > maxX[i]) && !(f.pointMax.x < minX[i]) &&
+			!(f.pointMin.y > maxY[i]) && !(f.pointMax.y < minY[i]) &&
+			!(f.pointMin.z > maxZ[i]) && !(f.pointMax.z < minZ[i]);
+
+		if (inside) mask |= 1u << i;
+	}
+	return mask;
+#endif
+}
+
+void Visibility::transformRowBounds(
+	const GPUInstance* instances,
+	const uint32_t* transformIDs,
+	const std::vector<GPUMeshData>& meshData,
+	const std::vector<glm::mat4>& transforms,
+	uint32_t first,
+	uint32_t count,
+	AABB* out,
+	CullKernel kernel)
+{
+	static_assert(sizeof(AABB) == 13 * sizeof(float), "transformRowSSE stores rely on AABB being packed floats");
+
+#if CULL_KERNELS_X86
+	switch (kernel) {
+	case CullKernel::AVX2: transformRowBoundsAVX2(instances, transformIDs, meshData, transforms, first, count, out); return;
+	case CullKernel::SSE: transformRowBoundsSSE(instances, transformIDs, meshData, transforms, first, count, out); return;
+	default: break;
+	}
+#endif
+	transformRowBoundsScalar(instances, transformIDs, meshData, transforms, first, count, out);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "common/Vk_Types.h"
+
+// Batched frustum tests over a structure-of-arrays bounds layout.
+// Every kernel gives exactly the same answer as Visibility::boxInFrustum.
+namespace Visibility {
+	enum class CullKernel : uint8_t {
+		Scalar,
+		SSE,  // 4 boxes per test
+		AVX2, // 8 boxes per test
+		Count
+	};
+
+	// Extra zeroed slots at the end of every array so a kernel can always load a full register
+	constexpr uint32_t CULL_BOUNDS_PADDING = 8;
+
+	// World bounds with one array per component, only what the frustum test reads
+	struct BoundsSoA {
+		std::vector<float> minX, minY, minZ;
+		std::vector<float> maxX, maxY, maxZ;
+		std::vector<float> radius;
+		uint32_t count = 0;
+
+		// Keeps existing entries so rows can be appended one at a time
+		inline void resize(uint32_t n) {
+			count = n;
+			for (auto* v : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ, &radius })
+				v->resize(n + CULL_BOUNDS_PADDING, 0.0f);
+		}
+
+		inline void set(uint32_t i, const AABB& b) {
+			minX[i] = b.vmin.x; minY[i] = b.vmin.y; minZ[i] = b.vmin.z;
+			maxX[i] = b.vmax.x; maxY[i] = b.vmax.y; maxZ[i] = b.vmax.z;
+			radius[i] = b.sphereRadius;
+		}
+
+		inline void clear() { resize(0); }
+	};
+
+	// Frustum unpacked for the kernels: plane components, absolute normals, and the
+	// extents of the corner points (all 8 corners past a box face is a min/max compare)
+	struct CullFrustum {
+		float nx[6], ny[6], nz[6], d[6];
+		float ax[6], ay[6], az[6];
+		glm::vec3 pointMin;
+		glm::vec3 pointMax;
+	};
+
+	CullFrustum prepareCullFrustum(const Frustum& frus);
+
+	// Views a single multi-view walk can take, one bit each in a row's view mask
+	constexpr uint32_t MAX_CULL_VIEWS = 8;
+
+	// Several frustums' planes side by side, lane v of every plane row is view v.
+	// Unused lanes hold a plane everything is inside of.
+	struct MultiCullFrustum {
+		alignas(16) float nx[6][MAX_CULL_VIEWS], ny[6][MAX_CULL_VIEWS], nz[6][MAX_CULL_VIEWS], d[6][MAX_CULL_VIEWS];
+		alignas(16) float ax[6][MAX_CULL_VIEWS], ay[6][MAX_CULL_VIEWS], az[6][MAX_CULL_VIEWS];
+	};
+
+	MultiCullFrustum prepareMultiCullFrustum(const Frustum* frustums, uint32_t viewCount);
+
+	// boxInFrustum's plane tests for one box against every view at once, same arithmetic.
+	// Bit v of outside[p] is set when the box is past plane p of view v, bit v of inside[p]
+	// when it is fully on the inner side of it.
+	void classifyBoxMulti(const AABB& box, const MultiCullFrustum& frus, uint8_t outside[6], uint8_t inside[6]);
+
+	// Widest kernel this CPU runs, detected once
+	CullKernel detectCullKernel();
+	bool cullKernelSupported(CullKernel kernel);
+	const char* cullKernelName(CullKernel kernel);
+
+	// Plane and corner test for 4 boxes given as SoA lanes, bit i set when box i may be visible.
+	// Skips boxInFrustum's sphere early out, so it is conservative rather than exact, meant for
+	// node bounds where the rows underneath get the exact test anyway.
+	uint32_t cullBox4(
+		const float* minX, const float* minY, const float* minZ,
+		const float* maxX, const float* maxY, const float* maxZ,
+		const CullFrustum& frus);
+
+	// Tests bounds[first, first + count) and writes the indices of the boxes that pass to out
+	// (room for count entries), in ascending order. Returns how many were written.
+	uint32_t cullBounds(
+		const BoundsSoA& bounds,
+		uint32_t first,
+		uint32_t count,
+		const CullFrustum& frus,
+		CullKernel kernel,
+		uint32_t* out);
+
+	// World bounds of rows [first, first + count) from their mesh's local bounds, written to
+	// out[row]. Center through the matrix, extent through its absolute 3x3, instead of 8 corners.
+	// Agrees with transformAABB to rounding, every kernel writes the same bits.
+	void transformRowBounds(
+		const GPUInstance* instances,
+		const uint32_t* transformIDs,
+		const std::vector<GPUMeshData>& meshData,
+		const std::vector<glm::mat4>& transforms,
+		uint32_t first,
+		uint32_t count,
+		AABB* out,
+		CullKernel kernel);
+}
@@ -0,0 +1,563 @@
+#include "pch.h"
+
+#include "DrawPreparation.h"
+#include "utils/BufferUtils.h"
+#include "engine/platform/profiler/FrameCounters.h"
+#include "engine/JobSystem.h"
+
+#include <bit>
+
+// CPU half of draw preparation, no device calls. Builds the frame's draw stream and packs it
+// into staging memory, uploadGPUBuffersForFrame records the copies. Linked by the headless bench.
+
+namespace {
+	constexpr uint32_t RADIX_DIGIT_BITS = 8;
+	constexpr uint32_t RADIX_BUCKETS = 1u << RADIX_DIGIT_BITS;
+	constexpr uint32_t RADIX_MAX_DIGITS = 64 / RADIX_DIGIT_BITS;
+	constexpr uint32_t INSERTION_SLACK_ROWS = 256;
+
+	// Where pass, material, mesh and level sit in a batch key, sized to the ids in the frame
+	struct BatchKeyLayout {
+		uint32_t meshShift;
+		uint32_t materialShift;
+		uint32_t passShift;
+		uint64_t lodMask;
+	};
+
+	BatchKeyLayout batchKeyLayout(uint32_t meshMask, uint32_t materialMask) {
+		BatchKeyLayout l{};
+		const uint32_t lodBits = static_cast<uint32_t>(std::bit_width(MAX_MESH_LODS - 1u));
+		l.meshShift = lodBits;
+		l.materialShift = l.meshShift + static_cast<uint32_t>(std::bit_width(meshMask));
+		l.passShift = l.materialShift + static_cast<uint32_t>(std::bit_width(materialMask));
+		l.lodMask = (1ull << lodBits) - 1ull;
+		ASSERT(l.passShift < 64 && "[DrawPrep] Mesh and material ids don't fit a batch key.");
+		return l;
+	}
+
+	// Transparent rows only carry the pass, they keep cull order until the depth sort
+	inline uint64_t batchKey(const GPUInstance& inst, uint32_t lod, const BatchKeyLayout& l) {
+		if (static_cast<MaterialPass>(inst.passType) != MaterialPass::Opaque) return 1ull << l.passShift;
+		return (static_cast<uint64_t>(inst.materialID) << l.materialShift) |
+			(static_cast<uint64_t>(inst.meshID) << l.meshShift) | lod;
+	}
+
+	inline uint32_t radixDigit(uint64_t key, uint32_t shift) {
+		return static_cast<uint32_t>(key >> shift) & (RADIX_BUCKETS - 1);
+	}
+
+	// LSD radix sort of keys with their rows alongside, stable. One read counts every digit,
+	// then digits all keys share are skipped, so a pass is only paid for bits that differ.
+	// Sorted keys and rows end up back in keys and rows.
+	void radixSortRows(
+		std::vector<uint64_t>& keys,
+		std::vector<uint32_t>& rows,
+		std::vector<uint64_t>& tmpKeys,
+		std::vector<uint32_t>& tmpRows,
+		uint32_t keyBits)
+	{
+		const uint32_t n = static_cast<uint32_t>(keys.size());
+		if (n < 2) return;
+		tmpKeys.resize(n);
+		tmpRows.resize(n);
+
+		const uint32_t digits = std::max((keyBits + RADIX_DIGIT_BITS - 1) / RADIX_DIGIT_BITS, 1u);
+		uint32_t counts[RADIX_MAX_DIGITS][RADIX_BUCKETS] = {};
+		for (uint32_t i = 0; i < n; ++i)
+			for (uint32_t d = 0; d < digits; ++d)
+				++counts[d][radixDigit(keys[i], d * RADIX_DIGIT_BITS)];
+
+		for (uint32_t d = 0; d < digits; ++d) {
+			const uint32_t shift = d * RADIX_DIGIT_BITS;
+			uint32_t* bucket = counts[d];
+			if (bucket[radixDigit(keys[0], shift)] == n) continue;
+
+			uint32_t sum = 0;
+			for (uint32_t b = 0; b < RADIX_BUCKETS; ++b) {
+				const uint32_t c = bucket[b];
+				bucket[b] = sum;
+				sum += c;
+			}
+			for (uint32_t i = 0; i < n; ++i) {
+				const uint32_t dst = bucket[radixDigit(keys[i], shift)]++;
+				tmpKeys[dst] = keys[i];
+				tmpRows[dst] = rows[i];
+			}
+			keys.swap(tmpKeys);
+			rows.swap(tmpRows);
+		}
+	}
+
+	// Insertion sort, keys are unique so it doesn't matter that it's stable. Gives up as soon as
+	// more than shiftsPerRow entries per row so far have moved, plus some slack for the first
+	// rows, leaving keys partly sorted.
+	bool insertionSortKeys(std::vector<uint64_t>& keys, uint32_t shiftsPerRow) {
+		const uint32_t n = static_cast<uint32_t>(keys.size());
+		uint64_t shifts = 0;
+		for (uint32_t i = 1; i < n; ++i) {
+			const uint64_t key = keys[i];
+			if (keys[i - 1] <= key) continue;
+
+			uint32_t j = i;
+			for (; j > 0 && keys[j - 1] > key; --j) keys[j] = keys[j - 1];
+			keys[j] = key;
+
+			shifts += i - j;
+			if (shifts > static_cast<uint64_t>(i + INSERTION_SLACK_ROWS) * shiftsPerRow) return false;
+		}
+		return true;
+	}
+
+	// Squared distances are never negative, so their bits order like the floats. Inverted, the
+	// farthest row gets the lowest key.
+	inline uint32_t depthKey(const glm::vec3& toRow) {
+		return ~std::bit_cast<uint32_t>(glm::dot(toRow, toRow));
+	}
+
+	// Sign bit is always clear, so the exponent and the kept mantissa bits
+	constexpr uint32_t OPAQUE_DEPTH_BITS = 8 + DrawPreparation::OPAQUE_DEPTH_MANTISSA_BITS;
+
+	// Squared distance from the camera to the nearest point of the box, 0 from inside it. The
+	// float's top bits step about evenly in log distance.
+	inline uint32_t depthBucket(const AABB& box, const glm::vec3& camPos) {
+		const glm::vec3 d = glm::max(glm::max(box.vmin - camPos, camPos - box.vmax), glm::vec3(0.0f));
+		return std::bit_cast<uint32_t>(glm::dot(d, d)) >> (23 - DrawPreparation::OPAQUE_DEPTH_MANTISSA_BITS);
+	}
+
+	// Draw for the opaque rows sorted into [runStart, runEnd), all with the same key
+	VkDrawIndexedIndirectCommand opaqueDraw(
+		const FrameContext& frameCtx,
+		const std::vector<GPUMeshData>& meshes,
+		const std::vector<MeshLODs>& meshLODs,
+		const BatchKeyLayout& layout,
+		uint32_t meshID,
+		uint64_t key,
+		uint32_t runStart,
+		uint32_t runEnd)
+	{
+		const uint32_t lod = static_cast<uint32_t>(key & layout.lodMask);
+		const GPUMeshData& mesh = meshes[meshID];
+		const MeshLODRange& range = meshLODs[meshID].levels[lod];
+
+		ASSERT(lod < meshLODs[meshID].count && "[DrawPrep] LOD level past the mesh's levels.");
+		ASSERT(range.firstIndex + range.indexCount <= frameCtx.drawDataPC.totalIndexCount &&
+			"[DrawPrep] Opaque draws would read past end of index buffer.");
+		ASSERT(mesh.vertexOffset + mesh.vertexCount <= frameCtx.drawDataPC.totalVertexCount &&
+			"[DrawPrep] Opaque draws would read past end of vertex buffer.");
+
+		return VkDrawIndexedIndirectCommand {
+			.indexCount = range.indexCount,
+			.instanceCount = runEnd - runStart,
+			.firstIndex = range.firstIndex,
+			.vertexOffset = static_cast<int32_t>(mesh.vertexOffset),
+			.firstInstance = frameCtx.opaqueRange.first + runStart
+		};
+	}
+
+	// Reorders the opaque draws, the only draws so far, and their rows by frameCtx.opaqueOrder.
+	// Every opaque row gets a key of its draw and depth bucket. Unless whole batches are kept, a
+	// stable sort on it puts each batch's rows nearest first. Segments, batches or runs of one
+	// bucket in a batch, are then sorted on their nearest bucket, equal ones in batch order.
+	void orderOpaqueDraws(
+		FrameContext& frameCtx,
+		const std::vector<AABB>& worldAABBs,
+		const glm::vec4 cameraPos,
+		uint32_t opaqueCount)
+	{
+		const OpaqueOrder order = frameCtx.opaqueOrder;
+		if (order == OpaqueOrder::Batched || opaqueCount == 0) return;
+
+		DrawBatchScratch& scratch = frameCtx.batchScratch;
+		const std::vector<GPUInstance>& source = scratch.sourceInstances;
+		const glm::vec3 camPos(cameraPos);
+		const uint32_t batches = static_cast<uint32_t>(frameCtx.indirectDraws.size());
+		const uint64_t depthMask = (1ull << OPAQUE_DEPTH_BITS) - 1ull;
+
+		scratch.orderKeys.resize(opaqueCount);
+		scratch.orderRows.resize(opaqueCount);
+		for (uint32_t d = 0; d < batches; ++d) {
+			const VkDrawIndexedIndirectCommand& cmd = frameCtx.indirectDraws[d];
+			const uint32_t first = cmd.firstInstance - frameCtx.opaqueRange.first;
+			for (uint32_t i = first; i < first + cmd.instanceCount; ++i) {
+				const uint32_t row = scratch.rows[i];
+				scratch.orderRows[i] = row;
+				scratch.orderKeys[i] = (static_cast<uint64_t>(d) << OPAQUE_DEPTH_BITS) | depthBucket(worldAABBs[row], camPos);
+			}
+		}
+
+		// Draw index on top, rows only move inside their batch
+		if (order != OpaqueOrder::FrontToBack) {
+			const uint32_t keyBits = OPAQUE_DEPTH_BITS + static_cast<uint32_t>(std::bit_width(batches));
+			radixSortRows(scratch.orderKeys, scratch.orderRows, scratch.tmpKeys, scratch.tmpRows, keyBits);
+		}
+
+		const uint64_t segmentMask = order == OpaqueOrder::DepthSlices ? ~0ull : ~depthMask;
+		scratch.segmentStarts.clear();
+		scratch.segmentKeys.clear();
+		for (uint32_t i = 0; i < opaqueCount; ++i) {
+			const uint64_t bucket = scratch.orderKeys[i] & depthMask;
+			if (i == 0 || ((scratch.orderKeys[i] ^ scratch.orderKeys[i - 1]) & segmentMask)) {
+				scratch.segmentStarts.push_back(i);
+				scratch.segmentKeys.push_back(bucket);
+			}
+			else {
+				scratch.segmentKeys.back() = std::min(scratch.segmentKeys.back(), bucket);
+			}
+		}
+		const uint32_t segments = static_cast<uint32_t>(scratch.segmentKeys.size());
+		scratch.segmentStarts.push_back(opaqueCount);
+		scratch.segmentOrder.resize(segments);
+		std::iota(scratch.segmentOrder.begin(), scratch.segmentOrder.end(), 0u);
+		radixSortRows(scratch.segmentKeys, scratch.segmentOrder, scratch.tmpKeys, scratch.tmpRows, OPAQUE_DEPTH_BITS);
+
+		scratch.batchDraws.assign(frameCtx.indirectDraws.begin(), frameCtx.indirectDraws.end());
+		frameCtx.indirectDraws.resize(segments);
+		uint32_t out = 0;
+		for (uint32_t k = 0; k < segments; ++k) {
+			const uint32_t segment = scratch.segmentOrder[k];
+			const uint32_t begin = scratch.segmentStarts[segment];
+			const uint32_t end = scratch.segmentStarts[segment + 1];
+
+			VkDrawIndexedIndirectCommand cmd = scratch.batchDraws[scratch.orderKeys[begin] >> OPAQUE_DEPTH_BITS];
+			cmd.instanceCount = end - begin;
+			cmd.firstInstance = frameCtx.opaqueRange.first + out;
+			frameCtx.indirectDraws[k] = cmd;
+			for (uint32_t i = begin; i < end; ++i) frameCtx.visibleInstances[out++] = source[scratch.orderRows[i]];
+		}
+	}
+
+	// Transparent rows are sorted past the opaque ones in cull order, drawn back to front one
+	// draw each after the opaque draws
+	void emitTransparentDraws(
+		FrameContext& frameCtx,
+		const std::vector<GPUMeshData>& meshes,
+		const std::vector<MeshLODs>& meshLODs,
+		const std::vector<AABB>& worldAABBs,
+		const glm::vec4 cameraPos,
+		uint32_t opaqueCount)
+	{
+		DrawBatchScratch& scratch = frameCtx.batchScratch;
+		const std::vector<GPUInstance>& source = scratch.sourceInstances;
+		const auto& lods = frameCtx.visibleLODs;
+		const uint32_t transparentCount = static_cast<uint32_t>(source.size()) - opaqueCount;
+		if (!transparentCount) return;
+
+		frameCtx.transparentRange.first = frameCtx.opaqueRange.visibleCount;
+		frameCtx.transparentRange.visibleCount = transparentCount;
+
+		// Rows index the AABBs of the visible list
+		const uint32_t* transparentRows = scratch.rows.data() + opaqueCount;
+		DrawPreparation::sortTransparentRows(scratch, transparentRows, transparentCount, worldAABBs, glm::vec3(cameraPos));
+		const std::vector<uint32_t>& order = scratch.transparentOrder;
+
+		for (uint32_t i = 0; i < transparentCount; ++i) {
+			const uint32_t row = transparentRows[order[i]];
+			const GPUInstance& inst = source[row];
+			const GPUMeshData& mesh = meshes[inst.meshID];
+			const uint32_t lod = lods.empty() ? 0u : lods[row];
+			const MeshLODRange& range = meshLODs[inst.meshID].levels[lod];
+
+			ASSERT(lod < meshLODs[inst.meshID].count && "[DrawPrep] LOD level past the mesh's levels.");
+			ASSERT(range.firstIndex + range.indexCount <= frameCtx.drawDataPC.totalIndexCount &&
+				"[DrawPrep] Transparent draws would read past end of index buffer.");
+			ASSERT(mesh.vertexOffset + mesh.vertexCount <= frameCtx.drawDataPC.totalVertexCount &&
+				"[DrawPrep] Transparent draws would read past end of vertex buffer.");
+
+			VkDrawIndexedIndirectCommand cmd {
+				.indexCount = range.indexCount,
+				.instanceCount = 1,
+				.firstIndex = range.firstIndex,
+				.vertexOffset = static_cast<int32_t>(mesh.vertexOffset),
+				.firstInstance = frameCtx.transparentRange.first + i
+			};
+
+			frameCtx.indirectDraws.push_back(cmd);
+			frameCtx.visibleInstances.push_back(inst);
+		}
+	}
+}
+
+// Depth goes in the high half of each key and the position in rows in the low half, so keys
+// are unique and both sorts break ties the same way. The order comes out the same whichever
+// runs, last frame's order only decides how fast.
+bool DrawPreparation::sortTransparentRows(
+	DrawBatchScratch& scratch,
+	const uint32_t* rows,
+	uint32_t count,
+	const std::vector<AABB>& worldAABBs,
+	const glm::vec3& camPos)
+{
+	std::vector<uint32_t>& order = scratch.transparentOrder;
+	std::vector<uint64_t>& keys = scratch.depthKeys;
+	order.resize(count);
+	keys.resize(count);
+
+	// Depth by position in rows, the radix sort's scratch is free until it runs
+	std::vector<uint64_t>& rowDepths = scratch.tmpKeys;
+	rowDepths.resize(count);
+	for (uint32_t i = 0; i < count; ++i)
+		rowDepths[i] = depthKey(worldAABBs[rows[i]].origin - camPos);
+
+	// A camera that barely moved leaves last order a few shifts from sorted
+	std::vector<uint32_t>& last = scratch.lastTransparentOrder;
+	bool coherent = false;
+	if (last.size() == count && count > 1) {
+		for (uint32_t i = 0; i < count; ++i) keys[i] = (rowDepths[last[i]] << 32) | last[i];
+		coherent = insertionSortKeys(keys, TRANSPARENT_INSERTION_SHIFTS);
+	}
+	if (coherent) {
+		for (uint32_t i = 0; i < count; ++i) order[i] = static_cast<uint32_t>(keys[i]);
+	}
+	else {
+		// Rows start in position order, the stable passes over the depth half keep it on ties
+		std::iota(order.begin(), order.end(), 0u);
+		std::copy(rowDepths.begin(), rowDepths.end(), keys.begin());
+		radixSortRows(keys, order, scratch.tmpKeys, scratch.tmpRows, 32);
+	}
+
+	last.resize(count);
+	std::copy(order.begin(), order.end(), last.begin());
+	return coherent;
+}
+
+// All render data is reset prior to this each frame. Every visible row gets a key of pass,
+// material, mesh and level packed into the bits this frame's ids need, transparent rows just
+// the pass. One stable sort puts opaque batches in key order with their rows in cull order and
+// the transparents behind them, runs of equal keys are the opaque draws.
+void DrawPreparation::buildAndSortIndirectDraws(
+	FrameContext& frameCtx,
+	const std::vector<GPUMeshData>& meshes,
+	const std::vector<MeshLODs>& meshLODs,
+	const std::vector<AABB>& worldAABBs,
+	const glm::vec4 cameraPos)
+{
+	DrawBatchScratch& scratch = frameCtx.batchScratch;
+	const auto& lods = frameCtx.visibleLODs;
+
+	// The culled list becomes the source, the frame's list is refilled in draw order
+	std::swap(scratch.sourceInstances, frameCtx.visibleInstances);
+	const std::vector<GPUInstance>& source = scratch.sourceInstances;
+	const uint32_t count = static_cast<uint32_t>(source.size());
+	frameCtx.visibleInstances.clear();
+
+	// === BATCH KEYS ===
+	uint32_t meshMask = 0, materialMask = 0;
+	for (const GPUInstance& inst : source) {
+		meshMask |= inst.meshID;
+		materialMask |= inst.materialID;
+	}
+	const BatchKeyLayout layout = batchKeyLayout(meshMask, materialMask);
+
+	scratch.keys.resize(count);
+	scratch.rows.resize(count);
+	uint32_t opaqueCount = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		scratch.rows[i] = i;
+		scratch.keys[i] = batchKey(source[i], lods.empty() ? 0u : lods[i], layout);
+		opaqueCount += static_cast<MaterialPass>(source[i].passType) == MaterialPass::Opaque ? 1u : 0u;
+	}
+	radixSortRows(scratch.keys, scratch.rows, scratch.tmpKeys, scratch.tmpRows, layout.passShift + 1);
+
+	// === EMIT OPAQUE BATCHES ===
+	uint32_t opaqueBatches = 0;
+	frameCtx.opaqueRange.first = 0;
+	for (uint32_t runStart = 0; runStart < opaqueCount;) {
+		const uint64_t key = scratch.keys[runStart];
+		uint32_t runEnd = runStart + 1;
+		while (runEnd < opaqueCount && scratch.keys[runEnd] == key) ++runEnd;
+
+		const uint32_t meshID = source[scratch.rows[runStart]].meshID;
+		frameCtx.indirectDraws.emplace_back(opaqueDraw(frameCtx, meshes, meshLODs, layout, meshID, key, runStart, runEnd));
+		for (uint32_t i = runStart; i < runEnd; ++i)
+			frameCtx.visibleInstances.emplace_back(source[scratch.rows[i]]);
+
+		++opaqueBatches;
+		runStart = runEnd;
+	}
+	frameCtx.opaqueRange.visibleCount = opaqueCount;
+	orderOpaqueDraws(frameCtx, worldAABBs, cameraPos, opaqueCount);
+
+	// === SORT AND BUILD TRANSPARENT ===
+	emitTransparentDraws(frameCtx, meshes, meshLODs, worldAABBs, cameraPos, opaqueCount);
+
+	FrameCounters::add(FrameCounter::OpaqueBatches, opaqueBatches);
+	FrameCounters::add(FrameCounter::TransparentDraws, count - opaqueCount);
+
+	// Levels live in the draws now, the list they lined up with was just reordered
+	frameCtx.visibleLODs.clear();
+}
+
+// Same draws as buildAndSortIndirectDraws. The rows are cut into fixed slices, and every
+// stage works slice by slice on JobSystem workers: keys, then each radix pass as a histogram
+// per slice, a prefix sum over bucket then slice, and a scatter that keeps each slice's rows
+// in order. Run starts are counted per slice for the draw offsets, then draws and instances
+// are written in place. Opaque ordering and the transparent sort stay on the calling thread.
+void DrawPreparation::buildIndirectDrawsParallel(
+	FrameContext& frameCtx,
+	const std::vector<GPUMeshData>& meshes,
+	const std::vector<MeshLODs>& meshLODs,
+	const std::vector<AABB>& worldAABBs,
+	const glm::vec4 cameraPos)
+{
+	const uint32_t threads = JobSystem::getThreadCount();
+	const uint32_t count = static_cast<uint32_t>(frameCtx.visibleInstances.size());
+	if (threads == 1 || count < DRAW_PARALLEL_MIN_ROWS) {
+		buildAndSortIndirectDraws(frameCtx, meshes, meshLODs, worldAABBs, cameraPos);
+		return;
+	}
+
+	DrawBatchScratch& scratch = frameCtx.batchScratch;
+	const auto& lods = frameCtx.visibleLODs;
+	std::swap(scratch.sourceInstances, frameCtx.visibleInstances);
+	const std::vector<GPUInstance>& source = scratch.sourceInstances;
+
+	const uint32_t slices = std::clamp(count / DRAW_PARALLEL_SLICE_ROWS, 1u, threads * 4u);
+	auto sliceBegin = [count, slices](uint32_t s) {
+		return static_cast<uint32_t>(static_cast<uint64_t>(count) * s / slices);
+	};
+	auto forSlices = [&](auto&& fn) {
+		JobSystem::parallelFor(slices, 1, [&](uint32_t begin, uint32_t end, uint32_t) {
+			for (uint32_t s = begin; s < end; ++s) fn(s, sliceBegin(s), sliceBegin(s + 1));
+		});
+	};
+
+	// Per slice: mesh and material masks and opaque rows, then one bucket histogram per pass
+	std::vector<uint32_t>& sliceCounts = scratch.sliceCounts;
+	sliceCounts.resize(static_cast<size_t>(slices) * RADIX_BUCKETS);
+
+	// === BATCH KEYS ===
+	forSlices([&](uint32_t s, uint32_t begin, uint32_t end) {
+		uint32_t meshMask = 0, materialMask = 0, opaque = 0;
+		for (uint32_t i = begin; i < end; ++i) {
+			meshMask |= source[i].meshID;
+			materialMask |= source[i].materialID;
+			opaque += static_cast<MaterialPass>(source[i].passType) == MaterialPass::Opaque ? 1u : 0u;
+		}
+		uint32_t* slot = sliceCounts.data() + static_cast<size_t>(s) * RADIX_BUCKETS;
+		slot[0] = meshMask;
+		slot[1] = materialMask;
+		slot[2] = opaque;
+	});
+
+	uint32_t meshMask = 0, materialMask = 0, opaqueCount = 0;
+	for (uint32_t s = 0; s < slices; ++s) {
+		const uint32_t* slot = sliceCounts.data() + static_cast<size_t>(s) * RADIX_BUCKETS;
+		meshMask |= slot[0];
+		materialMask |= slot[1];
+		opaqueCount += slot[2];
+	}
+	const BatchKeyLayout layout = batchKeyLayout(meshMask, materialMask);
+
+	scratch.keys.resize(count);
+	scratch.rows.resize(count);
+	scratch.tmpKeys.resize(count);
+	scratch.tmpRows.resize(count);
+	forSlices([&](uint32_t, uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			scratch.rows[i] = i;
+			scratch.keys[i] = batchKey(source[i], lods.empty() ? 0u : lods[i], layout);
+		}
+	});
+
+	// === RADIX PASSES ===
+	const uint32_t keyBits = layout.passShift + 1;
+	for (uint32_t shift = 0; shift < keyBits; shift += RADIX_DIGIT_BITS) {
+		forSlices([&](uint32_t s, uint32_t begin, uint32_t end) {
+			uint32_t* hist = sliceCounts.data() + static_cast<size_t>(s) * RADIX_BUCKETS;
+			std::fill(hist, hist + RADIX_BUCKETS, 0u);
+			for (uint32_t i = begin; i < end; ++i) ++hist[radixDigit(scratch.keys[i], shift)];
+		});
+
+		// Bucket major, so a slice's rows land after the same bucket's rows of earlier slices
+		uint32_t sum = 0;
+		bool sharedDigit = false;
+		for (uint32_t b = 0; b < RADIX_BUCKETS; ++b) {
+			const uint32_t bucketStart = sum;
+			for (uint32_t s = 0; s < slices; ++s) {
+				uint32_t& c = sliceCounts[static_cast<size_t>(s) * RADIX_BUCKETS + b];
+				const uint32_t n = c;
+				c = sum;
+				sum += n;
+			}
+			sharedDigit |= sum - bucketStart == count;
+		}
+		if (sharedDigit) continue;
+
+		forSlices([&](uint32_t s, uint32_t begin, uint32_t end) {
+			uint32_t* offsets = sliceCounts.data() + static_cast<size_t>(s) * RADIX_BUCKETS;
+			for (uint32_t i = begin; i < end; ++i) {
+				const uint32_t dst = offsets[radixDigit(scratch.keys[i], shift)]++;
+				scratch.tmpKeys[dst] = scratch.keys[i];
+				scratch.tmpRows[dst] = scratch.rows[i];
+			}
+		});
+		scratch.keys.swap(scratch.tmpKeys);
+		scratch.rows.swap(scratch.tmpRows);
+	}
+
+	// === EMIT OPAQUE BATCHES ===
+	// Runs starting in each slice give its first draw, the run that starts it is written there
+	std::vector<uint32_t>& sliceRuns = scratch.sliceRuns;
+	sliceRuns.resize(slices + 1);
+	auto runStarts = [&](uint32_t i) { return i < opaqueCount && (i == 0 || scratch.keys[i] != scratch.keys[i - 1]); };
+	forSlices([&](uint32_t s, uint32_t begin, uint32_t end) {
+		uint32_t runs = 0;
+		for (uint32_t i = begin; i < end; ++i) runs += runStarts(i) ? 1u : 0u;
+		sliceRuns[s + 1] = runs;
+	});
+	sliceRuns[0] = 0;
+	for (uint32_t s = 0; s < slices; ++s) sliceRuns[s + 1] += sliceRuns[s];
+	const uint32_t opaqueBatches = sliceRuns[slices];
+
+	frameCtx.opaqueRange.first = 0;
+	frameCtx.opaqueRange.visibleCount = opaqueCount;
+	frameCtx.indirectDraws.resize(opaqueBatches);
+	frameCtx.visibleInstances.resize(opaqueCount);
+	forSlices([&](uint32_t s, uint32_t begin, uint32_t end) {
+		uint32_t draw = sliceRuns[s];
+		for (uint32_t i = begin; i < end && i < opaqueCount; ++i) {
+			frameCtx.visibleInstances[i] = source[scratch.rows[i]];
+			if (!runStarts(i)) continue;
+
+			const uint64_t key = scratch.keys[i];
+			uint32_t runEnd = i + 1;
+			while (runEnd < opaqueCount && scratch.keys[runEnd] == key) ++runEnd;
+			frameCtx.indirectDraws[draw++] = opaqueDraw(frameCtx, meshes, meshLODs, layout, source[scratch.rows[i]].meshID, key, i, runEnd);
+		}
+	});
+	orderOpaqueDraws(frameCtx, worldAABBs, cameraPos, opaqueCount);
+
+	// === SORT AND BUILD TRANSPARENT ===
+	emitTransparentDraws(frameCtx, meshes, meshLODs, worldAABBs, cameraPos, opaqueCount);
+
+	FrameCounters::add(FrameCounter::OpaqueBatches, opaqueBatches);
+	FrameCounters::add(FrameCounter::TransparentDraws, count - opaqueCount);
+
+	frameCtx.visibleLODs.clear();
+}
+
+DrawPreparation::RenderDataStaging DrawPreparation::packRenderData(
+	const FrameContext& frameCtx,
+	uint8_t* staging,
+	size_t stagingSize,
+	size_t alignment,
+	size_t& stagingHead)
+{
+	RenderDataStaging out{};
+	out.instanceBytes = frameCtx.visibleInstances.size() * sizeof(GPUInstance);
+	out.drawBytes = frameCtx.indirectDraws.size() * sizeof(VkDrawIndexedIndirectCommand);
+	const size_t addrBytes = sizeof(GPUAddressTable);
+
+	out.instanceOffset = BufferUtils::reserveStagingAligned(stagingHead, stagingSize, out.instanceBytes, alignment);
+	out.drawOffset = BufferUtils::reserveStagingAligned(stagingHead, stagingSize, out.drawBytes, alignment);
+	out.addressOffset = BufferUtils::reserveStagingAligned(stagingHead, stagingSize, addrBytes, alignment);
+
+	// visible instances buffer staging
+	memcpy(staging + out.instanceOffset, frameCtx.visibleInstances.data(), out.instanceBytes);
+	// indirect draws buffer staging
+	memcpy(staging + out.drawOffset, frameCtx.indirectDraws.data(), out.drawBytes);
+	// frame address table staging
+	memcpy(staging + out.addressOffset, &frameCtx.addressTable, addrBytes);
+
+	return out;
+}
@@ -1,144 +1,28 @@
 #include "pch.h"
 
 #include "DrawPreparation.h"
+#include "renderer/Renderer.h"
 #include "engine/Engine.h"
 #include "utils/BufferUtils.h"
 
-// All render data is reset prior to this each frame
-void DrawPreparation::buildAndSortIndirectDraws(
-	FrameContext& frameCtx,
-	const std::vector<GPUMeshData>& meshes,
-	const std::vector<AABB>& worldAABBs,
-	const glm::vec4 cameraPos)
-{
-	// Partition visible instances, while remembering their original indices
-	std::vector<GPUInstance> opaqueInstances;
-	std::vector<GPUInstance> transparentInstances;
-	std::vector<uint32_t> transparentVisIdx;
-
-	opaqueInstances.reserve(frameCtx.visibleInstances.size());
-	transparentInstances.reserve(frameCtx.visibleInstances.size());
-	transparentVisIdx.reserve(frameCtx.visibleInstances.size());
-
-	// === BATCH OPAQUE INSTANCES ===
-	std::unordered_map<OpaqueBatchKey, std::vector<uint32_t>, OpaqueBatchKeyHash> opaqueBatches;
-
-	// Separate pass types
-	for (uint32_t i = 0; i < frameCtx.visibleInstances.size(); ++i) {
-		const auto& inst = frameCtx.visibleInstances[i];
-		if (static_cast<MaterialPass>(inst.passType) == MaterialPass::Opaque) {
-			opaqueInstances.push_back(inst);
-			const OpaqueBatchKey key{ inst.meshID, inst.materialID };
-			opaqueBatches[key].push_back(i);
-		}
-		else {
-			transparentInstances.push_back(inst);
-			transparentVisIdx.push_back(i); // Need index into worldaabbs for transparent depth sort
-		}
-	}
-
-	frameCtx.indirectDraws.reserve(opaqueBatches.size() + transparentInstances.size());
-
-	// Rebuild instances in draw order
-	frameCtx.visibleInstances.clear();
-	frameCtx.visibleInstances.reserve(opaqueInstances.size() + transparentInstances.size());
-
-	// Opaque first
-	frameCtx.opaqueRange.first = 0;
-	for (const auto& [key, instanceIndices] : opaqueBatches) {
-		const GPUMeshData& mesh = meshes[key.meshID];
-
-		ASSERT(mesh.firstIndex + mesh.indexCount <= frameCtx.drawDataPC.totalIndexCount &&
-			"[DrawPrep] Opaque draws would read past end of index buffer.");
-		ASSERT(mesh.vertexOffset + mesh.vertexCount <= frameCtx.drawDataPC.totalVertexCount &&
-			"[DrawPrep] Opaque draws would read past end of vertex buffer.");
-
-		VkDrawIndexedIndirectCommand cmd {
-			.indexCount = mesh.indexCount,
-			.instanceCount = static_cast<uint32_t>(instanceIndices.size()),
-			.firstIndex = mesh.firstIndex,
-			.vertexOffset = static_cast<int32_t>(mesh.vertexOffset),
-			.firstInstance = frameCtx.opaqueRange.first + frameCtx.opaqueRange.visibleCount
-		};
-
-		frameCtx.indirectDraws.emplace_back(cmd);
-		for (uint32_t idx : instanceIndices)
-			frameCtx.visibleInstances.emplace_back(opaqueInstances[idx]);
-
-		frameCtx.opaqueRange.visibleCount += cmd.instanceCount;
-	}
-
-	// === SORT AND BUILD TRANSPARENT ===
-	if (!transparentInstances.empty()) {
-		frameCtx.transparentRange.first = frameCtx.opaqueRange.visibleCount;
-		frameCtx.transparentRange.visibleCount = static_cast<uint32_t>(transparentInstances.size());
-
-		// Sort using AABBs aligned with the original visible list
-		std::vector<uint32_t> order(transparentInstances.size());
-		std::iota(order.begin(), order.end(), 0);
-
-		const glm::vec3 camPos = glm::vec3(cameraPos);
-		std::sort(order.begin(), order.end(), [&](uint32_t ia, uint32_t ib) {
-			const auto& aabbA = worldAABBs[transparentVisIdx[ia]];
-			const auto& aabbB = worldAABBs[transparentVisIdx[ib]];
-			return glm::length(aabbA.origin - camPos) > glm::length(aabbB.origin - camPos);
-		});
-
-		for (uint32_t i = 0; i < order.size(); ++i) {
-			const GPUInstance& inst = transparentInstances[order[i]];
-			const GPUMeshData& mesh = meshes[inst.meshID];
-
-			ASSERT(mesh.firstIndex + mesh.indexCount <= frameCtx.drawDataPC.totalIndexCount &&
-				"[DrawPrep] Transparent draws would read past end of index buffer.");
-			ASSERT(mesh.vertexOffset + mesh.vertexCount <= frameCtx.drawDataPC.totalVertexCount &&
-				"[DrawPrep] Transparent draws would read past end of vertex buffer.");
-
-			VkDrawIndexedIndirectCommand cmd {
-				.indexCount = mesh.indexCount,
-				.instanceCount = 1,
-				.firstIndex = mesh.firstIndex,
-				.vertexOffset = static_cast<int32_t>(mesh.vertexOffset),
-				.firstInstance = frameCtx.transparentRange.first + i
-			};
-
-			frameCtx.indirectDraws.push_back(cmd);
-			frameCtx.visibleInstances.push_back(inst);
-		}
-	}
-}
-
-
 void DrawPreparation::uploadGPUBuffersForFrame(FrameContext& frameCtx, GPUQueue& transferQueue, const VmaAllocator allocator) {
 	ASSERT(frameCtx.combinedGPUStaging.buffer != VK_NULL_HANDLE &&
 		"[DrawPreparation::uploadGPUBuffersForFrame] combinedGPUstaging buffer is invalid.");
 
-	const size_t visInstBytes = frameCtx.visibleInstances.size() * sizeof(GPUInstance);
-	const size_t indirectDrawBytes = frameCtx.indirectDraws.size() * sizeof(VkDrawIndexedIndirectCommand);
+	const RenderDataStaging packed = packRenderData(
+		frameCtx,
+		static_cast<uint8_t*>(frameCtx.combinedGPUStaging.info.pMappedData),
+		frameCtx.combinedGPUStaging.info.size,
+		BufferUtils::stagingAlignment(),
+		frameCtx.stagingHead);
+
+	const size_t visInstOffset = packed.instanceOffset;
+	const size_t visInstBytes = packed.instanceBytes;
+	const size_t indirectDrawOffset = packed.drawOffset;
+	const size_t indirectDrawBytes = packed.drawBytes;
+	const size_t addrOffset = packed.addressOffset;
 	const size_t addrBytes = sizeof(GPUAddressTable);
 
-	uint8_t* const mappedStagingPtr = static_cast<uint8_t*>(frameCtx.combinedGPUStaging.info.pMappedData);
-	const size_t stagingSize = frameCtx.combinedGPUStaging.info.size;
-
-	const size_t visInstOffset = BufferUtils::reserveStaging(
-		frameCtx.stagingHead,
-		stagingSize,
-		visInstBytes);
-	const size_t indirectDrawOffset = BufferUtils::reserveStaging(
-		frameCtx.stagingHead,
-		stagingSize,
-		indirectDrawBytes);
-	const size_t addrOffset = BufferUtils::reserveStaging(
-		frameCtx.stagingHead,
-		stagingSize,
-		addrBytes);
-
-	// visible instances buffer staging
-	memcpy(mappedStagingPtr + visInstOffset, frameCtx.visibleInstances.data(), visInstBytes);
-	// indirect draws buffer staging
-	memcpy(mappedStagingPtr + indirectDrawOffset, frameCtx.indirectDraws.data(), indirectDrawBytes);
-	// frame address table staging
-	memcpy(mappedStagingPtr + addrOffset, &frameCtx.addressTable, addrBytes);
-
 	const auto bufAlloc = frameCtx.combinedGPUStaging.allocation;
 	BufferUtils::flushStagingRange(bufAlloc, visInstOffset, visInstBytes, allocator);
 	BufferUtils::flushStagingRange(bufAlloc, indirectDrawOffset, indirectDrawBytes, allocator);
@@ -147,27 +31,30 @@ void DrawPreparation::uploadGPUBuffersForFrame(FrameContext& frameCtx, GPUQueue&
 	// Record big transfer copies for indirect, instance, and main frame address table buffers
 	CommandBuffer::recordDeferredCmd([&](VkCommandBuffer cmd) {
 
-		// visible instance data
-		VkBufferCopy visInstCpy{};
-		visInstCpy.srcOffset = visInstOffset;
-		visInstCpy.dstOffset = 0;
-		visInstCpy.size = visInstBytes;
-		vkCmdCopyBuffer(cmd,
-			frameCtx.combinedGPUStaging.buffer,
-			frameCtx.visibleInstancesBuffer.buffer,
-			1,
-			&visInstCpy);
-
-		// indirect draw commands
-		VkBufferCopy indirectDrawsCpy{};
-		indirectDrawsCpy.srcOffset = indirectDrawOffset;
-		indirectDrawsCpy.dstOffset = 0;
-		indirectDrawsCpy.size = indirectDrawBytes;
-		vkCmdCopyBuffer(cmd,
-			frameCtx.combinedGPUStaging.buffer,
-			frameCtx.indirectDrawsBuffer.buffer,
-			1,
-			&indirectDrawsCpy);
+		// the gpu occlusion path can upload just the address table, zero sized copies are invalid
+		if (visInstBytes > 0) {
+			// visible instance data
+			VkBufferCopy visInstCpy{};
+			visInstCpy.srcOffset = visInstOffset;
+			visInstCpy.dstOffset = 0;
+			visInstCpy.size = visInstBytes;
+			vkCmdCopyBuffer(cmd,
+				frameCtx.combinedGPUStaging.buffer,
+				frameCtx.visibleInstancesBuffer.buffer,
+				1,
+				&visInstCpy);
+
+			// indirect draw commands
+			VkBufferCopy indirectDrawsCpy{};
+			indirectDrawsCpy.srcOffset = indirectDrawOffset;
+			indirectDrawsCpy.dstOffset = 0;
+			indirectDrawsCpy.size = indirectDrawBytes;
+			vkCmdCopyBuffer(cmd,
+				frameCtx.combinedGPUStaging.buffer,
+				frameCtx.indirectDrawsBuffer.buffer,
+				1,
+				&indirectDrawsCpy);
+		}
 
 		// GPU address table copy
 		VkBufferCopy addressCpy{};
@@ -197,6 +84,7 @@ void DrawPreparation::uploadGPUBuffersForFrame(FrameContext& frameCtx, GPUQueue&
 
 	frameCtx.stashSubmitted(QueueType::Transfer);
 	frameCtx.transferWaitValue = signalValue;
+	frameCtx.renderDataUploaded = true;
 }
 
 static glm::mat4 makeGridTransform(uint32_t index, uint32_t count, float spacing) {
@@ -1,35 +1,70 @@
 #pragma once
 
 #include "common/EngineTypes.h"
-#include "renderer/Renderer.h"
+#include "core/ResourceManager.h"
+#include "renderer/frame/FrameContext.h"
 #include "SceneGraph.h"
 
-struct OpaqueBatchKey {
-	uint32_t meshID;
-	uint32_t materialID;
-
-	bool operator==(const OpaqueBatchKey& other) const {
-		return meshID == other.meshID && materialID == other.materialID;
-	}
-};
+namespace DrawPreparation {
+	// The parallel draw build runs serially below this, and cuts rows into slices of this size
+	constexpr uint32_t DRAW_PARALLEL_MIN_ROWS = 16384;
+	constexpr uint32_t DRAW_PARALLEL_SLICE_ROWS = 4096;
+	// Entries an insertion pass over last build's transparent order may shift per row before
+	// the radix sort takes over
+	constexpr uint32_t TRANSPARENT_INSERTION_SHIFTS = 16;
+	// Mantissa bits kept in an opaque row's depth bucket, each doubling of squared distance is cut
+	// into 1 << this. Fewer keeps more of a batch together under OpaqueOrder::DepthSlices.
+	constexpr uint32_t OPAQUE_DEPTH_MANTISSA_BITS = 2;
 
-struct OpaqueBatchKeyHash {
-	std::size_t operator()(const OpaqueBatchKey& k) const {
-		std::size_t h1 = std::hash<uint32_t>{}(k.meshID);
-		std::size_t h2 = std::hash<uint32_t>{}(k.materialID);
-		return h1 ^ (h2 + 0x9e3779b9 + (h1 << 6) + (h1 >> 2));
-	}
-};
+	// Where packRenderData put the frame's instances, draws and address table in staging
+	struct RenderDataStaging {
+		size_t instanceOffset = 0;
+		size_t instanceBytes = 0;
+		size_t drawOffset = 0;
+		size_t drawBytes = 0;
+		size_t addressOffset = 0;
+	};
 
-namespace DrawPreparation {
 	void uploadGPUBuffersForFrame(FrameContext& frameCtx, GPUQueue& transferQueue, const VmaAllocator allocator);
 
+	// Copies the frame's render data into mapped staging memory from stagingHead on, every part
+	// starting at a multiple of alignment. Memory only, the upload records and flushes the copies.
+	RenderDataStaging packRenderData(
+		const FrameContext& frameCtx,
+		uint8_t* staging,
+		size_t stagingSize,
+		size_t alignment,
+		size_t& stagingHead);
+
+	// frameCtx.visibleLODs picks each instance's index range out of meshLODs. Opaque draws come
+	// out in material, mesh, level order with their rows in cull order, reordered after by
+	// frameCtx.opaqueOrder, then the transparents back to front. Works in frameCtx.batchScratch.
 	void buildAndSortIndirectDraws(
 		FrameContext& frameCtx,
 		const std::vector<GPUMeshData>& meshes,
+		const std::vector<MeshLODs>& meshLODs,
+		const std::vector<AABB>& worldAABBs,
+		const glm::vec4 cameraPos);
+	// Same draws and instances, keys, radix passes and opaque draws built on JobSystem workers
+	void buildIndirectDrawsParallel(
+		FrameContext& frameCtx,
+		const std::vector<GPUMeshData>& meshes,
+		const std::vector<MeshLODs>& meshLODs,
 		const std::vector<AABB>& worldAABBs,
 		const glm::vec4 cameraPos);
 
+	// Back to front order of rows by squared distance from camPos to their box centers, equal
+	// depths in the order they come in rows. One integer key per row, then an insertion pass over
+	// the order the last call on this scratch left when the count is the same, given up for a
+	// radix sort once it moves more than TRANSPARENT_INSERTION_SHIFTS entries per row. Positions
+	// into rows land in scratch.transparentOrder, true if the insertion pass made it.
+	bool sortTransparentRows(
+		DrawBatchScratch& scratch,
+		const uint32_t* rows,
+		uint32_t count,
+		const std::vector<AABB>& worldAABBs,
+		const glm::vec3& camPos);
+
 	void syncGlobalInstancesAndTransforms(
 		FrameContext& frameCtx,
 		GPUResources& gpuResources,
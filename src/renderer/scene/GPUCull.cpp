@@ -0,0 +1,436 @@
+#include "pch.h"
+
+#include "GPUCull.h"
+#include "engine/Engine.h"
+#include "renderer/Renderer.h"
+#include "utils/BufferUtils.h"
+
+static_assert(sizeof(Visibility::CullRow) == 24, "CullRow must match frustum_cull_comp.comp");
+static_assert(sizeof(Visibility::CullBatch) == 24, "CullBatch must match cull_compact_comp.comp");
+
+namespace GPUCull {
+	// Batch table on the CPU, each frame context uploads its own copy after its fence
+	static Visibility::CullBatchTable _table;
+	static uint64_t _tableVersion = 0;
+	static bool _dirty = true;
+
+	static void uploadTable(FrameContext& frameCtx, const VmaAllocator allocator);
+	static bool prepareTable(
+		FrameContext& frameCtx,
+		const Visibility::VisibilityState& vs,
+		const std::vector<GPUMeshData>& meshes,
+		const VmaAllocator allocator);
+	static void recordBatching(VkCommandBuffer cmd, FrameContext& frameCtx);
+	static void keepCPUBatching(FrameContext& frameCtx, const VmaAllocator allocator);
+	static uint32_t compareBatching(const FrameContext& frameCtx, uint32_t gpuDraws, const VmaAllocator allocator);
+}
+
+void GPUCull::markDirty() { _dirty = true; }
+
+// Only called once this frame context's fence was waited on, the other frames in flight keep
+// reading their own copies
+void GPUCull::uploadTable(FrameContext& frameCtx, const VmaAllocator allocator) {
+	const uint32_t rowCount = static_cast<uint32_t>(_table.rows.size());
+	if (rowCount > frameCtx.gpuCullRowCapacity) {
+		auto& persistent = frameCtx.persistentGPUBuffers;
+		for (AllocatedBuffer* buf : { &frameCtx.gpuCullRows, &frameCtx.gpuCullBatches }) {
+			if (buf->buffer == VK_NULL_HANDLE) continue;
+			const VkBuffer old = buf->buffer;
+			persistent.erase(std::remove_if(persistent.begin(), persistent.end(),
+				[old](const AllocatedBuffer& b) { return b.buffer == old; }), persistent.end());
+			BufferUtils::destroyAllocatedBuffer(*buf, allocator);
+		}
+
+		frameCtx.gpuCullRowCapacity = std::max(rowCount, frameCtx.gpuCullRowCapacity * 2);
+
+		// Never more batches than rows
+		frameCtx.gpuCullRows = BufferUtils::createBuffer(
+			frameCtx.gpuCullRowCapacity * sizeof(Visibility::CullRow),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VMA_MEMORY_USAGE_CPU_TO_GPU,
+			allocator);
+		frameCtx.persistentGPUBuffers.push_back(frameCtx.gpuCullRows);
+
+		frameCtx.gpuCullBatches = BufferUtils::createBuffer(
+			frameCtx.gpuCullRowCapacity * sizeof(Visibility::CullBatch),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VMA_MEMORY_USAGE_CPU_TO_GPU,
+			allocator);
+		frameCtx.persistentGPUBuffers.push_back(frameCtx.gpuCullBatches);
+	}
+
+	if (rowCount > 0) {
+		const size_t rowBytes = _table.rows.size() * sizeof(Visibility::CullRow);
+		const size_t batchBytes = _table.batches.size() * sizeof(Visibility::CullBatch);
+
+		memcpy(frameCtx.gpuCullRows.mapped, _table.rows.data(), rowBytes);
+		vmaFlushAllocation(allocator, frameCtx.gpuCullRows.allocation, 0, rowBytes);
+		memcpy(frameCtx.gpuCullBatches.mapped, _table.batches.data(), batchBytes);
+		vmaFlushAllocation(allocator, frameCtx.gpuCullBatches.allocation, 0, batchBytes);
+	}
+
+	frameCtx.gpuCullTableVersion = _tableVersion;
+}
+
+// Counters and batch table, shared by both modes. False when the rows don't fit the frame's
+// instance buffer, the frame goes down the CPU path then.
+bool GPUCull::prepareTable(
+	FrameContext& frameCtx,
+	const Visibility::VisibilityState& vs,
+	const std::vector<GPUMeshData>& meshes,
+	const VmaAllocator allocator)
+{
+	if (frameCtx.gpuCullCounts.buffer == VK_NULL_HANDLE) {
+		frameCtx.gpuCullCounts = BufferUtils::createBuffer(
+			COUNT_BUFFER_BYTES,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+			VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VMA_MEMORY_USAGE_GPU_TO_CPU,
+			allocator);
+		frameCtx.persistentGPUBuffers.push_back(frameCtx.gpuCullCounts);
+	}
+	else if (frameCtx.gpuCullRecorded) {
+		// This frame context's fence was waited on before the scene update, its last counters are final
+		CullCounters counters{};
+		vmaInvalidateAllocation(allocator, frameCtx.gpuCullCounts.allocation, 0, sizeof(CullCounters));
+		memcpy(&counters, frameCtx.gpuCullCounts.mapped, sizeof(CullCounters));
+
+		auto& stats = Engine::getProfiler().getStats();
+		stats.gpuCullVisible.store(counters.visibleRows);
+		stats.gpuCullOpaqueDraws.store(counters.drawCount[0]);
+		stats.gpuCullCPUVisible.store(frameCtx.gpuCullCPUCount);
+		stats.gpuCullCPUOpaqueDraws.store(frameCtx.gpuCullCPUDraws);
+		if (frameCtx.gpuBatchCheck)
+			stats.gpuBatchMismatches.store(compareBatching(frameCtx, counters.drawCount[0], allocator));
+	}
+	frameCtx.gpuCullRecorded = false;
+	frameCtx.gpuBatchCheck = false;
+
+	// Every row has a slot in the frame's instance buffer, the fallback is logged once per table
+	if (_dirty) {
+		Visibility::buildCullBatches(vs, meshes, _table);
+		++_tableVersion;
+		_dirty = false;
+
+		if (_table.instanceSlots() > MAX_DRAWS)
+			fmt::print("[GPUCull] {} rows is over the {} instance limit, using the CPU path\n", _table.instanceSlots(), MAX_DRAWS);
+	}
+
+	if (_table.instanceSlots() > MAX_DRAWS) {
+		frameCtx.gpuCullActive = false;
+		return false;
+	}
+
+	if (frameCtx.gpuCullTableVersion != _tableVersion)
+		uploadTable(frameCtx, allocator);
+	return true;
+}
+
+void GPUCull::prepareFrame(
+	FrameContext& frameCtx,
+	const Visibility::VisibilityState& vs,
+	const std::vector<GPUMeshData>& meshes,
+	uint32_t cpuVisibleCount,
+	uint32_t cpuOpaqueDraws,
+	const VmaAllocator allocator)
+{
+	frameCtx.gpuCullBatching = false;
+	if (!prepareTable(frameCtx, vs, meshes, allocator)) return;
+
+	const uint32_t rowCount = static_cast<uint32_t>(_table.rows.size());
+	frameCtx.gpuCullActive = rowCount > 0;
+	if (!frameCtx.gpuCullActive) return;
+
+	auto& pc = frameCtx.cullingPCData;
+	pc.rowBufferAddr = frameCtx.gpuCullRows.address;
+	pc.batchBufferAddr = frameCtx.gpuCullBatches.address;
+	pc.countBufferAddr = frameCtx.gpuCullCounts.address;
+	pc.rowCount = rowCount;
+	pc.batchCount = static_cast<uint32_t>(_table.batches.size());
+
+	frameCtx.gpuCullRecorded = true;
+	frameCtx.gpuCullCPUCount = cpuVisibleCount;
+	frameCtx.gpuCullCPUDraws = cpuOpaqueDraws;
+}
+
+void GPUCull::cullTransparents(
+	const Visibility::VisibilityState& vs,
+	const Frustum& frustum,
+	std::vector<GPUInstance>& visibleInstances,
+	std::vector<AABB>& visibleWorldAABBs)
+{
+	visibleInstances.clear();
+	visibleWorldAABBs.clear();
+	Visibility::cullTransparentRows(vs, _table, frustum, visibleInstances, visibleWorldAABBs);
+	Engine::getProfiler().getStats().gpuCullTransparentDraws.store(static_cast<uint32_t>(visibleInstances.size()));
+}
+
+void GPUCull::gatherTransparents(
+	const Visibility::VisibilityState& vs,
+	const std::vector<uint32_t>& visibleRows,
+	std::vector<GPUInstance>& visibleInstances,
+	std::vector<AABB>& visibleWorldAABBs)
+{
+	visibleInstances.clear();
+	visibleWorldAABBs.clear();
+	for (uint32_t row : visibleRows) {
+		if (static_cast<MaterialPass>(vs.instances[row].passType) == MaterialPass::Opaque) continue;
+		visibleInstances.push_back(vs.instances[row]);
+		visibleWorldAABBs.push_back(vs.worldAABBs[row]);
+	}
+	Engine::getProfiler().getStats().gpuCullTransparentDraws.store(static_cast<uint32_t>(visibleInstances.size()));
+}
+
+void GPUCull::prepareBatching(
+	FrameContext& frameCtx,
+	const Visibility::VisibilityState& vs,
+	const std::vector<GPUMeshData>& meshes,
+	const std::vector<uint32_t>& visibleRows,
+	bool validate,
+	const VmaAllocator allocator)
+{
+	frameCtx.gpuCullBatching = true;
+	if (!prepareTable(frameCtx, vs, meshes, allocator)) return;
+
+	frameCtx.gpuCullActive = !visibleRows.empty() && !_table.rows.empty();
+	if (!frameCtx.gpuCullActive) return;
+
+	// Visible rows are a subset of the table, never more than MAX_DRAWS
+	if (frameCtx.gpuBatchRows.buffer == VK_NULL_HANDLE) {
+		frameCtx.gpuBatchRows = BufferUtils::createBuffer(
+			MAX_DRAWS * sizeof(uint32_t),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VMA_MEMORY_USAGE_CPU_TO_GPU,
+			allocator);
+		frameCtx.persistentGPUBuffers.push_back(frameCtx.gpuBatchRows);
+	}
+
+	// Only the opaque rows have table entries
+	uint32_t* entries = static_cast<uint32_t*>(frameCtx.gpuBatchRows.mapped);
+	uint32_t visibleCount = 0;
+	for (uint32_t row : visibleRows) {
+		const uint32_t entry = _table.rowEntry[row];
+		if (entry != Visibility::ROW_INACTIVE) entries[visibleCount++] = entry;
+	}
+	vmaFlushAllocation(allocator, frameCtx.gpuBatchRows.allocation, 0, visibleCount * sizeof(uint32_t));
+
+	auto& pc = frameCtx.batchPCData;
+	pc.rowBufferAddr = frameCtx.gpuCullRows.address;
+	pc.batchBufferAddr = frameCtx.gpuCullBatches.address;
+	pc.countBufferAddr = frameCtx.gpuCullCounts.address;
+	pc.visibleRowsAddr = frameCtx.gpuBatchRows.address;
+	pc.visibleCount = visibleCount;
+	pc.batchCount = static_cast<uint32_t>(_table.batches.size());
+
+	frameCtx.gpuCullRecorded = true;
+	frameCtx.gpuCullCPUCount = 0;
+	frameCtx.gpuCullCPUDraws = 0;
+	if (validate) keepCPUBatching(frameCtx, allocator);
+}
+
+// The frame context still holds the CPU batching of the same rows, its opaque draws come first
+// with their instances from 0. Rows are kept as sorted transform ids per draw, the scatter's
+// atomics leave a batch's rows in any order.
+void GPUCull::keepCPUBatching(FrameContext& frameCtx, const VmaAllocator allocator) {
+	if (frameCtx.gpuBatchReadback.buffer == VK_NULL_HANDLE) {
+		frameCtx.gpuBatchReadback = BufferUtils::createBuffer(
+			MAX_DRAWS * (sizeof(VkDrawIndexedIndirectCommand) + sizeof(GPUInstance)),
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VMA_MEMORY_USAGE_GPU_TO_CPU,
+			allocator);
+		frameCtx.persistentGPUBuffers.push_back(frameCtx.gpuBatchReadback);
+	}
+
+	const auto& draws = frameCtx.indirectDraws;
+	const size_t opaqueDraws = draws.size() - frameCtx.transparentRange.visibleCount;
+	frameCtx.gpuBatchCPUDraws.assign(draws.begin(), draws.begin() + opaqueDraws);
+
+	// Indexed like the CPU's instances
+	auto& rows = frameCtx.gpuBatchCPURows;
+	rows.clear();
+	for (const VkDrawIndexedIndirectCommand& cmd : frameCtx.gpuBatchCPUDraws) {
+		const uint32_t end = cmd.firstInstance + cmd.instanceCount;
+		if (rows.size() < end) rows.resize(end);
+		for (uint32_t i = cmd.firstInstance; i < end; ++i) rows[i] = frameCtx.visibleInstances[i].transformID;
+		std::sort(rows.begin() + cmd.firstInstance, rows.begin() + end);
+	}
+
+	frameCtx.gpuCullCPUDraws = static_cast<uint32_t>(opaqueDraws);
+	frameCtx.gpuBatchInstanceFirst = _table.batches[0].firstInstance;
+	frameCtx.gpuBatchCheck = true;
+}
+
+// Draws of the recorded frame that differ from the CPU batching's: the command, its instance
+// offset past the transparents' slots, or the rows it draws. Missing or extra draws count too.
+uint32_t GPUCull::compareBatching(const FrameContext& frameCtx, uint32_t gpuDraws, const VmaAllocator allocator) {
+	const auto& cpuDraws = frameCtx.gpuBatchCPUDraws;
+	const uint32_t cpuDrawCount = static_cast<uint32_t>(cpuDraws.size());
+	const uint32_t gpuRows = frameCtx.batchPCData.visibleCount;
+
+	vmaInvalidateAllocation(allocator, frameCtx.gpuBatchReadback.allocation, 0, VK_WHOLE_SIZE);
+	const auto* draws = static_cast<const VkDrawIndexedIndirectCommand*>(frameCtx.gpuBatchReadback.mapped);
+	const auto* instances = reinterpret_cast<const GPUInstance*>(draws + MAX_DRAWS);
+
+	const uint32_t common = std::min(gpuDraws, cpuDrawCount);
+	uint32_t differ = std::max(gpuDraws, cpuDrawCount) - common;
+
+	std::vector<uint32_t> ids;
+	for (uint32_t d = 0; d < common; ++d) {
+		const VkDrawIndexedIndirectCommand& a = cpuDraws[d];
+		const VkDrawIndexedIndirectCommand& b = draws[d];
+		bool same = a.indexCount == b.indexCount && a.instanceCount == b.instanceCount && a.firstIndex == b.firstIndex &&
+			a.vertexOffset == b.vertexOffset && a.firstInstance + frameCtx.gpuBatchInstanceFirst == b.firstInstance &&
+			a.firstInstance + a.instanceCount <= gpuRows;
+		if (same) {
+			ids.clear();
+			for (uint32_t i = a.firstInstance; i < a.firstInstance + a.instanceCount; ++i) ids.push_back(instances[i].transformID);
+			std::sort(ids.begin(), ids.end());
+			same = std::equal(ids.begin(), ids.end(), frameCtx.gpuBatchCPURows.begin() + a.firstInstance);
+		}
+		differ += same ? 0u : 1u;
+	}
+	return differ;
+}
+
+void GPUCull::recordBatching(VkCommandBuffer cmd, FrameContext& frameCtx) {
+	const auto& pc = frameCtx.batchPCData;
+	const auto& pcRange = Pipelines::_globalLayout.pcRange;
+	const uint32_t rowGroups = (pc.visibleCount + BATCH_GROUP_SIZE - 1) / BATCH_GROUP_SIZE;
+
+	vkCmdFillBuffer(cmd, frameCtx.gpuCullCounts.buffer, 0, sizeof(CullCounters) + pc.batchCount * sizeof(uint32_t), 0);
+
+	BarrierUtils::memoryBarrier(cmd,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, Pipelines::getPipelineByID(PipelineID::BatchCount));
+	vkCmdPushConstants(cmd, Pipelines::_globalLayout.layout, pcRange.stageFlags, pcRange.offset, sizeof(pc), &pc);
+	vkCmdDispatch(cmd, rowGroups, 1, 1);
+
+	// scan reads the final counts
+	BarrierUtils::memoryBarrier(cmd,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+
+	// One group walks every batch
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, Pipelines::getPipelineByID(PipelineID::BatchScan));
+	vkCmdPushConstants(cmd, Pipelines::_globalLayout.layout, pcRange.stageFlags, pcRange.offset, sizeof(pc), &pc);
+	vkCmdDispatch(cmd, 1, 1, 1);
+
+	// scatter appends from the offsets the scan left in the counts
+	BarrierUtils::memoryBarrier(cmd,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, Pipelines::getPipelineByID(PipelineID::BatchScatter));
+	vkCmdPushConstants(cmd, Pipelines::_globalLayout.layout, pcRange.stageFlags, pcRange.offset, sizeof(pc), &pc);
+	vkCmdDispatch(cmd, rowGroups, 1, 1);
+
+	// Draws read the commands, counts and instances, the host reads the counters after the fence.
+	// Validation copies the commands and instances back too.
+	BarrierUtils::memoryBarrier(cmd,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_HOST_BIT | VK_PIPELINE_STAGE_2_COPY_BIT,
+		VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_HOST_READ_BIT | VK_ACCESS_2_TRANSFER_READ_BIT);
+
+	if (!frameCtx.gpuBatchCheck) return;
+
+	// Opaque draws past the transparents' slots to the front of the readback, instances after
+	// MAX_DRAWS draws. Every table batch may have drawn, the count says how many did.
+	constexpr VkDeviceSize drawCmdSize = sizeof(VkDrawIndexedIndirectCommand);
+	const VkBufferCopy drawCopy{ _table.transparentRows.size() * drawCmdSize, 0, pc.batchCount * drawCmdSize };
+	vkCmdCopyBuffer(cmd, frameCtx.indirectDrawsBuffer.buffer, frameCtx.gpuBatchReadback.buffer, 1, &drawCopy);
+	if (pc.visibleCount > 0) {
+		const VkBufferCopy instanceCopy{
+			frameCtx.gpuBatchInstanceFirst * sizeof(GPUInstance), MAX_DRAWS * drawCmdSize, pc.visibleCount * sizeof(GPUInstance) };
+		vkCmdCopyBuffer(cmd, frameCtx.visibleInstancesBuffer.buffer, frameCtx.gpuBatchReadback.buffer, 1, &instanceCopy);
+	}
+
+	BarrierUtils::memoryBarrier(cmd,
+		VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+}
+
+void GPUCull::recordCull(VkCommandBuffer cmd, FrameContext& frameCtx) {
+	if (frameCtx.gpuCullBatching) {
+		recordBatching(cmd, frameCtx);
+		return;
+	}
+
+	const auto& pc = frameCtx.cullingPCData;
+	const auto& pcRange = Pipelines::_globalLayout.pcRange;
+
+	vkCmdFillBuffer(cmd, frameCtx.gpuCullCounts.buffer, 0, sizeof(CullCounters) + pc.batchCount * sizeof(uint32_t), 0);
+
+	BarrierUtils::memoryBarrier(cmd,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, Pipelines::getPipelineByID(PipelineID::FrustumCull));
+	vkCmdPushConstants(cmd, Pipelines::_globalLayout.layout, pcRange.stageFlags, pcRange.offset, sizeof(pc), &pc);
+	vkCmdDispatch(cmd, (pc.rowCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+	// compaction reads the final instance counts
+	BarrierUtils::memoryBarrier(cmd,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, Pipelines::getPipelineByID(PipelineID::CullCompact));
+	vkCmdPushConstants(cmd, Pipelines::_globalLayout.layout, pcRange.stageFlags, pcRange.offset, sizeof(pc), &pc);
+	vkCmdDispatch(cmd, (pc.batchCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+	// Draws read the commands, counts and instances, the host reads the counters after the fence
+	BarrierUtils::memoryBarrier(cmd,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_HOST_BIT,
+		VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_HOST_READ_BIT);
+}
+
+void GPUCull::drawCulled(FrameContext& frameCtx, GPUResources& resources, Profiler& profiler) {
+	auto pLayout = Pipelines::_globalLayout;
+
+	const auto& idxBuffer = resources.getGPUAddrsBuffer(AddressBufferType::Index).buffer;
+
+	VkPipeline pipeline{};
+	if (!profiler.pipeOverride.enabled)
+		pipeline = Pipelines::getPipelineByID(PipelineID::Opaque);
+	else
+		pipeline = Pipelines::getPipelineByID(profiler.pipeOverride.selectedID);
+
+	constexpr VkDeviceSize drawCmdSize = sizeof(VkDrawIndexedIndirectCommand);
+	const uint32_t opaqueBatches = static_cast<uint32_t>(_table.batches.size());
+	const VkDeviceSize opaqueDrawOffset = _table.transparentRows.size() * drawCmdSize;
+
+	vkCmdBindPipeline(frameCtx.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	vkCmdBindIndexBuffer(frameCtx.commandBuffer, idxBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+	vkCmdPushConstants(frameCtx.commandBuffer,
+		pLayout.layout,
+		pLayout.pcRange.stageFlags,
+		pLayout.pcRange.offset,
+		sizeof(frameCtx.drawDataPC),
+		&frameCtx.drawDataPC);
+
+	// Counts live on the GPU, the stats take the last ones read back
+	const auto& stats = profiler.getStats();
+	if (opaqueBatches > 0) {
+		vkCmdDrawIndexedIndirectCount(frameCtx.commandBuffer,
+			frameCtx.indirectDrawsBuffer.buffer,
+			opaqueDrawOffset,
+			frameCtx.gpuCullCounts.buffer,
+			offsetof(CullCounters, drawCount),
+			opaqueBatches,
+			static_cast<uint32_t>(drawCmdSize));
+		profiler.addGPUCountedDraws(stats.gpuCullOpaqueDraws.load());
+	}
+}
+
+// The table's buffers belong to the frame contexts
+void GPUCull::cleanup() {
+	_table.clear();
+	_dirty = true;
+}
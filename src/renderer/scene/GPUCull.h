@@ -0,0 +1,80 @@
+#pragma once
+
+#include "core/ResourceManager.h"
+#include "renderer/frame/FrameContext.h"
+#include "engine/platform/profiler/Profiler.h"
+#include "CullBatches.h"
+
+// Frustum cull and draw build on the GPU for every opaque row. The CPU keeps a batch table that
+// only changes with the row set, each frame it just hands over the frustum. frustum_cull_comp
+// appends survivors into their batch's instance range, cull_compact_comp packs the batches that
+// kept anything into indirect draws, drawn through vkCmdDrawIndexedIndirectCount. Transparent
+// rows are culled and sorted back to front on the CPU like on the CPU path, their instances and
+// draws go to the front of the frame buffers ahead of the table's ranges.
+//
+// Batching alone is the other mode: the CPU culls and uploads the visible opaque rows' table
+// entries. batch_count_comp counts rows per batch, batch_scan_comp scans the counts into
+// instance offsets and writes the draws, batch_scatter_comp writes the instances. Draws come out
+// in batch table order, the same order the CPU batching gives level 0 opaques. The visible
+// transparents are sorted and drawn from the CPU the same way as under the GPU cull.
+namespace GPUCull {
+	constexpr uint32_t CULL_GROUP_SIZE = LOCAL_SIZE_X; // frustum_cull_comp and cull_compact_comp local_size_x
+	constexpr uint32_t BATCH_GROUP_SIZE = LOCAL_SIZE_X; // batch_count_comp, batch_scan_comp and batch_scatter_comp local_size_x
+
+	// Header of the per frame count buffer, one instance count per batch follows it
+	struct CullCounters {
+		uint32_t drawCount[2]; // per MaterialPass
+		uint32_t visibleRows;
+		uint32_t pad0;
+	};
+	constexpr size_t COUNT_BUFFER_BYTES = sizeof(CullCounters) + MAX_DRAWS * sizeof(uint32_t);
+
+	// Batch table is built again on the next prepareFrame
+	void markDirty();
+
+	// CPU side, in place of the CPU cull. Picks up the counters this frame context wrote last time,
+	// rebuilds the batch table when the row set changed and fills the frame's push constants, the
+	// frustum has to be in them already. cpuVisibleCount and cpuOpaqueDraws, the CPU cull and
+	// batching of the same frame's opaques, are shown next to the GPU counts once read back.
+	void prepareFrame(
+		FrameContext& frameCtx,
+		const Visibility::VisibilityState& vs,
+		const std::vector<GPUMeshData>& meshes,
+		uint32_t cpuVisibleCount,
+		uint32_t cpuOpaqueDraws,
+		const VmaAllocator allocator);
+
+	// CPU cull of the table's transparent rows, after prepareFrame. Fills the lists for the
+	// regular transparent draw build and upload.
+	void cullTransparents(
+		const Visibility::VisibilityState& vs,
+		const Frustum& frustum,
+		std::vector<GPUInstance>& visibleInstances,
+		std::vector<AABB>& visibleWorldAABBs);
+	// Same lists from rows the CPU already culled, for batching alone
+	void gatherTransparents(
+		const Visibility::VisibilityState& vs,
+		const std::vector<uint32_t>& visibleRows,
+		std::vector<GPUInstance>& visibleInstances,
+		std::vector<AABB>& visibleWorldAABBs);
+
+	// CPU side of batching alone, after the CPU frustum cull. Same counters and table as
+	// prepareFrame, visibleRows are VisibilityState rows, the transparent ones are skipped.
+	// Levels aren't batched, every row draws level 0 as on the GPU cull. When validating the frame
+	// context holds the CPU batching of the same rows, the GPU's draws and instances are read back
+	// and compared with it command for command. The caller clears the render data after.
+	void prepareBatching(
+		FrameContext& frameCtx,
+		const Visibility::VisibilityState& vs,
+		const std::vector<GPUMeshData>& meshes,
+		const std::vector<uint32_t>& visibleRows,
+		bool validate,
+		const VmaAllocator allocator);
+
+	// Recorded before the geometry pass, either mode
+	void recordCull(VkCommandBuffer cmd, FrameContext& frameCtx);
+	// Opaque draws only, the transparents go through the CPU path's draws
+	void drawCulled(FrameContext& frameCtx, GPUResources& resources, Profiler& profiler);
+
+	void cleanup();
+}
@@ -0,0 +1,392 @@
+#include "pch.h"
+
+#include "GPUOcclusion.h"
+#include "engine/Engine.h"
+#include "renderer/Renderer.h"
+#include "utils/BufferUtils.h"
+
+static_assert(offsetof(GPUOcclusion::HiZCullParams, candidatesAddr) == 288, "HiZCullParams must match visibility_comp.comp");
+static_assert(sizeof(GPUOcclusion::HiZCullParams) == 360, "HiZCullParams must match visibility_comp.comp");
+
+namespace GPUOcclusion {
+	static bool _ready = false;
+	static VkResolveModeFlagBits _depthResolveMode = VK_RESOLVE_MODE_NONE;
+
+	// bindless indices
+	static uint32_t _depthSourceIndex = UINT32_MAX; // depth the pyramid starts from, combined sampler
+	static uint32_t _pyramidIndex = UINT32_MAX;     // whole pyramid, combined sampler
+	static std::vector<uint32_t> _pyramidLevelIndices; // one storage image per level
+
+	// Opaque rows the cull walks on the CPU, each frame context uploads its own copy after its fence
+	static std::vector<GPUInstance> _candidates;
+	static uint64_t _candidatesVersion = 0;
+	static bool _candidatesDirty = true;
+
+	struct CullPushConstants {
+		VkDeviceAddress paramsAddr;
+		uint32_t phase;
+		uint32_t pad0;
+	};
+
+	struct PyramidPushConstants {
+		glm::uvec2 srcSize;
+		glm::uvec2 dstSize;
+		uint32_t srcIndex;
+		uint32_t dstIndex;
+		uint32_t level;
+		uint32_t pad0;
+	};
+
+	static void gatherCandidates(const Visibility::VisibilityState& vs);
+	static void uploadCandidates(FrameContext& frameCtx, const VmaAllocator allocator);
+}
+
+void GPUOcclusion::registerImages(ImageTableManager& imageManager, GPUResources& resources) {
+	auto& pyramid = ResourceManager::getDepthPyramidImage();
+	auto& depthSource = MSAA_ENABLED ? ResourceManager::getDepthResolveImage() : ResourceManager::getDepthImage();
+	const VkSampler sampler = ResourceManager::getDefaultSamplerNearest();
+
+	// Entries go in push order, the descriptor arrays are written straight from them
+	depthSource.lutEntry.combinedImageIndex = imageManager.addCombinedImage(depthSource.imageView, sampler);
+	resources.addImageLUTEntry(depthSource.lutEntry);
+	_depthSourceIndex = depthSource.lutEntry.combinedImageIndex;
+
+	pyramid.lutEntry.combinedImageIndex = imageManager.addCombinedImage(pyramid.imageView, sampler);
+	resources.addImageLUTEntry(pyramid.lutEntry);
+	_pyramidIndex = pyramid.lutEntry.combinedImageIndex;
+
+	_pyramidLevelIndices.clear();
+	for (VkImageView levelView : pyramid.storageViews) {
+		const auto levelEntry = ImageLUTEntry::StorageOnly(imageManager.addStorageImage(levelView));
+		resources.addImageLUTEntry(levelEntry);
+		_pyramidLevelIndices.push_back(levelEntry.storageImageIndex);
+	}
+	ASSERT(_pyramidLevelIndices.size() == pyramid.mipLevelCount);
+
+	if (MSAA_ENABLED) {
+		VkPhysicalDeviceDepthStencilResolveProperties resolveProps{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DEPTH_STENCIL_RESOLVE_PROPERTIES };
+		VkPhysicalDeviceProperties2 props{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+		props.pNext = &resolveProps;
+		vkGetPhysicalDeviceProperties2(Backend::getPhysicalDevice(), &props);
+
+		// Farthest sample keeps the pyramid conservative, sample zero is the only mode every device has
+		if (resolveProps.supportedDepthResolveModes & VK_RESOLVE_MODE_MAX_BIT) {
+			_depthResolveMode = VK_RESOLVE_MODE_MAX_BIT;
+		}
+		else {
+			_depthResolveMode = VK_RESOLVE_MODE_SAMPLE_ZERO_BIT;
+			fmt::print("[GPUOcclusion] Max depth resolve unsupported, using sample zero\n");
+		}
+	}
+
+	_ready = true;
+}
+
+bool GPUOcclusion::isReady() { return _ready; }
+
+VkResolveModeFlagBits GPUOcclusion::getDepthResolveMode() { return _depthResolveMode; }
+
+void GPUOcclusion::markCandidatesDirty() { _candidatesDirty = true; }
+
+void GPUOcclusion::gatherCandidates(const Visibility::VisibilityState& vs) {
+	_candidates.clear();
+	_candidates.reserve(vs.active.size());
+	for (uint32_t row : vs.active) {
+		const auto& inst = vs.instances[row];
+		if (static_cast<MaterialPass>(inst.passType) == MaterialPass::Opaque)
+			_candidates.push_back(inst);
+	}
+
+	++_candidatesVersion;
+	_candidatesDirty = false;
+}
+
+// Only called once this frame context's fence was waited on, the other frames in flight keep
+// reading their own copies
+void GPUOcclusion::uploadCandidates(FrameContext& frameCtx, const VmaAllocator allocator) {
+	const uint32_t count = static_cast<uint32_t>(_candidates.size());
+	if (count > frameCtx.gpuOcclusionCapacity) {
+		auto& persistent = frameCtx.persistentGPUBuffers;
+		for (AllocatedBuffer* buf : { &frameCtx.gpuOcclusionCandidates, &frameCtx.gpuOcclusionFlags }) {
+			if (buf->buffer == VK_NULL_HANDLE) continue;
+			const VkBuffer old = buf->buffer;
+			persistent.erase(std::remove_if(persistent.begin(), persistent.end(),
+				[old](const AllocatedBuffer& b) { return b.buffer == old; }), persistent.end());
+			BufferUtils::destroyAllocatedBuffer(*buf, allocator);
+		}
+
+		frameCtx.gpuOcclusionCapacity = std::max(count, frameCtx.gpuOcclusionCapacity * 2);
+
+		// Rows only change on topology edits, written straight from the host
+		frameCtx.gpuOcclusionCandidates = BufferUtils::createBuffer(
+			frameCtx.gpuOcclusionCapacity * sizeof(GPUInstance),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VMA_MEMORY_USAGE_CPU_TO_GPU,
+			allocator);
+		frameCtx.persistentGPUBuffers.push_back(frameCtx.gpuOcclusionCandidates);
+
+		frameCtx.gpuOcclusionFlags = BufferUtils::createBuffer(
+			frameCtx.gpuOcclusionCapacity * sizeof(uint32_t),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VMA_MEMORY_USAGE_GPU_ONLY,
+			allocator);
+		frameCtx.persistentGPUBuffers.push_back(frameCtx.gpuOcclusionFlags);
+	}
+
+	if (count > 0) {
+		memcpy(frameCtx.gpuOcclusionCandidates.mapped, _candidates.data(), count * sizeof(GPUInstance));
+		vmaFlushAllocation(allocator, frameCtx.gpuOcclusionCandidates.allocation, 0, count * sizeof(GPUInstance));
+	}
+
+	frameCtx.gpuOcclusionVersion = _candidatesVersion;
+
+	// Rows moved, nothing is known about last frame so every row starts out in phase 0
+	frameCtx.gpuOcclusionFlagsReset = true;
+}
+
+void GPUOcclusion::prepareFrame(
+	FrameContext& frameCtx,
+	const Visibility::VisibilityState& vs,
+	const Frustum& frustum,
+	const glm::mat4& viewProj,
+	uint32_t cpuFrustumCount,
+	bool occlusionEnabled,
+	const VmaAllocator allocator)
+{
+	if (frameCtx.gpuOcclusionCounters.buffer == VK_NULL_HANDLE) {
+		frameCtx.gpuOcclusionParams = BufferUtils::createBuffer(
+			sizeof(HiZCullParams),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VMA_MEMORY_USAGE_CPU_TO_GPU,
+			allocator);
+		frameCtx.persistentGPUBuffers.push_back(frameCtx.gpuOcclusionParams);
+
+		frameCtx.gpuOcclusionCounters = BufferUtils::createBuffer(
+			sizeof(HiZCounters),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+			VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VMA_MEMORY_USAGE_GPU_TO_CPU,
+			allocator);
+		frameCtx.persistentGPUBuffers.push_back(frameCtx.gpuOcclusionCounters);
+	}
+	else if (frameCtx.gpuOcclusionRecorded) {
+		// This frame context's fence was waited on before the scene update, its last counters are final
+		HiZCounters counters{};
+		vmaInvalidateAllocation(allocator, frameCtx.gpuOcclusionCounters.allocation, 0, sizeof(HiZCounters));
+		memcpy(&counters, frameCtx.gpuOcclusionCounters.mapped, sizeof(HiZCounters));
+
+		auto& stats = Engine::getProfiler().getStats();
+		stats.gpuOcclusionDrawsFirst.store(counters.drawCount[0]);
+		stats.gpuOcclusionDrawsSecond.store(counters.drawCount[1]);
+		stats.gpuOcclusionFrustum.store(counters.frustumVisible);
+		stats.gpuOcclusionOccluded.store(counters.occluded);
+		stats.gpuOcclusionCPUFrustum.store(frameCtx.gpuOcclusionCPUCount);
+
+		if (counters.drawCount[0] > PHASE_CAPACITY || counters.drawCount[1] > PHASE_CAPACITY) {
+			fmt::print("[GPUOcclusion] Phase draws over capacity ({}, {} of {}), extra rows were dropped\n",
+				counters.drawCount[0], counters.drawCount[1], PHASE_CAPACITY);
+		}
+	}
+	frameCtx.gpuOcclusionRecorded = false;
+
+	if (_candidatesDirty) {
+		gatherCandidates(vs);
+	}
+
+	frameCtx.gpuOcclusionActive = !_candidates.empty();
+	if (!frameCtx.gpuOcclusionActive) return;
+
+	if (frameCtx.gpuOcclusionVersion != _candidatesVersion)
+		uploadCandidates(frameCtx, allocator);
+
+	const auto& pyramid = ResourceManager::getDepthPyramidImage();
+	const auto drawExtent = Renderer::getDrawExtent();
+
+	HiZCullParams params{};
+	params.viewProj = viewProj;
+	std::copy(std::begin(frustum.planes), std::end(frustum.planes), std::begin(params.frusPlanes));
+	std::copy(std::begin(frustum.points), std::end(frustum.points), std::begin(params.frusPoints));
+	params.candidatesAddr = frameCtx.gpuOcclusionCandidates.address;
+	params.flagsAddr = frameCtx.gpuOcclusionFlags.address;
+	params.countersAddr = frameCtx.gpuOcclusionCounters.address;
+	params.drawExtent = { drawExtent.width, drawExtent.height };
+	params.pyramidExtent = { pyramid.imageExtent.width, pyramid.imageExtent.height };
+	params.candidateCount = static_cast<uint32_t>(_candidates.size());
+	params.pyramidIndex = _pyramidIndex;
+	params.pyramidLevels = pyramid.mipLevelCount;
+	params.occlusionEnabled = occlusionEnabled ? 1u : 0u;
+	params.phaseFirst[0] = PHASE_FIRST[0];
+	params.phaseFirst[1] = PHASE_FIRST[1];
+	params.phaseCapacity = PHASE_CAPACITY;
+
+	memcpy(frameCtx.gpuOcclusionParams.mapped, &params, sizeof(HiZCullParams));
+	vmaFlushAllocation(allocator, frameCtx.gpuOcclusionParams.allocation, 0, sizeof(HiZCullParams));
+
+	frameCtx.gpuOcclusionRecorded = true;
+	frameCtx.gpuOcclusionCPUCount = cpuFrustumCount;
+}
+
+void GPUOcclusion::beginFrame(VkCommandBuffer cmd, FrameContext& frameCtx) {
+	vkCmdFillBuffer(cmd, frameCtx.gpuOcclusionCounters.buffer, 0, sizeof(HiZCounters), 0);
+
+	if (frameCtx.gpuOcclusionFlagsReset) {
+		vkCmdFillBuffer(cmd, frameCtx.gpuOcclusionFlags.buffer, 0, _candidates.size() * sizeof(uint32_t), 1u);
+		frameCtx.gpuOcclusionFlagsReset = false;
+	}
+
+	// Also orders this frame's flag reads after the phase 1 writes this frame context made last time
+	BarrierUtils::memoryBarrier(cmd,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+}
+
+void GPUOcclusion::cullPhase(VkCommandBuffer cmd, FrameContext& frameCtx, uint32_t phase) {
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, Pipelines::getPipelineByID(PipelineID::Visibility));
+
+	const CullPushConstants pc{
+		.paramsAddr = frameCtx.gpuOcclusionParams.address,
+		.phase = phase
+	};
+
+	const auto& pcRange = Pipelines::_globalLayout.pcRange;
+	vkCmdPushConstants(cmd, Pipelines::_globalLayout.layout, pcRange.stageFlags, pcRange.offset, sizeof(pc), &pc);
+
+	const uint32_t candidateCount = static_cast<uint32_t>(_candidates.size());
+	vkCmdDispatch(cmd, (candidateCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+	// Draws read the commands, count and instances, phase 1 reads the counters again. The fence
+	// alone doesn't make phase 1's counters visible to the host reading them back.
+	VkPipelineStageFlags2 dstStages = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	VkAccessFlags2 dstAccess = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT;
+	if (phase == 1) {
+		dstStages |= VK_PIPELINE_STAGE_2_HOST_BIT;
+		dstAccess |= VK_ACCESS_2_HOST_READ_BIT;
+	}
+	BarrierUtils::memoryBarrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, dstStages, dstAccess);
+}
+
+void GPUOcclusion::buildDepthPyramid(VkCommandBuffer cmd, VkExtent2D drawExtent) {
+	auto& pyramid = ResourceManager::getDepthPyramidImage();
+	auto& depthSource = MSAA_ENABLED ? ResourceManager::getDepthResolveImage() : ResourceManager::getDepthImage();
+
+	// Depth resolves are written in the color output stage, the msaa path needs that in the source scope
+	VkImageMemoryBarrier2 depthBarrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+	depthBarrier.srcStageMask = VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+	depthBarrier.srcAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+	depthBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	depthBarrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+	depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.image = depthSource.image;
+	depthBarrier.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+
+	// One pyramid for every frame in flight, this frame's phase 1 and the last frame's phase 2 may
+	// still be sampling it. Its contents are thrown away, waiting for those reads is enough.
+	VkImageMemoryBarrier2 pyramidBarrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+	pyramidBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	pyramidBarrier.srcAccessMask = VK_ACCESS_2_NONE;
+	pyramidBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	pyramidBarrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+	pyramidBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	pyramidBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	pyramidBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	pyramidBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	pyramidBarrier.image = pyramid.image;
+	pyramidBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1 };
+
+	const VkImageMemoryBarrier2 barriers[2] = { depthBarrier, pyramidBarrier };
+	VkDependencyInfo dep{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	dep.imageMemoryBarrierCount = 2;
+	dep.pImageMemoryBarriers = barriers;
+	vkCmdPipelineBarrier2(cmd, &dep);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, Pipelines::getPipelineByID(PipelineID::DepthPyramid));
+
+	const auto& pcRange = Pipelines::_globalLayout.pcRange;
+
+	glm::uvec2 srcSize{ drawExtent.width, drawExtent.height };
+	for (uint32_t level = 0; level < pyramid.mipLevelCount; ++level) {
+		const glm::uvec2 dstSize{
+			std::max(pyramid.imageExtent.width >> level, 1u),
+			std::max(pyramid.imageExtent.height >> level, 1u)
+		};
+
+		const PyramidPushConstants pc{
+			.srcSize = srcSize,
+			.dstSize = dstSize,
+			.srcIndex = level == 0 ? _depthSourceIndex : _pyramidLevelIndices[level - 1],
+			.dstIndex = _pyramidLevelIndices[level],
+			.level = level
+		};
+		vkCmdPushConstants(cmd, Pipelines::_globalLayout.layout, pcRange.stageFlags, pcRange.offset, sizeof(pc), &pc);
+
+		vkCmdDispatch(cmd,
+			(dstSize.x + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE,
+			(dstSize.y + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE,
+			1);
+
+		// next level reads this one
+		BarrierUtils::memoryBarrier(cmd,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT);
+
+		srcSize = dstSize;
+	}
+
+	ImageUtils::transitionImage(cmd, pyramid.image, pyramid.imageFormat,
+		VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	// Without msaa phase 1 keeps drawing into the depth that was just read
+	if (!MSAA_ENABLED) {
+		ImageUtils::transitionImage(cmd, depthSource.image, depthSource.imageFormat,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+	}
+}
+
+void GPUOcclusion::drawPhase(FrameContext& frameCtx, uint32_t phase, GPUResources& resources, Profiler& profiler) {
+	auto pLayout = Pipelines::_globalLayout;
+
+	const auto& idxBuffer = resources.getGPUAddrsBuffer(AddressBufferType::Index).buffer;
+
+	VkPipeline pipeline{};
+	if (!profiler.pipeOverride.enabled)
+		pipeline = Pipelines::getPipelineByID(PipelineID::Opaque);
+	else
+		pipeline = Pipelines::getPipelineByID(profiler.pipeOverride.selectedID);
+
+	constexpr VkDeviceSize drawCmdSize = sizeof(VkDrawIndexedIndirectCommand);
+
+	vkCmdBindPipeline(frameCtx.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	vkCmdBindIndexBuffer(frameCtx.commandBuffer, idxBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+	vkCmdPushConstants(frameCtx.commandBuffer,
+		pLayout.layout,
+		pLayout.pcRange.stageFlags,
+		pLayout.pcRange.offset,
+		sizeof(frameCtx.drawDataPC),
+		&frameCtx.drawDataPC);
+
+	vkCmdDrawIndexedIndirectCount(frameCtx.commandBuffer,
+		frameCtx.indirectDrawsBuffer.buffer,
+		PHASE_FIRST[phase] * drawCmdSize,
+		frameCtx.gpuOcclusionCounters.buffer,
+		offsetof(HiZCounters, drawCount) + phase * sizeof(uint32_t),
+		PHASE_CAPACITY,
+		static_cast<uint32_t>(drawCmdSize));
+
+	// Counts live on the GPU, the stats take the last ones read back
+	const auto& stats = profiler.getStats();
+	profiler.addGPUCountedDraws(phase == 0 ? stats.gpuOcclusionDrawsFirst.load() : stats.gpuOcclusionDrawsSecond.load());
+}
+
+// The candidate and flag buffers belong to the frame contexts
+void GPUOcclusion::cleanup() {
+	_candidates.clear();
+	_candidatesDirty = true;
+}
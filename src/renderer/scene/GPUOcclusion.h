@@ -0,0 +1,78 @@
+#pragma once
+
+#include "core/ResourceManager.h"
+#include "renderer/frame/FrameContext.h"
+#include "engine/platform/profiler/Profiler.h"
+#include "Visibility.h"
+
+// Two phase Hi-Z occlusion on the GPU for opaque rows. Phase 0 draws the rows that were visible
+// the last time this frame context ran, their depth is reduced into a max depth pyramid, then
+// every row is tested against the frustum and the pyramid. Rows that pass and weren't drawn yet
+// go out in phase 1, and the pass result becomes the frame context's next phase 0 set. Each frame
+// in flight keeps its own rows and flags, so a row set change never waits on the queue.
+// Transparent rows stay on the CPU path.
+namespace GPUOcclusion {
+	// The frame instance and draw buffers are split, the CPU uploads (transparents only while this
+	// is on) keep the front and each phase writes its own range after it
+	constexpr uint32_t CPU_CAPACITY = MAX_DRAWS / 4;
+	constexpr uint32_t PHASE_CAPACITY = (MAX_DRAWS - CPU_CAPACITY) / 2;
+	constexpr uint32_t PHASE_FIRST[2] = { CPU_CAPACITY, CPU_CAPACITY + PHASE_CAPACITY };
+	constexpr uint32_t CULL_GROUP_SIZE = LOCAL_SIZE_X; // visibility_comp local_size_x
+	constexpr uint32_t PYRAMID_GROUP_SIZE = 16;        // depth_pyramid_comp local_size_x/y
+
+	// Matches HiZCullParams in visibility_comp.comp, scalar layout
+	struct HiZCullParams {
+		glm::mat4 viewProj;
+		glm::vec4 frusPlanes[6];
+		glm::vec4 frusPoints[8];
+		VkDeviceAddress candidatesAddr;
+		VkDeviceAddress flagsAddr;
+		VkDeviceAddress countersAddr;
+		glm::uvec2 drawExtent;
+		glm::uvec2 pyramidExtent;
+		uint32_t candidateCount;
+		uint32_t pyramidIndex;
+		uint32_t pyramidLevels;
+		uint32_t occlusionEnabled;
+		uint32_t phaseFirst[2];
+		uint32_t phaseCapacity;
+		uint32_t pad0;
+	};
+
+	// Written by the cull, read back once the frame's fence is waited on
+	struct HiZCounters {
+		uint32_t drawCount[2];
+		uint32_t frustumVisible;
+		uint32_t occluded;
+	};
+
+	// Pushes the pyramid levels and the depth it reads into the bindless tables, called with the
+	// other static images before the global set is written
+	void registerImages(ImageTableManager& imageManager, GPUResources& resources);
+	bool isReady();
+
+	VkResolveModeFlagBits getDepthResolveMode();
+
+	// Rows are gathered again on the next prepareFrame, everything counts as visible for one frame
+	void markCandidatesDirty();
+
+	// CPU side, after the frustum cull. Picks up the counters this frame context wrote last time,
+	// gathers the opaque rows when the row set changed and fills this frame's cull parameters.
+	// cpuFrustumCount is the CPU cull's opaque count, shown next to the GPU frustum count once read back.
+	void prepareFrame(
+		FrameContext& frameCtx,
+		const Visibility::VisibilityState& vs,
+		const Frustum& frustum,
+		const glm::mat4& viewProj,
+		uint32_t cpuFrustumCount,
+		bool occlusionEnabled,
+		const VmaAllocator allocator);
+
+	// Recorded in this order around the two geometry passes
+	void beginFrame(VkCommandBuffer cmd, FrameContext& frameCtx);
+	void cullPhase(VkCommandBuffer cmd, FrameContext& frameCtx, uint32_t phase);
+	void buildDepthPyramid(VkCommandBuffer cmd, VkExtent2D drawExtent);
+	void drawPhase(FrameContext& frameCtx, uint32_t phase, GPUResources& resources, Profiler& profiler);
+
+	void cleanup();
+}
@@ -0,0 +1,342 @@
+#include "pch.h"
+
+#include "Visibility.h"
+#include "engine/JobSystem.h"
+
+#include <bit>
+
+// Linear BVH: rows sorted along a Morton curve over their centroids, then split top down at
+// the highest bit where the codes under a node differ. No cost evaluation anywhere, so the
+// build is a sort plus one pass, cheap enough to redo every frame for scenes that all move.
+// 30-bit codes, 63-bit ones when too many rows share a 30-bit cell, both sort and split the same way.
+namespace Visibility {
+	constexpr uint32_t MORTON_RADIX_BITS = 10;
+	constexpr uint32_t MORTON_RADIX_BUCKETS = 1u << MORTON_RADIX_BITS;
+	constexpr uint32_t MORTON_SORT_CHUNK_ROWS = 16384;
+
+	// 10 bits spread out to every third bit
+	static inline uint32_t expandBits10(uint32_t v) {
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	}
+
+	// 21 bits spread out to every third bit
+	static inline uint64_t expandBits21(uint64_t v) {
+		v &= 0x1FFFFFull;
+		v = (v | (v << 32)) & 0x1F00000000FFFFull;
+		v = (v | (v << 16)) & 0x1F0000FF0000FFull;
+		v = (v | (v << 8)) & 0x100F00F00F00F00Full;
+		v = (v | (v << 4)) & 0x10C30C30C30C30C3ull;
+		v = (v | (v << 2)) & 0x1249249249249249ull;
+		return v;
+	}
+
+	uint32_t mortonCode30(const glm::vec3& unit) {
+		const glm::vec3 q = glm::clamp(unit * 1024.0f, glm::vec3(0.0f), glm::vec3(1023.0f));
+		return (expandBits10(static_cast<uint32_t>(q.x)) << 2)
+			| (expandBits10(static_cast<uint32_t>(q.y)) << 1)
+			| expandBits10(static_cast<uint32_t>(q.z));
+	}
+
+	uint64_t mortonCode63(const glm::vec3& unit) {
+		const glm::vec3 q = glm::clamp(unit * 2097152.0f, glm::vec3(0.0f), glm::vec3(2097151.0f));
+		return (expandBits21(static_cast<uint64_t>(q.x)) << 2)
+			| (expandBits21(static_cast<uint64_t>(q.y)) << 1)
+			| expandBits21(static_cast<uint64_t>(q.z));
+	}
+
+	template<typename Code> constexpr uint32_t MORTON_CODE_BITS = sizeof(Code) == 8 ? 63u : 30u;
+
+	// Stable LSD radix sort of codes with rows riding along, MORTON_RADIX_BITS per pass.
+	// Chunks count their digits and scatter on workers, the offsets between are one serial scan.
+	// Stable, so the result is the same for any chunk or thread count.
+	template<typename Code>
+	static void radixSortMorton(std::vector<Code>& codes, std::vector<uint32_t>& rows) {
+		const uint32_t count = static_cast<uint32_t>(codes.size());
+		const uint32_t chunks = (count + MORTON_SORT_CHUNK_ROWS - 1) / MORTON_SORT_CHUNK_ROWS;
+		const bool parallel = chunks > 1 && JobSystem::getThreadCount() > 1;
+
+		std::vector<Code> codesTmp(count);
+		std::vector<uint32_t> rowsTmp(count);
+		std::vector<uint32_t> offsets(static_cast<size_t>(chunks) * MORTON_RADIX_BUCKETS);
+
+		auto forChunks = [&](const std::function<void(uint32_t chunk)>& fn) {
+			if (!parallel) {
+				for (uint32_t c = 0; c < chunks; ++c) fn(c);
+				return;
+			}
+			JobSystem::parallelFor(chunks, 1, [&](uint32_t begin, uint32_t end, uint32_t) {
+				for (uint32_t c = begin; c < end; ++c) fn(c);
+			});
+		};
+
+		for (uint32_t shift = 0; shift < MORTON_CODE_BITS<Code>; shift += MORTON_RADIX_BITS) {
+			forChunks([&](uint32_t c) {
+				uint32_t* hist = &offsets[static_cast<size_t>(c) * MORTON_RADIX_BUCKETS];
+				std::fill(hist, hist + MORTON_RADIX_BUCKETS, 0u);
+				const uint32_t end = std::min(count, (c + 1) * MORTON_SORT_CHUNK_ROWS);
+				for (uint32_t i = c * MORTON_SORT_CHUNK_ROWS; i < end; ++i)
+					++hist[(codes[i] >> shift) & (MORTON_RADIX_BUCKETS - 1)];
+			});
+
+			// Digit major, chunk minor, so every chunk's rows land after the earlier chunks'
+			uint32_t sum = 0;
+			bool onePass = false;
+			for (uint32_t d = 0; d < MORTON_RADIX_BUCKETS; ++d) {
+				const uint32_t before = sum;
+				for (uint32_t c = 0; c < chunks; ++c) {
+					uint32_t& slot = offsets[static_cast<size_t>(c) * MORTON_RADIX_BUCKETS + d];
+					const uint32_t n = slot;
+					slot = sum;
+					sum += n;
+				}
+				if (sum - before == count) onePass = true; // every code shares this digit
+			}
+			if (onePass) continue;
+
+			forChunks([&](uint32_t c) {
+				uint32_t* next = &offsets[static_cast<size_t>(c) * MORTON_RADIX_BUCKETS];
+				const uint32_t end = std::min(count, (c + 1) * MORTON_SORT_CHUNK_ROWS);
+				for (uint32_t i = c * MORTON_SORT_CHUNK_ROWS; i < end; ++i) {
+					const uint32_t dst = next[(codes[i] >> shift) & (MORTON_RADIX_BUCKETS - 1)]++;
+					codesTmp[dst] = codes[i];
+					rowsTmp[dst] = rows[i];
+				}
+			});
+			codes.swap(codesTmp);
+			rows.swap(rowsTmp);
+		}
+	}
+
+	template<typename Code>
+	struct LBVHBuildContext {
+		const std::vector<AABB>& world;
+		const std::vector<uint32_t>& leafIndex;
+		const std::vector<Code>& codes; // parallel to leafIndex, ascending
+		uint32_t maxLeaf = BVH_MAX_LEAF_ROWS;
+		uint32_t parallelRows = BVH_PARALLEL_SUBTREE_ROWS;
+	};
+
+	// A range below parallelRows, built on its own and spliced in under slot
+	struct LBVHSubtree {
+		uint32_t first = 0;
+		uint32_t count = 0;
+		uint32_t slot = 0;
+		std::vector<BVHNode> nodes;
+	};
+
+	// Last index of the left half: where the highest bit differing over the range flips.
+	// Equal codes split down the middle.
+	template<typename Code>
+	static uint32_t findMortonSplit(const std::vector<Code>& codes, uint32_t first, uint32_t last) {
+		const Code firstCode = codes[first];
+		const Code lastCode = codes[last];
+		if (firstCode == lastCode) return (first + last) >> 1;
+
+		const int prefix = std::countl_zero(firstCode ^ lastCode);
+
+		// Binary search for the last code still sharing more than prefix bits with the first
+		uint32_t split = first;
+		uint32_t step = last - first;
+		do {
+			step = (step + 1) >> 1;
+			const uint32_t next = split + step;
+			if (next < last && std::countl_zero(firstCode ^ codes[next]) > prefix)
+				split = next;
+		} while (step > 1);
+		return split;
+	}
+
+	static void unionChildren(std::vector<BVHNode>& nodes, uint32_t idx) {
+		const BVHNode& l = nodes[nodes[idx].left];
+		const BVHNode& r = nodes[nodes[idx].right];
+		AABB b{};
+		b.vmin = glm::min(l.box.vmin, r.box.vmin);
+		b.vmax = glm::max(l.box.vmax, r.box.vmax);
+		b.origin = 0.5f * (b.vmin + b.vmax);
+		b.extent = 0.5f * (b.vmax - b.vmin);
+		b.sphereRadius = glm::length(b.extent);
+		nodes[idx].box = b;
+	}
+
+	// Depth first with every root before its subtree, bounds come up from the children
+	template<typename Code>
+	static uint32_t buildLBVHRecursive(
+		const LBVHBuildContext<Code>& ctx,
+		std::vector<BVHNode>& nodes,
+		uint32_t first,
+		uint32_t count)
+	{
+		const uint32_t idx = static_cast<uint32_t>(nodes.size());
+		nodes.push_back(BVHNode{});
+
+		if (count <= ctx.maxLeaf) {
+			AABB b = ctx.world[ctx.leafIndex[first]];
+			for (uint32_t i = 1; i < count; ++i) {
+				const AABB& a = ctx.world[ctx.leafIndex[first + i]];
+				b.vmin = glm::min(b.vmin, a.vmin);
+				b.vmax = glm::max(b.vmax, a.vmax);
+			}
+			b.origin = 0.5f * (b.vmin + b.vmax);
+			b.extent = 0.5f * (b.vmax - b.vmin);
+			b.sphereRadius = glm::length(b.extent);
+
+			nodes[idx].box = b;
+			nodes[idx].first = first;
+			nodes[idx].count = static_cast<uint16_t>(count);
+			return idx;
+		}
+
+		const uint32_t mid = findMortonSplit(ctx.codes, first, first + count - 1) + 1;
+		const uint32_t L = buildLBVHRecursive(ctx, nodes, first, mid - first);
+		const uint32_t R = buildLBVHRecursive(ctx, nodes, mid, first + count - mid);
+		nodes[idx].left = static_cast<int>(L);
+		nodes[idx].right = static_cast<int>(R);
+		unionChildren(nodes, idx);
+		return idx;
+	}
+
+	// Splits above parallelRows only, every smaller range becomes a subtree with its root slot
+	// reserved here. Boxes are filled in once the subtrees are in.
+	template<typename Code>
+	static uint32_t buildLBVHTop(
+		const LBVHBuildContext<Code>& ctx,
+		std::vector<BVHNode>& nodes,
+		std::vector<LBVHSubtree>& subtrees,
+		uint32_t first,
+		uint32_t count)
+	{
+		const uint32_t idx = static_cast<uint32_t>(nodes.size());
+		nodes.push_back(BVHNode{});
+
+		if (count < ctx.parallelRows || count <= ctx.maxLeaf) {
+			subtrees.push_back({ first, count, idx, {} });
+			return idx;
+		}
+
+		const uint32_t mid = findMortonSplit(ctx.codes, first, first + count - 1) + 1;
+		const uint32_t L = buildLBVHTop(ctx, nodes, subtrees, first, mid - first);
+		const uint32_t R = buildLBVHTop(ctx, nodes, subtrees, mid, first + count - mid);
+		nodes[idx].left = static_cast<int>(L);
+		nodes[idx].right = static_cast<int>(R);
+		return idx;
+	}
+
+	// Codes for the centroids mapped to [0, 1] by cmin and invExt, leafIndex sorted along them
+	template<typename Code>
+	static void sortMortonCodes(
+		const std::vector<AABB>& world,
+		std::vector<uint32_t>& leafIndex,
+		const glm::vec3& cmin,
+		const glm::vec3& invExt,
+		std::vector<Code>& codes)
+	{
+		const uint32_t count = static_cast<uint32_t>(leafIndex.size());
+		codes.resize(count);
+		JobSystem::parallelFor(count, MORTON_SORT_CHUNK_ROWS, [&](uint32_t begin, uint32_t end, uint32_t) {
+			for (uint32_t i = begin; i < end; ++i) {
+				const glm::vec3 unit = (world[leafIndex[i]].origin - cmin) * invExt;
+				if constexpr (sizeof(Code) == 8) codes[i] = mortonCode63(unit);
+				else codes[i] = mortonCode30(unit);
+			}
+		});
+
+		radixSortMorton(codes, leafIndex);
+	}
+
+	// Rows sharing their cell with the row before them, codes sorted
+	static uint32_t sharedCellRows(const std::vector<uint32_t>& codes) {
+		uint32_t shared = 0;
+		for (size_t i = 1; i < codes.size(); ++i)
+			shared += codes[i] == codes[i - 1] ? 1u : 0u;
+		return shared;
+	}
+
+	template<typename Code>
+	static void buildLBVHFromCodes(
+		const std::vector<AABB>& world,
+		const std::vector<uint32_t>& leafIndex,
+		std::vector<BVHNode>& nodes,
+		const std::vector<Code>& codes)
+	{
+		const uint32_t count = static_cast<uint32_t>(leafIndex.size());
+
+		// Top splits serially, the subtrees below on workers, then each subtree is copied in once.
+		// Every node still lands after its parent and the layout doesn't depend on the thread count.
+		const LBVHBuildContext<Code> ctx{ world, leafIndex, codes };
+		std::vector<LBVHSubtree> subtrees;
+		nodes.reserve(2 * (count / ctx.maxLeaf) + 1);
+		buildLBVHTop(ctx, nodes, subtrees, 0u, count);
+		const uint32_t topCount = static_cast<uint32_t>(nodes.size());
+
+		JobSystem::parallelFor(static_cast<uint32_t>(subtrees.size()), 1, [&](uint32_t begin, uint32_t end, uint32_t) {
+			for (uint32_t s = begin; s < end; ++s)
+				buildLBVHRecursive(ctx, subtrees[s].nodes, subtrees[s].first, subtrees[s].count);
+		});
+
+		std::vector<uint8_t> isSlot(topCount, 0);
+		for (LBVHSubtree& sub : subtrees) {
+			isSlot[sub.slot] = 1;
+
+			// Local root goes into its slot, local node i to offset + i - 1
+			const int shift = static_cast<int>(nodes.size()) - 1;
+			for (size_t i = 0; i < sub.nodes.size(); ++i) {
+				BVHNode n = sub.nodes[i];
+				if (!n.count) {
+					n.left += shift;
+					n.right += shift;
+				}
+				if (i == 0) nodes[sub.slot] = n;
+				else nodes.push_back(n);
+			}
+			std::vector<BVHNode>().swap(sub.nodes);
+		}
+
+		for (uint32_t n = topCount; n-- > 0;)
+			if (!isSlot[n]) unionChildren(nodes, n);
+	}
+}
+
+void Visibility::buildLBVH(
+	const std::vector<AABB>& world,
+	std::vector<uint32_t>& leafIndex,
+	std::vector<BVHNode>& nodes,
+	MortonCodes codes)
+{
+	const uint32_t count = static_cast<uint32_t>(leafIndex.size());
+	if (count == 0) return;
+
+	glm::vec3 cmin(1e30f), cmax(-1e30f);
+	for (uint32_t row : leafIndex) {
+		cmin = glm::min(cmin, world[row].origin);
+		cmax = glm::max(cmax, world[row].origin);
+	}
+	const glm::vec3 ext = cmax - cmin;
+	const glm::vec3 invExt(
+		ext.x > 1e-6f ? 1.0f / ext.x : 0.0f,
+		ext.y > 1e-6f ? 1.0f / ext.y : 0.0f,
+		ext.z > 1e-6f ? 1.0f / ext.z : 0.0f);
+
+	if (codes != MortonCodes::Bits63) {
+		// Kept for a 63-bit sort from the same order, so ties come out as if it ran first
+		std::vector<uint32_t> unsorted;
+		if (codes == MortonCodes::Auto) unsorted = leafIndex;
+
+		std::vector<uint32_t> narrow;
+		sortMortonCodes(world, leafIndex, cmin, invExt, narrow);
+		if (codes == MortonCodes::Bits30 ||
+			static_cast<float>(sharedCellRows(narrow)) <= static_cast<float>(count) * BVH_LBVH_WIDE_CODE_SHARED_FRACTION) {
+			buildLBVHFromCodes(world, leafIndex, nodes, narrow);
+			return;
+		}
+		// Cells too coarse for the rows in them, the 30-bit sort is thrown away
+		leafIndex.swap(unsorted);
+	}
+
+	std::vector<uint64_t> wide;
+	sortMortonCodes(world, leafIndex, cmin, invExt, wide);
+	buildLBVHFromCodes(world, leafIndex, nodes, wide);
+}
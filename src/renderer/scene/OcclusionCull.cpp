@@ -0,0 +1,380 @@
+#include "pch.h"
+
+#include "OcclusionCull.h"
+#include "engine/JobSystem.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define OCCLUSION_SSE 1
+#include <immintrin.h>
+#else
+#define OCCLUSION_SSE 0
+#endif
+
+namespace Visibility {
+	static inline float elapsedMs(std::chrono::high_resolution_clock::time_point start) {
+		return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	static inline void boxCorners(const AABB& box, glm::vec3 out[8]) {
+		for (uint32_t i = 0; i < 8; ++i) {
+			out[i] = glm::vec3(
+				(i & 1) ? box.vmax.x : box.vmin.x,
+				(i & 2) ? box.vmax.y : box.vmin.y,
+				(i & 4) ? box.vmax.z : box.vmin.z);
+		}
+	}
+
+	// Screen position in occlusion buffer pixels plus 1/w, false if the point is too close
+	static inline bool projectPoint(const glm::mat4& viewProj, const glm::vec3& p, glm::vec3& out) {
+		const glm::vec4 clip = viewProj * glm::vec4(p, 1.0f);
+		if (clip.w < OCCLUSION_NEAR_W) return false;
+
+		const float invW = 1.0f / clip.w;
+		out.x = (clip.x * invW * 0.5f + 0.5f) * static_cast<float>(OCCLUSION_WIDTH);
+		out.y = (clip.y * invW * 0.5f + 0.5f) * static_cast<float>(OCCLUSION_HEIGHT);
+		out.z = invW;
+		return true;
+	}
+
+	static inline float cross2(const glm::vec2& o, const glm::vec2& a, const glm::vec2& b) {
+		return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+	}
+
+	// Counter-clockwise convex hull of the projected corners (monotone chain), at most 6 points
+	static uint32_t hull2D(glm::vec2 pts[8], glm::vec2 hull[9]) {
+		std::sort(pts, pts + 8, [](const glm::vec2& a, const glm::vec2& b) {
+			return a.x < b.x || (a.x == b.x && a.y < b.y);
+		});
+
+		uint32_t k = 0;
+		for (uint32_t i = 0; i < 8; ++i) {
+			while (k >= 2 && cross2(hull[k - 2], hull[k - 1], pts[i]) <= 0.0f) --k;
+			hull[k++] = pts[i];
+		}
+		for (int i = 6, lower = static_cast<int>(k) + 1; i >= 0; --i) {
+			while (static_cast<int>(k) >= lower && cross2(hull[k - 2], hull[k - 1], pts[i]) <= 0.0f) --k;
+			hull[k++] = pts[i];
+		}
+		return k - 1; // last point repeats the first
+	}
+
+	// Affine a*x + b*y + c through three screen points, c shifted so evaluating at integer pixel
+	// coordinates gives the smallest value anywhere in that pixel
+	static bool depthPlane(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, glm::vec3& out) {
+		const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+		if (std::abs(n.z) < 1e-12f) return false;
+
+		const float a = -n.x / n.z;
+		const float b = -n.y / n.z;
+		const float c = p0.z - a * p0.x - b * p0.y;
+		out = glm::vec3(a, b, c + 0.5f * a + 0.5f * b - 0.5f * (std::abs(a) + std::abs(b)));
+		return true;
+	}
+
+	static bool setupOccluder(const AABB& box, const glm::mat4& viewProj, const glm::vec3& eye, OccluderPoly& poly) {
+		glm::vec3 corners[8], screen[8];
+		boxCorners(box, corners);
+		for (uint32_t i = 0; i < 8; ++i)
+			if (!projectPoint(viewProj, corners[i], screen[i])) return false;
+
+		// Faces the camera sees, each is the box side on one axis. Corner index bit a picks max on axis a.
+		poly.planeCount = 0;
+		for (uint32_t axis = 0; axis < 3; ++axis) {
+			uint32_t side;
+			if (eye[axis] > box.vmax[axis]) side = 1u << axis;
+			else if (eye[axis] < box.vmin[axis]) side = 0u;
+			else continue;
+
+			const uint32_t u = 1u << ((axis + 1) % 3);
+			const uint32_t v = 1u << ((axis + 2) % 3);
+			if (!depthPlane(screen[side], screen[side | u], screen[side | v], poly.planes[poly.planeCount]))
+				return false;
+			++poly.planeCount;
+		}
+		if (!poly.planeCount) return false; // camera inside the box
+
+		glm::vec2 pts[8], hull[9];
+		for (uint32_t i = 0; i < 8; ++i) pts[i] = glm::vec2(screen[i]);
+		const uint32_t count = hull2D(pts, hull);
+		if (count < 3 || count > 6) return false; // degenerate, or rounding let extra points in
+
+		glm::vec2 smin(1e30f), smax(-1e30f);
+		poly.edgeCount = 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			const glm::vec2 p = hull[i];
+			const glm::vec2 q = hull[(i + 1) % count];
+			const float a = -(q.y - p.y);
+			const float b = q.x - p.x;
+			const float c = -(a * p.x + b * p.y);
+			poly.edges[poly.edgeCount++] = glm::vec3(a, b, c + 0.5f * a + 0.5f * b - 0.5f * (std::abs(a) + std::abs(b)));
+			smin = glm::min(smin, p);
+			smax = glm::max(smax, p);
+		}
+
+		poly.minX = std::max(0, static_cast<int32_t>(std::floor(smin.x)));
+		poly.minY = std::max(0, static_cast<int32_t>(std::floor(smin.y)));
+		poly.maxX = std::min(static_cast<int32_t>(OCCLUSION_WIDTH) - 1, static_cast<int32_t>(std::ceil(smax.x)) - 1);
+		poly.maxY = std::min(static_cast<int32_t>(OCCLUSION_HEIGHT) - 1, static_cast<int32_t>(std::ceil(smax.y)) - 1);
+		return poly.minX <= poly.maxX && poly.minY <= poly.maxY;
+	}
+
+	// Rasterizes one poly into the rows of a tile, x0..x1 is 4 aligned
+	static void rasterPolyTile(float* invW, const OccluderPoly& poly, int32_t x0, int32_t x1, int32_t y0, int32_t y1) {
+		for (int32_t y = y0; y <= y1; ++y) {
+			float* row = invW + static_cast<size_t>(y) * OCCLUSION_WIDTH;
+			const float fy = static_cast<float>(y);
+
+#if OCCLUSION_SSE
+			__m128 edgeA[6], edgeRow[6], planeA[3], planeRow[3];
+			for (uint32_t e = 0; e < poly.edgeCount; ++e) {
+				edgeA[e] = _mm_set1_ps(poly.edges[e].x);
+				edgeRow[e] = _mm_set1_ps(poly.edges[e].y * fy + poly.edges[e].z);
+			}
+			for (uint32_t p = 0; p < poly.planeCount; ++p) {
+				planeA[p] = _mm_set1_ps(poly.planes[p].x);
+				planeRow[p] = _mm_set1_ps(poly.planes[p].y * fy + poly.planes[p].z);
+			}
+			const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+			const __m128 zero = _mm_setzero_ps();
+
+			for (int32_t x = x0; x <= x1; x += 4) {
+				const __m128 fx = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), lanes);
+
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], fx), edgeRow[0]), zero);
+				for (uint32_t e = 1; e < poly.edgeCount; ++e)
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[e], fx), edgeRow[e]), zero));
+				if (!_mm_movemask_ps(inside)) continue;
+
+				__m128 depth = _mm_add_ps(_mm_mul_ps(planeA[0], fx), planeRow[0]);
+				for (uint32_t p = 1; p < poly.planeCount; ++p)
+					depth = _mm_min_ps(depth, _mm_add_ps(_mm_mul_ps(planeA[p], fx), planeRow[p]));
+
+				const __m128 cur = _mm_loadu_ps(row + x);
+				const __m128 nearer = _mm_max_ps(cur, depth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, cur)));
+			}
+#else
+			for (int32_t x = x0; x <= x1; ++x) {
+				const float fx = static_cast<float>(x);
+				bool inside = true;
+				for (uint32_t e = 0; e < poly.edgeCount && inside; ++e)
+					inside = poly.edges[e].x * fx + poly.edges[e].y * fy + poly.edges[e].z >= 0.0f;
+				if (!inside) continue;
+
+				float depth = 1e30f;
+				for (uint32_t p = 0; p < poly.planeCount; ++p)
+					depth = std::min(depth, poly.planes[p].x * fx + poly.planes[p].y * fy + poly.planes[p].z);
+				row[x] = std::max(row[x], depth);
+			}
+#endif
+		}
+	}
+
+	// Every pixel in the range farther than invW, range is inside the buffer
+	static bool rangeHidden(const OcclusionBuffer& ob, int32_t x0, int32_t y0, int32_t x1, int32_t y1, float nearestInvW) {
+		// Tiles whose farthest occluder is still in front settle it without touching pixels
+		const int32_t tx0 = x0 / static_cast<int32_t>(OCCLUSION_TILE_WIDTH);
+		const int32_t tx1 = x1 / static_cast<int32_t>(OCCLUSION_TILE_WIDTH);
+		const int32_t ty0 = y0 / static_cast<int32_t>(OCCLUSION_TILE_HEIGHT);
+		const int32_t ty1 = y1 / static_cast<int32_t>(OCCLUSION_TILE_HEIGHT);
+
+		bool allTiles = true;
+		for (int32_t ty = ty0; ty <= ty1 && allTiles; ++ty)
+			for (int32_t tx = tx0; tx <= tx1 && allTiles; ++tx)
+				allTiles = ob.tileMin[ty * OCCLUSION_TILES_X + tx] > nearestInvW;
+		if (allTiles) return true;
+
+		for (int32_t y = y0; y <= y1; ++y) {
+			const float* row = ob.invW.data() + static_cast<size_t>(y) * OCCLUSION_WIDTH;
+			int32_t x = x0;
+#if OCCLUSION_SSE
+			const __m128 nearest = _mm_set1_ps(nearestInvW);
+			for (; x + 3 <= x1; x += 4) {
+				if (_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(row + x), nearest))) return false;
+			}
+#endif
+			for (; x <= x1; ++x)
+				if (row[x] <= nearestInvW) return false;
+		}
+		return true;
+	}
+}
+
+AABB Visibility::occluderWorldBox(const AABB& localBox, const glm::mat4& transform) {
+	AABB out{};
+	const glm::mat3 linear(transform);
+	out.origin = glm::vec3(transform * glm::vec4(localBox.origin, 1.0f));
+	out.vmin = out.vmax = out.origin;
+	if (std::abs(glm::determinant(linear)) < 1e-12f) return out;
+
+	// World extent of the transformed box, then shrunk until every corner of the world box
+	// maps back inside the local one
+	glm::vec3 extent(0.0f);
+	for (int j = 0; j < 3; ++j) extent += glm::abs(linear[j]) * localBox.extent[j];
+
+	const glm::mat3 inv = glm::inverse(linear);
+	float scale = 1.0f;
+	for (int i = 0; i < 3; ++i) {
+		const float reach = std::abs(inv[0][i]) * extent.x + std::abs(inv[1][i]) * extent.y + std::abs(inv[2][i]) * extent.z;
+		if (reach > localBox.extent[i]) scale = std::min(scale, localBox.extent[i] / reach);
+	}
+
+	out.extent = extent * scale;
+	out.vmin = out.origin - out.extent;
+	out.vmax = out.origin + out.extent;
+	out.sphereRadius = glm::length(out.extent);
+	return out;
+}
+
+void Visibility::selectOccluders(
+	const std::vector<GPUInstance>& visibleInstances,
+	const std::vector<MeshOccluder>& meshOccluders,
+	const std::vector<glm::mat4>& transforms,
+	const glm::mat4& viewProj,
+	uint32_t maxCount,
+	std::vector<AABB>& occluders)
+{
+	occluders.clear();
+
+	// Bounding sphere over center distance squared, proportional to the screen area it covers
+	std::vector<std::pair<float, AABB>> scored;
+	for (const GPUInstance& inst : visibleInstances) {
+		const MeshOccluder& occ = meshOccluders[inst.meshID];
+		if (!occ.solid) continue;
+
+		const AABB b = occluderWorldBox(occ.box, transforms[inst.transformID]);
+		if (b.sphereRadius <= 0.0f) continue;
+		const float w = (viewProj * glm::vec4(b.origin, 1.0f)).w;
+		if (w <= b.sphereRadius + OCCLUSION_NEAR_W) continue; // too close to project as a whole
+		scored.emplace_back((b.sphereRadius * b.sphereRadius) / (w * w), b);
+	}
+
+	const uint32_t count = std::min(maxCount, static_cast<uint32_t>(scored.size()));
+	std::partial_sort(scored.begin(), scored.begin() + count, scored.end(),
+		[](const auto& a, const auto& b) { return a.first > b.first; });
+
+	for (uint32_t i = 0; i < count; ++i)
+		occluders.push_back(scored[i].second);
+}
+
+void Visibility::rasterizeOccluders(
+	OcclusionBuffer& ob,
+	const std::vector<AABB>& occluders,
+	const glm::mat4& viewProj,
+	const glm::vec3& eye,
+	OcclusionStats* stats)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+	constexpr uint32_t tileCount = OCCLUSION_TILES_X * OCCLUSION_TILES_Y;
+
+	ob.invW.resize(static_cast<size_t>(OCCLUSION_WIDTH) * OCCLUSION_HEIGHT);
+	ob.tileMin.resize(tileCount);
+	ob.tileBins.resize(tileCount);
+	for (auto& bin : ob.tileBins) bin.clear();
+
+	ob.polys.clear();
+	for (const AABB& box : occluders) {
+		OccluderPoly poly;
+		if (setupOccluder(box, viewProj, eye, poly)) ob.polys.push_back(poly);
+	}
+
+	// Bin by pixel bounds, tiles then rasterize without sharing any pixels
+	for (uint32_t p = 0; p < ob.polys.size(); ++p) {
+		const OccluderPoly& poly = ob.polys[p];
+		for (int32_t ty = poly.minY / static_cast<int32_t>(OCCLUSION_TILE_HEIGHT); ty <= poly.maxY / static_cast<int32_t>(OCCLUSION_TILE_HEIGHT); ++ty)
+			for (int32_t tx = poly.minX / static_cast<int32_t>(OCCLUSION_TILE_WIDTH); tx <= poly.maxX / static_cast<int32_t>(OCCLUSION_TILE_WIDTH); ++tx)
+				ob.tileBins[ty * OCCLUSION_TILES_X + tx].push_back(p);
+	}
+
+	JobSystem::parallelFor(tileCount, 1, [&](uint32_t begin, uint32_t end, uint32_t) {
+		for (uint32_t t = begin; t < end; ++t) {
+			const int32_t tx0 = static_cast<int32_t>((t % OCCLUSION_TILES_X) * OCCLUSION_TILE_WIDTH);
+			const int32_t ty0 = static_cast<int32_t>((t / OCCLUSION_TILES_X) * OCCLUSION_TILE_HEIGHT);
+			const int32_t tx1 = tx0 + static_cast<int32_t>(OCCLUSION_TILE_WIDTH) - 1;
+			const int32_t ty1 = ty0 + static_cast<int32_t>(OCCLUSION_TILE_HEIGHT) - 1;
+
+			for (int32_t y = ty0; y <= ty1; ++y)
+				std::fill_n(ob.invW.data() + static_cast<size_t>(y) * OCCLUSION_WIDTH + tx0, OCCLUSION_TILE_WIDTH, 0.0f);
+
+			for (uint32_t p : ob.tileBins[t]) {
+				const OccluderPoly& poly = ob.polys[p];
+				const int32_t x0 = std::max(tx0, poly.minX) & ~3;
+				const int32_t x1 = std::min(tx1, poly.maxX | 3);
+				rasterPolyTile(ob.invW.data(), poly, x0, x1, std::max(ty0, poly.minY), std::min(ty1, poly.maxY));
+			}
+
+			float tileMin = 1e30f;
+			for (int32_t y = ty0; y <= ty1; ++y) {
+				const float* row = ob.invW.data() + static_cast<size_t>(y) * OCCLUSION_WIDTH;
+				for (int32_t x = tx0; x <= tx1; ++x) tileMin = std::min(tileMin, row[x]);
+			}
+			ob.tileMin[t] = tileMin;
+		}
+	});
+
+	if (stats) {
+		stats->occluders = static_cast<uint32_t>(ob.polys.size());
+		stats->rasterMs = elapsedMs(start);
+	}
+}
+
+bool Visibility::isOccluded(const OcclusionBuffer& ob, const AABB& box, const glm::mat4& viewProj) {
+	glm::vec3 corners[8];
+	boxCorners(box, corners);
+
+	glm::vec2 smin(1e30f), smax(-1e30f);
+	float nearestInvW = 0.0f;
+	for (uint32_t i = 0; i < 8; ++i) {
+		glm::vec3 s;
+		if (!projectPoint(viewProj, corners[i], s)) return false;
+		smin = glm::min(smin, glm::vec2(s));
+		smax = glm::max(smax, glm::vec2(s));
+		nearestInvW = std::max(nearestInvW, s.z); // w is affine, its smallest value is at a corner
+	}
+
+	// Partly off screen, nothing there to hide it
+	const int32_t x0 = static_cast<int32_t>(std::floor(smin.x));
+	const int32_t y0 = static_cast<int32_t>(std::floor(smin.y));
+	const int32_t x1 = static_cast<int32_t>(std::ceil(smax.x)) - 1;
+	const int32_t y1 = static_cast<int32_t>(std::ceil(smax.y)) - 1;
+	if (x0 < 0 || y0 < 0 || x1 >= static_cast<int32_t>(OCCLUSION_WIDTH) || y1 >= static_cast<int32_t>(OCCLUSION_HEIGHT))
+		return false;
+
+	return rangeHidden(ob, x0, y0, std::max(x0, x1), std::max(y0, y1), nearestInvW);
+}
+
+void Visibility::cullOccluded(
+	OcclusionBuffer& ob,
+	const glm::mat4& viewProj,
+	std::vector<GPUInstance>& visibleInstances,
+	std::vector<AABB>& visibleWorldAABBs,
+	OcclusionStats* stats)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+	const uint32_t count = static_cast<uint32_t>(visibleWorldAABBs.size());
+
+	uint32_t kept = count;
+	if (!ob.polys.empty()) {
+		ob.occluded.resize(count);
+		JobSystem::parallelFor(count, 256, [&](uint32_t begin, uint32_t end, uint32_t) {
+			for (uint32_t i = begin; i < end; ++i)
+				ob.occluded[i] = isOccluded(ob, visibleWorldAABBs[i], viewProj) ? 1 : 0;
+		});
+
+		kept = 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			if (ob.occluded[i]) continue;
+			visibleInstances[kept] = visibleInstances[i];
+			visibleWorldAABBs[kept] = visibleWorldAABBs[i];
+			++kept;
+		}
+		visibleInstances.resize(kept);
+		visibleWorldAABBs.resize(kept);
+	}
+
+	if (stats) {
+		stats->tested = count;
+		stats->occluded = count - kept;
+		stats->testMs = elapsedMs(start);
+	}
+}
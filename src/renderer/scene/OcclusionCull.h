@@ -0,0 +1,82 @@
+#pragma once
+
+#include "common/ResourceTypes.h"
+
+// CPU software occlusion, runs after the frustum cull. A few chosen occluder boxes are
+// rasterized into a small depth buffer and every surviving row's bounds are tested against it.
+// Occluder boxes come from solid meshes only and sit inside them, a row is only dropped when
+// it is hidden at every pixel.
+namespace Visibility {
+	constexpr uint32_t OCCLUSION_WIDTH = 256;
+	constexpr uint32_t OCCLUSION_HEIGHT = 128;
+	constexpr uint32_t OCCLUSION_TILE_WIDTH = 32;  // multiple of the 4 pixel SIMD width
+	constexpr uint32_t OCCLUSION_TILE_HEIGHT = 16;
+	constexpr uint32_t OCCLUSION_TILES_X = OCCLUSION_WIDTH / OCCLUSION_TILE_WIDTH;
+	constexpr uint32_t OCCLUSION_TILES_Y = OCCLUSION_HEIGHT / OCCLUSION_TILE_HEIGHT;
+	constexpr uint32_t OCCLUSION_MAX_OCCLUDERS = 32;
+	// Boxes with a corner closer than this (clip w) are skipped as occluders and always kept as occludees
+	constexpr float OCCLUSION_NEAR_W = 1e-2f;
+
+	// Occluder box on screen: its silhouette as edge functions, a*x + b*y + c >= 0 inside, and
+	// the planes of its camera facing sides as 1/w over the screen. Both are evaluated at pixel
+	// coordinates and already pulled in by half a pixel, so a pixel only counts as covered when
+	// all of it is, at the farthest depth anywhere inside it.
+	struct OccluderPoly {
+		glm::vec3 edges[6];
+		glm::vec3 planes[3];
+		uint32_t edgeCount = 0;
+		uint32_t planeCount = 0;
+		int32_t minX = 0, minY = 0, maxX = -1, maxY = -1; // pixel range, inclusive
+	};
+
+	// Farthest occluder surface per pixel stored as 1/w, which is linear in screen space.
+	// Larger is nearer, 0 means nothing was drawn there.
+	struct OcclusionBuffer {
+		std::vector<float> invW;
+		std::vector<float> tileMin; // smallest invW in each tile, lets most tests skip the pixels
+
+		std::vector<OccluderPoly> polys;
+		std::vector<std::vector<uint32_t>> tileBins; // polys touching each tile
+		std::vector<uint8_t> occluded;               // per row, reused by cullOccluded
+	};
+
+	struct OcclusionStats {
+		uint32_t occluders = 0; // rasterized, after near plane and size rejects
+		uint32_t tested = 0;
+		uint32_t occluded = 0;
+		float rasterMs = 0.0f;
+		float testMs = 0.0f;
+	};
+
+	// Largest world box inside a mesh space box once it's transformed, empty extent when the
+	// transform is degenerate. Without rotation it's the transformed box itself.
+	AABB occluderWorldBox(const AABB& localBox, const glm::mat4& transform);
+
+	// Picks the occluder boxes that cover the most screen among the visible rows whose mesh is
+	// solid (MeshOccluder::solid). Rows of open, hollow or concave meshes never occlude.
+	void selectOccluders(
+		const std::vector<GPUInstance>& visibleInstances,
+		const std::vector<MeshOccluder>& meshOccluders,
+		const std::vector<glm::mat4>& transforms,
+		const glm::mat4& viewProj,
+		uint32_t maxCount,
+		std::vector<AABB>& occluders);
+
+	// Bins the occluders into screen tiles and rasterizes the tiles on JobSystem threads
+	void rasterizeOccluders(
+		OcclusionBuffer& ob,
+		const std::vector<AABB>& occluders,
+		const glm::mat4& viewProj,
+		const glm::vec3& eye,
+		OcclusionStats* stats = nullptr);
+
+	bool isOccluded(const OcclusionBuffer& ob, const AABB& box, const glm::mat4& viewProj);
+
+	// Drops the occluded rows from both lists, the rest keep their order
+	void cullOccluded(
+		OcclusionBuffer& ob,
+		const glm::mat4& viewProj,
+		std::vector<GPUInstance>& visibleInstances,
+		std::vector<AABB>& visibleWorldAABBs,
+		OcclusionStats* stats = nullptr);
+}
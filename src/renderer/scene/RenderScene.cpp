@@ -4,7 +4,13 @@
 #include "SceneGraph.h"
 #include "DrawPreparation.h"
 #include "Visibility.h"
+#include "OcclusionCull.h"
+#include "GPUOcclusion.h"
+#include "GPUCull.h"
+#include "ContributionCull.h"
+#include "TwoLevelBVH.h"
 #include "core/Environment.h"
+#include "renderer/Renderer.h"
 #include "utils/BufferUtils.h"
 #include "engine/Engine.h"
 
@@ -16,7 +22,14 @@ namespace RenderScene {
 	std::vector<glm::mat4> _globalTransforms;
 
 	static Visibility::VisibilityState _visState;
+	static Visibility::CullScratch _cullScratch;
+	static Visibility::SceneTLAS _sceneTLAS;
+	static Visibility::TwoLevelCullScratch _twoLevelScratch;
 	static std::vector<AABB> _visibleWorldAABBs;
+	static std::vector<uint32_t> _visibleRows; // GPU batching, the CPU cull's rows
+	static Visibility::OcclusionBuffer _occlusionBuffer;
+	static std::vector<AABB> _occluders;
+	static Visibility::LODState _lodState;
 
 	Camera _mainCamera;
 	static glm::mat4 _curCamView;
@@ -29,6 +42,34 @@ namespace RenderScene {
 	bool _isFirstViewProj = true;
 
 	static Frustum _currentFrustum;
+
+	// Versions the draw cache is keyed on, bumped whenever the frustum or the rows move
+	static uint64_t _frustumVersion = 0;
+	static uint64_t _sceneVersion = 0;
+
+	// Last CPU built visible set and draw stream. Reused as long as the view, the scene and the
+	// cull toggles match its build, by every frame in flight.
+	struct DrawCache {
+		bool valid = false;
+		uint64_t version = 0; // bumped on every store, frames remember the one their buffers hold
+		uint64_t frustumVersion = 0;
+		uint64_t sceneVersion = 0;
+		uint32_t viewportHeight = 0;
+		CullingToggles toggles{};
+
+		std::vector<GPUInstance> visibleInstances;
+		std::vector<VkDrawIndexedIndirectCommand> indirectDraws;
+		PassRange opaqueRange;
+		PassRange transparentRange;
+	};
+	static DrawCache _drawCache;
+
+	static bool reuseDrawCache(FrameContext& frameCtx, const CullingToggles& toggles, uint32_t viewportHeight,
+		GPUQueue& transferQueue, const VmaAllocator allocator);
+	static void storeDrawCache(FrameContext& frameCtx, const CullingToggles& toggles, uint32_t viewportHeight);
+
+	static void readOverdrawQuery(FrameContext& frameCtx, FrameStats& stats);
+	static void beginOverdrawQuery(FrameContext& frameCtx);
 }
 
 void RenderScene::setScene() {
@@ -82,9 +123,13 @@ void RenderScene::updateScene(FrameContext& frameCtx, GPUResources& resources) {
 	if (_sceneData.viewproj != _lastViewProj) {
 		_lastViewProj = _sceneData.viewproj;
 		_currentFrustum = Visibility::extractFrustum(_sceneData.viewproj);
+		++_frustumVersion;
 		//copyFrustumToFrame(frameCtx.cullingPCData);
 	}
 
+	frameCtx.renderDataUploaded = false;
+	readOverdrawQuery(frameCtx, Engine::getProfiler().getStats());
+
 	const auto allocator = resources.getAllocator();
 	allocateSceneBuffer(frameCtx, allocator);
 
@@ -93,6 +138,8 @@ void RenderScene::updateScene(FrameContext& frameCtx, GPUResources& resources) {
 
 	auto& tQueue = Backend::getTransferQueue();
 	auto& meshes = resources.getResgisteredMeshes().meshData;
+	const auto& meshLODs = resources.getResgisteredMeshes().meshLODs;
+	const auto& meshOccluders = resources.getResgisteredMeshes().meshOccluders;
 
 	DrawPreparation::syncGlobalInstancesAndTransforms(
 		frameCtx,
@@ -101,6 +148,7 @@ void RenderScene::updateScene(FrameContext& frameCtx, GPUResources& resources) {
 		_globalInstances,
 		_globalTransforms,
 		tQueue);
+	const bool transformsChanged = frameCtx.transformsBufferUploadNeeded;
 
 	frameCtx.visSyncResult = Visibility::syncFromGlobalInstances(
 		_visState,
@@ -109,27 +157,286 @@ void RenderScene::updateScene(FrameContext& frameCtx, GPUResources& resources) {
 		meshes,
 		_globalTransforms);
 
+	const auto& cullToggles = Engine::getProfiler().cullToggles;
+	_visState.asyncRebuild = cullToggles.asyncBVHRebuild;
 	Visibility::applySyncResult(
 		_visState,
 		frameCtx.visSyncResult);
 
-	// CPU CULLING
+	if (frameCtx.visSyncResult.topologyChanged) {
+		GPUOcclusion::markCandidatesDirty();
+		GPUCull::markDirty();
+		_lodState.clear();
+	}
+
+	// Dynamic slabs refit every frame, only moved transforms change what is visible
+	if (frameCtx.visSyncResult.topologyChanged || transformsChanged)
+		++_sceneVersion;
+
+	// Build mode or layout switched from the editor, tree has to be rebuilt
+	if (_visState.buildMode != cullToggles.buildMode || _visState.layout != cullToggles.layout ||
+		_visState.lbvhDynamicFraction != cullToggles.lbvhDynamicFraction) {
+		_visState.buildMode = cullToggles.buildMode;
+		_visState.layout = cullToggles.layout;
+		_visState.lbvhDynamicFraction = cullToggles.lbvhDynamicFraction;
+		Visibility::buildBVH(_visState);
+	}
+	_visState.planeMasks = cullToggles.planeMasks;
+
+	// Follows the flat rows while it's on, picks up whatever changed in between when turned back on
+	if (cullToggles.twoLevelBVH)
+		Visibility::syncSceneTLAS(_sceneTLAS, _visState, _globalInstances, meshes, _globalTransforms);
+
+	// DRAW CACHE, the GPU paths cull every frame on their own and never go through it
+	const uint32_t viewportHeight = Renderer::getDrawExtent().height;
+	const bool cacheable = cullToggles.drawCache && !cullToggles.gpuFrustumCull && !cullToggles.gpuBatching && !cullToggles.gpuOcclusion;
+	if (cacheable && reuseDrawCache(frameCtx, cullToggles, viewportHeight, tQueue, allocator)) return;
+
 	frameCtx.clearRenderData();
-	Visibility::cullBVHCollect(
-		_visState,
-		_currentFrustum,
-		frameCtx.visibleInstances,
-		_visibleWorldAABBs);
+	frameCtx.drawCacheVersion = 0;
+
+	// GPU CULLING, takes the opaque cull and draw build below off the CPU
+	if (cullToggles.gpuFrustumCull) {
+		uint32_t cpuVisible = 0;
+		uint32_t cpuOpaqueDraws = 0;
+		if (cullToggles.gpuCullValidate) {
+			// The GPU counts the opaque rows only, and batches them like the batched order does
+			Visibility::cullBVHCollect(_visState, _currentFrustum, frameCtx.visibleInstances, _visibleWorldAABBs);
+			for (const GPUInstance& inst : frameCtx.visibleInstances)
+				cpuVisible += static_cast<MaterialPass>(inst.passType) == MaterialPass::Opaque ? 1u : 0u;
+			frameCtx.opaqueOrder = OpaqueOrder::Batched;
+			DrawPreparation::buildAndSortIndirectDraws(frameCtx, meshes, meshLODs, _visibleWorldAABBs, _sceneData.cameraPosition);
+			cpuOpaqueDraws = static_cast<uint32_t>(frameCtx.indirectDraws.size()) - frameCtx.transparentRange.visibleCount;
+			frameCtx.clearRenderData();
+		}
+
+		copyFrustumToFrame(frameCtx.cullingPCData);
+		GPUCull::prepareFrame(frameCtx, _visState, meshes, cpuVisible, cpuOpaqueDraws, allocator);
+
+		if (frameCtx.gpuCullActive) {
+			frameCtx.gpuOcclusionActive = false;
+			GPUOcclusion::markCandidatesDirty();
+
+			// Transparents are culled and sorted back to front here, the cull writes the opaque
+			// instances and draws itself
+			GPUCull::cullTransparents(_visState, _currentFrustum, frameCtx.visibleInstances, _visibleWorldAABBs);
+			if (!frameCtx.visibleInstances.empty()) {
+				frameCtx.visibleCount = static_cast<uint32_t>(frameCtx.visibleInstances.size());
+				DrawPreparation::buildAndSortIndirectDraws(frameCtx, meshes, meshLODs, _visibleWorldAABBs, _sceneData.cameraPosition);
+			}
+
+			DrawPreparation::uploadGPUBuffersForFrame(frameCtx, tQueue, allocator);
+			return;
+		}
+	}
+	// GPU BATCHING, the CPU culls and uploads the visible rows, batches and draws are built on the GPU
+	else if (cullToggles.gpuBatching) {
+		Visibility::cullBVHCollectRows(_visState, _currentFrustum, _visibleRows, nullptr, &_cullScratch);
+
+		if (cullToggles.gpuCullValidate) {
+			// CPU batching of the same rows, the GPU's draws and instances should match it
+			_visibleWorldAABBs.clear();
+			for (uint32_t row : _visibleRows) {
+				frameCtx.visibleInstances.push_back(_visState.instances[row]);
+				_visibleWorldAABBs.push_back(_visState.worldAABBs[row]);
+			}
+			// The GPU batches like the batched order does, the other orders split batches. Whatever
+			// the frame context was left with from its last CPU frame doesn't count here.
+			frameCtx.opaqueOrder = OpaqueOrder::Batched;
+			DrawPreparation::buildAndSortIndirectDraws(frameCtx, meshes, meshLODs, _visibleWorldAABBs, _sceneData.cameraPosition);
+		}
+
+		GPUCull::prepareBatching(frameCtx, _visState, meshes, _visibleRows, cullToggles.gpuCullValidate, allocator);
+		frameCtx.clearRenderData();
+
+		if (frameCtx.gpuCullActive) {
+			frameCtx.gpuOcclusionActive = false;
+			GPUOcclusion::markCandidatesDirty();
+
+			// Transparents are sorted back to front here, the batching writes the opaque instances
+			// and draws itself
+			GPUCull::gatherTransparents(_visState, _visibleRows, frameCtx.visibleInstances, _visibleWorldAABBs);
+			if (!frameCtx.visibleInstances.empty()) {
+				frameCtx.visibleCount = static_cast<uint32_t>(frameCtx.visibleInstances.size());
+				DrawPreparation::buildAndSortIndirectDraws(frameCtx, meshes, meshLODs, _visibleWorldAABBs, _sceneData.cameraPosition);
+			}
+
+			DrawPreparation::uploadGPUBuffersForFrame(frameCtx, tQueue, allocator);
+			return;
+		}
+	}
+	else {
+		frameCtx.gpuCullActive = false;
+		GPUCull::markDirty();
+	}
+
+	// CPU CULLING
+	Visibility::CullStats cullStats{};
+	if (cullToggles.twoLevelBVH) {
+		Visibility::cullTwoLevelCollect(
+			_sceneTLAS,
+			_visState,
+			_currentFrustum,
+			frameCtx.visibleInstances,
+			_visibleWorldAABBs,
+			_twoLevelScratch,
+			&cullStats);
+	}
+	else if (cullToggles.parallelCull) {
+		Visibility::cullBVHCollectParallel(
+			_visState,
+			_currentFrustum,
+			frameCtx.visibleInstances,
+			_visibleWorldAABBs,
+			_cullScratch,
+			&cullStats);
+	}
+	else {
+		Visibility::cullBVHCollect(
+			_visState,
+			_currentFrustum,
+			frameCtx.visibleInstances,
+			_visibleWorldAABBs,
+			&cullStats,
+			&_cullScratch);
+	}
+
+	auto& frameStats = Engine::getProfiler().getStats();
+	frameStats.cullSubtreesAccepted.store(cullStats.subtreesAccepted);
+	frameStats.bvhLooseRows.store(static_cast<uint32_t>(_visState.looseRows.size()));
+
+	// GPU OCCLUSION, opaque rows are culled and drawn on the GPU, the CPU list keeps the transparents.
+	// They have to fit in front of the phases' ranges, past that the frame stays on the CPU path.
+	size_t transparentCount = 0;
+	if (cullToggles.gpuOcclusion) {
+		for (const GPUInstance& inst : frameCtx.visibleInstances)
+			transparentCount += static_cast<MaterialPass>(inst.passType) != MaterialPass::Opaque ? 1u : 0u;
+	}
+	if (cullToggles.gpuOcclusion && GPUOcclusion::isReady() && transparentCount <= GPUOcclusion::CPU_CAPACITY) {
+		auto& visible = frameCtx.visibleInstances;
+		size_t kept = 0;
+		for (size_t i = 0; i < visible.size(); ++i) {
+			if (static_cast<MaterialPass>(visible[i].passType) == MaterialPass::Opaque) continue;
+			visible[kept] = visible[i];
+			_visibleWorldAABBs[kept] = _visibleWorldAABBs[i];
+			++kept;
+		}
+		const uint32_t opaqueCount = static_cast<uint32_t>(visible.size() - kept);
+		visible.resize(kept);
+		_visibleWorldAABBs.resize(kept);
+
+		GPUOcclusion::prepareFrame(frameCtx, _visState, _currentFrustum, _sceneData.viewproj,
+			opaqueCount, cullToggles.gpuHiZTest, allocator);
+	}
+	else {
+		// Rows can change while the GPU path is off, gathered fresh once it's back on
+		frameCtx.gpuOcclusionActive = false;
+		GPUOcclusion::markCandidatesDirty();
+	}
+
+	// CPU OCCLUSION, boxes inside the largest solid meshes on screen stand in for them
+	Visibility::OcclusionStats occlusionStats{};
+	if (cullToggles.occlusionCull && !frameCtx.gpuOcclusionActive && !frameCtx.visibleInstances.empty()) {
+		Visibility::selectOccluders(frameCtx.visibleInstances, meshOccluders,
+			_globalTransforms, _sceneData.viewproj, Visibility::OCCLUSION_MAX_OCCLUDERS, _occluders);
+		Visibility::rasterizeOccluders(_occlusionBuffer, _occluders, _sceneData.viewproj, _mainCamera._position, &occlusionStats);
+		Visibility::cullOccluded(_occlusionBuffer, _sceneData.viewproj, frameCtx.visibleInstances, _visibleWorldAABBs, &occlusionStats);
+	}
+	frameStats.occlusionTested.store(occlusionStats.tested);
+	frameStats.occlusionOccluded.store(occlusionStats.occluded);
+	frameStats.occlusionTime.store(occlusionStats.rasterMs + occlusionStats.testMs);
+
+	// SCREEN SIZE, drops rows too small to matter and picks a detail level for the rest
+	Visibility::ContributionStats contributionStats{};
+	if ((cullToggles.contributionCull || cullToggles.lodSelection) && !frameCtx.visibleInstances.empty()) {
+		const Visibility::ContributionSettings settings{
+			.contributionCull = cullToggles.contributionCull,
+			.minPixelSize = cullToggles.minPixelSize,
+			.lodSelection = cullToggles.lodSelection,
+			.lodBias = cullToggles.lodBias,
+			.lodHysteresis = cullToggles.lodHysteresis
+		};
+		const float scale = Visibility::pixelScale(_curCamProj, static_cast<float>(viewportHeight));
+
+		Visibility::cullContribution(settings, _lodState, _mainCamera._position, scale, meshLODs,
+			frameCtx.visibleInstances, _visibleWorldAABBs, frameCtx.visibleLODs, &contributionStats);
+	}
+	frameStats.contributionCulled.store(contributionStats.culled);
+	for (uint32_t i = 0; i < MAX_MESH_LODS; ++i)
+		frameStats.lodRows[i].store(contributionStats.levelRows[i]);
 
 	if (!frameCtx.visibleInstances.empty()) {
 		frameCtx.visibleCount = static_cast<uint32_t>(frameCtx.visibleInstances.size());
+		frameCtx.opaqueOrder = cullToggles.opaqueOrder;
+
+		if (cullToggles.parallelDrawBuild)
+			DrawPreparation::buildIndirectDrawsParallel(frameCtx, meshes, meshLODs, _visibleWorldAABBs, _sceneData.cameraPosition);
+		else
+			DrawPreparation::buildAndSortIndirectDraws(frameCtx, meshes, meshLODs, _visibleWorldAABBs, _sceneData.cameraPosition);
+	}
 
-		DrawPreparation::buildAndSortIndirectDraws(frameCtx, meshes, _visibleWorldAABBs, _sceneData.cameraPosition);
+	if (cacheable) storeDrawCache(frameCtx, cullToggles, viewportHeight);
 
+	// The GPU phases still need the frame address table even with nothing culled on the CPU
+	if (!frameCtx.visibleInstances.empty() || frameCtx.gpuOcclusionActive) {
+		ASSERT(!frameCtx.gpuOcclusionActive || frameCtx.visibleInstances.size() <= GPUOcclusion::CPU_CAPACITY);
 		DrawPreparation::uploadGPUBuffersForFrame(frameCtx, tQueue, allocator);
 	}
 }
 
+bool RenderScene::reuseDrawCache(FrameContext& frameCtx, const CullingToggles& toggles, uint32_t viewportHeight,
+	GPUQueue& transferQueue, const VmaAllocator allocator)
+{
+	auto& frameStats = Engine::getProfiler().getStats();
+
+	if (!_drawCache.valid ||
+		_drawCache.frustumVersion != _frustumVersion ||
+		_drawCache.sceneVersion != _sceneVersion ||
+		_drawCache.viewportHeight != viewportHeight ||
+		_drawCache.toggles != toggles) {
+		frameStats.drawCacheMisses++;
+		return false;
+	}
+
+	frameStats.drawCacheHits++;
+	frameCtx.gpuCullActive = false;
+	frameCtx.gpuOcclusionActive = false;
+
+	// Buffers still hold this build from the last time the frame went around
+	if (frameCtx.drawCacheVersion == _drawCache.version) {
+		frameStats.drawCacheUploadHits++;
+		return true;
+	}
+
+	frameCtx.clearRenderData();
+	frameCtx.visibleInstances = _drawCache.visibleInstances;
+	frameCtx.indirectDraws = _drawCache.indirectDraws;
+	frameCtx.visibleCount = static_cast<uint32_t>(frameCtx.visibleInstances.size());
+	frameCtx.opaqueRange = _drawCache.opaqueRange;
+	frameCtx.transparentRange = _drawCache.transparentRange;
+	frameCtx.drawCacheVersion = _drawCache.version;
+
+	if (!frameCtx.visibleInstances.empty())
+		DrawPreparation::uploadGPUBuffersForFrame(frameCtx, transferQueue, allocator);
+	return true;
+}
+
+void RenderScene::storeDrawCache(FrameContext& frameCtx, const CullingToggles& toggles, uint32_t viewportHeight) {
+	_drawCache.valid = true;
+	++_drawCache.version;
+	_drawCache.frustumVersion = _frustumVersion;
+	_drawCache.sceneVersion = _sceneVersion;
+	_drawCache.viewportHeight = viewportHeight;
+	_drawCache.toggles = toggles;
+
+	_drawCache.visibleInstances = frameCtx.visibleInstances;
+	_drawCache.indirectDraws = frameCtx.indirectDraws;
+	_drawCache.opaqueRange = frameCtx.opaqueRange;
+	_drawCache.transparentRange = frameCtx.transparentRange;
+
+	frameCtx.drawCacheVersion = _drawCache.version;
+}
+
 void RenderScene::allocateSceneBuffer(FrameContext& frameCtx, const VmaAllocator allocator) {
 	const size_t sceneDataBytes = sizeof(GPUSceneData);
 
@@ -148,12 +455,12 @@ void RenderScene::allocateSceneBuffer(FrameContext& frameCtx, const VmaAllocator
 	vmaFlushAllocation(allocator, frameCtx.sceneDataBuffer.allocation, 0, sceneDataBytes);
 }
 
-void RenderScene::renderGeometry(FrameContext& frameCtx, Profiler& profiler) {
+void RenderScene::renderGeometry(FrameContext& frameCtx, Profiler& profiler, GeometryPhase phase) {
 	// all pipelines share push constant and descriptor setup
 	auto defaultPC = Pipelines::_globalLayout.pcRange;
 
 	// === SKYBOX DRAW ===
-	{
+	if (phase != GeometryPhase::OcclusionSecond) {
 		vkCmdBindPipeline(
 			frameCtx.commandBuffer,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
@@ -177,10 +484,24 @@ void RenderScene::renderGeometry(FrameContext& frameCtx, Profiler& profiler) {
 		profiler.addDrawCall(1);
 	}
 
-	if (frameCtx.visibleCount == 0) return;
-
 	auto& resources = Engine::getState().getGPUResources();
 
+	// === GPU CULLED ROWS ===
+	if (frameCtx.gpuCullActive) {
+		GPUCull::drawCulled(frameCtx, resources, profiler);
+		// The CPU list holds the transparents only
+		if (frameCtx.visibleCount > 0) drawIndirectCommands(frameCtx, resources, profiler);
+		return;
+	}
+
+	// === GPU OCCLUSION CULLED OPAQUES ===
+	if (phase != GeometryPhase::Full) {
+		GPUOcclusion::drawPhase(frameCtx, phase == GeometryPhase::OcclusionFirst ? 0 : 1, resources, profiler);
+		if (phase == GeometryPhase::OcclusionFirst) return;
+	}
+
+	if (frameCtx.visibleCount == 0) return;
+
 	drawIndirectCommands(frameCtx, resources, profiler);
 
 	// === VISIBLE OBB FOR OBJECTS ===
@@ -270,6 +591,9 @@ void RenderScene::drawIndirectCommands(FrameContext& frameCtx, GPUResources& res
 	vkCmdBindPipeline(frameCtx.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 	vkCmdBindIndexBuffer(frameCtx.commandBuffer, idxBuffer, 0, VK_INDEX_TYPE_UINT32);
 
+	// Ranges count instances, the opaque draws are the ones before the transparents'
+	const uint32_t opaqueDraws = static_cast<uint32_t>(frameCtx.indirectDraws.size()) - frameCtx.transparentRange.visibleCount;
+
 	if (frameCtx.opaqueRange.visibleCount > 0) {
 		vkCmdPushConstants(frameCtx.commandBuffer,
 			pLayout.layout,
@@ -278,15 +602,20 @@ void RenderScene::drawIndirectCommands(FrameContext& frameCtx, GPUResources& res
 			pLayout.pcRange.size,
 			&frameCtx.drawDataPC);
 
+		const bool measureOverdraw = profiler.debugToggles.measureOverdraw;
+		if (measureOverdraw) beginOverdrawQuery(frameCtx);
+
 		vkCmdDrawIndexedIndirect(frameCtx.commandBuffer,
 			frameCtx.indirectDrawsBuffer.buffer,
-			frameCtx.opaqueRange.first,
-			frameCtx.opaqueRange.visibleCount,
+			0,
+			opaqueDraws,
 			drawCmdSize
 		);
 
-		for (uint32_t i = 0; i < frameCtx.opaqueRange.visibleCount; ++i) {
-			const auto& draw = frameCtx.indirectDraws[static_cast<size_t>(frameCtx.opaqueRange.first + i)];
+		if (measureOverdraw) vkCmdEndQuery(frameCtx.commandBuffer, frameCtx.overdrawQueries, 0);
+
+		for (uint32_t i = 0; i < opaqueDraws; ++i) {
+			const auto& draw = frameCtx.indirectDraws[i];
 			uint32_t triangleCount = (draw.indexCount * draw.instanceCount) / 3;
 			profiler.addDrawCall(triangleCount);
 		}
@@ -309,25 +638,60 @@ void RenderScene::drawIndirectCommands(FrameContext& frameCtx, GPUResources& res
 
 		vkCmdDrawIndexedIndirect(frameCtx.commandBuffer,
 			frameCtx.indirectDrawsBuffer.buffer,
-			frameCtx.transparentRange.first,
+			opaqueDraws * drawCmdSize,
 			frameCtx.transparentRange.visibleCount,
 			drawCmdSize
 		);
 
-		const auto& meshes = resources.getResgisteredMeshes().meshData;
+		// One draw per transparent at the end of the list, their index counts carry the LOD
+		const size_t firstTransparentDraw = opaqueDraws;
 
 		for (uint32_t i = 0; i < frameCtx.transparentRange.visibleCount; ++i) {
-			const uint32_t meshID = frameCtx.visibleInstances[static_cast<size_t>(frameCtx.transparentRange.first + i)].meshID;
-			auto& mesh = meshes[meshID];
-			uint32_t triangleCount = mesh.indexCount / 3;
+			const auto& draw = frameCtx.indirectDraws[firstTransparentDraw + i];
+			uint32_t triangleCount = draw.indexCount / 3;
 			profiler.addDrawCall(triangleCount);
 		}
 	}
 }
 
-void RenderScene::copyFrustumToFrame(CullingPushConstantsAddrs& frustumData) {
-	if (!GPU_ACCELERATION_ENABLED) return;
+// Fragment shader invocations of the opaque draws, over the draw extent's pixels. Read once per
+// frame after its fence, only when this frame context's last frame recorded the query, so frames
+// that skipped it never show an older result.
+void RenderScene::readOverdrawQuery(FrameContext& frameCtx, FrameStats& stats) {
+	if (!frameCtx.overdrawRecorded) return;
+	frameCtx.overdrawRecorded = false;
+
+	uint64_t fragments = 0;
+	const VkResult res = vkGetQueryPoolResults(Backend::getDevice(), frameCtx.overdrawQueries, 0, 1,
+		sizeof(fragments), &fragments, sizeof(fragments), VK_QUERY_RESULT_64_BIT);
+	if (res == VK_SUCCESS) {
+		stats.opaqueFragments.store(fragments);
+		stats.opaqueOverdraw.store(static_cast<float>(fragments) / static_cast<float>(frameCtx.overdrawPixels));
+	}
+}
+
+// A new pool's query starts undefined, every use is reset from the host first. Nothing pending
+// uses it, this frame's fence was waited on and the query is recorded once per frame.
+void RenderScene::beginOverdrawQuery(FrameContext& frameCtx) {
+	const VkDevice device = Backend::getDevice();
+
+	if (frameCtx.overdrawQueries == VK_NULL_HANDLE) {
+		VkQueryPoolCreateInfo info{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+		info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		info.queryCount = 1;
+		info.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+		VK_CHECK(vkCreateQueryPool(device, &info, nullptr, &frameCtx.overdrawQueries));
+	}
 
+	const VkExtent3D extent = Renderer::getDrawExtent();
+	frameCtx.overdrawPixels = extent.width * extent.height;
+
+	vkResetQueryPool(device, frameCtx.overdrawQueries, 0, 1);
+	vkCmdBeginQuery(frameCtx.commandBuffer, frameCtx.overdrawQueries, 0, 0);
+	frameCtx.overdrawRecorded = true;
+}
+
+void RenderScene::copyFrustumToFrame(CullingPushConstantsAddrs& frustumData) {
 	std::copy(
 		std::begin(_currentFrustum.planes),
 		std::end(_currentFrustum.planes),
@@ -344,4 +708,13 @@ void RenderScene::copyFrustumToFrame(CullingPushConstantsAddrs& frustumData) {
 void RenderScene::cleanScene() {
 	_loadedScenes.clear();
 	_visState.cleanup();
+	_cullScratch = {};
+	_sceneTLAS.cleanup();
+	_twoLevelScratch = {};
+	_occlusionBuffer = {};
+	_occluders.clear();
+	_lodState.clear();
+	_drawCache = {};
+	GPUOcclusion::cleanup();
+	GPUCull::cleanup();
 }
\ No newline at end of file
@@ -5,6 +5,13 @@
 #include "renderer/frame/FrameContext.h"
 #include "engine/platform/input/Camera.h"
 
+// Which part of the frame a geometry pass records, the occlusion phases are split by the depth pyramid build
+enum class GeometryPhase : uint8_t {
+	Full,
+	OcclusionFirst,  // skybox and last frame's visible opaques
+	OcclusionSecond  // newly visible opaques and the CPU culled transparents
+};
+
 // Holds and controls scene data
 namespace RenderScene {
 	GPUSceneData& getCurrentSceneData();
@@ -32,6 +39,6 @@ namespace RenderScene {
 
 	void allocateSceneBuffer(FrameContext& frameCtx, const VmaAllocator allocator);
 	void updateScene(FrameContext& frameCtx, GPUResources& resources);
-	void renderGeometry(FrameContext& frameCtx, Profiler& profiler);
+	void renderGeometry(FrameContext& frameCtx, Profiler& profiler, GeometryPhase phase = GeometryPhase::Full);
 	void drawIndirectCommands(FrameContext& frameCtx, GPUResources& resources, Profiler& profiler);
 }
\ No newline at end of file
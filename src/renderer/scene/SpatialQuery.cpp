@@ -0,0 +1,263 @@
+#include "pch.h"
+
+#include "SpatialQuery.h"
+#include "engine/JobSystem.h"
+
+namespace Visibility {
+	// Zero direction components get a huge reciprocal instead of inf, so a slab the origin
+	// sits on gives 0 rather than 0 * inf = NaN
+	struct PreparedRay {
+		glm::vec3 origin;
+		glm::vec3 invDir;
+		float tMax;
+	};
+
+	static PreparedRay prepareRay(const Ray& ray) {
+		PreparedRay r{ ray.origin, glm::vec3(0.0f), ray.tMax };
+		for (int a = 0; a < 3; ++a)
+			r.invDir[a] = ray.dir[a] != 0.0f ? 1.0f / ray.dir[a] : std::copysign(1e30f, ray.dir[a]);
+		return r;
+	}
+
+	static inline bool slabTest(const PreparedRay& r, const glm::vec3& vmin, const glm::vec3& vmax, float tLimit, float& t) {
+		const glm::vec3 t0 = (vmin - r.origin) * r.invDir;
+		const glm::vec3 t1 = (vmax - r.origin) * r.invDir;
+		const glm::vec3 tNear = glm::min(t0, t1);
+		const glm::vec3 tFar = glm::max(t0, t1);
+		const float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		const float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tLimit));
+		t = enter;
+		return enter <= exit;
+	}
+
+	static inline bool closerHit(float t, uint32_t row, const RayHit& best) {
+		return t < best.t || (t == best.t && row < best.row);
+	}
+
+	static inline bool closerRow(const RowDistance& a, const RowDistance& b) {
+		return a.distSq < b.distSq || (a.distSq == b.distSq && a.row < b.row);
+	}
+
+	struct RayStackEntry {
+		uint32_t node;
+		float t; // entry into the node's box
+	};
+
+	static RayHit raycast(const VisibilityState& vs, const PreparedRay& ray, std::vector<RayStackEntry>& stack, QueryStats& stats) {
+		RayHit best{};
+		float t = 0.0f;
+
+		// Rows waiting for a background build first, a hit among them prunes the walk too
+		for (uint32_t row : vs.looseRows) {
+			const AABB& b = vs.worldAABBs[row];
+			++stats.rowsTested;
+			if (slabTest(ray, b.vmin, b.vmax, std::min(ray.tMax, best.t), t) && closerHit(t, row, best))
+				best = { row, t };
+		}
+		if (vs.bvh.empty() || !slabTest(ray, vs.bvh[0].box.vmin, vs.bvh[0].box.vmax, std::min(ray.tMax, best.t), t)) return best;
+
+		stack.clear();
+		stack.push_back({ 0u, t });
+		while (!stack.empty()) {
+			const RayStackEntry e = stack.back();
+			stack.pop_back();
+			if (e.t > best.t) continue; // a closer hit came in since this was pushed
+			++stats.nodesVisited;
+
+			const BVHNode& node = vs.bvh[e.node];
+			if (node.count) {
+				for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+					const uint32_t row = vs.leafIndex[i];
+					const AABB& b = vs.worldAABBs[row];
+					++stats.rowsTested;
+					if (slabTest(ray, b.vmin, b.vmax, std::min(ray.tMax, best.t), t) && closerHit(t, row, best))
+						best = { row, t };
+				}
+				continue;
+			}
+
+			const uint32_t L = static_cast<uint32_t>(node.left);
+			const uint32_t R = static_cast<uint32_t>(node.right);
+			float tL = 0.0f, tR = 0.0f;
+			const float limit = std::min(ray.tMax, best.t);
+			const bool hitL = slabTest(ray, vs.bvh[L].box.vmin, vs.bvh[L].box.vmax, limit, tL);
+			const bool hitR = slabTest(ray, vs.bvh[R].box.vmin, vs.bvh[R].box.vmax, limit, tR);
+
+			// Far child goes on first so the near one is walked first
+			if (hitL && hitR) {
+				if (tL <= tR) {
+					stack.push_back({ R, tR });
+					stack.push_back({ L, tL });
+				}
+				else {
+					stack.push_back({ L, tL });
+					stack.push_back({ R, tR });
+				}
+			}
+			else if (hitL) stack.push_back({ L, tL });
+			else if (hitR) stack.push_back({ R, tR });
+		}
+		return best;
+	}
+
+	// Every row under nodes accepted by nodeTest whose box passes rowTest, in leaf order
+	template<typename NodeTest, typename RowTest>
+	static void overlap(
+		const VisibilityState& vs,
+		NodeTest nodeTest,
+		RowTest rowTest,
+		std::vector<uint32_t>& rows,
+		QueryStats* stats)
+	{
+		rows.clear();
+		QueryStats local{};
+		for (uint32_t row : vs.looseRows) {
+			++local.rowsTested;
+			if (rowTest(vs.worldAABBs[row])) rows.push_back(row);
+		}
+		if (vs.bvh.empty()) {
+			if (stats) *stats = local;
+			return;
+		}
+
+		std::vector<uint32_t> stack;
+		stack.reserve(64);
+		stack.push_back(0u);
+		while (!stack.empty()) {
+			const BVHNode& node = vs.bvh[stack.back()];
+			stack.pop_back();
+			++local.nodesVisited;
+			if (!nodeTest(node.box)) continue;
+
+			if (node.count) {
+				for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+					const uint32_t row = vs.leafIndex[i];
+					++local.rowsTested;
+					if (rowTest(vs.worldAABBs[row])) rows.push_back(row);
+				}
+				continue;
+			}
+			stack.push_back(static_cast<uint32_t>(node.right));
+			stack.push_back(static_cast<uint32_t>(node.left));
+		}
+
+		if (stats) *stats = local;
+	}
+}
+
+bool Visibility::rayHitsAABB(const Ray& ray, const AABB& box, float& t) {
+	return slabTest(prepareRay(ray), box.vmin, box.vmax, ray.tMax, t);
+}
+
+float Visibility::distanceSqToAABB(const glm::vec3& p, const AABB& box) {
+	const glm::vec3 d = glm::max(glm::max(box.vmin - p, p - box.vmax), glm::vec3(0.0f));
+	return glm::dot(d, d);
+}
+
+Visibility::RayHit Visibility::raycastBVH(const VisibilityState& vs, const Ray& ray, QueryStats* stats) {
+	std::vector<RayStackEntry> stack;
+	stack.reserve(64);
+	QueryStats local{};
+	const RayHit hit = raycast(vs, prepareRay(ray), stack, local);
+	if (stats) *stats = local;
+	return hit;
+}
+
+void Visibility::raycastBVHBatch(const VisibilityState& vs, const std::vector<Ray>& rays, std::vector<RayHit>& hits) {
+	const uint32_t count = static_cast<uint32_t>(rays.size());
+	hits.resize(count);
+
+	JobSystem::parallelFor(count, RAY_BATCH_CHUNK, [&](uint32_t begin, uint32_t end, uint32_t) {
+		std::vector<RayStackEntry> stack;
+		stack.reserve(64);
+		QueryStats unused{};
+		for (uint32_t i = begin; i < end; ++i)
+			hits[i] = raycast(vs, prepareRay(rays[i]), stack, unused);
+	});
+}
+
+void Visibility::overlapBoxBVH(const VisibilityState& vs, const AABB& box, std::vector<uint32_t>& rows, QueryStats* stats) {
+	auto touches = [&box](const AABB& b) {
+		return glm::all(glm::lessThanEqual(b.vmin, box.vmax)) && glm::all(glm::lessThanEqual(box.vmin, b.vmax));
+	};
+	overlap(vs, touches, touches, rows, stats);
+}
+
+void Visibility::overlapSphereBVH(
+	const VisibilityState& vs,
+	const glm::vec3& center,
+	float radius,
+	std::vector<uint32_t>& rows,
+	QueryStats* stats)
+{
+	const float radiusSq = radius * radius;
+	auto touches = [&](const AABB& b) { return distanceSqToAABB(center, b) <= radiusSq; };
+	overlap(vs, touches, touches, rows, stats);
+}
+
+void Visibility::nearestBVH(
+	const VisibilityState& vs,
+	const glm::vec3& p,
+	uint32_t k,
+	std::vector<RowDistance>& out,
+	QueryStats* stats)
+{
+	out.clear();
+	QueryStats local{};
+	if (k == 0) {
+		if (stats) *stats = local;
+		return;
+	}
+
+	// out is a max heap on closerRow while the walk runs, its front the worst row kept
+	auto offer = [&](uint32_t row) {
+		const RowDistance cand{ row, distanceSqToAABB(p, vs.worldAABBs[row]) };
+		++local.rowsTested;
+		if (out.size() < k) {
+			out.push_back(cand);
+			std::push_heap(out.begin(), out.end(), closerRow);
+		}
+		else if (closerRow(cand, out.front())) {
+			std::pop_heap(out.begin(), out.end(), closerRow);
+			out.back() = cand;
+			std::push_heap(out.begin(), out.end(), closerRow);
+		}
+	};
+	for (uint32_t row : vs.looseRows) offer(row);
+
+	struct Entry {
+		uint32_t node;
+		float distSq;
+	};
+	std::vector<Entry> stack;
+	stack.reserve(64);
+	if (!vs.bvh.empty()) stack.push_back({ 0u, distanceSqToAABB(p, vs.bvh[0].box) });
+
+	while (!stack.empty()) {
+		const Entry e = stack.back();
+		stack.pop_back();
+		// Equal distance still goes in, a lower row there would displace the worst
+		if (out.size() == k && e.distSq > out.front().distSq) continue;
+		++local.nodesVisited;
+
+		const BVHNode& node = vs.bvh[e.node];
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) offer(vs.leafIndex[i]);
+			continue;
+		}
+
+		const Entry l{ static_cast<uint32_t>(node.left), distanceSqToAABB(p, vs.bvh[node.left].box) };
+		const Entry r{ static_cast<uint32_t>(node.right), distanceSqToAABB(p, vs.bvh[node.right].box) };
+		if (l.distSq <= r.distSq) {
+			stack.push_back(r);
+			stack.push_back(l);
+		}
+		else {
+			stack.push_back(l);
+			stack.push_back(r);
+		}
+	}
+
+	std::sort_heap(out.begin(), out.end(), closerRow);
+	if (stats) *stats = local;
+}
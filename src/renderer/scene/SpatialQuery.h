@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Visibility.h"
+
+// Queries over the culling tree for picking and gameplay code. Everything works on the rows'
+// world AABBs through vs.bvh, whatever layout the cull uses, so the tree has to be built or
+// refit for the bounds in worldAABBs. Loose rows waiting for a background build are tested one
+// by one. Results name VisibilityState rows.
+namespace Visibility {
+	// Rays per JobSystem range in raycastBVHBatch
+	constexpr uint32_t RAY_BATCH_CHUNK = 64;
+
+	struct Ray {
+		glm::vec3 origin;
+		glm::vec3 dir; // any length, t is measured in multiples of it
+		float tMax = std::numeric_limits<float>::max();
+	};
+
+	struct RayHit {
+		uint32_t row = ROW_INACTIVE; // ROW_INACTIVE on a miss
+		float t = std::numeric_limits<float>::max();
+	};
+
+	struct RowDistance {
+		uint32_t row;
+		float distSq; // 0 when the point is inside the row's box
+	};
+
+	struct QueryStats {
+		uint32_t nodesVisited = 0;
+		uint32_t rowsTested = 0;
+	};
+
+	// Entry t of the ray into the box, 0 when the origin is inside. False on a miss or past tMax.
+	bool rayHitsAABB(const Ray& ray, const AABB& box, float& t);
+	float distanceSqToAABB(const glm::vec3& p, const AABB& box);
+
+	// Nearest row whose box the ray enters, lowest row on equal t. Near child first, nodes
+	// entered past the best hit so far are skipped.
+	RayHit raycastBVH(const VisibilityState& vs, const Ray& ray, QueryStats* stats = nullptr);
+	// One hit per ray, ranges of RAY_BATCH_CHUNK rays on JobSystem workers
+	void raycastBVHBatch(const VisibilityState& vs, const std::vector<Ray>& rays, std::vector<RayHit>& hits);
+
+	// Rows whose boxes touch the query, in leaf order
+	void overlapBoxBVH(const VisibilityState& vs, const AABB& box, std::vector<uint32_t>& rows, QueryStats* stats = nullptr);
+	void overlapSphereBVH(
+		const VisibilityState& vs,
+		const glm::vec3& center,
+		float radius,
+		std::vector<uint32_t>& rows,
+		QueryStats* stats = nullptr);
+
+	// The k rows with the closest boxes to p, nearest first, lower row on equal distance
+	void nearestBVH(
+		const VisibilityState& vs,
+		const glm::vec3& p,
+		uint32_t k,
+		std::vector<RowDistance>& out,
+		QueryStats* stats = nullptr);
+}
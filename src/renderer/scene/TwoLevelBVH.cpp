@@ -0,0 +1,197 @@
+#include "pch.h"
+
+#include "TwoLevelBVH.h"
+
+namespace Visibility {
+	static bool isDynamic(const GlobalInstance& gi) {
+		return gi.drawType == DrawType::DrawDynamic || gi.drawType == DrawType::DrawMultiDynamic;
+	}
+
+	// Model space bounds of every primitive from copy 0, relative to its first transform
+	static void boundModel(
+		ModelBLAS& blas,
+		const VisibilityState& vs,
+		const CoreSlab& slab,
+		const std::vector<GPUMeshData>& meshData,
+		const std::vector<glm::mat4>& transforms)
+	{
+		const uint32_t first = slab.copyFirst[0];
+		const glm::mat4 worldToModel = glm::inverse(transforms[vs.transformIDs[first]]);
+
+		VisibilityState& tree = blas.tree;
+		const bool fresh = tree.instances.empty();
+		if (fresh) {
+			tree.instances.resize(slab.stride);
+			tree.transformIDs.resize(slab.stride);
+			tree.worldAABBs.resize(slab.stride);
+		}
+
+		for (uint32_t local = 0; local < slab.stride; ++local) {
+			const uint32_t row = first + local;
+			tree.worldAABBs[local] = transformAABB(meshData[vs.instances[row].meshID].localAABB,
+				worldToModel * transforms[vs.transformIDs[row]]);
+			if (!fresh) continue;
+
+			tree.instances[local] = vs.instances[row];
+			tree.instances[local].transformID = local;
+			tree.transformIDs[local] = local;
+			setRowActive(tree, local, true);
+		}
+
+		if (fresh) {
+			buildBVH(tree);
+			return;
+		}
+		markRowsDirty(tree, { { 0, slab.stride } });
+		refitDirtyBVH(tree);
+	}
+
+	static uint32_t addTopRow(SceneTLAS& tlas, uint32_t model) {
+		VisibilityState& top = tlas.top;
+		const uint32_t row = static_cast<uint32_t>(top.instances.size());
+
+		GPUInstance inst{};
+		inst.transformID = row;
+		top.instances.push_back(inst);
+		top.transformIDs.push_back(row);
+		top.worldAABBs.push_back(AABB{});
+
+		tlas.rowModel.push_back(model);
+		tlas.rowFirst.push_back(0);
+		tlas.rowTransform.push_back(UINT32_MAX);
+		tlas.modelToWorld.push_back(glm::mat4(1.0f));
+		tlas.worldToModel.push_back(glm::mat4(1.0f));
+		return row;
+	}
+}
+
+void Visibility::syncSceneTLAS(
+	SceneTLAS& tlas,
+	const VisibilityState& vs,
+	const std::vector<GlobalInstance>& gis,
+	const std::vector<GPUMeshData>& meshData,
+	const std::vector<glm::mat4>& transforms)
+{
+	VisibilitySyncResult res{};
+	std::vector<RowRun> moved;
+
+	for (const GlobalInstance& gi : gis) {
+		const SceneID sid = static_cast<SceneID>(gi.sceneID);
+		const auto slabIt = vs.slabs.find(sid);
+		if (slabIt == vs.slabs.end() || slabIt->second.copyFirst.empty()) continue;
+		const CoreSlab& slab = slabIt->second;
+		const bool dynamic = isDynamic(gi);
+
+		auto [modelIt, inserted] = tlas.modelIndex.try_emplace(sid, static_cast<uint32_t>(tlas.models.size()));
+		if (inserted) tlas.models.emplace_back();
+		const uint32_t model = modelIt->second;
+
+		const bool fresh = tlas.models[model].tree.instances.empty();
+		if (fresh || dynamic) {
+			tlas.models[model].stride = slab.stride;
+			boundModel(tlas.models[model], vs, slab, meshData, transforms);
+		}
+
+		ModelBLAS& blas = tlas.models[model];
+		const AABB modelBounds = blas.tree.bvh.empty() ? AABB{} : blas.tree.bvh[0].box;
+
+		for (uint32_t c = 0; c < slab.usedCopies; ++c) {
+			if (c >= blas.copyRows.size())
+				blas.copyRows.push_back(addTopRow(tlas, model));
+			const uint32_t row = blas.copyRows[c];
+			const uint32_t first = slab.copyFirst[c];
+			const uint32_t tid = vs.transformIDs[first];
+
+			// New copies, copies other models shifted and every dynamic copy get placed again
+			const bool live = tlas.top.activeSlot.size() > row && tlas.top.activeSlot[row] != ROW_INACTIVE;
+			const bool place = !live || fresh || dynamic || tlas.rowTransform[row] != tid;
+			if (place) {
+				tlas.rowFirst[row] = first;
+				tlas.rowTransform[row] = tid;
+				tlas.modelToWorld[row] = transforms[tid];
+				tlas.worldToModel[row] = glm::inverse(transforms[tid]);
+				tlas.top.worldAABBs[row] = transformAABB(modelBounds, transforms[tid]);
+			}
+
+			if (!live) {
+				setRowActive(tlas.top, row, true);
+				res.addedRows.push_back(row);
+			}
+			else if (place) {
+				moved.push_back({ row, 1 });
+			}
+		}
+
+		// Copies past usedCopies keep their rows for regrowth, like the slab does
+		for (uint32_t c = slab.usedCopies; c < blas.copyRows.size(); ++c) {
+			const uint32_t row = blas.copyRows[c];
+			if (tlas.top.activeSlot[row] == ROW_INACTIVE) continue;
+			setRowActive(tlas.top, row, false);
+			res.removedRows.push_back(row);
+		}
+	}
+
+	res.topologyChanged = !res.addedRows.empty() || !res.removedRows.empty();
+	res.refitOnly = !moved.empty();
+	markRowsDirty(tlas.top, moved);
+	applySyncResult(tlas.top, res);
+}
+
+Frustum Visibility::transformFrustum(const Frustum& frus, const glm::mat4& modelToWorld, const glm::mat4& worldToModel) {
+	// Plane rows go through the transpose of the forward transform, then get normalized again
+	// so the sphere early out in boxInFrustum still measures distances
+	const glm::mat4 planeTransform = glm::transpose(modelToWorld);
+
+	Frustum out{};
+	for (int i = 0; i < 6; ++i) {
+		out.planes[i] = planeTransform * frus.planes[i];
+		out.planes[i] /= glm::length(glm::vec3(out.planes[i]));
+	}
+	for (int i = 0; i < 8; ++i)
+		out.points[i] = worldToModel * glm::vec4(glm::vec3(frus.points[i]), 1.0f);
+	return out;
+}
+
+void Visibility::cullTwoLevelCollect(
+	const SceneTLAS& tlas,
+	const VisibilityState& vs,
+	const Frustum& frus,
+	std::vector<GPUInstance>& visibleInstances,
+	std::vector<AABB>& visibleWorldAABBs,
+	TwoLevelCullScratch& scratch,
+	CullStats* stats)
+{
+	visibleInstances.clear();
+	visibleWorldAABBs.clear();
+
+	CullStats total{};
+	CullStats level{};
+	cullBVHCollect(tlas.top, frus, scratch.copies, scratch.copyBounds, &level);
+
+	auto add = [&total](const CullStats& s) {
+		total.nodesVisited += s.nodesVisited;
+		total.leavesTested += s.leavesTested;
+		total.leavesAccepted += s.leavesAccepted;
+		total.planeTests += s.planeTests;
+		total.subtreesAccepted += s.subtreesAccepted;
+	};
+	add(level);
+
+	for (const GPUInstance& copy : scratch.copies) {
+		const uint32_t row = copy.transformID;
+		const ModelBLAS& blas = tlas.models[tlas.rowModel[row]];
+		const Frustum local = transformFrustum(frus, tlas.modelToWorld[row], tlas.worldToModel[row]);
+
+		level = {};
+		cullBVHCollect(blas.tree, local, scratch.rows, scratch.rowBounds, &level);
+		add(level);
+
+		const uint32_t first = tlas.rowFirst[row];
+		for (const GPUInstance& prim : scratch.rows) {
+			visibleInstances.push_back(vs.instances[first + prim.transformID]);
+			visibleWorldAABBs.push_back(vs.worldAABBs[first + prim.transformID]);
+		}
+	}
+
+	if (stats) *stats = total;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Visibility.h"
+
+// Two-level tree over the same rows as VisibilityState. Every model gets one bottom-level tree
+// over its primitives in model space, the top level holds one row per copy with the copy's
+// transform. Adding or dropping a copy is one O(log copies) edit of the top level, the bottom
+// levels stay as they are. Both levels are VisibilityStates, so they build, edit and cull
+// through the same paths as the flat tree.
+//
+// Model space is the space of a copy's first primitive transform. Copies are placed as a
+// whole, so a primitive's transform relative to it is the same in every copy and copy 0's is
+// used for all of them. Dynamic models move parts on their own, their bottom level is refit
+// from copy 0 every sync.
+namespace Visibility {
+	// Rows are the model's primitives, worldAABBs hold model space bounds and
+	// instances[i].transformID the primitive's slot in the copy
+	struct ModelBLAS {
+		VisibilityState tree;
+		std::vector<uint32_t> copyRows; // top level row of every copy ever realized
+		uint32_t stride = 0;
+	};
+
+	struct SceneTLAS {
+		std::vector<ModelBLAS> models;
+		std::unordered_map<SceneID, uint32_t> modelIndex;
+
+		// Rows are copies, worldAABBs the model's bounds through the copy transform and
+		// instances[i].transformID the row itself
+		VisibilityState top;
+		// Parallel to top's rows
+		std::vector<uint32_t> rowModel;
+		std::vector<uint32_t> rowFirst; // VisibilityState row of the copy's first primitive
+		std::vector<uint32_t> rowTransform; // transformID the copy was last placed with
+		std::vector<glm::mat4> modelToWorld;
+		std::vector<glm::mat4> worldToModel;
+
+		inline void cleanup() {
+			models.clear();
+			modelIndex.clear();
+			top.cleanup();
+			rowModel.clear();
+			rowFirst.clear();
+			rowTransform.clear();
+			modelToWorld.clear();
+			worldToModel.clear();
+		}
+	};
+
+	// Lists reused between culls
+	struct TwoLevelCullScratch {
+		std::vector<GPUInstance> copies;
+		std::vector<AABB> copyBounds;
+		std::vector<GPUInstance> rows;
+		std::vector<AABB> rowBounds;
+	};
+
+	// Follows vs after syncFromGlobalInstances: builds the bottom level of new models, adds and
+	// drops copies in the top level and refits the copies that moved
+	void syncSceneTLAS(
+		SceneTLAS& tlas,
+		const VisibilityState& vs,
+		const std::vector<GlobalInstance>& gis,
+		const std::vector<GPUMeshData>& meshData,
+		const std::vector<glm::mat4>& transforms);
+
+	// Planes and corners of a world frustum in the space worldToModel maps into
+	Frustum transformFrustum(const Frustum& frus, const glm::mat4& modelToWorld, const glm::mat4& worldToModel);
+
+	// Walks the top level, then each visible copy's bottom level with the frustum in model space.
+	// Outputs vs's rows and world bounds. Primitives are tested as model space boxes instead of
+	// world AABBs, so rows at the frustum's edges can differ from the flat cull. Neither drops a
+	// row whose mesh bounds the frustum touches.
+	void cullTwoLevelCollect(
+		const SceneTLAS& tlas,
+		const VisibilityState& vs,
+		const Frustum& frus,
+		std::vector<GPUInstance>& visibleInstances,
+		std::vector<AABB>& visibleWorldAABBs,
+		TwoLevelCullScratch& scratch,
+		CullStats* stats = nullptr);
+}
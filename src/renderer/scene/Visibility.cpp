@@ -2,6 +2,10 @@
 
 #include "Visibility.h"
 #include "renderer/gpu/PipelineManager.h"
+#include "engine/JobSystem.h"
+#include "engine/platform/profiler/FrameCounters.h"
+
+#include <bit>
 
 namespace Visibility {
 	// === HELPERS ===
@@ -46,18 +50,122 @@ namespace Visibility {
 		std::vector<BVHNode>& nodes,
 		uint32_t first,
 		uint32_t count,
-		uint32_t maxLeaf = 8);
+		uint32_t maxLeaf = BVH_MAX_LEAF_ROWS);
+
+	struct SAHBuildContext {
+		const std::vector<AABB>& world;
+		std::vector<uint32_t>& leafIndex;
+		uint32_t maxLeaf = BVH_MAX_LEAF_ROWS;
+		uint32_t parallelRows = BVH_PARALLEL_SUBTREE_ROWS;
+	};
+
+	// Writes the subtree for leafIndex[first, first + count) into nodes in depth-first order,
+	// its root is the first node pushed. Large subtrees build into their own lists on workers
+	// and are spliced back in, so the layout is the same for any thread count.
+	static uint32_t buildBinnedSAHRecursive(
+		const SAHBuildContext& ctx,
+		std::vector<BVHNode>& nodes,
+		uint32_t first,
+		uint32_t count);
+
+	bool prefersLinearBuild(const VisibilityState& vs, const std::vector<uint32_t>& rows) {
+		if (vs.buildMode == BVHBuildMode::LBVH) return true;
+
+		uint32_t dynamicRows = 0;
+		for (uint32_t row : rows) {
+			const DrawType type = static_cast<DrawType>(vs.instances[row].drawType);
+			dynamicRows += (type == DrawType::DrawDynamic || type == DrawType::DrawMultiDynamic) ? 1u : 0u;
+		}
+		return static_cast<float>(dynamicRows) > static_cast<float>(rows.size()) * vs.lbvhDynamicFraction;
+	}
+
+	void buildBVHNodes(
+		const std::vector<AABB>& world,
+		std::vector<uint32_t>& leafIndex,
+		BVHBuildMode mode,
+		bool linear,
+		std::vector<BVHNode>& nodes)
+	{
+		const uint32_t count = static_cast<uint32_t>(leafIndex.size());
+		FrameCounters::add(FrameCounter::BVHRebuilds, 1);
+		if (linear) {
+			buildLBVH(world, leafIndex, nodes);
+		}
+		else if (mode == BVHBuildMode::BinnedSAH) {
+			const SAHBuildContext ctx{ world, leafIndex };
+			nodes.reserve(count);
+			buildBinnedSAHRecursive(ctx, nodes, 0u, count);
+		}
+		else {
+			buildMedianBVHRecursive(world, leafIndex, nodes, 0u, count);
+		}
+	}
 
 	void buildBVH(VisibilityState& vs) {
 		vs.leafIndex = vs.active; // copy active indices
 		vs.bvh.clear();
-		if (!vs.leafIndex.empty())
-			buildMedianBVHRecursive(
-				vs.worldAABBs,
-				vs.leafIndex,
-				vs.bvh,
-				0u,
-				static_cast<uint32_t>(vs.leafIndex.size()));
+		vs.builtLinear = false;
+		++vs.buildGeneration;
+
+		// A fresh build reads every row's bounds, nothing is left to refit
+		for (uint32_t row : vs.dirtyRows) vs.rowDirty[row] = 0;
+		vs.dirtyRows.clear();
+		vs.refitAll = false;
+		// and holds every live row
+		for (uint32_t row : vs.looseRows) vs.looseSlot[row] = ROW_INACTIVE;
+		vs.looseRows.clear();
+		if (vs.leafIndex.empty()) {
+			vs.leafBounds.clear();
+			vs.bvh4.clear();
+			vs.bvhParent.clear();
+			vs.rowLeaf.assign(vs.instances.size(), BVH_NO_NODE);
+			vs.freeNodes.clear();
+			vs.freeLeafSlots.clear();
+			return;
+		}
+
+		vs.builtLinear = prefersLinearBuild(vs, vs.leafIndex);
+		buildBVHNodes(vs.worldAABBs, vs.leafIndex, vs.buildMode, vs.builtLinear, vs.bvh);
+
+		linkBVH(vs);
+		gatherLeafBounds(vs);
+
+		vs.builtSAHCost = computeSAHCost(vs.bvh);
+		vs.editsSinceCheck = 0;
+		vs.refitsSinceCheck = 0;
+
+		if (vs.layout != BVHLayout::Binary)
+			buildBVH4(vs);
+		else
+			vs.bvh4.clear();
+	}
+
+	void linkBVH(VisibilityState& vs) {
+		vs.freeNodes.clear();
+		vs.freeLeafSlots.clear();
+		vs.bvhParent.assign(vs.bvh.size(), -1);
+		vs.rowLeaf.assign(vs.instances.size(), BVH_NO_NODE);
+
+		for (uint32_t n = 0; n < vs.bvh.size(); ++n) {
+			const BVHNode& node = vs.bvh[n];
+			if (node.count) {
+				for (uint32_t i = node.first; i < node.first + node.count; ++i)
+					vs.rowLeaf[vs.leafIndex[i]] = n;
+			}
+			else {
+				vs.bvhParent[node.left] = static_cast<int>(n);
+				vs.bvhParent[node.right] = static_cast<int>(n);
+			}
+		}
+	}
+
+	void gatherLeafBounds(VisibilityState& vs) {
+		const uint32_t count = static_cast<uint32_t>(vs.leafIndex.size());
+		if (vs.leafBounds.count != count)
+			vs.leafBounds.resize(count);
+
+		for (uint32_t i = 0; i < count; ++i)
+			vs.leafBounds.set(i, vs.worldAABBs[vs.leafIndex[i]]);
 	}
 
 	// === Visibility state creation, management and bvh setup. ===
@@ -87,33 +195,44 @@ namespace Visibility {
 	//	const std::vector<GPUMeshData>& meshData,
 	//	const std::vector<glm::mat4>& transforms);
 
-	//// Append ONLY newly-realized copies for a scene (multi draw slider increased).
-	//// Fills core rows, transformIDs, worldAABBs for the new range and activates them.
-	//// Returns the appended slice [outFirst, outFirst + outCount).
-	//static void appendSceneCopies(
-	//	VisibilityState& vs,
-	//	const GlobalInstance& gi,
-	//	uint32_t oldCopies,
-	//	const ModelAsset& asset,
-	//	const std::vector<GPUMeshData>& meshData,
-	//	const std::vector<glm::mat4>& transforms,
-	//	uint32_t& outFirst,
-	//	uint32_t& outCount);
+	// Realizes copies [slab.usedCopies, gi.usedCopies) for a scene (multi draw slider increased).
+	// Reuses rows of copies dropped earlier, new ones are appended. Fills rows, transformIDs and
+	// worldAABBs, activates them and lists them in addedRows. O(added rows).
+	static void appendSceneCopies(
+		VisibilityState& vs,
+		const GlobalInstance& gi,
+		const ModelAsset& asset,
+		const std::vector<GPUMeshData>& meshData,
+		const std::vector<glm::mat4>& transforms,
+		std::vector<uint32_t>& addedRows);
 
-	//// Lazy shrink (slider decreased). No memory reclamation; just reduce usedCopies
-	//// and rebuild the 'active' list. Call buildBVH() after this (topology changed).
-	//static void shrinkSceneCopiesLazy(VisibilityState& vs, SceneID sid, uint32_t newCopies);
+	// Lazy shrink (slider decreased). No memory reclamation, the dropped copies' rows are
+	// deactivated and listed in removedRows. O(removed rows).
+	static void shrinkSceneCopiesLazy(
+		VisibilityState& vs,
+		SceneID sid,
+		uint32_t newCopies,
+		std::vector<uint32_t>& removedRows);
 
-	//// Transform slab moved (firstTransform changed) but copy count is the same.
-	//// Rewrites the scene's slice with new transformIDs and worldAABBs. Then refitBVH().
-	//static void rewriteSceneSlice(
-	//	VisibilityState& vs,
-	//	const GlobalInstance& gi,
-	//	const ModelAsset& asset,
-	//	const std::vector<GPUMeshData>& meshData,
-	//	const std::vector<glm::mat4>& transforms);
+	// Transform slab moved (firstTransform changed) but copy count is the same.
+	// Rewrites the scene's rows with new transformIDs and worldAABBs. Then refitBVH().
+	static void rewriteSceneSlice(
+		VisibilityState& vs,
+		const GlobalInstance& gi,
+		const ModelAsset& asset,
+		const std::vector<GPUMeshData>& meshData,
+		const std::vector<glm::mat4>& transforms);
 
-	static void rebuildActive(VisibilityState& vs);
+	// Fills one row of a copy from the model's baked template
+	static void writeSceneRow(
+		VisibilityState& vs,
+		uint32_t row,
+		const GlobalInstance& gi,
+		const ModelAsset& asset,
+		uint32_t copy,
+		uint32_t local,
+		const std::vector<GPUMeshData>& meshData,
+		const std::vector<glm::mat4>& transforms);
 }
 
 
@@ -127,7 +246,6 @@ VisibilitySyncResult Visibility::syncFromGlobalInstances(
 	const std::vector<glm::mat4>& transforms)
 {
 	VisibilitySyncResult res{};
-	bool needRebuildActive = false;
 	bool anyRefit = false;
 
 	for (const GlobalInstance& gi : gis) {
@@ -144,7 +262,10 @@ VisibilitySyncResult Visibility::syncFromGlobalInstances(
 		if (slabIt == vs.slabs.end()) {
 			uint32_t f = 0, c = 0;
 			bakeCoreSceneMeshes(vs, gi, asset, meshData, transforms, f, c);
-			needRebuildActive = true;
+			for (uint32_t row = f; row < f + c; ++row) {
+				setRowActive(vs, row, true);
+				res.addedRows.push_back(row);
+			}
 			res.topologyChanged = true;
 			continue;
 		}
@@ -185,40 +306,58 @@ VisibilitySyncResult Visibility::syncFromGlobalInstances(
 		//	}
 		//}
 
-		//// New copies added
-		//if (gi.usedCopies > slab.usedCopies) {
-		//	const uint32_t oldCopies = slab.usedCopies;
-		//	uint32_t f = 0, c = 0;
-		//	appendSceneCopies(vs, gi, oldCopies, asset, meshData, transforms, f, c);
-		//	needRebuildActive = true;
-		//	res.topologyChanged = true;
-		//	continue;
-		//}
-		//// Copies reduced
-		//if (gi.usedCopies < slab.usedCopies) {
-		//	shrinkSceneCopiesLazy(vs, sid, gi.usedCopies);
-		//	needRebuildActive = false;
-		//	res.topologyChanged = true;
-		//	continue;
-		//}
+		const CoreSlab& slab = slabIt->second;
+
+		// Other models might've shifted this one's transforms, checked before any copies come
+		// or go so the surviving copies are rewritten too
+		if (slab.usedCopies > 0) {
+			const uint32_t nodeSlot = static_cast<uint32_t>(asset.runtime.localToNodeSlot[0]);
+			const uint32_t expectedFirstTID = transformIDFor(gi, 0, nodeSlot); // first copy, local = 0
+			const uint32_t haveFirstTID = vs.transformIDs[slab.copyFirst[0]];
+			if (haveFirstTID != expectedFirstTID) {
+				rewriteSceneSlice(vs, gi, asset, meshData, transforms);
+				anyRefit = true;
+			}
+		}
 
-		//// Nothing has changed, but other models might've shifted
-		//if (slab.usedCopies > 0) {
-		//	const uint32_t expectedFirstTID = gi.firstTransform; // first copy, local = 0
-		//	const uint32_t haveFirstTID = vs.instances[slab.first].transformID;
-		//	if (haveFirstTID != expectedFirstTID) {
-		//		rewriteSceneSlice(vs, gi, asset, meshData, transforms);
-		//		res.refitOnly = true;
-		//	}
-		//}
+		// New copies added
+		if (gi.usedCopies > slab.usedCopies) {
+			appendSceneCopies(vs, gi, asset, meshData, transforms, res.addedRows);
+			res.topologyChanged = true;
+		}
+		// Copies reduced
+		else if (gi.usedCopies < slab.usedCopies) {
+			shrinkSceneCopiesLazy(vs, sid, gi.usedCopies, res.removedRows);
+			res.topologyChanged = true;
+		}
 	}
 
-	if (needRebuildActive) rebuildActive(vs);
-
-	res.refitOnly = (!res.topologyChanged && anyRefit);
+	// Incremental edits don't see moved bounds, so a refit can ride along with them
+	res.refitOnly = anyRefit;
 	return res;
 }
 
+void Visibility::setRowActive(VisibilityState& vs, uint32_t row, bool active) {
+	if (vs.activeSlot.size() <= row)
+		vs.activeSlot.resize(vs.instances.size(), ROW_INACTIVE);
+
+	const uint32_t slot = vs.activeSlot[row];
+	if (active == (slot != ROW_INACTIVE)) return;
+
+	if (active) {
+		vs.activeSlot[row] = static_cast<uint32_t>(vs.active.size());
+		vs.active.push_back(row);
+		return;
+	}
+
+	// swap-remove, the last live row takes the freed slot
+	const uint32_t last = vs.active.back();
+	vs.active[slot] = last;
+	vs.activeSlot[last] = slot;
+	vs.active.pop_back();
+	vs.activeSlot[row] = ROW_INACTIVE;
+}
+
 void Visibility::bakeCoreSceneMeshes(
 	VisibilityState& vs,
 	const GlobalInstance& gi,
@@ -241,26 +380,43 @@ void Visibility::bakeCoreSceneMeshes(
 	vs.transformIDs.resize(newSize);
 	vs.worldAABBs.resize(newSize);
 
+	CoreSlab slab{ outFirst, stride, copies };
+	slab.copyFirst.reserve(copies);
+
 	uint32_t w = outFirst;
 	for (uint32_t c = 0; c < copies; ++c) {
+		slab.copyFirst.push_back(w);
 		for (uint32_t local = 0; local < stride; ++local, ++w) {
-			const GPUInstance& baked = *asset.runtime.bakedInstances[local];
+			writeSceneRow(vs, w, gi, asset, c, local, meshData, transforms);
+		}
+	}
+
+	vs.slabs[static_cast<SceneID>(gi.sceneID)] = std::move(slab);
+}
 
-			const uint32_t nodeSlot = static_cast<uint32_t>(asset.runtime.localToNodeSlot[local]);
-			const uint32_t tid = transformIDFor(gi, c, nodeSlot);
+void Visibility::writeSceneRow(
+	VisibilityState& vs,
+	uint32_t row,
+	const GlobalInstance& gi,
+	const ModelAsset& asset,
+	uint32_t copy,
+	uint32_t local,
+	const std::vector<GPUMeshData>& meshData,
+	const std::vector<glm::mat4>& transforms)
+{
+	const GPUInstance& baked = *asset.runtime.bakedInstances[local];
 
-			vs.instances[w] = makeRow(baked, tid, gi.drawType);
-			vs.transformIDs[w] = tid;
+	const uint32_t nodeSlot = static_cast<uint32_t>(asset.runtime.localToNodeSlot[local]);
+	const uint32_t tid = transformIDFor(gi, copy, nodeSlot);
 
-			const uint32_t meshID = baked.meshID;
-			ASSERT(meshID < meshData.size());
-			ASSERT(tid < transforms.size());
-			ASSERT(tid >= gi.firstTransform && tid < gi.firstTransform + gi.transformCount * gi.usedCopies);
-			vs.worldAABBs[w] = transformAABB(meshData[meshID].localAABB, transforms[tid]);
-		}
-	}
+	vs.instances[row] = makeRow(baked, tid, gi.drawType);
+	vs.transformIDs[row] = tid;
 
-	vs.slabs[static_cast<SceneID>(gi.sceneID)] = { outFirst, stride, copies };
+	const uint32_t meshID = baked.meshID;
+	ASSERT(meshID < meshData.size());
+	ASSERT(tid < transforms.size());
+	ASSERT(tid >= gi.firstTransform && tid < gi.firstTransform + gi.transformCount * gi.usedCopies);
+	vs.worldAABBs[row] = transformAABB(meshData[meshID].localAABB, transforms[tid]);
 }
 
 bool Visibility::updateWorldAABBsForDynamic(
@@ -279,116 +435,137 @@ bool Visibility::updateWorldAABBsForDynamic(
 	const CoreSlab& slab = it->second;
 	if (slab.usedCopies == 0) return false;
 
-	const uint32_t rowCount = slab.usedCopies * slab.stride;
-	uint32_t idx = slab.first;
+	// Baked copies sit back to back, they go through as one run
+	std::vector<RowRun> runs;
+	for (uint32_t c = 0; c < slab.usedCopies; ++c) {
+		const uint32_t first = slab.copyFirst[c];
+		if (!runs.empty() && runs.back().first + runs.back().count == first)
+			runs.back().count += slab.stride;
+		else
+			runs.push_back({ first, slab.stride });
+	}
 
-	for (uint32_t i = 0; i < rowCount; ++i, ++idx) {
-		const uint32_t meshID = vs.instances[idx].meshID;
-		const uint32_t tid = vs.transformIDs[idx];
+	updateWorldAABBs(vs, runs, meshData, transforms);
+	markRowsDirty(vs, runs);
+
+	return slab.stride > 0;
+}
+
+void Visibility::updateWorldAABBs(
+	VisibilityState& vs,
+	const std::vector<RowRun>& runs,
+	const std::vector<GPUMeshData>& meshData,
+	const std::vector<glm::mat4>& transforms)
+{
+	uint32_t total = 0;
+	for (const RowRun& run : runs) {
+		ASSERT(run.first + run.count <= vs.worldAABBs.size());
+		total += run.count;
+	}
 
-		ASSERT(meshID < meshData.size());
-		ASSERT(tid < transforms.size());
+	if (total < AABB_TRANSFORM_PARALLEL_ROWS || JobSystem::getThreadCount() < 2) {
+		for (const RowRun& run : runs) {
+			transformRowBounds(vs.instances.data(), vs.transformIDs.data(), meshData, transforms,
+				run.first, run.count, vs.worldAABBs.data(), vs.cullKernel);
+		}
+		return;
+	}
 
-		vs.worldAABBs[idx] = Visibility::transformAABB(
-			meshData[meshID].localAABB, transforms[tid]);
+	// Long runs are cut into chunks so one big slab still spreads over the workers
+	std::vector<RowRun> chunks;
+	for (const RowRun& run : runs) {
+		for (uint32_t off = 0; off < run.count; off += AABB_TRANSFORM_CHUNK_ROWS)
+			chunks.push_back({ run.first + off, std::min(AABB_TRANSFORM_CHUNK_ROWS, run.count - off) });
 	}
 
-	return rowCount > 0;
+	JobSystem::parallelFor(static_cast<uint32_t>(chunks.size()), 1, [&](uint32_t begin, uint32_t end, uint32_t) {
+		for (uint32_t i = begin; i < end; ++i) {
+			transformRowBounds(vs.instances.data(), vs.transformIDs.data(), meshData, transforms,
+				chunks[i].first, chunks[i].count, vs.worldAABBs.data(), vs.cullKernel);
+		}
+	});
 }
 
-//void Visibility::appendSceneCopies(
-//	VisibilityState& vs,
-//	const GlobalInstance& gi,
-//	uint32_t oldCopies,
-//	const ModelAsset& asset,
-//	const std::vector<GPUMeshData>& meshData,
-//	const std::vector<glm::mat4>& transforms,
-//	uint32_t& outFirst,
-//	uint32_t& outCount)
-//{
-//	const uint32_t stride = gi.perInstanceStride;
-//	const uint32_t newCopies = gi.usedCopies;
-//	if (newCopies <= oldCopies) { outFirst = outCount = 0; return; }
-//
-//	ASSERT(stride == asset.runtime.bakedInstances.size());
-//
-//	outFirst = static_cast<uint32_t>(vs.instances.size());
-//	outCount = (newCopies - oldCopies) * stride;
-//
-//	const size_t newSize = static_cast<size_t>(outFirst + outCount);
-//	vs.instances.resize(newSize);
-//	vs.transformIDs.resize(newSize);
-//	vs.worldAABBs.resize(newSize);
-//
-//	uint32_t w = outFirst;
-//	for (uint32_t c = oldCopies; c < newCopies; ++c) {
-//		for (uint32_t local = 0; local < stride; ++local, ++w) {
-//			const GPUInstance& baked = *asset.runtime.bakedInstances[local];
-//			const uint32_t nodeSlot = static_cast<uint32_t>(asset.runtime.localToNodeSlot[local]);
-//			const uint32_t tid = transformIDFor(gi, c, nodeSlot);
-//
-//			vs.instances[w] = makeRow(baked, tid, gi.drawType);
-//			vs.transformIDs[w] = tid;
-//
-//			const uint32_t meshID = baked.meshID;
-//			vs.worldAABBs[w] = transformAABB(meshData[meshID].localAABB, transforms[tid]);
-//		}
-//	}
-//
-//	auto& slab = vs.slabs.at(static_cast<SceneID>(gi.sceneID));
-//	slab.usedCopies = newCopies;
-//	slab.stride = stride;
-//}
-//
-//void Visibility::shrinkSceneCopiesLazy(VisibilityState& vs, SceneID sid, uint32_t newCopies) {
-//	auto it = vs.slabs.find(sid);
-//	if (it == vs.slabs.end()) return;
-//	it->second.usedCopies = newCopies; // keep memory; we just rebuild 'active'
-//	vs.active.clear();
-//	for (auto& [sid2, slab] : vs.slabs) {
-//		for (uint32_t c = 0; c < slab.usedCopies; ++c)
-//			for (uint32_t local = 0; local < slab.stride; ++local)
-//				vs.active.push_back(slab.first + c * slab.stride + local);
-//	}
-//}
+void Visibility::appendSceneCopies(
+	VisibilityState& vs,
+	const GlobalInstance& gi,
+	const ModelAsset& asset,
+	const std::vector<GPUMeshData>& meshData,
+	const std::vector<glm::mat4>& transforms,
+	std::vector<uint32_t>& addedRows)
+{
+	CoreSlab& slab = vs.slabs.at(static_cast<SceneID>(gi.sceneID));
+	const uint32_t stride = gi.perInstanceStride;
+	const uint32_t oldCopies = slab.usedCopies;
+	const uint32_t newCopies = gi.usedCopies;
+	if (newCopies <= oldCopies) return;
 
-//void Visibility::rewriteSceneSlice(
-//	VisibilityState& vs,
-//	const GlobalInstance& gi,
-//	const ModelAsset& asset,
-//	const std::vector<GPUMeshData>& meshData,
-//	const std::vector<glm::mat4>& transforms)
-//{
-//	auto it = vs.slabs.find(static_cast<SceneID>(gi.sceneID));
-//	if (it == vs.slabs.end()) return;
-//	const CoreSlab& slab = it->second;
-//
-//	uint32_t w = slab.first;
-//	for (uint32_t c = 0; c < slab.usedCopies; ++c) {
-//		for (uint32_t local = 0; local < slab.stride; ++local, ++w) {
-//			const GPUInstance& baked = *asset.runtime.bakedInstances[local];
-//			const uint32_t nodeSlot = static_cast<uint32_t>(asset.runtime.localToNodeSlot[local]);
-//			const uint32_t tid = transformIDFor(gi, c, nodeSlot);
-//
-//			vs.instances[w].transformID = tid; // keep mesh/material/pass as baked
-//			vs.transformIDs[w] = tid;
-//
-//			const uint32_t meshID = baked.meshID;
-//			vs.worldAABBs[w] = transformAABB(meshData[meshID].localAABB, transforms[tid]);
-//		}
-//	}
-//}
+	ASSERT(stride == asset.runtime.bakedInstances.size());
+	ASSERT(stride == slab.stride);
+
+	for (uint32_t c = oldCopies; c < newCopies; ++c) {
+		// rows left behind by an earlier shrink are rewritten, past that the arrays grow
+		if (c >= slab.copyFirst.size()) {
+			const uint32_t first = static_cast<uint32_t>(vs.instances.size());
+			const size_t newSize = static_cast<size_t>(first) + stride;
+			vs.instances.resize(newSize);
+			vs.transformIDs.resize(newSize);
+			vs.worldAABBs.resize(newSize);
+			slab.copyFirst.push_back(first);
+		}
 
-void Visibility::rebuildActive(VisibilityState& vs) {
-	vs.active.clear();
-	for (auto& [sid, slab] : vs.slabs) {
-		const uint32_t stride = slab.stride;
-		for (uint32_t c = 0; c < slab.usedCopies; ++c) {
-			for (uint32_t local = 0; local < stride; ++local) {
-				vs.active.push_back(slab.first + c * stride + local);
-			}
+		const uint32_t first = slab.copyFirst[c];
+		for (uint32_t local = 0; local < stride; ++local) {
+			writeSceneRow(vs, first + local, gi, asset, c, local, meshData, transforms);
+			setRowActive(vs, first + local, true);
+			addedRows.push_back(first + local);
 		}
 	}
+
+	slab.usedCopies = newCopies;
+}
+
+void Visibility::shrinkSceneCopiesLazy(
+	VisibilityState& vs,
+	SceneID sid,
+	uint32_t newCopies,
+	std::vector<uint32_t>& removedRows)
+{
+	auto it = vs.slabs.find(sid);
+	if (it == vs.slabs.end()) return;
+
+	CoreSlab& slab = it->second;
+	for (uint32_t c = newCopies; c < slab.usedCopies; ++c) {
+		const uint32_t first = slab.copyFirst[c];
+		for (uint32_t row = first; row < first + slab.stride; ++row) {
+			setRowActive(vs, row, false);
+			removedRows.push_back(row);
+		}
+	}
+
+	slab.usedCopies = newCopies; // keep memory, rows come back on regrow
+}
+
+void Visibility::rewriteSceneSlice(
+	VisibilityState& vs,
+	const GlobalInstance& gi,
+	const ModelAsset& asset,
+	const std::vector<GPUMeshData>& meshData,
+	const std::vector<glm::mat4>& transforms)
+{
+	auto it = vs.slabs.find(static_cast<SceneID>(gi.sceneID));
+	if (it == vs.slabs.end()) return;
+	const CoreSlab& slab = it->second;
+
+	std::vector<RowRun> runs;
+	for (uint32_t c = 0; c < slab.usedCopies; ++c) {
+		const uint32_t first = slab.copyFirst[c];
+		for (uint32_t local = 0; local < slab.stride; ++local) {
+			writeSceneRow(vs, first + local, gi, asset, c, local, meshData, transforms);
+		}
+		runs.push_back({ first, slab.stride });
+	}
+	markRowsDirty(vs, runs);
 }
 
 //void Visibility::recomputeWorldRanges(
@@ -412,48 +589,616 @@ void Visibility::rebuildActive(VisibilityState& vs) {
 
 // === TREE SETUP ====
 
+// True when all 8 frustum corners lie past one face of the box, catches big boxes the planes miss
+static bool cornersRejectBox(const AABB& box, const Frustum& fru) {
+	for (int axis = 0; axis < 3; ++axis) {
+		int above = 0, below = 0;
+		for (int i = 0; i < 8; i++) {
+			above += (fru.points[i][axis] > box.vmax[axis]) ? 1 : 0;
+			below += (fru.points[i][axis] < box.vmin[axis]) ? 1 : 0;
+		}
+		if (above == 8 || below == 8) return true;
+	}
+	return false;
+}
+
+enum class PlaneClass : uint8_t { Outside, Straddles, Inside };
+
+// boxInFrustum's plane loop restricted to the planes set in mask, clears the planes the box is
+// fully inside. The plane that last rejected this node goes first.
+static PlaneClass classifyPlanes(const AABB& box, const Frustum& fru, uint8_t& mask, uint8_t* failedPlane, uint32_t& planeTests) {
+	const glm::vec3 center = (box.vmax + box.vmin) * 0.5f;
+	const glm::vec3 extents = (box.vmax - box.vmin) * 0.5f;
+	const float safeRadius = glm::max(box.sphereRadius, box.sphereRadius * 0.01f);
+
+	const uint32_t start = (failedPlane && *failedPlane < 6) ? *failedPlane : 0u;
+	for (uint32_t k = 0; k < 6; ++k) {
+		const uint32_t i = (start + k) % 6;
+		if (!(mask & (1u << i))) continue;
+		++planeTests;
+
+		const glm::vec3 normal = glm::vec3(fru.planes[i]);
+		const float dist = glm::dot(normal, center) + fru.planes[i].w;
+		const float r =
+			extents.x * abs(normal.x) +
+			extents.y * abs(normal.y) +
+			extents.z * abs(normal.z);
+
+		if (dist < -safeRadius || dist + r < 0.0f) {
+			if (failedPlane) *failedPlane = static_cast<uint8_t>(i);
+			return PlaneClass::Outside;
+		}
+		if (dist - r >= 0.0f) mask &= ~static_cast<uint8_t>(1u << i);
+	}
+
+	return mask ? PlaneClass::Straddles : PlaneClass::Inside;
+}
+
+// Node test for the walks below. A box inside every plane can't be rejected by the frustum
+// corners either, so only straddling boxes pay for the corner checks.
+static PlaneClass classifyNode(const AABB& box, const Frustum& fru, bool planeMasks, uint8_t& mask, uint8_t* failedPlane, uint32_t& planeTests) {
+	if (!planeMasks) {
+		mask = Visibility::FRUSTUM_ALL_PLANES;
+		failedPlane = nullptr;
+	}
+
+	const PlaneClass c = classifyPlanes(box, fru, mask, failedPlane, planeTests);
+	if (c == PlaneClass::Straddles && cornersRejectBox(box, fru)) return PlaneClass::Outside;
+	if (!planeMasks && c == PlaneClass::Inside) return PlaneClass::Straddles;
+	return c;
+}
+
+struct CullStackEntry {
+	uint32_t node;
+	uint8_t mask; // planes the node's parent straddled
+};
+
+// Where the walks below put a visible row, copies of its instance and bounds or just its index
+struct InstanceSink {
+	std::vector<GPUInstance>& instances;
+	std::vector<AABB>& worldAABBs;
+
+	inline void emit(const Visibility::VisibilityState& vs, uint32_t row) {
+		worldAABBs.push_back(vs.worldAABBs[row]);
+		instances.push_back(vs.instances[row]);
+	}
+};
+
+struct RowSink {
+	std::vector<uint32_t>& rows;
+
+	inline void emit(const Visibility::VisibilityState&, uint32_t row) { rows.push_back(row); }
+};
+
+// Appends every row under a subtree, no tests
+template<typename Sink>
+static void emitSubtree(
+	const Visibility::VisibilityState& vs,
+	uint32_t root,
+	Sink& sink,
+	std::vector<CullStackEntry>& stack,
+	Visibility::CullStats& stats)
+{
+	const size_t base = stack.size();
+	stack.push_back({ root, 0 });
+
+	while (stack.size() > base) {
+		const uint32_t ni = stack.back().node;
+		stack.pop_back();
+		const Visibility::BVHNode& node = vs.bvh[ni];
+
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i)
+				sink.emit(vs, vs.leafIndex[i]);
+			stats.leavesAccepted += node.count;
+		}
+		else {
+			stack.push_back({ static_cast<uint32_t>(node.left), 0 });
+			stack.push_back({ static_cast<uint32_t>(node.right), 0 });
+		}
+	}
+}
+
+// Depth-first walk of one subtree, appends visible rows in the same order a full walk visits them.
+// Shared by the serial cull and the parallel tasks so both produce identical lists.
+template<typename Sink>
+static void cullSubtree(
+	const Visibility::VisibilityState& vs,
+	const Frustum& frus,
+	const Visibility::CullFrustum& cullFrus,
+	uint32_t root,
+	uint8_t rootMask,
+	uint8_t* failedPlane,
+	Sink& sink,
+	std::vector<CullStackEntry>& stack,
+	std::vector<uint32_t>& accepted,
+	Visibility::CullStats& stats)
+{
+	stack.clear();
+	stack.push_back({ root, rootMask });
+
+	while (!stack.empty()) {
+		const auto [ni, parentMask] = stack.back();
+		stack.pop_back();
+		const Visibility::BVHNode& node = vs.bvh[ni];
+		++stats.nodesVisited;
+
+		uint8_t mask = parentMask;
+		const PlaneClass c = classifyNode(node.box, frus, vs.planeMasks, mask,
+			failedPlane ? failedPlane + ni : nullptr, stats.planeTests);
+		if (c == PlaneClass::Outside) continue;
+
+		if (c == PlaneClass::Inside) {
+			++stats.subtreesAccepted;
+			emitSubtree(vs, ni, sink, stack, stats);
+			continue;
+		}
+
+		if (node.count) {
+			// Rows go through the exact kernel, which always tests all 6 planes
+			stats.leavesTested += node.count;
+			stats.planeTests += 6u * node.count;
+			if (accepted.size() < node.count) accepted.resize(node.count);
+
+			const uint32_t passed = Visibility::cullBounds(vs.leafBounds, node.first, node.count, cullFrus, vs.cullKernel, accepted.data());
+			for (uint32_t i = 0; i < passed; ++i)
+				sink.emit(vs, vs.leafIndex[accepted[i]]);
+			stats.leavesAccepted += passed;
+		}
+		else {
+			stack.push_back({ static_cast<uint32_t>(node.left), mask });
+			stack.push_back({ static_cast<uint32_t>(node.right), mask });
+		}
+	}
+}
+
+// Sizes the per-node plane hints to the current tree, a rebuilt tree just starts from stale hints
+static uint8_t* failedPlaneHints(const Visibility::VisibilityState& vs, Visibility::CullScratch* scratch) {
+	if (!scratch || !vs.planeMasks) return nullptr;
+	if (scratch->failedPlane.size() != vs.bvh.size())
+		scratch->failedPlane.assign(vs.bvh.size(), Visibility::PLANE_NONE);
+	return scratch->failedPlane.data();
+}
+
+void Visibility::countCullStats(const CullStats& stats) {
+	FrameCounters::add(FrameCounter::CullNodesVisited, stats.nodesVisited);
+	FrameCounters::add(FrameCounter::CullPlaneTests, stats.planeTests);
+	FrameCounters::add(FrameCounter::CullLeavesTested, stats.leavesTested);
+	FrameCounters::add(FrameCounter::CullLeavesAccepted, stats.leavesAccepted);
+}
+
+template<typename Sink>
+static void cullLoose(const Visibility::VisibilityState& vs, const Frustum& frus, Sink& sink, Visibility::CullStats* stats) {
+	if (vs.looseRows.empty()) return;
+
+	Visibility::CullStats local{};
+	for (uint32_t row : vs.looseRows) {
+		if (!Visibility::boxInFrustum(vs.worldAABBs[row], frus)) continue;
+		sink.emit(vs, row);
+		++local.leavesAccepted;
+	}
+	local.leavesTested = static_cast<uint32_t>(vs.looseRows.size());
+	local.planeTests = 6u * local.leavesTested;
+	Visibility::countCullStats(local);
+
+	if (!stats) return;
+	stats->leavesTested += local.leavesTested;
+	stats->planeTests += local.planeTests;
+	stats->leavesAccepted += local.leavesAccepted;
+}
+
+void Visibility::cullLooseRows(
+	const VisibilityState& vs,
+	const Frustum& frus,
+	std::vector<GPUInstance>& visibleInstances,
+	std::vector<AABB>& visibleWorldAABBs,
+	CullStats* stats)
+{
+	InstanceSink sink{ visibleInstances, visibleWorldAABBs };
+	cullLoose(vs, frus, sink, stats);
+}
+
 // Walk the BVH, cull and emit visible rows.
 void Visibility::cullBVHCollect(
 	const VisibilityState& vs,
 	const Frustum& frus,
 	std::vector<GPUInstance>& visibleInstances,
-	std::vector<AABB>& visibleWorldAABBs)
+	std::vector<AABB>& visibleWorldAABBs,
+	CullStats* stats,
+	CullScratch* scratch)
 {
+	if (walksBVH4(vs)) {
+		cullBVH4Collect(vs, frus, visibleInstances, visibleWorldAABBs, stats);
+		cullLooseRows(vs, frus, visibleInstances, visibleWorldAABBs, stats);
+		return;
+	}
+
 	visibleInstances.clear();
 	visibleWorldAABBs.clear();
-	if (vs.bvh.empty()) return;
+	if (vs.bvh.empty()) {
+		cullLooseRows(vs, frus, visibleInstances, visibleWorldAABBs, stats);
+		return;
+	}
+
+	CullStats local{};
 
 	visibleInstances.reserve(vs.active.size());
 	visibleWorldAABBs.reserve(vs.active.size());
 
-	std::vector<uint32_t> stack;
+	const CullFrustum cullFrus = prepareCullFrustum(frus);
+	std::vector<uint32_t> accepted(BVH_MAX_LEAF_ROWS);
+	std::vector<CullStackEntry> stack;
 	stack.reserve(128);
-	stack.push_back(0u); // root
+
+	InstanceSink sink{ visibleInstances, visibleWorldAABBs };
+	cullSubtree(vs, frus, cullFrus, 0u, FRUSTUM_ALL_PLANES, failedPlaneHints(vs, scratch),
+		sink, stack, accepted, local);
+	countCullStats(local);
+	cullLooseRows(vs, frus, visibleInstances, visibleWorldAABBs, &local);
+
+	if (stats) *stats = local;
+}
+
+void Visibility::cullBVHCollectRows(
+	const VisibilityState& vs,
+	const Frustum& frus,
+	std::vector<uint32_t>& visibleRows,
+	CullStats* stats,
+	CullScratch* scratch)
+{
+	visibleRows.clear();
+	RowSink sink{ visibleRows };
+	CullStats local{};
+
+	if (!vs.bvh.empty()) {
+		visibleRows.reserve(vs.active.size());
+
+		const CullFrustum cullFrus = prepareCullFrustum(frus);
+		std::vector<uint32_t> accepted(BVH_MAX_LEAF_ROWS);
+		std::vector<CullStackEntry> stack;
+		stack.reserve(128);
+
+		cullSubtree(vs, frus, cullFrus, 0u, FRUSTUM_ALL_PLANES, failedPlaneHints(vs, scratch),
+			sink, stack, accepted, local);
+		countCullStats(local);
+	}
+	cullLoose(vs, frus, sink, &local);
+
+	if (stats) *stats = local;
+}
+
+struct MultiCullStackEntry {
+	uint32_t node;
+	uint8_t straddling; // views the parent was partly inside
+	uint8_t inside;     // views the parent was fully inside, nothing below is tested for them
+	uint8_t masks[Visibility::MAX_CULL_VIEWS];
+};
+
+// Every row under a subtree with the same view bits, no tests
+static void emitSubtreeMulti(
+	const Visibility::VisibilityState& vs,
+	uint32_t root,
+	uint8_t views,
+	Visibility::MultiViewCullResult& out,
+	std::vector<MultiCullStackEntry>& stack,
+	Visibility::CullStats& stats)
+{
+	const size_t base = stack.size();
+	stack.push_back({ root, 0, 0, {} });
+
+	while (stack.size() > base) {
+		const uint32_t ni = stack.back().node;
+		stack.pop_back();
+		const Visibility::BVHNode& node = vs.bvh[ni];
+
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				const uint32_t idx = vs.leafIndex[i];
+				out.worldAABBs.push_back(vs.worldAABBs[idx]);
+				out.instances.push_back(vs.instances[idx]);
+				out.viewMasks.push_back(views);
+			}
+			stats.leavesAccepted += node.count;
+		}
+		else {
+			stack.push_back({ static_cast<uint32_t>(node.left), 0, 0, {} });
+			stack.push_back({ static_cast<uint32_t>(node.right), 0, 0, {} });
+		}
+	}
+}
+
+// One walk for every view. Each view keeps its own plane mask and gets the same classification
+// as cullSubtree, so its rows come out the same and in the same order. Node planes are tested
+// for all views together, four views per instruction.
+// A node is only dropped once no view reaches it.
+void Visibility::cullBVHCollectMulti(
+	const VisibilityState& vs,
+	const Frustum* frustums,
+	uint32_t viewCount,
+	MultiViewCullResult& out,
+	CullStats* stats)
+{
+	ASSERT(viewCount > 0 && viewCount <= MAX_CULL_VIEWS);
+
+	out.clear();
+	out.viewCount = viewCount;
+	if (vs.bvh.empty()) return;
+
+	CullStats local{};
+
+	out.instances.reserve(vs.active.size());
+	out.worldAABBs.reserve(vs.active.size());
+	out.viewMasks.reserve(vs.active.size());
+
+	// Box around every view's corners, a node past it is outside them all after one compare
+	CullFrustum cullFrus[MAX_CULL_VIEWS];
+	glm::vec3 unionMin(std::numeric_limits<float>::max()), unionMax(-std::numeric_limits<float>::max());
+	for (uint32_t v = 0; v < viewCount; ++v) {
+		cullFrus[v] = prepareCullFrustum(frustums[v]);
+		unionMin = glm::min(unionMin, cullFrus[v].pointMin);
+		unionMax = glm::max(unionMax, cullFrus[v].pointMax);
+	}
+	const MultiCullFrustum multiFrus = prepareMultiCullFrustum(frustums, viewCount);
+
+	std::vector<uint32_t> accepted(BVH_MAX_LEAF_ROWS);
+	std::vector<uint8_t> rowViews(BVH_MAX_LEAF_ROWS);
+	std::vector<MultiCullStackEntry> stack;
+	stack.reserve(128);
+
+	MultiCullStackEntry root{ 0u, static_cast<uint8_t>((1u << viewCount) - 1u), 0, {} };
+	std::fill(std::begin(root.masks), std::end(root.masks), FRUSTUM_ALL_PLANES);
+	stack.push_back(root);
 
 	while (!stack.empty()) {
-		const uint32_t ni = stack.back();
+		MultiCullStackEntry e = stack.back();
 		stack.pop_back();
-		const BVHNode& node = vs.bvh[ni];
+		const BVHNode& node = vs.bvh[e.node];
+		++local.nodesVisited;
+
+		// A view the parent was inside overlaps its own corner box, so this never drops one
+		if (!e.inside && (glm::any(glm::greaterThan(unionMin, node.box.vmax)) ||
+			glm::any(glm::lessThan(unionMax, node.box.vmin))))
+			continue;
 
-		if (!boxInFrustum(node.box, frus)) continue;
+		// Every plane of every view in one go, then classifyNode's outcome per straddling view
+		uint8_t planeOutside[6], planeInside[6];
+		classifyBoxMulti(node.box, multiFrus, planeOutside, planeInside);
+
+		uint8_t straddling = 0;
+		for (uint32_t bits = e.straddling; bits; bits &= bits - 1u) {
+			const uint32_t v = static_cast<uint32_t>(std::countr_zero(bits));
+			const uint8_t mask = vs.planeMasks ? e.masks[v] : FRUSTUM_ALL_PLANES;
+			local.planeTests += static_cast<uint32_t>(std::popcount(mask));
+
+			uint8_t outsideMask = 0, insideMask = 0;
+			for (int p = 0; p < 6; ++p) {
+				outsideMask |= static_cast<uint8_t>(((planeOutside[p] >> v) & 1u) << p);
+				insideMask |= static_cast<uint8_t>(((planeInside[p] >> v) & 1u) << p);
+			}
+			if (mask & outsideMask) continue;
+
+			const uint8_t left = mask & ~insideMask;
+			if (left) {
+				if (cornersRejectBox(node.box, frustums[v])) continue;
+				straddling |= static_cast<uint8_t>(1u << v);
+			}
+			else if (vs.planeMasks) {
+				e.inside |= static_cast<uint8_t>(1u << v);
+			}
+			else {
+				straddling |= static_cast<uint8_t>(1u << v);
+			}
+			e.masks[v] = left;
+		}
+
+		if (!straddling && !e.inside) continue;
+
+		if (!straddling) {
+			++local.subtreesAccepted;
+			emitSubtreeMulti(vs, e.node, e.inside, out, stack, local);
+			continue;
+		}
 
 		if (node.count) {
-			const uint32_t first = node.first;
-			const uint32_t last = first + node.count;
-			for (uint32_t i = first; i < last; ++i) {
-				const uint32_t idx = vs.leafIndex[i];
-				const AABB& wb = vs.worldAABBs[idx];
-				if (!boxInFrustum(wb, frus)) continue;
+			// Rows go through the exact kernel once per view still straddling
+			if (accepted.size() < node.count) {
+				accepted.resize(node.count);
+				rowViews.resize(node.count);
+			}
+			std::fill(rowViews.begin(), rowViews.begin() + node.count, e.inside);
+
+			for (uint32_t bits = straddling; bits; bits &= bits - 1u) {
+				const uint32_t v = static_cast<uint32_t>(std::countr_zero(bits));
+				local.leavesTested += node.count;
+				local.planeTests += 6u * node.count;
+
+				const uint32_t passed = cullBounds(vs.leafBounds, node.first, node.count, cullFrus[v], vs.cullKernel, accepted.data());
+				for (uint32_t i = 0; i < passed; ++i)
+					rowViews[accepted[i] - node.first] |= static_cast<uint8_t>(1u << v);
+			}
 
-				visibleWorldAABBs.push_back(wb);
-				visibleInstances.push_back(vs.instances[idx]);
+			for (uint32_t i = 0; i < node.count; ++i) {
+				if (!rowViews[i]) continue;
+				const uint32_t idx = vs.leafIndex[node.first + i];
+				out.worldAABBs.push_back(vs.worldAABBs[idx]);
+				out.instances.push_back(vs.instances[idx]);
+				out.viewMasks.push_back(rowViews[i]);
+				++local.leavesAccepted;
 			}
 		}
 		else {
-			stack.push_back(static_cast<uint32_t>(node.left));
-			stack.push_back(static_cast<uint32_t>(node.right));
+			e.straddling = straddling;
+			e.node = static_cast<uint32_t>(node.left);
+			stack.push_back(e);
+			e.node = static_cast<uint32_t>(node.right);
+			stack.push_back(e);
+		}
+	}
+
+	// Loose rows, each against every view
+	for (uint32_t row : vs.looseRows) {
+		uint8_t views = 0;
+		for (uint32_t v = 0; v < viewCount; ++v)
+			views |= boxInFrustum(vs.worldAABBs[row], frustums[v]) ? static_cast<uint8_t>(1u << v) : 0u;
+		local.leavesTested += viewCount;
+		local.planeTests += 6u * viewCount;
+		if (!views) continue;
+		out.worldAABBs.push_back(vs.worldAABBs[row]);
+		out.instances.push_back(vs.instances[row]);
+		out.viewMasks.push_back(views);
+		++local.leavesAccepted;
+	}
+
+	for (uint8_t views : out.viewMasks)
+		for (uint32_t bits = views; bits; bits &= bits - 1u)
+			++out.viewRowCounts[std::countr_zero(bits)];
+
+	countCullStats(local);
+	if (stats) *stats = local;
+}
+
+void Visibility::extractView(
+	const MultiViewCullResult& result,
+	uint32_t view,
+	std::vector<GPUInstance>& visibleInstances,
+	std::vector<AABB>& visibleWorldAABBs)
+{
+	ASSERT(view < result.viewCount);
+
+	visibleInstances.clear();
+	visibleWorldAABBs.clear();
+	visibleInstances.reserve(result.viewRowCounts[view]);
+	visibleWorldAABBs.reserve(result.viewRowCounts[view]);
+
+	const uint8_t bit = static_cast<uint8_t>(1u << view);
+	for (size_t i = 0; i < result.viewMasks.size(); ++i) {
+		if (!(result.viewMasks[i] & bit)) continue;
+		visibleInstances.push_back(result.instances[i]);
+		visibleWorldAABBs.push_back(result.worldAABBs[i]);
+	}
+}
+
+// Same result as cullBVHCollect. The top of the tree is walked on the calling thread down to a
+// frontier of subtrees, each subtree is culled by a JobSystem task into its own lists, and the
+// lists are joined in frontier order, which is the order the serial walk reaches them in.
+void Visibility::cullBVHCollectParallel(
+	const VisibilityState& vs,
+	const Frustum& frus,
+	std::vector<GPUInstance>& visibleInstances,
+	std::vector<AABB>& visibleWorldAABBs,
+	CullScratch& scratch,
+	CullStats* stats)
+{
+	const uint32_t threads = JobSystem::getThreadCount();
+	// The 4-wide walk is stackless and serial, only the binary tree splits into tasks
+	if (threads == 1 || vs.active.size() < BVH_PARALLEL_CULL_MIN_ROWS || walksBVH4(vs)) {
+		cullBVHCollect(vs, frus, visibleInstances, visibleWorldAABBs, stats, &scratch);
+		return;
+	}
+
+	visibleInstances.clear();
+	visibleWorldAABBs.clear();
+
+	CullStats local{};
+	uint8_t* failedPlane = failedPlaneHints(vs, &scratch);
+
+	// A few subtrees per thread keeps workers busy when the frustum only reaches part of the tree
+	const uint32_t frontierDepth = std::clamp(
+		static_cast<uint32_t>(std::bit_width(threads * 4u - 1u)),
+		BVH_PARALLEL_CULL_MIN_DEPTH,
+		BVH_PARALLEL_CULL_MAX_DEPTH);
+
+	// Collect the frontier, nodes above it are tested here, frontier roots are left to the tasks
+	scratch.frontier.clear();
+	scratch.frontierMasks.clear();
+	struct TopEntry { uint32_t node, depth; uint8_t mask; };
+	std::vector<TopEntry> stack;
+	stack.push_back({ 0u, 0u, FRUSTUM_ALL_PLANES });
+
+	while (!stack.empty()) {
+		const TopEntry e = stack.back();
+		stack.pop_back();
+		const BVHNode& node = vs.bvh[e.node];
+
+		if (node.count || e.depth == frontierDepth) {
+			scratch.frontier.push_back(e.node);
+			scratch.frontierMasks.push_back(e.mask);
+			continue;
+		}
+
+		uint8_t mask = e.mask;
+		const PlaneClass c = classifyNode(node.box, frus, vs.planeMasks, mask,
+			failedPlane ? failedPlane + e.node : nullptr, local.planeTests);
+		if (c == PlaneClass::Outside) {
+			++local.nodesVisited;
+			continue;
+		}
+
+		// Fully inside subtrees are frontier roots too, their task emits them without tests and
+		// counts the visit
+		if (c == PlaneClass::Inside) {
+			scratch.frontier.push_back(e.node);
+			scratch.frontierMasks.push_back(0);
+			continue;
+		}
+
+		++local.nodesVisited;
+
+		stack.push_back({ static_cast<uint32_t>(node.left), e.depth + 1, mask });
+		stack.push_back({ static_cast<uint32_t>(node.right), e.depth + 1, mask });
+	}
+
+	countCullStats(local);
+
+	const uint32_t taskCount = static_cast<uint32_t>(scratch.frontier.size());
+	if (scratch.tasks.size() < taskCount) scratch.tasks.resize(taskCount);
+
+	const CullFrustum cullFrus = prepareCullFrustum(frus);
+
+	JobSystem::parallelFor(taskCount, 1, [&](uint32_t begin, uint32_t end, uint32_t) {
+		std::vector<CullStackEntry> taskStack;
+		taskStack.reserve(64);
+		std::vector<uint32_t> accepted(BVH_MAX_LEAF_ROWS);
+
+		for (uint32_t t = begin; t < end; ++t) {
+			CullScratch::TaskOutput& out = scratch.tasks[t];
+			out.instances.clear();
+			out.worldAABBs.clear();
+			out.stats = {};
+			InstanceSink sink{ out.instances, out.worldAABBs };
+			cullSubtree(vs, frus, cullFrus, scratch.frontier[t], scratch.frontierMasks[t], failedPlane,
+				sink, taskStack, accepted, out.stats);
+			countCullStats(out.stats);
 		}
+	});
+
+	// Prefix sum over the task lists gives every task its slice of the output
+	scratch.offsets.resize(taskCount + 1);
+	scratch.offsets[0] = 0;
+	for (uint32_t t = 0; t < taskCount; ++t) {
+		const CullScratch::TaskOutput& out = scratch.tasks[t];
+		scratch.offsets[t + 1] = scratch.offsets[t] + static_cast<uint32_t>(out.instances.size());
+
+		local.nodesVisited += out.stats.nodesVisited;
+		local.leavesTested += out.stats.leavesTested;
+		local.leavesAccepted += out.stats.leavesAccepted;
+		local.planeTests += out.stats.planeTests;
+		local.subtreesAccepted += out.stats.subtreesAccepted;
 	}
+
+	visibleInstances.resize(scratch.offsets[taskCount]);
+	visibleWorldAABBs.resize(scratch.offsets[taskCount]);
+
+	JobSystem::parallelFor(taskCount, 1, [&](uint32_t begin, uint32_t end, uint32_t) {
+		for (uint32_t t = begin; t < end; ++t) {
+			const CullScratch::TaskOutput& out = scratch.tasks[t];
+			std::copy(out.instances.begin(), out.instances.end(), visibleInstances.begin() + scratch.offsets[t]);
+			std::copy(out.worldAABBs.begin(), out.worldAABBs.end(), visibleWorldAABBs.begin() + scratch.offsets[t]);
+		}
+	});
+	cullLooseRows(vs, frus, visibleInstances, visibleWorldAABBs, &local);
+
+	if (stats) *stats = local;
 }
 
 uint32_t Visibility::buildMedianBVHRecursive(
@@ -516,6 +1261,211 @@ uint32_t Visibility::buildMedianBVHRecursive(
 	return idx;
 }
 
+// Binned SAH: centroids are dropped into BVH_SAH_BIN_COUNT buckets per axis and the
+// cheapest bucket boundary over all three axes becomes the split plane.
+uint32_t Visibility::buildBinnedSAHRecursive(
+	const SAHBuildContext& ctx,
+	std::vector<BVHNode>& nodes,
+	uint32_t first,
+	uint32_t count)
+{
+	const std::vector<AABB>& world = ctx.world;
+	std::vector<uint32_t>& leafIndex = ctx.leafIndex;
+
+	AABB nodeB{};
+	nodeB.vmin = glm::vec3(1e30f);
+	nodeB.vmax = glm::vec3(-1e30f);
+	glm::vec3 cmin(1e30f), cmax(-1e30f);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		const AABB& a = world[leafIndex[first + i]];
+		growMinMax(nodeB, a);
+		cmin = glm::min(cmin, centerOf(a));
+		cmax = glm::max(cmax, centerOf(a));
+	}
+	finalizeFromMinMax(nodeB);
+
+	const uint32_t idx = static_cast<uint32_t>(nodes.size());
+	nodes.push_back(BVHNode{});
+	nodes[idx].box = nodeB;
+
+	auto makeLeaf = [&]() {
+		nodes[idx].first = first;
+		nodes[idx].count = static_cast<uint16_t>(count);
+		return idx;
+	};
+
+	// Row tests cost about the same as node tests while culling, so a leaf keeps up to
+	// maxLeaf rows instead of letting the SAH split down to single rows
+	if (count <= ctx.maxLeaf) return makeLeaf();
+
+	constexpr uint32_t BINS = BVH_SAH_BIN_COUNT;
+	struct Bin {
+		glm::vec3 vmin{ 1e30f };
+		glm::vec3 vmax{ -1e30f };
+		uint32_t count = 0;
+	};
+
+	const glm::vec3 cExt = cmax - cmin;
+	glm::vec3 binScale{};
+	for (int a = 0; a < 3; ++a)
+		binScale[a] = (cExt[a] > 1e-6f) ? (static_cast<float>(BINS) * 0.9999f) / cExt[a] : 0.0f;
+
+	auto binOf = [&](const AABB& a, int axis) {
+		const float b = (centerOf(a)[axis] - cmin[axis]) * binScale[axis];
+		return std::min(static_cast<uint32_t>(b), BINS - 1);
+	};
+
+	// Fill all three axes in one pass over the rows
+	Bin bins[3][BINS];
+	for (uint32_t i = 0; i < count; ++i) {
+		const AABB& a = world[leafIndex[first + i]];
+		for (int axis = 0; axis < 3; ++axis) {
+			if (binScale[axis] == 0.0f) continue;
+			Bin& bin = bins[axis][binOf(a, axis)];
+			bin.vmin = glm::min(bin.vmin, a.vmin);
+			bin.vmax = glm::max(bin.vmax, a.vmax);
+			++bin.count;
+		}
+	}
+
+	// Sweep each axis, right side areas first so the left sweep can finish the cost
+	float bestCost = std::numeric_limits<float>::max();
+	int bestAxis = -1;
+	uint32_t bestSplit = 0; // bins [0, bestSplit) go left
+
+	for (int axis = 0; axis < 3; ++axis) {
+		if (binScale[axis] == 0.0f) continue;
+
+		float rightArea[BINS]{};
+		uint32_t rightCount[BINS]{};
+		glm::vec3 rmin(1e30f), rmax(-1e30f);
+		uint32_t rc = 0;
+		for (uint32_t b = BINS - 1; b > 0; --b) {
+			const Bin& bin = bins[axis][b];
+			rmin = glm::min(rmin, bin.vmin);
+			rmax = glm::max(rmax, bin.vmax);
+			rc += bin.count;
+			rightArea[b] = rc ? aabbHalfArea(rmin, rmax) : 0.0f;
+			rightCount[b] = rc;
+		}
+
+		glm::vec3 lmin(1e30f), lmax(-1e30f);
+		uint32_t lc = 0;
+		for (uint32_t b = 1; b < BINS; ++b) {
+			const Bin& bin = bins[axis][b - 1];
+			lmin = glm::min(lmin, bin.vmin);
+			lmax = glm::max(lmax, bin.vmax);
+			lc += bin.count;
+
+			if (lc == 0 || rightCount[b] == 0) continue;
+
+			const float cost =
+				aabbHalfArea(lmin, lmax) * static_cast<float>(lc) +
+				rightArea[b] * static_cast<float>(rightCount[b]);
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	uint32_t mid = first + count / 2;
+	if (bestAxis >= 0) {
+		auto it = std::partition(leafIndex.begin() + first, leafIndex.begin() + first + count,
+			[&](uint32_t row) { return binOf(world[row], bestAxis) < bestSplit; });
+		mid = static_cast<uint32_t>(it - leafIndex.begin());
+	}
+	// Every centroid in one spot (stacked copies): no plane separates them, split the list
+	if (mid == first || mid == first + count) {
+		mid = first + count / 2;
+	}
+
+	const uint32_t leftCount = mid - first;
+	const uint32_t rightCount = count - leftCount;
+
+	uint32_t L = 0, R = 0;
+	if (count >= ctx.parallelRows) {
+		std::vector<BVHNode> leftNodes, rightNodes;
+		JobSystem::parallelInvoke(
+			[&] { buildBinnedSAHRecursive(ctx, leftNodes, first, leftCount); },
+			[&] { buildBinnedSAHRecursive(ctx, rightNodes, mid, rightCount); });
+
+		auto splice = [&](const std::vector<BVHNode>& sub) {
+			const uint32_t offset = static_cast<uint32_t>(nodes.size());
+			for (BVHNode n : sub) {
+				if (!n.count) {
+					n.left += static_cast<int>(offset);
+					n.right += static_cast<int>(offset);
+				}
+				nodes.push_back(n);
+			}
+			return offset;
+		};
+		L = splice(leftNodes);
+		R = splice(rightNodes);
+	}
+	else {
+		L = buildBinnedSAHRecursive(ctx, nodes, first, leftCount);
+		R = buildBinnedSAHRecursive(ctx, nodes, mid, rightCount);
+	}
+
+	nodes[idx].left = static_cast<int>(L);
+	nodes[idx].right = static_cast<int>(R);
+	return idx;
+}
+
+float Visibility::computeSAHCost(const std::vector<BVHNode>& nodes) {
+	if (nodes.empty()) return 0.0f;
+
+	const float rootArea = aabbHalfArea(nodes[0].box.vmin, nodes[0].box.vmax);
+	if (rootArea <= 0.0f) return 0.0f;
+
+	float cost = 0.0f;
+	for (const BVHNode& n : nodes) {
+		if (!n.count && n.left < 0) continue; // slot freed by an incremental remove
+		const float area = aabbHalfArea(n.box.vmin, n.box.vmax) / rootArea;
+		cost += n.count ? area * static_cast<float>(n.count) : area;
+	}
+	return cost;
+}
+
+namespace Visibility {
+	// Leaf box from its rows, inner box from its children. Shared by both refits so they agree
+	static void refitLeafBox(const std::vector<AABB>& world, const std::vector<uint32_t>& leafIndex, BVHNode& n) {
+		AABB b = world[leafIndex[n.first]];
+		for (uint32_t i = 1; i < n.count; ++i)
+			growMinMax(b, world[leafIndex[n.first + i]]);
+		finalizeFromMinMax(b);
+		n.box = b;
+	}
+
+	static void refitInnerBox(std::vector<BVHNode>& nodes, BVHNode& n) {
+		const BVHNode& L = nodes[n.left];
+		const BVHNode& R = nodes[n.right];
+
+		AABB b{};
+		b.vmin = glm::min(L.box.vmin, R.box.vmin);
+		b.vmax = glm::max(L.box.vmax, R.box.vmax);
+		finalizeFromMinMax(b);
+		n.box = b;
+	}
+
+	// refitBVH restricted to the marked nodes, every other subtree keeps its box
+	static void refitMarked(VisibilityState& vs, uint32_t nIdx, uint32_t& refit) {
+		BVHNode& n = vs.bvh[nIdx];
+		++refit;
+		if (n.count) {
+			refitLeafBox(vs.worldAABBs, vs.leafIndex, n);
+			return;
+		}
+		if (vs.refitMarks[n.left] == vs.refitEpoch) refitMarked(vs, static_cast<uint32_t>(n.left), refit);
+		if (vs.refitMarks[n.right] == vs.refitEpoch) refitMarked(vs, static_cast<uint32_t>(n.right), refit);
+		refitInnerBox(vs.bvh, n);
+	}
+}
+
 void Visibility::refitBVH(
 	const std::vector<AABB>& world,
 	const std::vector<uint32_t>& leafIndex,
@@ -524,29 +1474,87 @@ void Visibility::refitBVH(
 {
 	BVHNode& n = nodes[nIdx];
 	if (n.count) {
-		AABB b{};
-		b.vmin = glm::vec3(1e30f);
-		b.vmax = glm::vec3(-1e30f);
-
-		for (uint32_t i = 0; i < n.count; ++i) {
-			const AABB& w = world[leafIndex[n.first + i]];
-			if (i == 0) b = w; else growMinMax(b, w);
-		}
-		finalizeFromMinMax(b);
-		n.box = b;
+		refitLeafBox(world, leafIndex, n);
 		return;
 	}
 	refitBVH(world, leafIndex, nodes, static_cast<uint32_t>(n.left));
 	refitBVH(world, leafIndex, nodes, static_cast<uint32_t>(n.right));
+	refitInnerBox(nodes, n);
+}
+
+void Visibility::markRowsDirty(VisibilityState& vs, const std::vector<RowRun>& runs) {
+	if (vs.refitAll) return;
+	if (vs.rowDirty.size() < vs.instances.size())
+		vs.rowDirty.resize(vs.instances.size(), 0);
+
+	const size_t treeRows = vs.leafIndex.size() - vs.freeLeafSlots.size();
+	const size_t maxTracked = static_cast<size_t>(static_cast<float>(treeRows) * BVH_DIRTY_REFIT_MAX_FRACTION);
+	for (const RowRun& run : runs) {
+		for (uint32_t row = run.first; row < run.first + run.count; ++row) {
+			if (vs.rowDirty[row]) continue;
+			vs.rowDirty[row] = 1;
+			vs.dirtyRows.push_back(row);
+		}
+
+		// Mostly moving scenes stop tracking here rather than queue every row
+		if (vs.dirtyRows.size() > maxTracked) {
+			for (uint32_t row : vs.dirtyRows) vs.rowDirty[row] = 0;
+			vs.dirtyRows.clear();
+			vs.refitAll = true;
+			return;
+		}
+	}
+}
+
+uint32_t Visibility::refitDirtyBVH(VisibilityState& vs) {
+	if (vs.dirtyRows.empty() && !vs.refitAll) return 0;
+
+	uint32_t refit = 0;
+	uint32_t rowsRefit = 0;
+	if (vs.bvh.empty()) {
+		// nothing to refit
+	}
+	else if (vs.refitAll) {
+		refitBVH(vs.worldAABBs, vs.leafIndex, vs.bvh);
+		gatherLeafBounds(vs);
+		refit = static_cast<uint32_t>(vs.bvh.size());
+		rowsRefit = static_cast<uint32_t>(vs.leafIndex.size() - vs.freeLeafSlots.size());
+	}
+	else {
+		// Epochs instead of clearing, a node is on a dirty path when its mark equals refitEpoch
+		if (vs.refitMarks.size() < vs.bvh.size())
+			vs.refitMarks.resize(vs.bvh.size(), 0);
+		if (++vs.refitEpoch == 0) {
+			std::fill(vs.refitMarks.begin(), vs.refitMarks.end(), 0);
+			vs.refitEpoch = 1;
+		}
 
-	const BVHNode& L = nodes[n.left];
-	const BVHNode& R = nodes[n.right];
+		for (uint32_t row : vs.dirtyRows) {
+			if (row >= vs.rowLeaf.size() || vs.rowLeaf[row] == BVH_NO_NODE) continue; // dropped since it was marked
+			const uint32_t leaf = vs.rowLeaf[row];
+			++rowsRefit;
+
+			const BVHNode& node = vs.bvh[leaf];
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				if (vs.leafIndex[i] != row) continue;
+				vs.leafBounds.set(i, vs.worldAABBs[row]);
+				break;
+			}
+
+			// Up to the first node another row already marked, its path is marked from there
+			for (int n = static_cast<int>(leaf); n >= 0 && vs.refitMarks[n] != vs.refitEpoch; n = vs.bvhParent[n])
+				vs.refitMarks[n] = vs.refitEpoch;
+		}
+
+		if (vs.refitMarks[0] == vs.refitEpoch)
+			refitMarked(vs, 0u, refit);
+	}
 
-	AABB b{};
-	b.vmin = glm::min(L.box.vmin, R.box.vmin);
-	b.vmax = glm::max(L.box.vmax, R.box.vmax);
-	finalizeFromMinMax(b);
-	n.box = b;
+	for (uint32_t row : vs.dirtyRows) vs.rowDirty[row] = 0;
+	vs.dirtyRows.clear();
+	vs.refitAll = false;
+	FrameCounters::add(FrameCounter::BVHRowsRefit, rowsRefit);
+	return refit;
 }
 
 
@@ -588,45 +1596,7 @@ bool Visibility::boxInFrustum(const AABB& box, const Frustum& fru) {
 		if (dist + r < 0.0f) return false;
 	}
 
-	int out;
-
-	// check +x
-	out = 0;
-	for (int i = 0; i < 8; i++)
-		out += (fru.points[i].x > box.vmax.x) ? 1 : 0;
-	if (out == 8) return false;
-
-	// check -x
-	out = 0;
-	for (int i = 0; i < 8; i++)
-		out += (fru.points[i].x < box.vmin.x) ? 1 : 0;
-	if (out == 8) return false;
-
-	// check +y
-	out = 0;
-	for (int i = 0; i < 8; i++)
-		out += (fru.points[i].y > box.vmax.y) ? 1 : 0;
-	if (out == 8) return false;
-
-	// check -y
-	out = 0;
-	for (int i = 0; i < 8; i++)
-		out += (fru.points[i].y < box.vmin.y) ? 1 : 0;
-	if (out == 8) return false;
-
-	// check +z
-	out = 0;
-	for (int i = 0; i < 8; i++)
-		out += (fru.points[i].z > box.vmax.z) ? 1 : 0;
-	if (out == 8) return false;
-
-	// check -z
-	out = 0;
-	for (int i = 0; i < 8; i++)
-		out += (fru.points[i].z < box.vmin.z) ? 1 : 0;
-	if (out == 8) return false;
-
-	return true;
+	return !cornersRejectBox(box, fru);
 }
 
 Frustum Visibility::extractFrustum(const glm::mat4& viewproj) {
@@ -2,9 +2,58 @@
 
 #include "common/ResourceTypes.h"
 #include "core/AssetManager.h"
+#include "CullKernels.h"
+#include "BVH4.h"
 
 namespace Visibility {
-	struct CoreSlab { uint32_t first, stride, usedCopies; };
+	constexpr uint32_t BVH_MAX_LEAF_ROWS = 8;
+	constexpr uint32_t BVH_SAH_BIN_COUNT = 16;
+	// Subtrees with at least this many rows are handed to a JobSystem worker during SAH builds
+	constexpr uint32_t BVH_PARALLEL_SUBTREE_ROWS = 4096;
+	// Parallel culls fall back to the serial walk below this, and split the tree at these depths
+	constexpr uint32_t BVH_PARALLEL_CULL_MIN_ROWS = 8192;
+	constexpr uint32_t BVH_PARALLEL_CULL_MIN_DEPTH = 3;
+	constexpr uint32_t BVH_PARALLEL_CULL_MAX_DEPTH = 8;
+	// Incremental edits: deltas over this fraction of the live rows rebuild instead, and
+	// the tree is rebuilt once its SAH cost grows past this ratio of the cost at build time
+	constexpr float BVH_INCREMENTAL_MAX_FRACTION = 0.25f;
+	constexpr float BVH_REBUILD_COST_RATIO = 1.3f;
+	// leafIndex slots freed by removals are reused by inserts, a net shrink past this fraction
+	// of the slots rebuilds to compact them
+	constexpr float BVH_DEAD_SLOT_MAX_FRACTION = 0.5f;
+	// With async rebuilds, batches of at least this many new rows go loose for a background
+	// build rather than being inserted one by one
+	constexpr uint32_t BVH_ASYNC_MIN_ADDED_ROWS = 1024;
+	// Bounds updates over this many rows go to JobSystem workers, a chunk of rows per task
+	constexpr uint32_t AABB_TRANSFORM_PARALLEL_ROWS = 4096;
+	constexpr uint32_t AABB_TRANSFORM_CHUNK_ROWS = 1024;
+	// Dirty refits over this fraction of the tree's rows refit the whole tree instead
+	constexpr float BVH_DIRTY_REFIT_MAX_FRACTION = 0.25f;
+	// Trees with more than this fraction of dynamic rows are built with the LBVH builder
+	constexpr float BVH_LBVH_DYNAMIC_FRACTION = 0.5f;
+	// LBVH builds go to 63-bit Morton codes, 21 bits per axis, once more than this fraction of
+	// rows share their 30-bit cell with the row before them. 1024 cells per axis only run out
+	// when a few far rows stretch the bounds, not with row count.
+	constexpr float BVH_LBVH_WIDE_CODE_SHARED_FRACTION = 0.25f;
+	// Linear-built trees check their SAH cost every this many refits and are rebuilt once it
+	// passes BVH_REBUILD_COST_RATIO, a check costs about as much as a refit
+	constexpr uint32_t BVH_REFIT_CHECK_INTERVAL = 8;
+
+	constexpr uint8_t FRUSTUM_ALL_PLANES = 0x3F;
+	constexpr uint8_t PLANE_NONE = 0xFF;
+
+	constexpr uint32_t BVH_NO_NODE = UINT32_MAX;
+	constexpr uint32_t ROW_INACTIVE = UINT32_MAX;
+
+	struct CoreSlab {
+		uint32_t first, stride, usedCopies;
+		// First row of every copy ever realized. The baked copies sit back to back from first,
+		// later ones go wherever there was room. Entries past usedCopies are kept for regrowth.
+		std::vector<uint32_t> copyFirst{};
+	};
+
+	// Background rebuild in flight, AsyncBVH.cpp
+	struct PendingBVHBuild;
 
 	struct BVHNode {
 		AABB box; // node bounds
@@ -23,10 +72,53 @@ namespace Visibility {
 		std::vector<uint32_t> transformIDs; // parallel to coreStatic
 		std::unordered_map<SceneID, CoreSlab> slabs;
 
-		std::vector<uint32_t> active;    // live rows (indices into coreStatic)
-		std::vector<uint32_t> leafIndex; // permutation used by BVH build
+		std::vector<uint32_t> active;     // live rows (indices into coreStatic)
+		std::vector<uint32_t> activeSlot; // position of each row in active, ROW_INACTIVE if not live
+		std::vector<uint32_t> leafIndex;  // permutation used by BVH build, incremental inserts reuse freed slots or append
 		std::vector<BVHNode> bvh;
 
+		// Links for incremental edits, kept in sync by buildBVH and the insert/remove paths
+		std::vector<int> bvhParent;      // parallel to bvh, -1 for the root
+		std::vector<uint32_t> rowLeaf;   // leaf node holding each row, BVH_NO_NODE if not in the tree
+		std::vector<uint32_t> freeNodes; // bvh slots released by removals
+		std::vector<uint32_t> freeLeafSlots; // leafIndex slots released by removals, no leaf covers them
+		float builtSAHCost = 0.0f;       // computeSAHCost right after the last full build
+		uint32_t editsSinceCheck = 0;
+		uint32_t refitsSinceCheck = 0;
+
+		// Rows whose worldAABBs moved since the last refit, refitDirtyBVH walks up from their leaves
+		std::vector<uint32_t> dirtyRows;
+		std::vector<uint8_t> rowDirty;    // parallel to instances, set while the row is in dirtyRows
+		std::vector<uint32_t> refitMarks; // parallel to bvh, nodes on a dirty path hold refitEpoch
+		uint32_t refitEpoch = 0;
+		bool refitAll = false;            // too many dirty rows to track, the next refit is a full one
+		BoundsSoA leafBounds; // worldAABBs gathered in leafIndex order, leaves test straight from it
+
+		BVH4 bvh4; // derived from bvh when layout asks for it
+		// Row edits only touch bvh, the cull walks it until bvh4 is collapsed again once the
+		// edits settle or pile up
+		bool bvh4Stale = false;
+		uint32_t editsSinceCollapse = 0;
+
+		BVHBuildMode buildMode = BVHBuildMode::BinnedSAH;
+		// Past this fraction of dynamic live rows buildBVH uses the LBVH builder whatever buildMode
+		// says, and the tree is rebuilt once refits have loosened it
+		float lbvhDynamicFraction = BVH_LBVH_DYNAMIC_FRACTION;
+		bool builtLinear = false; // last build went through buildLBVH
+		uint32_t buildGeneration = 0; // bumped by every buildBVH, a background build from before one is dropped
+
+		// Large topology changes rebuild on a worker while the old tree keeps culling. Live rows
+		// the tree doesn't hold yet are tested one by one after every walk until a build lands.
+		bool asyncRebuild = false;
+		std::vector<uint32_t> looseRows;
+		std::vector<uint32_t> looseSlot; // position of each row in looseRows, ROW_INACTIVE if not loose
+		std::shared_ptr<PendingBVHBuild> pendingBuild;
+		BVHLayout layout = BVHLayout::Binary;
+		CullKernel cullKernel = detectCullKernel();
+		// Binary walk carries the planes still straddled down the tree and takes fully inside
+		// subtrees without testing them, off tests every node against all 6 planes
+		bool planeMasks = true;
+
 		inline void cleanup() {
 			instances.clear();
 			worldAABBs.clear();
@@ -34,8 +126,29 @@ namespace Visibility {
 			slabs.clear();
 
 			active.clear();
+			activeSlot.clear();
 			leafIndex.clear();
 			bvh.clear();
+			bvhParent.clear();
+			rowLeaf.clear();
+			freeNodes.clear();
+			freeLeafSlots.clear();
+			builtSAHCost = 0.0f;
+			editsSinceCheck = 0;
+			refitsSinceCheck = 0;
+			dirtyRows.clear();
+			rowDirty.clear();
+			refitMarks.clear();
+			refitEpoch = 0;
+			refitAll = false;
+			builtLinear = false;
+			looseRows.clear();
+			looseSlot.clear();
+			pendingBuild.reset();
+			leafBounds.clear();
+			bvh4.clear();
+			bvh4Stale = false;
+			editsSinceCollapse = 0;
 		}
 	};
 
@@ -46,7 +159,132 @@ namespace Visibility {
 		const std::vector<GPUMeshData>& meshData,
 		const std::vector<glm::mat4>& transforms);
 
+	// Traversal counters, filled when a cull is given somewhere to write them
+	struct CullStats {
+		uint32_t nodesVisited = 0;
+		uint32_t leavesTested = 0;
+		uint32_t leavesAccepted = 0;
+		uint32_t planeTests = 0;       // node and row plane tests
+		uint32_t subtreesAccepted = 0; // nodes fully inside, emitted without tests below them
+	};
+
+	// Adds a walk's stats to the frame counters, once per walk so the hot loops only touch
+	// their local stats. Parallel tasks add their own on their worker.
+	void countCullStats(const CullStats& stats);
+
+	// Lists reused between parallel culls, one per frontier subtree, so they keep their capacity
+	struct CullScratch {
+		struct TaskOutput {
+			std::vector<GPUInstance> instances;
+			std::vector<AABB> worldAABBs;
+			CullStats stats;
+		};
+
+		std::vector<uint32_t> frontier;
+		std::vector<uint8_t> frontierMasks; // planes each frontier root still has to test
+		std::vector<TaskOutput> tasks;
+		std::vector<uint32_t> offsets;
+
+		// Plane that last rejected each bvh node, tested first next frame. One scratch per view
+		// keeps the hints coherent, they are only an ordering so a stale entry is harmless.
+		std::vector<uint8_t> failedPlane;
+	};
+
+	// Contiguous rows [first, first + count)
+	struct RowRun {
+		uint32_t first;
+		uint32_t count;
+	};
+
+	// worldAABBs for every row in the runs from their mesh bounds and transforms, through
+	// transformRowBounds with vs.cullKernel. Doesn't touch the tree.
+	void updateWorldAABBs(
+		VisibilityState& vs,
+		const std::vector<RowRun>& runs,
+		const std::vector<GPUMeshData>& meshData,
+		const std::vector<glm::mat4>& transforms);
+
+	// Queues rows whose worldAABBs were rewritten for the next refitDirtyBVH
+	void markRowsDirty(VisibilityState& vs, const std::vector<RowRun>& runs);
+	// Refits the leaves holding dirty rows and their ancestors only, boxes come out the same as
+	// refitBVH's. Refits everything once markRowsDirty passed BVH_DIRTY_REFIT_MAX_FRACTION.
+	// Updates leafBounds for the rows it touched and empties the queue. Returns nodes refit.
+	uint32_t refitDirtyBVH(VisibilityState& vs);
+
 	void buildBVH(VisibilityState& vs);
+	// Whether buildBVH would pick the LBVH builder for these rows
+	bool prefersLinearBuild(const VisibilityState& vs, const std::vector<uint32_t>& rows);
+	// The builder buildBVH runs, on plain lists: reorders leafIndex and writes nodes
+	void buildBVHNodes(
+		const std::vector<AABB>& world,
+		std::vector<uint32_t>& leafIndex,
+		BVHBuildMode mode,
+		bool linear,
+		std::vector<BVHNode>& nodes);
+	// Parent links and the row -> leaf map the incremental paths walk, from bvh and leafIndex
+	void linkBVH(VisibilityState& vs);
+	enum class MortonCodes : uint8_t {
+		Auto,   // 30-bit, 63-bit past BVH_LBVH_WIDE_CODE_SHARED_FRACTION
+		Bits30,
+		Bits63,
+	};
+	// Sorts leafIndex along a Morton curve over the row centroids, then splits each node where
+	// the highest differing code bit flips. Parallel radix sort and subtree builds.
+	void buildLBVH(
+		const std::vector<AABB>& world,
+		std::vector<uint32_t>& leafIndex,
+		std::vector<BVHNode>& nodes,
+		MortonCodes codes = MortonCodes::Auto);
+	// Centroid in [0, 1] per axis to 10 interleaved bits per axis, x highest
+	uint32_t mortonCode30(const glm::vec3& unit);
+	// Same with 21 bits per axis
+	uint64_t mortonCode63(const glm::vec3& unit);
+	// Refreshes leafBounds from worldAABBs, needed after every build or refit
+	void gatherLeafBounds(VisibilityState& vs);
+	// Adds or drops a row from the live list in O(1), doesn't touch the tree
+	void setRowActive(VisibilityState& vs, uint32_t row, bool active);
+
+	// O(log n) tree edits: insertion picks the sibling with the lowest SAH cost growth,
+	// both paths refit and rotate on the way back up to the root
+	void insertRowBVH(VisibilityState& vs, uint32_t row);
+	void removeRowBVH(VisibilityState& vs, uint32_t row);
+	// Applies a sync's added/removed rows to the tree. Rebuilds instead when the tree is empty,
+	// the delta is large, the SAH cost has drifted past BVH_REBUILD_COST_RATIO or free leafIndex
+	// slots pass BVH_DEAD_SLOT_MAX_FRACTION. With
+	// asyncRebuild the last two start a background build instead, and so does a batch of
+	// BVH_ASYNC_MIN_ADDED_ROWS or more, its rows culled loose until the build lands. The 4-wide
+	// layouts are left stale rather than collapsed again per edit, see walksBVH4.
+	// Returns true when it rebuilt.
+	bool updateBVHIncremental(VisibilityState& vs, const VisibilitySyncResult& sync);
+
+	// Snapshots worldAABBs and the live rows and builds a tree from them on a worker. Rows the
+	// current tree doesn't hold turn loose. Builds in place with one scheduler thread.
+	void startAsyncBVHBuild(VisibilityState& vs);
+	// Swaps a finished background build in: relinks it, refits it to the current bounds, drops
+	// rows that died since the snapshot and inserts the ones born since, or keeps them loose and
+	// starts another build if there are too many. A build that a synchronous one overtook is
+	// dropped, and another starts if rows are still loose. wait blocks until the build is done.
+	// Returns true when it swapped.
+	bool finishAsyncBVHBuild(VisibilityState& vs, bool wait = false);
+	// Adds or drops a row from looseRows in O(1)
+	void setRowLoose(VisibilityState& vs, uint32_t row, bool loose);
+
+	// Collapses vs.bvh into vs.bvh4, called by buildBVH for the 4-wide layouts
+	void buildBVH4(VisibilityState& vs);
+	// The 4-wide layouts walk bvh4 unless row edits left it behind bvh
+	inline bool walksBVH4(const VisibilityState& vs) {
+		return vs.layout != BVHLayout::Binary && !vs.bvh4Stale;
+	}
+	// Bottom-up bounds update from leafBounds, gatherLeafBounds has to run first
+	void refitBVH4(VisibilityState& vs);
+	// Expected traversal cost of a tree relative to its root, lower is better.
+	// Internal nodes cost 1, leaves cost 1 per row, both weighted by surface area.
+	float computeSAHCost(const std::vector<BVHNode>& nodes);
+
+	inline float aabbHalfArea(const glm::vec3& vmin, const glm::vec3& vmax) {
+		const glm::vec3 d = glm::max(vmax - vmin, glm::vec3(0.0f));
+		return d.x * d.y + d.y * d.z + d.z * d.x;
+	}
 	void refitBVH(const std::vector<AABB>& world,
 		const std::vector<uint32_t>& leafIndex,
 		std::vector<BVHNode>& nodes,
@@ -61,23 +299,109 @@ namespace Visibility {
 		VisibilityState& vs,
 		const VisibilitySyncResult& sync)
 	{
-		// Early out: nothing changed, BVH still valid
-		if (!sync.topologyChanged && !sync.refitOnly) return;
+		// A background build that finished since the last sync goes in first, edits below apply to it
+		if (vs.pendingBuild) finishAsyncBVHBuild(vs);
 
-		if (sync.topologyChanged) {
-			// BVH topology changed (new or fewer nodes) -> rebuild from scratch
-			buildBVH(vs);
+		// Early out: nothing changed, BVH still valid. Row edits have settled, bvh4 catches up once.
+		if (!sync.topologyChanged && !sync.refitOnly) {
+			if (vs.bvh4Stale) buildBVH4(vs);
+			return;
 		}
-		// Topology stable but transforms moved -> cheap refit
-		else if (sync.refitOnly) {
-			refitBVH(vs.worldAABBs, vs.leafIndex, vs.bvh);
+
+		// Rows came or went -> edit the tree in place, a rebuild already reads the moved bounds
+		if (sync.topologyChanged && updateBVHIncremental(vs, sync)) return;
+
+		// Transforms moved -> refit the paths above the moved rows
+		if (sync.refitOnly) {
+			refitDirtyBVH(vs);
+
+			// Mostly dynamic trees were built linear. Even a linear rebuild costs 2-3x a full refit
+			// in the LBVH bench, so they're only rebuilt once refits have degraded them.
+			if (vs.builtLinear && ++vs.refitsSinceCheck >= BVH_REFIT_CHECK_INTERVAL) {
+				vs.refitsSinceCheck = 0;
+				if (computeSAHCost(vs.bvh) > vs.builtSAHCost * BVH_REBUILD_COST_RATIO) {
+					buildBVH(vs);
+					return;
+				}
+			}
+
+			if (vs.bvh4Stale && !sync.topologyChanged)
+				buildBVH4(vs);
+			else if (walksBVH4(vs))
+				refitBVH4(vs);
 		}
 	}
 
+	// Appends the loose rows inside the frustum and adds its tests to stats. Every cull below
+	// runs it after its walk.
+	void cullLooseRows(
+		const VisibilityState& vs,
+		const Frustum& fr,
+		std::vector<GPUInstance>& visibleInstances,
+		std::vector<AABB>& visibleWorldAABBs,
+		CullStats* stats = nullptr);
+
 	void cullBVHCollect(
 		const VisibilityState& vs,
 		const Frustum& fr,
 		std::vector<GPUInstance>& visibleInstances,
+		std::vector<AABB>& visibleWorldAABBs,
+		CullStats* stats = nullptr,
+		CullScratch* scratch = nullptr);
+	// Indices of the visible rows instead of copies, for paths that keep the rows on the GPU.
+	// Walks the binary tree whatever the layout, same rows as cullBVHCollect.
+	void cullBVHCollectRows(
+		const VisibilityState& vs,
+		const Frustum& fr,
+		std::vector<uint32_t>& visibleRows,
+		CullStats* stats = nullptr,
+		CullScratch* scratch = nullptr);
+	// cullBVHCollect for the 4-wide layouts, same rows in a different order
+	void cullBVH4Collect(
+		const VisibilityState& vs,
+		const Frustum& fr,
+		std::vector<GPUInstance>& visibleInstances,
+		std::vector<AABB>& visibleWorldAABBs,
+		CullStats* stats = nullptr);
+	void cullBVHCollectParallel(
+		const VisibilityState& vs,
+		const Frustum& fr,
+		std::vector<GPUInstance>& visibleInstances,
+		std::vector<AABB>& visibleWorldAABBs,
+		CullScratch& scratch,
+		CullStats* stats = nullptr);
+
+	// Rows visible in at least one view, in walk order, each with the views that see it
+	struct MultiViewCullResult {
+		std::vector<GPUInstance> instances;
+		std::vector<AABB> worldAABBs;
+		std::vector<uint8_t> viewMasks; // bit v set when view v sees the row
+		uint32_t viewRowCounts[MAX_CULL_VIEWS] = {};
+		uint32_t viewCount = 0;
+
+		inline void clear() {
+			instances.clear();
+			worldAABBs.clear();
+			viewMasks.clear();
+			std::fill(std::begin(viewRowCounts), std::end(viewRowCounts), 0u);
+			viewCount = 0;
+		}
+	};
+
+	// Culls up to MAX_CULL_VIEWS frustums in one walk of the binary tree, whatever the layout.
+	// A subtree outside every view is dropped once. Each view's rows match cullBVHCollect on
+	// the binary layout, order included. nodesVisited counts each node once, tests count per view.
+	void cullBVHCollectMulti(
+		const VisibilityState& vs,
+		const Frustum* frustums,
+		uint32_t viewCount,
+		MultiViewCullResult& out,
+		CullStats* stats = nullptr);
+	// One view's rows out of a multi-view result
+	void extractView(
+		const MultiViewCullResult& result,
+		uint32_t view,
+		std::vector<GPUInstance>& visibleInstances,
 		std::vector<AABB>& visibleWorldAABBs);
 
 	bool isVisible(const AABB& aabb, const Frustum& frus);
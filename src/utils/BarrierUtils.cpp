@@ -200,4 +200,22 @@ void BarrierUtils::releaseComputeToIndirectQ(
 		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
 		VK_ACCESS_2_SHADER_WRITE_BIT, // compute fills indirect args
 		srcQ, dstQ);
-}
\ No newline at end of file
+}
+void BarrierUtils::memoryBarrier(
+	VkCommandBuffer cmd,
+	VkPipelineStageFlags2 srcStage,
+	VkAccessFlags2        srcAccess,
+	VkPipelineStageFlags2 dstStage,
+	VkAccessFlags2        dstAccess)
+{
+	VkMemoryBarrier2 b{ VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+	b.srcStageMask = srcStage;
+	b.srcAccessMask = srcAccess;
+	b.dstStageMask = dstStage;
+	b.dstAccessMask = dstAccess;
+
+	VkDependencyInfo dep{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	dep.memoryBarrierCount = 1;
+	dep.pMemoryBarriers = &b;
+	vkCmdPipelineBarrier2(cmd, &dep);
+}
@@ -92,4 +92,14 @@ namespace BarrierUtils {
 		const AllocatedBuffer& buf,
 		QueueType srcQ = QueueType::Compute,
 		QueueType dstQ = QueueType::Graphics);
+
+	// === GLOBAL BARRIERS ===
+
+	// same queue producer -> consumer, no ownership transfer
+	void memoryBarrier(
+		VkCommandBuffer cmd,
+		VkPipelineStageFlags2 srcStage,
+		VkAccessFlags2        srcAccess,
+		VkPipelineStageFlags2 dstStage,
+		VkAccessFlags2        dstAccess);
 }
\ No newline at end of file
@@ -111,8 +111,9 @@ AllocatedBuffer BufferUtils::createGPUAddressBuffer(AddressBufferType addressBuf
 		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
 
+	// Draws can be written in compute too, the GPU batching's validation copies them back
 	if (AddressBufferType::IndirectDraws == addressBufferType) {
-		usage |= VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+		usage |= VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
 	}
 
 	if (AddressBufferType::Vertex == addressBufferType) {
@@ -158,18 +159,13 @@ void BufferUtils::destroyAllocatedBuffer(AllocatedBuffer& buffer, const VmaAlloc
 	buffer.mapped = nullptr;
 }
 
-size_t BufferUtils::alignUp(size_t x, size_t a) { return (x + (a - 1)) & ~(a - 1); }
+size_t BufferUtils::stagingAlignment() {
+	const size_t atom = Backend::getNonCoherentAtomSize();
+	return (atom > 16) ? atom : 16; // 16-byte min alignment
+}
 
 size_t BufferUtils::reserveStaging(size_t& stagingHead, size_t totalStagingSize, size_t stageBytes) {
-	const size_t atom = Backend::getNonCoherentAtomSize();
-	const size_t alignment = (atom > 16) ? atom : 16; // 16-byte min alignment
-	ASSERT((alignment & (alignment - 1)) == 0 && "[staging] alignment must be pow2");
-	ASSERT((stageBytes % 4) == 0 && "[staging] require 4-byte size");
-
-	const size_t offset = alignUp(stagingHead, alignment);
-	ASSERT(offset + stageBytes <= totalStagingSize && "[staging] overflow");
-	stagingHead = offset + stageBytes;
-	return offset;
+	return reserveStagingAligned(stagingHead, totalStagingSize, stageBytes, stagingAlignment());
 }
 
 void BufferUtils::flushStagingRange(const VmaAllocation bufAllocation, size_t offset, size_t bytes, const VmaAllocator allocator) {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common/ResourceTypes.h"
+#include "engine/platform/profiler/FrameCounters.h"
 
 namespace BufferUtils {
 	// Designed for storage buffer address creation
@@ -22,7 +23,26 @@ namespace BufferUtils {
 
 	// Staging buffer helpers
 	size_t reserveStaging(size_t& stagingHead, size_t totalStagingSize, size_t stageBytes);
-	size_t alignUp(size_t x, size_t a);
+	inline size_t alignUp(size_t x, size_t a) { return (x + (a - 1)) & ~(a - 1); }
+
+	// reserveStaging with the alignment given, no device query. Counts the bytes as staged this frame.
+	inline size_t reserveStagingAligned(size_t& stagingHead, size_t totalStagingSize, size_t stageBytes, size_t alignment) {
+		ASSERT((alignment & (alignment - 1)) == 0 && "[staging] alignment must be pow2");
+		ASSERT((stageBytes % 4) == 0 && "[staging] require 4-byte size");
+
+		// Checked in release too, callers copy stageBytes to the offset right after
+		const size_t offset = alignUp(stagingHead, alignment);
+		if (offset + stageBytes > totalStagingSize) {
+			fmt::print(stderr, "[staging] {} bytes at offset {} overflow the {} byte staging buffer\n", stageBytes, offset, totalStagingSize);
+			abort();
+		}
+		stagingHead = offset + stageBytes;
+		FrameCounters::add(FrameCounter::BytesStaged, stageBytes);
+		return offset;
+	}
+
+	// Alignment reserveStaging uses, the non-coherent atom size but at least 16 bytes
+	size_t stagingAlignment();
 
 	// Flush a written host range
 	void flushStagingRange(const VmaAllocation bufAllocation, size_t offset, size_t bytes, const VmaAllocator allocator);
@@ -155,13 +155,13 @@ void ImageUtils::createRenderImage(
 
 			VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &renderImage.storageView));
 
-			if (imgInfo.mipLevels > 1 && renderImage.isCubeMap && renderImage.perMipStorageViews) {
+			if (imgInfo.mipLevels > 1 && renderImage.perMipStorageViews) {
 				renderImage.storageViews.resize(imgInfo.mipLevels);
 
 				for (uint32_t mip = 0; mip < imgInfo.mipLevels; ++mip) {
 					VkImageViewCreateInfo mipViewInfo = viewInfo;
 					mipViewInfo.subresourceRange.baseMipLevel = mip;
-					mipViewInfo.subresourceRange.layerCount = 6;
+					mipViewInfo.subresourceRange.layerCount = renderImage.arrayLayers;
 					mipViewInfo.subresourceRange.levelCount = 1;
 
 					VK_CHECK(vkCreateImageView(device, &mipViewInfo, nullptr, &renderImage.storageViews[mip]));